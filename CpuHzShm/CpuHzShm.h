@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * Shared-memory layout of the latest CpuHzTray reading (C and C++).
+ *
+ * The tray creates a named file mapping and rewrites it once per sample under
+ * a seqlock: `seq` is odd while a write is in progress and even when the
+ * reading is consistent. Readers never block the writer and never take a
+ * lock; they copy the reading and retry if `seq` changed meanwhile.
+ * See CpuHzShmReader.h for the reader side.
+ */
+
+#include <windows.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CPUHZ_SHM_NAME L"Local\\CpuHzTray.Readings"
+#define CPUHZ_SHM_MAGIC 0x4D535A48u /* 'HZSM' */
+#define CPUHZ_SHM_VERSION 1u
+#define CPUHZ_SHM_MAX_CORES 2048
+#define CPUHZ_SHM_SOURCE_LEN 64
+
+typedef struct CpuHzShmReading
+{
+	uint64_t timeUnixMs;   /* wall-clock time of the sample */
+	uint64_t sampleIndex;  /* increments by one per published sample */
+	double avgMHz;
+	double maxMHz;
+	double minMHz;
+	double baseMHz;
+	int32_t validCoreCount;
+	int32_t ok;
+	int32_t nominalLike;
+	int32_t lastPdhStatus;
+	uint32_t lastPdhCStatus;
+	int32_t perCoreCount;  /* 0 when per-core publishing is off */
+	wchar_t source[CPUHZ_SHM_SOURCE_LEN];
+	float perCoreMHz[CPUHZ_SHM_MAX_CORES]; /* global processor index -> MHz, 0 = no value */
+} CpuHzShmReading;
+
+typedef struct CpuHzShmSegment
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;         /* sizeof(CpuHzShmSegment) */
+	uint32_t maxCores;
+	volatile LONG seq;     /* seqlock: odd = write in progress */
+	uint8_t pad[44];       /* keep `reading` on its own cache line */
+	CpuHzShmReading reading;
+} CpuHzShmSegment;
+
+/* Byte count of the reading up to (not including) the per-core array. */
+#define CPUHZ_SHM_READING_HEAD_SIZE offsetof(CpuHzShmReading, perCoreMHz)
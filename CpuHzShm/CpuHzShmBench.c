@@ -0,0 +1,141 @@
+/*
+ * Reader benchmark for the CpuHzTray shared-memory segment.
+ *
+ *   CpuHzShmBench [--iterations N] [--per-core] [--standalone]
+ *
+ * By default it reads the live segment published by a running tray.
+ * --standalone creates a private segment and runs a writer thread that
+ * republishes as fast as it can, to measure reads under worst-case contention.
+ */
+
+#include "CpuHzShmReader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+static volatile LONG g_stop = 0;
+
+static DWORD WINAPI WriterThread(LPVOID param)
+{
+	CpuHzShmSegment* seg = (CpuHzShmSegment*)param;
+	uint64_t i = 0;
+	int c;
+
+	while(!g_stop)
+	{
+		InterlockedIncrement(&seg->seq);
+		seg->reading.sampleIndex = ++i;
+		seg->reading.avgMHz = 2000.0 + (double)(i % 1000);
+		seg->reading.maxMHz = seg->reading.avgMHz + 100.0;
+		seg->reading.minMHz = seg->reading.avgMHz - 100.0;
+		for(c = 0; c < seg->reading.perCoreCount; ++c)
+			seg->reading.perCoreMHz[c] = (float)seg->reading.avgMHz;
+		InterlockedIncrement(&seg->seq);
+	}
+	return 0;
+}
+
+static double QpcToNs(LONGLONG ticks, LONGLONG freq)
+{
+	return (double)ticks * 1e9 / (double)freq;
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+	long long iterations = 10000000;
+	int perCore = 0;
+	int standalone = 0;
+	wchar_t name[128];
+	HANDLE ownMapping = NULL;
+	CpuHzShmSegment* ownSeg = NULL;
+	HANDLE writer = NULL;
+	CpuHzShmReader reader;
+	CpuHzShmReading snap;
+	LARGE_INTEGER freq, t0, t1;
+	unsigned long long totalRetries = 0;
+	unsigned maxRetries = 0;
+	long long ok = 0, busy = 0;
+	long long i;
+	int rc;
+	int a;
+
+	for(a = 1; a < argc; ++a)
+	{
+		if(_wcsicmp(argv[a], L"--iterations") == 0 && a + 1 < argc)
+			iterations = _wtoi64(argv[++a]);
+		else if(_wcsicmp(argv[a], L"--per-core") == 0)
+			perCore = 1;
+		else if(_wcsicmp(argv[a], L"--standalone") == 0)
+			standalone = 1;
+		else
+		{
+			fwprintf(stderr, L"usage: CpuHzShmBench [--iterations N] [--per-core] [--standalone]\n");
+			return 2;
+		}
+	}
+	if(iterations <= 0)
+		iterations = 1;
+	memset(&snap, 0, sizeof(snap));
+
+	wcscpy_s(name, 128, CPUHZ_SHM_NAME);
+	if(standalone)
+	{
+		swprintf_s(name, 128, L"Local\\CpuHzShmBench.%lu", GetCurrentProcessId());
+		ownMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(CpuHzShmSegment), name);
+		if(!ownMapping)
+			return 1;
+		ownSeg = (CpuHzShmSegment*)MapViewOfFile(ownMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(CpuHzShmSegment));
+		if(!ownSeg)
+			return 1;
+		memset(ownSeg, 0, sizeof(*ownSeg));
+		ownSeg->magic = CPUHZ_SHM_MAGIC;
+		ownSeg->version = CPUHZ_SHM_VERSION;
+		ownSeg->size = sizeof(CpuHzShmSegment);
+		ownSeg->maxCores = CPUHZ_SHM_MAX_CORES;
+		ownSeg->reading.perCoreCount = perCore ? 256 : 0;
+		writer = CreateThread(NULL, 0, WriterThread, ownSeg, 0, NULL);
+		Sleep(10);
+	}
+
+	rc = cpuhz_shm_open(&reader, name);
+	if(rc != CPUHZ_SHM_OK)
+	{
+		fwprintf(stderr, L"cpuhz_shm_open(%s) failed: %d\n", name, rc);
+		return 1;
+	}
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t0);
+	for(i = 0; i < iterations; ++i)
+	{
+		unsigned retries = 0;
+		rc = cpuhz_shm_read(&reader, &snap, perCore, &retries);
+		if(rc == CPUHZ_SHM_OK || rc == CPUHZ_SHM_NO_DATA) ++ok;
+		else if(rc == CPUHZ_SHM_BUSY) ++busy;
+		totalRetries += retries;
+		if(retries > maxRetries) maxRetries = retries;
+	}
+	QueryPerformanceCounter(&t1);
+
+	wprintf(L"segment      %s%s\n", name, standalone ? L" (standalone writer)" : L"");
+	wprintf(L"iterations   %lld (per-core %s)\n", iterations, perCore ? L"on" : L"off");
+	wprintf(L"ns/read      %.1f\n", QpcToNs(t1.QuadPart - t0.QuadPart, freq.QuadPart) / (double)iterations);
+	wprintf(L"ok/busy      %lld / %lld\n", ok, busy);
+	wprintf(L"retries      avg %.4f, max %u\n", (double)totalRetries / (double)iterations, maxRetries);
+	wprintf(L"last sample  #%llu %.0f MHz\n", (unsigned long long)snap.sampleIndex, snap.avgMHz);
+
+	cpuhz_shm_close(&reader);
+	if(writer)
+	{
+		InterlockedExchange(&g_stop, 1);
+		WaitForSingleObject(writer, INFINITE);
+		CloseHandle(writer);
+	}
+	if(ownSeg)
+		UnmapViewOfFile(ownSeg);
+	if(ownMapping)
+		CloseHandle(ownMapping);
+	return 0;
+}
@@ -0,0 +1,109 @@
+#include "CpuHzShmReader.h"
+
+#include <string.h>
+
+#define CPUHZ_SHM_MAX_RETRIES 1000u
+
+int cpuhz_shm_open(CpuHzShmReader* reader, const wchar_t* name)
+{
+	const CpuHzShmSegment* seg;
+
+	reader->mapping = NULL;
+	reader->segment = NULL;
+
+	reader->mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name ? name : CPUHZ_SHM_NAME);
+	if(!reader->mapping)
+		return CPUHZ_SHM_NOT_FOUND;
+
+	seg = (const CpuHzShmSegment*)MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0, sizeof(CpuHzShmSegment));
+	if(!seg)
+	{
+		CloseHandle(reader->mapping);
+		reader->mapping = NULL;
+		return CPUHZ_SHM_NOT_FOUND;
+	}
+
+	if(seg->magic != CPUHZ_SHM_MAGIC || seg->version != CPUHZ_SHM_VERSION ||
+		seg->size != sizeof(CpuHzShmSegment) || seg->maxCores != CPUHZ_SHM_MAX_CORES)
+	{
+		UnmapViewOfFile(seg);
+		CloseHandle(reader->mapping);
+		reader->mapping = NULL;
+		return CPUHZ_SHM_BAD_LAYOUT;
+	}
+
+	reader->segment = seg;
+	return CPUHZ_SHM_OK;
+}
+
+void cpuhz_shm_close(CpuHzShmReader* reader)
+{
+	if(reader->segment)
+	{
+		UnmapViewOfFile((LPCVOID)reader->segment);
+		reader->segment = NULL;
+	}
+	if(reader->mapping)
+	{
+		CloseHandle(reader->mapping);
+		reader->mapping = NULL;
+	}
+}
+
+int cpuhz_shm_read(const CpuHzShmReader* reader, CpuHzShmReading* out, int includePerCore, unsigned* outRetries)
+{
+	const volatile CpuHzShmSegment* seg = reader->segment;
+	unsigned retries = 0;
+
+	if(outRetries)
+		*outRetries = 0;
+	if(!seg)
+		return CPUHZ_SHM_NOT_FOUND;
+
+	for(;;)
+	{
+		LONG before = seg->seq;
+		LONG after;
+		size_t bytes;
+
+		if(before & 1)
+		{
+			/* Writer is mid-update. */
+			if(++retries > CPUHZ_SHM_MAX_RETRIES)
+				break;
+			YieldProcessor();
+			continue;
+		}
+		MemoryBarrier();
+
+		bytes = CPUHZ_SHM_READING_HEAD_SIZE;
+		if(includePerCore)
+		{
+			int n = seg->reading.perCoreCount;
+			if(n < 0) n = 0;
+			if(n > CPUHZ_SHM_MAX_CORES) n = CPUHZ_SHM_MAX_CORES;
+			bytes += (size_t)n * sizeof(float);
+		}
+		memcpy(out, (const void*)&seg->reading, bytes);
+
+		MemoryBarrier();
+		after = seg->seq;
+		if(after == before)
+		{
+			if(outRetries)
+				*outRetries = retries;
+			if(!includePerCore)
+				out->perCoreCount = 0;
+			else if(out->perCoreCount > CPUHZ_SHM_MAX_CORES)
+				out->perCoreCount = CPUHZ_SHM_MAX_CORES;
+			return before == 0 ? CPUHZ_SHM_NO_DATA : CPUHZ_SHM_OK;
+		}
+
+		if(++retries > CPUHZ_SHM_MAX_RETRIES)
+			break;
+	}
+
+	if(outRetries)
+		*outRetries = retries;
+	return CPUHZ_SHM_BUSY;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+/*
+ * Minimal reader for the CpuHzTray shared-memory segment (see CpuHzShm.h).
+ * Lock-free: a read copies the reading straight out of the mapping and
+ * retries only if the tray published a new sample during the copy.
+ *
+ *   CpuHzShmReader r;
+ *   if(cpuhz_shm_open(&r, NULL) == CPUHZ_SHM_OK)
+ *   {
+ *       CpuHzShmReading snap;
+ *       if(cpuhz_shm_read(&r, &snap, 0, NULL) == CPUHZ_SHM_OK)
+ *           printf("%.0f MHz\n", snap.avgMHz);
+ *       cpuhz_shm_close(&r);
+ *   }
+ */
+
+#include "CpuHzShm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum
+{
+	CPUHZ_SHM_OK = 0,
+	CPUHZ_SHM_NOT_FOUND = 1,   /* tray not running or segment name differs */
+	CPUHZ_SHM_BAD_LAYOUT = 2,  /* magic/version/size mismatch */
+	CPUHZ_SHM_NO_DATA = 3,     /* nothing published yet */
+	CPUHZ_SHM_BUSY = 4         /* writer kept interfering; retry later */
+};
+
+typedef struct CpuHzShmReader
+{
+	HANDLE mapping;
+	const volatile CpuHzShmSegment* segment;
+} CpuHzShmReader;
+
+/* name may be NULL for CPUHZ_SHM_NAME. */
+int cpuhz_shm_open(CpuHzShmReader* reader, const wchar_t* name);
+void cpuhz_shm_close(CpuHzShmReader* reader);
+
+/* Copies a consistent snapshot into *out. With includePerCore == 0 the
+ * per-core array is skipped and out->perCoreCount is set to 0.
+ * outRetries (optional) receives the number of seqlock retries. */
+int cpuhz_shm_read(const CpuHzShmReader* reader, CpuHzShmReading* out, int includePerCore, unsigned* outRetries);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+// Sampling interval that follows signal volatility.
+// - A sample that moved more than the material-delta threshold since the
+//   previous one drops the interval straight to the minimum.
+// - Every `flatSamplesPerStep` consecutive flat samples double it, up to the
+//   maximum, so a clock pinned at base is polled rarely.
+// - Failed readings reset to the base interval (keep probing at normal rate).
+// Timestamps come from each reading, so consumers never assume a fixed period.
+
+// Samples that span `durationMs` at `intervalMs` (at least one). Run lengths
+// and throttles are specified in time and converted with this, so they mean
+// the same wall time whatever the current interval is.
+inline int SamplesForDuration(unsigned durationMs, unsigned intervalMs)
+{
+	intervalMs = std::max(intervalMs, 1u);
+	return (int)std::max((durationMs + intervalMs - 1) / intervalMs, 1u);
+}
+
+struct AdaptiveIntervalConfig
+{
+	unsigned minMs = 250;
+	unsigned baseMs = 1000;
+	unsigned maxMs = 4000;
+	int flatSamplesPerStep = 5;
+};
+
+class AdaptiveInterval
+{
+public:
+	AdaptiveInterval() { SetConfig({}); }
+	explicit AdaptiveInterval(const AdaptiveIntervalConfig& cfg) { SetConfig(cfg); }
+
+	// Clamps to min <= base <= max and restarts at the base interval.
+	void SetConfig(const AdaptiveIntervalConfig& cfg)
+	{
+		cfg_ = cfg;
+		cfg_.minMs = std::max(cfg_.minMs, 50u);
+		cfg_.maxMs = std::max(cfg_.maxMs, cfg_.minMs);
+		cfg_.baseMs = std::clamp(cfg_.baseMs, cfg_.minMs, cfg_.maxMs);
+		cfg_.flatSamplesPerStep = std::max(cfg_.flatSamplesPerStep, 1);
+		currentMs_ = cfg_.baseMs;
+		flatRun_ = 0;
+		hasPrev_ = false;
+	}
+
+	const AdaptiveIntervalConfig& Config() const { return cfg_; }
+	unsigned CurrentMs() const { return currentMs_; }
+
+	// Feeds one sample and returns the interval until the next one.
+	unsigned OnSample(bool ok, double mhz, double thresholdMHz)
+	{
+		if(!ok || mhz <= 0.0)
+		{
+			hasPrev_ = false;
+			flatRun_ = 0;
+			currentMs_ = cfg_.baseMs;
+			return currentMs_;
+		}
+
+		if(hasPrev_ && std::abs(mhz - prevMHz_) > thresholdMHz)
+		{
+			currentMs_ = cfg_.minMs;
+			flatRun_ = 0;
+		}
+		else if(hasPrev_ && ++flatRun_ >= cfg_.flatSamplesPerStep)
+		{
+			currentMs_ = std::min(currentMs_ * 2, cfg_.maxMs);
+			flatRun_ = 0;
+		}
+
+		prevMHz_ = mhz;
+		hasPrev_ = true;
+		return currentMs_;
+	}
+
+private:
+	AdaptiveIntervalConfig cfg_;
+	unsigned currentMs_ = 1000;
+	int flatRun_ = 0;
+	double prevMHz_ = 0.0;
+	bool hasPrev_ = false;
+};
@@ -0,0 +1,471 @@
+#include "AlertEngine.h"
+#include "CpuFrequency.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+struct Cursor
+{
+	const char* p;
+
+	void Skip()
+	{
+		while(*p == ' ' || *p == '\t' || *p == '\r')
+			++p;
+	}
+
+	bool AtEnd()
+	{
+		Skip();
+		return *p == '\0' || *p == '#';
+	}
+
+	bool Eat(const char* s)
+	{
+		Skip();
+		const size_t n = strlen(s);
+		if(strncmp(p, s, n) != 0)
+			return false;
+		p += n;
+		return true;
+	}
+
+	bool Word(std::string& out)
+	{
+		Skip();
+		const char* begin = p;
+		// Bytes >= 0x80 are UTF-8: rule names may be non-ASCII.
+		while(isalnum((unsigned char)*p) || *p == '_' || *p == '-' || *p == '.' || (unsigned char)*p >= 0x80)
+			++p;
+		out.assign(begin, p);
+		return p != begin;
+	}
+
+	// Consumes `kw` only if it is the next whole word.
+	bool Keyword(const char* kw)
+	{
+		const char* save = p;
+		std::string w;
+		if(Word(w) && w == kw)
+			return true;
+		p = save;
+		return false;
+	}
+
+	bool Number(double& out)
+	{
+		Skip();
+		if(!isdigit((unsigned char)*p) && *p != '.' && *p != '-')
+			return false;
+		char* end = nullptr;
+		out = strtod(p, &end);
+		if(end == p)
+			return false;
+		p = end;
+		return true;
+	}
+
+	bool Duration(uint64_t& outMs)
+	{
+		double n = 0.0;
+		if(!Number(n) || n < 0.0)
+			return false;
+		const char* begin = p;
+		while(isalpha((unsigned char)*p))
+			++p;
+		const std::string unit(begin, p);
+		double scale;
+		if(unit == "ms") scale = 1.0;
+		else if(unit == "s") scale = 1000.0;
+		else if(unit == "m") scale = 60000.0;
+		else if(unit == "h") scale = 3600000.0;
+		else return false;
+		outMs = (uint64_t)(n * scale + 0.5);
+		return true;
+	}
+};
+
+bool ParseMetric(const std::string& w, AlertMetric& out)
+{
+	for(int m = 0; m < (int)AlertMetric::Count; ++m)
+	{
+		if(w == AlertEngine::MetricName((AlertMetric)m))
+		{
+			out = (AlertMetric)m;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ReadMetrics(const CpuReading& r, double* m)
+{
+	m[(int)AlertMetric::Avg] = r.avgMHz;
+	m[(int)AlertMetric::Min] = r.minMHz;
+	m[(int)AlertMetric::Max] = r.maxMHz;
+	m[(int)AlertMetric::Spread] = r.maxMHz - r.minMHz;
+	m[(int)AlertMetric::Base] = r.baseMHz;
+	m[(int)AlertMetric::Busy] = r.busyWeightedMHz;
+	m[(int)AlertMetric::Limit] = r.limitMHz;
+	m[(int)AlertMetric::BelowLimit] = r.belowLimitMHz;
+	m[(int)AlertMetric::Limited] = (double)r.limitedCoreCount;
+	m[(int)AlertMetric::Capped] = (double)r.cappedCoreCount;
+	m[(int)AlertMetric::Valid] = (double)r.validCoreCount;
+	m[(int)AlertMetric::Nominal] = r.nominalLike ? 1.0 : 0.0;
+	m[(int)AlertMetric::Ok] = r.ok ? 1.0 : 0.0;
+}
+
+}
+
+const char* AlertEngine::MetricName(AlertMetric m)
+{
+	switch(m)
+	{
+	case AlertMetric::Avg: return "avg";
+	case AlertMetric::Min: return "min";
+	case AlertMetric::Max: return "max";
+	case AlertMetric::Spread: return "spread";
+	case AlertMetric::Base: return "base";
+	case AlertMetric::Busy: return "busy";
+	case AlertMetric::Limit: return "limit";
+	case AlertMetric::BelowLimit: return "belowlimit";
+	case AlertMetric::Limited: return "limited";
+	case AlertMetric::Capped: return "capped";
+	case AlertMetric::Valid: return "valid";
+	case AlertMetric::Nominal: return "nominal";
+	case AlertMetric::Ok: return "ok";
+	default: return "?";
+	}
+}
+
+void AlertEngine::SampleRing::PushBack(const Sample& s)
+{
+	if(size == buf.size())
+	{
+		// Unroll into a buffer twice the size, oldest first.
+		std::vector<Sample> grown(buf.empty() ? 8 : buf.size() * 2);
+		for(size_t i = 0; i < size; ++i)
+			grown[i] = buf[(head + i) % buf.size()];
+		buf.swap(grown);
+		head = 0;
+	}
+	buf[(head + size) % buf.size()] = s;
+	++size;
+}
+
+int AlertEngine::FindOrAddAggregate(Fn fn, AlertMetric metric, uint64_t windowMs)
+{
+	for(size_t i = 0; i < aggregates_.size(); ++i)
+	{
+		const auto& a = aggregates_[i];
+		if(a.fn == fn && a.metric == metric && a.windowMs == windowMs)
+			return (int)i;
+	}
+	Aggregate a;
+	a.fn = fn;
+	a.metric = metric;
+	a.windowMs = windowMs;
+	aggregates_.push_back(std::move(a));
+	return (int)aggregates_.size() - 1;
+}
+
+bool AlertEngine::CompileLine(const std::string& line, std::string& error)
+{
+	Cursor c{ line.c_str() };
+	Rule rule;
+	if(!c.Word(rule.name) || !c.Eat(":"))
+	{
+		error = "expected '<name>:'";
+		return false;
+	}
+
+	do
+	{
+		Condition cond;
+		std::string w;
+		if(!c.Word(w))
+		{
+			error = "expected a metric";
+			return false;
+		}
+
+		Fn fn = Fn::Now;
+		if(c.Eat("("))
+		{
+			if(w == "avg") fn = Fn::Avg;
+			else if(w == "min") fn = Fn::Min;
+			else if(w == "max") fn = Fn::Max;
+			else if(w == "sum") fn = Fn::Sum;
+			else if(w == "count") fn = Fn::Count;
+			else
+			{
+				error = "unknown function '" + w + "'";
+				return false;
+			}
+			uint64_t windowMs = 0;
+			if(!c.Word(w) || !ParseMetric(w, cond.metric) || !c.Eat(",") || !c.Duration(windowMs) || windowMs == 0 || !c.Eat(")"))
+			{
+				error = "expected <function>(<metric>, <duration>)";
+				return false;
+			}
+			cond.aggregate = FindOrAddAggregate(fn, cond.metric, windowMs);
+		}
+		else if(!ParseMetric(w, cond.metric))
+		{
+			error = "unknown metric '" + w + "'";
+			return false;
+		}
+
+		if(c.Eat("<=")) cond.op = Op::Le;
+		else if(c.Eat(">=")) cond.op = Op::Ge;
+		else if(c.Eat("==")) cond.op = Op::Eq;
+		else if(c.Eat("!=")) cond.op = Op::Ne;
+		else if(c.Eat("<")) cond.op = Op::Lt;
+		else if(c.Eat(">")) cond.op = Op::Gt;
+		else
+		{
+			error = "expected a comparison";
+			return false;
+		}
+
+		if(c.Keyword("base"))
+		{
+			cond.threshold = 1.0;
+			cond.ofBase = true;
+		}
+		else if(c.Number(cond.threshold))
+		{
+			if(c.Eat("%"))
+			{
+				cond.threshold /= 100.0;
+				cond.ofBase = true;
+			}
+		}
+		else
+		{
+			error = "expected a number, a percentage of base, or 'base'";
+			return false;
+		}
+		rule.conditions.push_back(cond);
+	} while(c.Keyword("and"));
+
+	if(c.Keyword("for") && !c.Duration(rule.forMs))
+	{
+		error = "expected a duration after 'for'";
+		return false;
+	}
+	if(c.Keyword("clear") && !c.Duration(rule.clearMs))
+	{
+		error = "expected a duration after 'clear'";
+		return false;
+	}
+	if(!c.AtEnd())
+	{
+		error = std::string("unexpected '") + c.p + "'";
+		return false;
+	}
+
+	rules_.push_back(std::move(rule));
+	return true;
+}
+
+int AlertEngine::Compile(const char* text, std::string* errors)
+{
+	int added = 0;
+	int lineNo = 0;
+	const char* p = text ? text : "";
+	while(*p)
+	{
+		const char* end = strchr(p, '\n');
+		if(!end) end = p + strlen(p);
+		const std::string line(p, end);
+		p = *end ? end + 1 : end;
+		++lineNo;
+
+		Cursor blank{ line.c_str() };
+		if(blank.AtEnd())
+			continue;
+
+		// A failed line must not leave unused aggregates behind.
+		const size_t aggregateCount = aggregates_.size();
+		std::string error;
+		if(CompileLine(line, error))
+		{
+			++added;
+		}
+		else
+		{
+			aggregates_.resize(aggregateCount);
+			if(errors)
+			{
+				char prefix[32];
+				sprintf_s(prefix, "line %d: ", lineNo);
+				if(!errors->empty()) *errors += "\n";
+				*errors += prefix + error;
+			}
+		}
+	}
+	return added;
+}
+
+bool AlertEngine::LoadFile(const wchar_t* path, std::string* errors)
+{
+	FILE* f = nullptr;
+	if(!path || _wfopen_s(&f, path, L"rb") != 0 || !f)
+		return false;
+	std::string text;
+	char buf[4096];
+	size_t n;
+	while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		text.append(buf, n);
+	fclose(f);
+	if(text.size() >= 3 && (unsigned char)text[0] == 0xEF && (unsigned char)text[1] == 0xBB && (unsigned char)text[2] == 0xBF)
+		text.erase(0, 3); // UTF-8 BOM
+	Compile(text.c_str(), errors);
+	return true;
+}
+
+void AlertEngine::UpdateAggregate(Aggregate& a, uint64_t nowMs, double v)
+{
+	if(a.firstMs == 0)
+		a.firstMs = nowMs;
+	a.ready = nowMs - a.firstMs >= a.windowMs;
+
+	auto& ring = a.ring;
+	switch(a.fn)
+	{
+	case Fn::Avg:
+	case Fn::Sum:
+	case Fn::Count:
+	{
+		const double x = a.fn == Fn::Count ? (v != 0.0 ? 1.0 : 0.0) : v;
+		ring.PushBack({ nowMs, x });
+		a.sum += x;
+		while(ring.size > 1 && ring.Front().timeMs + a.windowMs <= nowMs)
+		{
+			a.sum -= ring.Front().value;
+			ring.PopFront();
+		}
+		if(a.fn == Fn::Avg)
+			a.value = a.sum / (double)ring.size;
+		else
+			a.value = a.sum;
+		break;
+	}
+	case Fn::Min:
+	case Fn::Max:
+	{
+		// Monotonic ring: the front is the window's min (max); later samples
+		// that are smaller (larger) make earlier ones irrelevant.
+		const bool isMin = a.fn == Fn::Min;
+		while(ring.size > 0 && (isMin ? ring.Back().value >= v : ring.Back().value <= v))
+			ring.PopBack();
+		ring.PushBack({ nowMs, v });
+		while(ring.size > 1 && ring.Front().timeMs + a.windowMs <= nowMs)
+			ring.PopFront();
+		a.value = ring.Front().value;
+		break;
+	}
+	default:
+		a.value = v;
+		break;
+	}
+}
+
+const std::vector<AlertEvent>& AlertEngine::Update(const CpuReading& r, uint64_t tickMs)
+{
+	events_.clear();
+	const uint64_t now = tickMs;
+	double metrics[(int)AlertMetric::Count];
+	ReadMetrics(r, metrics);
+	const double base = r.typeWeightedBaseMHz > 0.0 ? r.typeWeightedBaseMHz : r.baseMHz;
+	auto missing = [&](AlertMetric m) { return !r.ok && m != AlertMetric::Ok; };
+
+	for(auto& a : aggregates_)
+	{
+		if(!missing(a.metric))
+			UpdateAggregate(a, now, metrics[(int)a.metric]);
+	}
+
+	for(size_t i = 0; i < rules_.size(); ++i)
+	{
+		Rule& rule = rules_[i];
+		if(std::any_of(rule.conditions.begin(), rule.conditions.end(), [&](const Condition& c) { return missing(c.metric); }))
+			continue;
+
+		bool all = true;
+		double firstValue = 0.0;
+		for(size_t k = 0; k < rule.conditions.size(); ++k)
+		{
+			const Condition& cond = rule.conditions[k];
+			bool known = true;
+			double v = metrics[(int)cond.metric];
+			if(cond.aggregate >= 0)
+			{
+				const Aggregate& a = aggregates_[(size_t)cond.aggregate];
+				v = a.value;
+				known = a.ready;
+			}
+			if(k == 0)
+				firstValue = v;
+
+			const double t = cond.ofBase ? cond.threshold * base : cond.threshold;
+			bool holds;
+			switch(cond.op)
+			{
+			case Op::Lt: holds = v < t; break;
+			case Op::Le: holds = v <= t; break;
+			case Op::Gt: holds = v > t; break;
+			case Op::Ge: holds = v >= t; break;
+			case Op::Eq: holds = v == t; break;
+			default: holds = v != t; break;
+			}
+			// A percentage of an unknown base never holds.
+			if(!known || (cond.ofBase && base <= 0.0) || !holds)
+			{
+				all = false;
+				break;
+			}
+		}
+
+		if(!rule.active)
+		{
+			rule.falseSinceMs = 0;
+			if(!all)
+			{
+				rule.trueSinceMs = 0;
+				continue;
+			}
+			if(rule.trueSinceMs == 0)
+				rule.trueSinceMs = now;
+			if(now - rule.trueSinceMs < rule.forMs)
+				continue;
+			rule.active = true;
+			++rule.fired;
+			++activeCount_;
+			events_.push_back({ (int)i, true, r.timeUnixMs, firstValue });
+		}
+		else
+		{
+			rule.trueSinceMs = 0;
+			if(all)
+			{
+				rule.falseSinceMs = 0;
+				continue;
+			}
+			if(rule.falseSinceMs == 0)
+				rule.falseSinceMs = now;
+			if(now - rule.falseSinceMs < rule.clearMs)
+				continue;
+			rule.active = false;
+			--activeCount_;
+			events_.push_back({ (int)i, false, r.timeUnixMs, firstValue });
+		}
+	}
+	return events_;
+}
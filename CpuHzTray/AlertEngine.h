@@ -0,0 +1,142 @@
+#pragma once
+#include <windows.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct CpuReading;
+
+// Alert rules evaluated on every reading, e.g.
+//   low-clock: avg < 70% and capped > 0 for 30s clear 10s
+//   stuck: nominal == 1 for 10m
+//   sagging: avg(avg, 30s) < 2000 and min(valid, 1m) >= 8
+// Syntax, one rule per line ('#' starts a comment):
+//   <name>: <cond> [and <cond>]... [for <duration>] [clear <duration>]
+//   (<name>: letters, digits, '_', '-', '.' and any non-ASCII UTF-8)
+//   <cond>     := <operand> (< | <= | > | >= | == | !=) <value>
+//   <operand>  := <metric> | (avg | min | max | sum | count)(<metric>, <duration>)
+//   <value>    := <number> | <number>% (of base) | base
+//   <duration> := <number>(ms | s | m | h)
+//   <metric>   := avg min max spread base busy limit belowlimit limited capped
+//                 valid nominal ok (CpuReading fields; nominal/ok are 0 or 1)
+// - count() counts the window's samples where the metric is non-zero.
+// - A rule fires once all its conditions have held for `for` and clears once
+//   they have failed for `clear` (time hysteresis; both default to 0).
+// - Windowed operands compile into aggregates shared by every rule using the
+//   same (function, metric, window): a running sum/count, or a monotonic
+//   ring for min/max, so each reading costs amortized O(1) per aggregate and
+//   O(conditions) per rule. A window counts as false until it has spanned
+//   its full length once.
+// - Windows and `for`/`clear` run on a monotonic millisecond tick, so a wall
+//   clock step cannot stretch or collapse them; events carry the reading's
+//   Unix time for the log.
+// - A failed reading (!ok) only feeds `ok`: the other metrics are missing,
+//   so their windows skip it and rules reading them keep their state.
+
+enum class AlertMetric : int
+{
+	Avg, Min, Max, Spread, Base, Busy, Limit, BelowLimit, Limited, Capped, Valid, Nominal, Ok,
+	Count
+};
+
+struct AlertEvent
+{
+	int rule = -1;
+	bool fired = false; // false = cleared
+	uint64_t timeUnixMs = 0;
+	double value = 0.0; // first condition's operand
+};
+
+class AlertEngine
+{
+public:
+	// Compiles `text` and appends its rules. Lines that do not parse are
+	// skipped; each adds "line N: reason" to `errors` (newline-separated).
+	// Returns the number of rules added.
+	int Compile(const char* text, std::string* errors = nullptr);
+	// Reads and compiles a rules file (UTF-8/ASCII). False if it cannot be read.
+	bool LoadFile(const wchar_t* path, std::string* errors = nullptr);
+
+	// Feeds one reading taken at `tickMs` (monotonic, e.g. GetTickCount64);
+	// returns the rules that fired or cleared on it (valid until the next call).
+	const std::vector<AlertEvent>& Update(const CpuReading& r, uint64_t tickMs);
+
+	int RuleCount() const { return (int)rules_.size(); }
+	int AggregateCount() const { return (int)aggregates_.size(); }
+	const std::string& RuleName(int rule) const { return rules_[(size_t)rule].name; }
+	bool IsActive(int rule) const { return rules_[(size_t)rule].active; }
+	uint64_t FiredCount(int rule) const { return rules_[(size_t)rule].fired; }
+	int ActiveCount() const { return activeCount_; }
+	// Current value of a windowed operand, in compile order (self-tests).
+	double AggregateValue(int aggregate) const { return aggregates_[(size_t)aggregate].value; }
+
+	static const char* MetricName(AlertMetric m);
+
+private:
+	enum class Fn : uint8_t { Now, Avg, Min, Max, Sum, Count };
+	enum class Op : uint8_t { Lt, Le, Gt, Ge, Eq, Ne };
+
+	struct Sample
+	{
+		uint64_t timeMs;
+		double value;
+	};
+
+	// Time-based ring; grows (doubling) only while a window is still longer
+	// than what it holds.
+	struct SampleRing
+	{
+		std::vector<Sample> buf;
+		size_t head = 0; // oldest
+		size_t size = 0;
+
+		void PushBack(const Sample& s);
+		const Sample& Front() const { return buf[head]; }
+		const Sample& Back() const { return buf[(head + size - 1) % buf.size()]; }
+		void PopFront() { head = (head + 1) % buf.size(); --size; }
+		void PopBack() { --size; }
+	};
+
+	struct Aggregate
+	{
+		Fn fn = Fn::Now;
+		AlertMetric metric = AlertMetric::Avg;
+		uint64_t windowMs = 0;
+		uint64_t firstMs = 0;
+		bool ready = false;
+		double sum = 0.0;
+		SampleRing ring; // all samples (avg/sum/count) or the monotonic min/max candidates
+		double value = 0.0;
+	};
+
+	struct Condition
+	{
+		int aggregate = -1; // index into aggregates_, or -1 for the current value
+		AlertMetric metric = AlertMetric::Avg;
+		Op op = Op::Lt;
+		double threshold = 0.0;
+		bool ofBase = false; // threshold is a fraction of base
+	};
+
+	struct Rule
+	{
+		std::string name;
+		std::vector<Condition> conditions;
+		uint64_t forMs = 0;
+		uint64_t clearMs = 0;
+		bool active = false;
+		uint64_t trueSinceMs = 0;
+		uint64_t falseSinceMs = 0;
+		uint64_t fired = 0;
+	};
+
+	bool CompileLine(const std::string& line, std::string& error);
+	int FindOrAddAggregate(Fn fn, AlertMetric metric, uint64_t windowMs);
+	void UpdateAggregate(Aggregate& a, uint64_t nowMs, double v);
+
+	std::vector<Rule> rules_;
+	std::vector<Aggregate> aggregates_;
+	std::vector<AlertEvent> events_;
+	int activeCount_ = 0;
+};
@@ -0,0 +1,353 @@
+#include "BurstCapture.h"
+#include "PersistentHistory.h"
+#include "SelfOverhead.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+
+#include <pdhmsg.h>
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Samples the recent level must have seen before a jump can trigger.
+static constexpr size_t kJumpWarmupSamples = 8;
+
+void BurstRecorder::Configure(const BurstConfig& config)
+{
+	config_ = config;
+	config_.periodUs = std::max(config_.periodUs, 100u);
+	preCount_ = std::max<size_t>((size_t)config_.preMs * 1000 / config_.periodUs, 1);
+	postCount_ = (size_t)config_.postMs * 1000 / config_.periodUs;
+	ring_.assign(preCount_ + 1 + postCount_, BurstSample{});
+	frozen_ = false; // no cooldown after reconfiguring
+	Rearm();
+}
+
+void BurstRecorder::Rearm()
+{
+	holdoffUntilUs_ = frozen_ ? lastTimeUs_ + (int64_t)config_.cooldownMs * 1000 : INT64_MIN;
+	head_ = 0;
+	size_ = 0;
+	triggerIndex_ = 0;
+	samplesSinceArm_ = 0;
+	triggerTimeUs_ = 0;
+	levelMHz_ = 0.0;
+	prevMHz_ = 0.0;
+	trigger_ = BurstTrigger::None;
+	frozen_ = false;
+}
+
+bool BurstRecorder::Push(int64_t timeUs, double mhz, bool manual)
+{
+	if(frozen_ || ring_.empty())
+		return false;
+	const size_t cap = ring_.size();
+	lastTimeUs_ = timeUs;
+
+	if(trigger_ == BurstTrigger::None)
+	{
+		BurstTrigger t = manual ? BurstTrigger::Manual : BurstTrigger::None;
+		if(t == BurstTrigger::None && samplesSinceArm_ > 0 && timeUs >= holdoffUntilUs_)
+		{
+			// Edge only: staying below the threshold does not re-trigger.
+			if(config_.dropBelowMHz > 0.0 && mhz < config_.dropBelowMHz && prevMHz_ >= config_.dropBelowMHz)
+				t = BurstTrigger::Drop;
+			else if(config_.jumpMHz > 0.0 && samplesSinceArm_ >= kJumpWarmupSamples
+				&& std::abs(mhz - levelMHz_) > config_.jumpMHz)
+				t = BurstTrigger::Jump;
+		}
+
+		// Keep the last preCount_ samples before the incoming one.
+		if(size_ > preCount_)
+		{
+			head_ = (head_ + 1) % cap;
+			--size_;
+		}
+		ring_[(head_ + size_) % cap] = { timeUs, mhz };
+		++size_;
+
+		if(t != BurstTrigger::None)
+		{
+			trigger_ = t;
+			triggerIndex_ = size_ - 1;
+			triggerTimeUs_ = timeUs;
+			frozen_ = postCount_ == 0;
+			return frozen_;
+		}
+
+		levelMHz_ = samplesSinceArm_ == 0 ? mhz : levelMHz_ + (mhz - levelMHz_) / 8.0;
+		prevMHz_ = mhz;
+		++samplesSinceArm_;
+		return false;
+	}
+
+	// Post-trigger: the ring has room for every remaining sample.
+	ring_[(head_ + size_) % cap] = { timeUs, mhz };
+	++size_;
+	frozen_ = size_ - 1 - triggerIndex_ >= postCount_;
+	return frozen_;
+}
+
+BurstSample BurstRecorder::CaptureSample(size_t i) const
+{
+	const BurstSample& s = ring_[(head_ + i) % ring_.size()];
+	return { s.offsetUs - triggerTimeUs_, s.mhz };
+}
+
+void BurstRecorder::FillHeader(BurstFileHeader& h, uint64_t triggerUnixMs) const
+{
+	h = {};
+	h.magic = kBurstFileMagic;
+	h.version = kBurstFileVersion;
+	h.headerSize = sizeof(BurstFileHeader);
+	h.sampleSize = sizeof(BurstSample);
+	h.source = (uint32_t)config_.source;
+	h.trigger = (uint32_t)trigger_;
+	h.sampleCount = (uint32_t)size_;
+	h.triggerIndex = (uint32_t)triggerIndex_;
+	h.periodUs = config_.periodUs;
+	h.triggerUnixMs = triggerUnixMs;
+	h.baseMHz = config_.baseMHz;
+	h.dropBelowMHz = config_.dropBelowMHz;
+	h.jumpMHz = config_.jumpMHz;
+	h.levelMHz = levelMHz_;
+}
+
+bool WriteBurstFile(const wchar_t* path, const BurstRecorder& recorder, uint64_t triggerUnixMs)
+{
+	FILE* f = nullptr;
+	if(!path || _wfopen_s(&f, path, L"wb") != 0 || !f)
+		return false;
+
+	BurstFileHeader h;
+	recorder.FillHeader(h, triggerUnixMs);
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+
+	// Converted in small chunks so writing never allocates.
+	BurstSample chunk[256];
+	for(size_t i = 0; ok && i < recorder.CaptureSize(); i += _countof(chunk))
+	{
+		const size_t n = std::min(_countof(chunk), recorder.CaptureSize() - i);
+		for(size_t k = 0; k < n; ++k)
+			chunk[k] = recorder.CaptureSample(i + k);
+		ok = fwrite(chunk, sizeof(BurstSample), n, f) == n;
+	}
+	return fclose(f) == 0 && ok;
+}
+
+bool BurstCapture::Arm(std::unique_ptr<CpuSourceBackend> source, const BurstConfig& config, SelfOverhead* overhead)
+{
+	Disarm();
+	if(!source)
+		return false;
+	config_ = config;
+	if(config_.source == BurstSource::TotalPerformance)
+	{
+		if(config_.baseMHz <= 0.0 || !source->OpenCounters(config_.baseMHz) || !source->HasCounter(CpuCounter::TotalPerformance))
+			return false;
+	}
+	else
+	{
+		ppi_.assign(source->ProcessorCount(), PROCESSOR_POWER_INFORMATION{});
+	}
+	source_ = std::move(source);
+	overhead_ = overhead;
+
+	double mhz = 0.0;
+	if(Sample(mhz))
+	{
+		recorder_.Configure(config_);
+		manual_.store(false);
+		timer_ = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		if(!timer_)
+			timer_ = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+		stop_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+		if(timer_ && stop_)
+			thread_ = CreateThread(nullptr, 0, ThreadProc, this, 0, nullptr);
+	}
+	if(!thread_)
+	{
+		Disarm();
+		return false;
+	}
+	return true;
+}
+
+void BurstCapture::Disarm()
+{
+	if(thread_)
+	{
+		SetEvent(stop_);
+		WaitForSingleObject(thread_, INFINITE);
+		CloseHandle(thread_);
+		thread_ = nullptr;
+	}
+	for(HANDLE* h : { &timer_, &stop_ })
+	{
+		if(*h)
+		{
+			CloseHandle(*h);
+			*h = nullptr;
+		}
+	}
+	// Disarmed costs nothing: the buffers and the source go too.
+	source_.reset();
+	ppi_ = {};
+	recorder_ = BurstRecorder();
+}
+
+bool BurstCapture::Sample(double& mhz)
+{
+	if(config_.source == BurstSource::TotalPerformance)
+	{
+		PDH_FMT_COUNTERVALUE v{};
+		if(source_->CollectCounters() != ERROR_SUCCESS
+			|| source_->ReadCounter(CpuCounter::TotalPerformance, v) != ERROR_SUCCESS
+			|| (v.CStatus != PDH_CSTATUS_VALID_DATA && v.CStatus != PDH_CSTATUS_NEW_DATA))
+			return false;
+		mhz = v.doubleValue * config_.baseMHz / 100.0;
+		return mhz > 0.0;
+	}
+
+	if(ppi_.empty() || !source_->ReadPowerInformation(ppi_.data(), (DWORD)ppi_.size()))
+		return false;
+	double sum = 0.0;
+	int n = 0;
+	for(const auto& p : ppi_)
+	{
+		if(p.CurrentMhz > 0)
+		{
+			sum += p.CurrentMhz;
+			++n;
+		}
+	}
+	mhz = n ? sum / n : 0.0;
+	return n > 0;
+}
+
+void BurstCapture::Save()
+{
+	wchar_t name[64];
+	swprintf_s(name, L"burst-%llu.bin", (unsigned long long)triggerUnixMs_);
+	wchar_t path[MAX_PATH]{};
+	if(GetAppDataFilePath(name, path, MAX_PATH) && WriteBurstFile(path, recorder_, triggerUnixMs_))
+	{
+		captures_.fetch_add(1, std::memory_order_relaxed);
+		PruneFiles();
+	}
+}
+
+// Deletes the oldest captures (by the trigger time in the name) until at
+// most maxFiles remain. Rescans per deletion: there is normally one extra.
+void BurstCapture::PruneFiles()
+{
+	if(config_.maxFiles == 0)
+		return;
+	wchar_t pattern[MAX_PATH]{};
+	if(!GetAppDataFilePath(L"burst-*.bin", pattern, MAX_PATH))
+		return;
+
+	for(;;)
+	{
+		WIN32_FIND_DATAW fd;
+		HANDLE find = FindFirstFileW(pattern, &fd);
+		if(find == INVALID_HANDLE_VALUE)
+			return;
+		unsigned count = 0;
+		unsigned long long oldestMs = ULLONG_MAX;
+		wchar_t oldest[MAX_PATH]{};
+		do
+		{
+			unsigned long long ms = 0;
+			if(swscanf_s(fd.cFileName, L"burst-%llu.bin", &ms) != 1)
+				continue;
+			++count;
+			if(ms < oldestMs)
+			{
+				oldestMs = ms;
+				wcscpy_s(oldest, fd.cFileName);
+			}
+		} while(FindNextFileW(find, &fd));
+		FindClose(find);
+
+		wchar_t path[MAX_PATH]{};
+		if(count <= config_.maxFiles || !GetAppDataFilePath(oldest, path, MAX_PATH) || !DeleteFileW(path))
+			return;
+	}
+}
+
+DWORD WINAPI BurstCapture::ThreadProc(LPVOID param)
+{
+	static_cast<BurstCapture*>(param)->Run();
+	return 0;
+}
+
+void BurstCapture::Run()
+{
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	const int64_t periodTicks = std::max<int64_t>(freq.QuadPart * std::max(config_.periodUs, 100u) / 1000000, 1);
+	QueryPerformanceCounter(&now);
+	int64_t next = now.QuadPart + periodTicks;
+
+	const HANDLE handles[] = { stop_, timer_ };
+	for(;;)
+	{
+		QueryPerformanceCounter(&now);
+		const int64_t waitTicks = next - now.QuadPart;
+		if(waitTicks > 0)
+		{
+			// Negative due time = relative, in 100 ns units.
+			LARGE_INTEGER due;
+			due.QuadPart = -std::max<LONGLONG>(waitTicks * 10000000 / freq.QuadPart, 1);
+			if(!SetWaitableTimer(timer_, &due, 0, nullptr, nullptr, FALSE))
+				return;
+			if(WaitForMultipleObjects(_countof(handles), handles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+				return;
+			QueryPerformanceCounter(&now);
+		}
+		else if(WaitForSingleObject(stop_, 0) == WAIT_OBJECT_0)
+		{
+			return;
+		}
+
+		// Periods we were too late for are skipped, not sampled back to back.
+		if(now.QuadPart - next >= periodTicks)
+		{
+			const int64_t late = (now.QuadPart - next) / periodTicks;
+			missed_.fetch_add((uint64_t)late, std::memory_order_relaxed);
+			next += late * periodTicks;
+		}
+		next += periodTicks;
+
+		double mhz = 0.0;
+		bool ok;
+		{
+			OverheadScope scope(overhead_, OverheadProbe::BurstSample);
+			ok = Sample(mhz);
+		}
+		if(!ok)
+			continue;
+
+		const int64_t timeUs = now.QuadPart / freq.QuadPart * 1000000 + now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart;
+		const bool manual = manual_.load(std::memory_order_relaxed) && manual_.exchange(false);
+		const bool wasTriggered = recorder_.Triggered();
+		const bool done = recorder_.Push(timeUs, mhz, manual);
+		if(!wasTriggered && recorder_.Triggered())
+			triggerUnixMs_ = source_->UnixMs();
+		if(done)
+		{
+			Save();
+			recorder_.Rearm();
+			// Restart the grid after the write; its time is not a miss.
+			QueryPerformanceCounter(&now);
+			next = now.QuadPart + periodTicks;
+		}
+	}
+}
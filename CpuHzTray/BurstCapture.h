@@ -0,0 +1,168 @@
+#pragma once
+#include <windows.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "CpuSource.h"
+
+// Oscilloscope-style capture of sub-second frequency excursions.
+// - While armed, a thread samples one cheap source every `periodUs` into a
+//   circular pre-trigger buffer.
+// - A trigger (drop below `dropBelowMHz`, jump beyond `jumpMHz` from the
+//   recent level, or Trigger()) freezes the buffer, records `postMs` more,
+//   writes %LOCALAPPDATA%\CpuHzTray\burst-<triggerUnixMs>.bin and re-arms.
+// - After a capture, drop/jump triggers are ignored for `cooldownMs` (manual
+//   ones still fire), and only the newest `maxFiles` captures are kept.
+// - Every buffer is allocated by Arm(); sampling and writing never allocate.
+//   Disarmed, no thread runs and nothing is sampled.
+
+inline constexpr uint32_t kBurstFileMagic = 0x425A4843; // 'CHZB'
+inline constexpr uint32_t kBurstFileVersion = 1;
+
+enum class BurstSource : uint32_t
+{
+	PowerInformation, // CallNtPowerInformation, average CurrentMhz
+	TotalPerformance, // _Total % Processor Performance x base
+};
+
+enum class BurstTrigger : uint32_t
+{
+	None,
+	Drop,
+	Jump,
+	Manual,
+};
+
+struct BurstConfig
+{
+	BurstSource source = BurstSource::PowerInformation;
+	unsigned periodUs = 1000;
+	unsigned preMs = 500;
+	unsigned postMs = 500;
+	double baseMHz = 0.0;
+	double dropBelowMHz = 0.0; // 0 = off
+	double jumpMHz = 500.0;    // 0 = off; well above the sources' noise band
+	unsigned cooldownMs = 10000;
+	unsigned maxFiles = 20;    // oldest burst-*.bin deleted beyond this; 0 = keep all
+};
+
+// burst-*.bin: header, then `sampleCount` samples, oldest first.
+struct BurstFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t sampleSize;
+	uint32_t source;       // BurstSource
+	uint32_t trigger;      // BurstTrigger
+	uint32_t sampleCount;
+	uint32_t triggerIndex; // index of the sample that fired the trigger
+	uint32_t periodUs;
+	uint32_t reserved;
+	uint64_t triggerUnixMs;
+	double baseMHz;
+	double dropBelowMHz;
+	double jumpMHz;
+	double levelMHz;       // recent level just before the trigger
+};
+
+struct BurstSample
+{
+	int64_t offsetUs; // relative to the trigger sample
+	double mhz;
+};
+
+// Pre/post-trigger buffering and trigger detection; no threads or I/O.
+class BurstRecorder
+{
+public:
+	// Allocates room for preMs + postMs of samples and arms.
+	void Configure(const BurstConfig& config);
+	// Drops the capture (if any) and waits for the next trigger. After a
+	// completed capture, drop/jump triggers wait out `cooldownMs` first.
+	void Rearm();
+
+	// Adds one sample (`timeUs` monotonic). `manual` fires the trigger on it.
+	// Returns true when the capture completes with this sample; later
+	// samples are ignored until Rearm().
+	bool Push(int64_t timeUs, double mhz, bool manual = false);
+
+	bool Triggered() const { return trigger_ != BurstTrigger::None; }
+	bool Frozen() const { return frozen_; }
+	BurstTrigger Trigger() const { return trigger_; }
+	size_t PreCapacity() const { return preCount_; }
+	size_t PostCapacity() const { return postCount_; }
+
+	// The capture, oldest first (valid once triggered).
+	size_t CaptureSize() const { return size_; }
+	size_t TriggerIndex() const { return triggerIndex_; }
+	BurstSample CaptureSample(size_t i) const;
+
+	void FillHeader(BurstFileHeader& h, uint64_t triggerUnixMs) const;
+
+private:
+	BurstConfig config_;
+	std::vector<BurstSample> ring_; // absolute timeUs while recording
+	size_t preCount_ = 0;
+	size_t postCount_ = 0;
+	size_t head_ = 0; // oldest
+	size_t size_ = 0;
+	size_t triggerIndex_ = 0;
+	size_t samplesSinceArm_ = 0;
+	int64_t triggerTimeUs_ = 0;
+	int64_t lastTimeUs_ = 0;
+	int64_t holdoffUntilUs_ = INT64_MIN; // automatic triggers ignored before this
+	double levelMHz_ = 0.0;
+	double prevMHz_ = 0.0;
+	BurstTrigger trigger_ = BurstTrigger::None;
+	bool frozen_ = false;
+};
+
+// Writes a frozen capture; false on I/O failure.
+bool WriteBurstFile(const wchar_t* path, const BurstRecorder& recorder, uint64_t triggerUnixMs);
+
+class SelfOverhead;
+
+class BurstCapture
+{
+public:
+	BurstCapture() = default;
+	~BurstCapture() { Disarm(); }
+	BurstCapture(const BurstCapture&) = delete;
+	BurstCapture& operator=(const BurstCapture&) = delete;
+
+	// Starts sampling `source` (counters are opened here when needed).
+	// False if the source cannot be read.
+	bool Arm(std::unique_ptr<CpuSourceBackend> source, const BurstConfig& config, SelfOverhead* overhead = nullptr);
+	void Disarm();
+	bool IsArmed() const { return thread_ != nullptr; }
+
+	// Manual trigger, taken on the next sample.
+	void Trigger() { manual_.store(true, std::memory_order_relaxed); }
+
+	uint64_t CaptureCount() const { return captures_.load(std::memory_order_relaxed); }
+	uint64_t MissedSamples() const { return missed_.load(std::memory_order_relaxed); }
+
+private:
+	static DWORD WINAPI ThreadProc(LPVOID param);
+	void Run();
+	bool Sample(double& mhz);
+	void Save();
+	void PruneFiles();
+
+	std::unique_ptr<CpuSourceBackend> source_;
+	std::vector<PROCESSOR_POWER_INFORMATION> ppi_;
+	BurstConfig config_;
+	BurstRecorder recorder_;
+	SelfOverhead* overhead_ = nullptr;
+	uint64_t triggerUnixMs_ = 0;
+	HANDLE thread_ = nullptr;
+	HANDLE timer_ = nullptr;
+	HANDLE stop_ = nullptr;
+	std::atomic<bool> manual_{ false };
+	std::atomic<uint64_t> captures_{ 0 };
+	std::atomic<uint64_t> missed_{ 0 };
+};
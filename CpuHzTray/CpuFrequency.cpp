@@ -1,60 +1,13 @@
 #include "CpuFrequency.h"
-
-#include <wbemidl.h>
-#include <comdef.h>
+#include "AdaptiveInterval.h"
+#include "SelfOverhead.h"
+#include "Trace.h"
 
 #include <algorithm>
-#include <optional>
+#include <array>
 #include <vector>
 
 #include <pdhmsg.h>
-#include <powrprof.h>
-
-// PROCESSOR_POWER_INFORMATION is defined in kernel-mode header ntpoapi.h;
-// define it here for user-mode use with CallNtPowerInformation.
-typedef struct _PROCESSOR_POWER_INFORMATION {
-	ULONG Number;
-	ULONG MaxMhz;
-	ULONG CurrentMhz;
-	ULONG MhzLimit;
-	ULONG MaxIdleState;
-	ULONG CurrentIdleState;
-} PROCESSOR_POWER_INFORMATION;
-
-#pragma comment(lib, "wbemuuid.lib")
-#pragma comment(lib, "pdh.lib")
-#pragma comment(lib, "PowrProf.lib")
-
-static std::optional<double> TryReadMaxClockSpeedMHz(IWbemServices* svc)
-{
-	IEnumWbemClassObject* enumerator = nullptr;
-	auto hr = svc->ExecQuery(
-		bstr_t(L"WQL"),
-		bstr_t(L"SELECT MaxClockSpeed FROM Win32_Processor"),
-		WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY,
-		nullptr,
-		&enumerator
-	);
-	if(FAILED(hr) || !enumerator) return std::nullopt;
-
-	IWbemClassObject* obj = nullptr;
-	ULONG returned = 0;
-	hr = enumerator->Next(WBEM_INFINITE, 1, &obj, &returned);
-	if(FAILED(hr) || returned == 0 || !obj) { enumerator->Release(); return std::nullopt; }
-
-	VARIANT vt;
-	VariantInit(&vt);
-	hr = obj->Get(L"MaxClockSpeed", 0, &vt, nullptr, nullptr);
-
-	std::optional<double> out;
-	if(SUCCEEDED(hr) && (vt.vt == VT_I4 || vt.vt == VT_UI4))
-		out = static_cast<double>(vt.ulVal);
-
-	VariantClear(&vt);
-	obj->Release();
-	enumerator->Release();
-	return out;
-}
 
 namespace {
 
@@ -74,6 +27,36 @@ bool IsRealLogicalProcessorInstance(const wchar_t* name)
 	return true;
 }
 
+// Parses a PDH processor instance name: "group,number" (Processor Information)
+// or "number" (Processor). Aggregates and malformed names return false.
+bool ParseProcessorInstance(const wchar_t* name, int& outGroup, int& outNumber)
+{
+	if(!IsRealLogicalProcessorInstance(name))
+		return false;
+
+	int values[2] = { 0, 0 };
+	int n = 0;
+	const wchar_t* p = name;
+	while(n < 2)
+	{
+		if(*p < L'0' || *p > L'9')
+			return false;
+		int v = 0;
+		while(*p >= L'0' && *p <= L'9')
+			v = v * 10 + (*p++ - L'0');
+		values[n++] = v;
+		if(*p == L',') { ++p; continue; }
+		if(*p == 0) break;
+		return false;
+	}
+	if(*p != 0)
+		return false;
+
+	outGroup = (n == 2) ? values[0] : 0;
+	outNumber = (n == 2) ? values[1] : values[0];
+	return true;
+}
+
 // Pure helper: compute average, max, and min from a list of per-core samples.
 struct CoreStats
 {
@@ -151,24 +134,55 @@ NamedStats ComputeNamedCoreStats(const NamedSample* samples, int count)
 	return result;
 }
 
-bool IsNominalLike(const SampleWindow& w, double baseMHz)
+// Clock limit stats of one PowerInformation sample. A processor is limited
+// when MhzLimit is below MaxMhz, and capped when it also runs at that limit
+// (within the material band): the limit, not idleness, sets its clock.
+struct LimitStats
 {
-	if(baseMHz <= 0.0) return false;
-	int n = w.Count();
-	if(n < 6) return false;
-	double threshold = std::max(75.0, baseMHz * 0.035);
-	for(int i = 0; i < 6; ++i)
+	double avgLimitMHz = 0.0;
+	double avgBelowLimitMHz = 0.0; // mean of (limit - current)
+	int count = 0;
+	int limitedCount = 0;
+	int cappedCount = 0;
+};
+
+LimitStats ComputeLimitStats(const double* currentMHz, const double* maxMHz, const double* limitMHz, int count)
+{
+	LimitStats result;
+	double limitSum = 0.0;
+	double belowSum = 0.0;
+	for(int i = 0; i < count; ++i)
 	{
-		double val = w.Recent(i);
-		if(val <= 0.0) return false;
-		if(std::abs(val - baseMHz) > threshold) return false;
+		if(currentMHz[i] <= 0.0 || limitMHz[i] <= 0.0)
+			continue;
+		limitSum += limitMHz[i];
+		belowSum += limitMHz[i] - currentMHz[i];
+		++result.count;
+		if(maxMHz[i] > 0.0 && limitMHz[i] < maxMHz[i])
+		{
+			++result.limitedCount;
+			// At the limit, within the band either way: a core well above it
+			// (a stale or low limit) is not held there.
+			if(std::abs(currentMHz[i] - limitMHz[i]) <= SourceWindow::BandMHz(maxMHz[i]))
+				++result.cappedCount;
+		}
 	}
-	return true;
+	if(result.count > 0)
+	{
+		result.avgLimitMHz = limitSum / result.count;
+		result.avgBelowLimitMHz = belowSum / result.count;
+	}
+	return result;
+}
+
+bool IsNominalLike(const SourceWindow& w, double baseMHz)
+{
+	return w.IsNominalLike(baseMHz);
 }
 
 static double MaterialDeltaMHz(double baseMHz)
 {
-	return baseMHz > 0.0 ? std::max(75.0, baseMHz * 0.035) : 75.0;
+	return SourceWindow::BandMHz(baseMHz);
 }
 
 static bool Near(double a, double b, double eps = 0.000001)
@@ -186,6 +200,7 @@ struct CandidateSample
 	bool ok = false;
 	long pdhStatus = 0;
 	unsigned long pdhCStatus = 0;
+	const std::vector<double>* perCore = nullptr; // optional, global processor index -> MHz
 };
 
 static bool IsBelowBase(double valueMHz, double baseMHz)
@@ -200,12 +215,15 @@ static bool IsBaseLikeValue(double valueMHz, double baseMHz)
 	return std::abs(valueMHz - baseMHz) <= MaterialDeltaMHz(baseMHz);
 }
 
-static int ChooseBestCandidate(
+#ifdef _DEBUG
+// Original loop-based selection, kept as the oracle for the exhaustive
+// equivalence test of the table-driven version below.
+static int ChooseBestCandidateReference(
 	const CandidateSample* candidates, int nCandidates,
-	const SampleWindow& powerInfoWin,
-	const SampleWindow& perCorePerfWin,
-	const SampleWindow& totalPerfWin,
-	const SampleWindow& procFreqWin,
+	const SourceWindow& powerInfoWin,
+	const SourceWindow& perCorePerfWin,
+	const SourceWindow& totalPerfWin,
+	const SourceWindow& procFreqWin,
 	double baseMHz,
 	bool& outAllNominalLike)
 {
@@ -279,7 +297,7 @@ static int ChooseBestCandidate(
 	for(const auto& prio : kPriority)
 	{
 		int idx = -1;
-		const SampleWindow* w = nullptr;
+		const SourceWindow* w = nullptr;
 		if(prio == L"PowerInformation-CurrentMhz") { idx = piIdx; w = &powerInfoWin; }
 		else if(prio == L"PDH-PerCore-PerfBase") { idx = perCoreIdx; w = &perCorePerfWin; }
 		else if(prio == L"PDH-Total-PerfBase") { idx = totalIdx; w = &totalPerfWin; }
@@ -309,6 +327,149 @@ static int ChooseBestCandidate(
 	return -1;
 }
 
+#endif
+
+// Selection rules as compile-time tables.
+// Sources are slots in normal priority order. Each rule is a priority order
+// over slots, and "first slot of that order present in a set" is precomputed
+// for every subset of slots, so a decision is a few bitmask table lookups.
+enum SourceSlot : int
+{
+	kSlotPowerInfo,
+	kSlotPerCorePerf,
+	kSlotTotalPerf,
+	kSlotProcFreq,
+	kSlotCount
+};
+
+constexpr const wchar_t* kSlotSourceNames[kSlotCount] = {
+	L"PowerInformation-CurrentMhz",
+	L"PDH-PerCore-PerfBase",
+	L"PDH-Total-PerfBase",
+	L"PDH-ProcessorFrequency-Diagnostic"
+};
+
+constexpr unsigned kSlotMaskCount = 1u << kSlotCount;
+
+// Rule 2 (and Rule 0's "highest-priority available") order.
+constexpr std::array<int, 4> kNormalOrder = { kSlotPowerInfo, kSlotPerCorePerf, kSlotTotalPerf, kSlotProcFreq };
+// Rule 0: below-base candidates.
+constexpr std::array<int, 4> kBelowBaseOrder = { kSlotPerCorePerf, kSlotTotalPerf, kSlotPowerInfo, kSlotProcFreq };
+// Rule 1: live sources when PowerInformation is base-like.
+constexpr std::array<int, 3> kLiveOrder = { kSlotPerCorePerf, kSlotTotalPerf, kSlotProcFreq };
+
+// table[mask] = first slot of `order` whose bit is set in mask, or -1.
+template <size_t N>
+constexpr std::array<int8_t, kSlotMaskCount> MakeFirstInOrder(const std::array<int, N>& order)
+{
+	std::array<int8_t, kSlotMaskCount> t{};
+	for(unsigned mask = 0; mask < kSlotMaskCount; ++mask)
+	{
+		t[mask] = -1;
+		for(int slot : order)
+		{
+			if(mask & (1u << slot))
+			{
+				t[mask] = (int8_t)slot;
+				break;
+			}
+		}
+	}
+	return t;
+}
+
+constexpr auto kFirstNormal = MakeFirstInOrder(kNormalOrder);
+constexpr auto kFirstBelowBase = MakeFirstInOrder(kBelowBaseOrder);
+constexpr auto kFirstLive = MakeFirstInOrder(kLiveOrder);
+
+static_assert(kFirstNormal[0] == -1 && kFirstNormal[0b1111] == kSlotPowerInfo);
+static_assert(kFirstBelowBase[0b1111] == kSlotPerCorePerf && kFirstBelowBase[0b1001] == kSlotPowerInfo);
+static_assert(kFirstLive[0b0001] == -1 && kFirstLive[0b1001] == kSlotProcFreq);
+
+static int ChooseBestCandidate(
+	const CandidateSample* candidates, int nCandidates,
+	const SourceWindow& powerInfoWin,
+	const SourceWindow& perCorePerfWin,
+	const SourceWindow& totalPerfWin,
+	const SourceWindow& procFreqWin,
+	double baseMHz,
+	bool& outAllNominalLike)
+{
+	outAllNominalLike = true;
+	if(nCandidates <= 0) return -1;
+
+	int idx[kSlotCount] = { -1, -1, -1, -1 };
+	for(int i = 0; i < nCandidates; ++i)
+	{
+		for(int slot = 0; slot < kSlotCount; ++slot)
+		{
+			if(candidates[i].source == kSlotSourceNames[slot])
+			{
+				idx[slot] = i;
+				break;
+			}
+		}
+	}
+
+	// Per-slot predicates as bitmasks over the available slots. With no base,
+	// baseLike and belowBase stay empty, which disables Rules 0 and 1.
+	const SourceWindow* windows[kSlotCount] = { &powerInfoWin, &perCorePerfWin, &totalPerfWin, &procFreqWin };
+	unsigned available = 0, baseLike = 0, belowBase = 0, positive = 0, nominal = 0;
+	for(int slot = 0; slot < kSlotCount; ++slot)
+	{
+		if(idx[slot] < 0) continue;
+		const double v = candidates[idx[slot]].avgMHz;
+		const unsigned bit = 1u << slot;
+		available |= bit;
+		if(IsBaseLikeValue(v, baseMHz)) baseLike |= bit;
+		if(IsBelowBase(v, baseMHz)) belowBase |= bit;
+		if(v > 0.0) positive |= bit;
+		if(IsNominalLike(*windows[slot], baseMHz)) nominal |= bit;
+	}
+
+	// Rule 0 — If the highest-priority available source is base-like, prefer
+	// the first below-base live source in below-base priority order.
+	const int first = kFirstNormal[available];
+	if(first >= 0 && (baseLike & (1u << first)))
+	{
+		const int slot = kFirstBelowBase[belowBase];
+		if(slot >= 0)
+		{
+			outAllNominalLike = false;
+			return idx[slot];
+		}
+	}
+
+	// Rule 1 — If PowerInformation is base-like, prefer the first live current source.
+	if(baseLike & (1u << kSlotPowerInfo))
+	{
+		const int slot = kFirstLive[positive];
+		if(slot >= 0)
+		{
+			outAllNominalLike = false;
+			return idx[slot];
+		}
+	}
+
+	// Rule 2 — First non-NominalLike source in priority order; if all are
+	// NominalLike, the highest-priority available one.
+	const int live = kFirstNormal[available & ~nominal];
+	if(live >= 0)
+	{
+		outAllNominalLike = false;
+		return idx[live];
+	}
+	return first >= 0 ? idx[first] : -1;
+}
+
+// True when a PowerInformation reading wins whatever the other sources say:
+// a value outside the base band disables Rules 0 and 1 and also resets its own
+// window, so Rule 2 selects it first. Read() then skips the PDH sources.
+static bool PowerInfoDecides(double piMHz, double baseMHz)
+{
+	return piMHz > 0.0 && !IsBaseLikeValue(piMHz, baseMHz);
+}
+
 std::wstring GetUtcTimestamp()
 {
 	SYSTEMTIME st;
@@ -337,6 +498,20 @@ bool RunSelfTests()
 		if(!check(nullptr, false)) return false;
 	}
 
+	// ParseProcessorInstance tests
+	{
+		int g = -1, n = -1;
+		if(!ParseProcessorInstance(L"0,3", g, n) || g != 0 || n != 3) return false;
+		if(!ParseProcessorInstance(L"1,12", g, n) || g != 1 || n != 12) return false;
+		if(!ParseProcessorInstance(L"7", g, n) || g != 0 || n != 7) return false;
+		if(ParseProcessorInstance(L"0,_Total", g, n)) return false;
+		if(ParseProcessorInstance(L"_Total", g, n)) return false;
+		if(ParseProcessorInstance(L"0,1,2", g, n)) return false;
+		if(ParseProcessorInstance(L"a,1", g, n)) return false;
+		if(ParseProcessorInstance(L"1,", g, n)) return false;
+		if(ParseProcessorInstance(nullptr, g, n)) return false;
+	}
+
 	// ComputeCoreStats tests
 	{
 		double vals[] = {1000.0, 2000.0, 3000.0};
@@ -368,6 +543,20 @@ bool RunSelfTests()
 		if(s.count != 0) return false;
 	}
 
+	// ComputeLimitStats: idle-clocked vs capped.
+	{
+		const double cur[] = { 1200.0, 2790.0, 2000.0, 0.0, 3000.0, 2850.0, 3000.0 };
+		const double mx[] = { 3000.0, 3000.0, 3000.0, 3000.0, 3000.0, 3000.0, 3000.0 };
+		const double lim[] = { 3000.0, 2800.0, 2800.0, 2800.0, 0.0, 2800.0, 2000.0 };
+		auto s = ComputeLimitStats(cur, mx, lim, 7);
+		// #0 idle below an unlimited clock, #1 capped, #2 limited but idle,
+		// #3 no current value, #4 no limit, #5 capped just above its limit,
+		// #6 well above its limit (stale): limited, not capped.
+		if(s.count != 5 || s.limitedCount != 4 || s.cappedCount != 2) return false;
+		if(!Near(s.avgLimitMHz, 13400.0 / 5.0) || !Near(s.avgBelowLimitMHz, (1800.0 + 10.0 + 800.0 - 50.0 - 1000.0) / 5.0)) return false;
+		if(ComputeLimitStats(cur, mx, lim, 0).count != 0) return false;
+	}
+
 	// ComputeNamedCoreStats with aggregate filtering.
 	{
 		NamedSample samples[] = {
@@ -382,25 +571,72 @@ bool RunSelfTests()
 
 	// IsNominalLike tests
 	{
-		SampleWindow w;
+		SourceWindow w;
 		if(IsNominalLike(w, 2500.0)) return false;
 		if(IsNominalLike(w, 0.0)) return false;
 		for(int i = 0; i < 6; ++i)
-			w.Push(2501.0);
+			w.Push(2501.0, 2500.0);
 		if(!IsNominalLike(w, 2500.0)) return false;
-		w.Push(3000.0);
+		w.Push(3000.0, 2500.0);
 		if(IsNominalLike(w, 2500.0)) return false;
 	}
 	{
-		SampleWindow w;
+		SourceWindow w;
 		double baseMhz = 2500.0;
 		double threshold = std::max(75.0, baseMhz * 0.035);
 		for(int i = 0; i < 6; ++i)
-			w.Push(baseMhz + threshold - 1.0);
+			w.Push(baseMhz + threshold - 1.0, baseMhz);
 		if(!IsNominalLike(w, baseMhz)) return false;
-		w.Push(baseMhz + threshold + 1.0);
+		w.Push(baseMhz + threshold + 1.0, baseMhz);
 		if(IsNominalLike(w, baseMhz)) return false;
 	}
+	{
+		// Ring wraps without shifting; Recent() stays newest-first.
+		SourceWindow w;
+		for(int i = 1; i <= 25; ++i)
+			w.Push((double)i, 2500.0);
+		if(w.Count() != SourceWindow::kCapacity) return false;
+		if(w.Recent(0) != 25.0 || w.Recent(9) != 16.0 || w.Recent(10) != 0.0) return false;
+		if(w.InBandRun() != 0) return false;
+		// Run rebuilds only after RunLength in-band samples, and saturates at capacity.
+		for(int i = 0; i < 5; ++i)
+			w.Push(2500.0, 2500.0);
+		if(w.InBandRun() != 5 || IsNominalLike(w, 2500.0)) return false;
+		for(int i = 0; i < 20; ++i)
+			w.Push(2500.0, 2500.0);
+		if(w.InBandRun() != SourceWindow::kCapacity || !IsNominalLike(w, 2500.0)) return false;
+		// A zero sample breaks the run.
+		w.Push(0.0, 2500.0);
+		if(w.InBandRun() != 0 || IsNominalLike(w, 2500.0)) return false;
+	}
+	{
+		// Samples pushed before base was known are recounted against the new base.
+		SourceWindow w;
+		for(int i = 0; i < 6; ++i)
+			w.Push(2500.0, 0.0);
+		if(w.InBandRun() != 0) return false;
+		if(!IsNominalLike(w, 2500.0)) return false;
+		w.Push(2500.0, 2500.0);
+		if(w.InBandRun() != 7) return false;
+	}
+	{
+		// The run is time-based: 6 s is 24 samples at 250 ms (beyond the
+		// ring) and 2 at 4 s.
+		SourceWindow w;
+		w.SetRunLength(SamplesForDuration(kNominalLikeMs, 250));
+		for(int i = 0; i < 23; ++i)
+			w.Push(2500.0, 2500.0);
+		if(w.RequiredRun() != 24 || IsNominalLike(w, 2500.0)) return false;
+		w.Push(2500.0, 2500.0);
+		if(!IsNominalLike(w, 2500.0)) return false;
+		w.SetRunLength(SamplesForDuration(kNominalLikeMs, 4000));
+		w.Push(3000.0, 2500.0);
+		w.Push(2500.0, 2500.0);
+		if(IsNominalLike(w, 2500.0)) return false;
+		w.Push(2500.0, 2500.0);
+		if(!IsNominalLike(w, 2500.0)) return false;
+		if(SamplesForDuration(kNominalLikeMs, 1000) != SourceWindow::kRunLength) return false;
+	}
 
 	// ChooseBestCandidate tests
 	{
@@ -410,7 +646,7 @@ bool RunSelfTests()
 			{L"PDH-PerCore-PerfBase", 1200.0, 1300.0, 1100.0, 16, true},
 			{L"PDH-Total-PerfBase", 1250.0, 1250.0, 1250.0, 1, true},
 		};
-		SampleWindow eWins[4];
+		SourceWindow eWins[4];
 		bool allNom = false;
 		int idx = ChooseBestCandidate(t1, 3, eWins[0], eWins[1], eWins[2], eWins[3], 2500.0, allNom);
 		if(idx != 1 || t1[idx].avgMHz != 1200.0 || allNom) return false;
@@ -421,7 +657,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 2500.0, 2500.0, 2500.0, 16, true},
 			{L"PDH-Total-PerfBase", 1400.0, 1400.0, 1400.0, 1, true},
 		};
-		SampleWindow eWins[4];
+		SourceWindow eWins[4];
 		bool allNom = false;
 		int idx = ChooseBestCandidate(t2, 2, eWins[0], eWins[1], eWins[2], eWins[3], 2500.0, allNom);
 		if(idx != 1 || t2[idx].avgMHz != 1400.0 || allNom) return false;
@@ -432,7 +668,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 3900.0, 3900.0, 3900.0, 16, true},
 			{L"PDH-PerCore-PerfBase", 3800.0, 3800.0, 3800.0, 16, true},
 		};
-		SampleWindow eWins[4];
+		SourceWindow eWins[4];
 		bool allNom = false;
 		int idx = ChooseBestCandidate(t3, 2, eWins[0], eWins[1], eWins[2], eWins[3], 2500.0, allNom);
 		if(idx != 0 || allNom) return false;
@@ -443,7 +679,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 2500.0, 2500.0, 2500.0, 16, true},
 			{L"PDH-PerCore-PerfBase", 3100.0, 3100.0, 3100.0, 16, true},
 		};
-		SampleWindow eWins[4];
+		SourceWindow eWins[4];
 		bool allNom = false;
 		int idx = ChooseBestCandidate(t4, 2, eWins[0], eWins[1], eWins[2], eWins[3], 2500.0, allNom);
 		if(idx != 1 || t4[idx].avgMHz != 3100.0 || allNom) return false;
@@ -453,7 +689,7 @@ bool RunSelfTests()
 		CandidateSample t5[] = {
 			{L"PowerInformation-CurrentMhz", 2500.0, 2500.0, 2500.0, 16, true},
 		};
-		SampleWindow eWins[4];
+		SourceWindow eWins[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t5, 1, eWins[0], eWins[1], eWins[2], eWins[3], 2500.0, allNom);
 		if(idx != 0 || allNom) return false;
@@ -465,12 +701,12 @@ bool RunSelfTests()
 			{L"PDH-PerCore-PerfBase", 2510.0, 2510.0, 2510.0, 16, true},
 			{L"PDH-Total-PerfBase", 2490.0, 2490.0, 2490.0, 1, true},
 		};
-		SampleWindow nomWins[4];
+		SourceWindow nomWins[4];
 		for(int i = 0; i < 6; ++i)
 		{
-			nomWins[0].Push(2502.0);
-			nomWins[1].Push(2508.0);
-			nomWins[2].Push(2492.0);
+			nomWins[0].Push(2502.0, 2500.0);
+			nomWins[1].Push(2508.0, 2500.0);
+			nomWins[2].Push(2492.0, 2500.0);
 		}
 		bool allNom = false;
 		int idx = ChooseBestCandidate(t6, 3, nomWins[0], nomWins[1], nomWins[2], nomWins[3], 2500.0, allNom);
@@ -482,7 +718,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 2500.0, 2500.0, 2500.0, 16, true},
 			{L"PDH-PerCore-PerfBase", 2460.0, 2480.0, 2440.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 2460.0 || allNom) return false;
@@ -493,7 +729,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 2500.0, 2500.0, 2500.0, 16, true},
 			{L"PDH-Total-PerfBase", 2460.0, 2460.0, 2460.0, 1, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 2460.0 || allNom) return false;
@@ -504,7 +740,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 2500.0, 2500.0, 2500.0, 16, true},
 			{L"PDH-ProcessorFrequency-Diagnostic", 2460.0, 2480.0, 2440.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 2460.0 || allNom) return false;
@@ -517,7 +753,7 @@ bool RunSelfTests()
 			{L"PDH-Total-PerfBase", 2300.0, 2300.0, 2300.0, 1, true},
 			{L"PDH-ProcessorFrequency-Diagnostic", 2200.0, 2210.0, 2190.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 4, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 2470.0 || allNom) return false;
@@ -528,7 +764,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 2500.0, 2500.0, 2500.0, 16, true},
 			{L"PDH-ProcessorFrequency-Diagnostic", 3100.0, 3150.0, 3000.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 3100.0 || allNom) return false;
@@ -539,7 +775,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 3900.0, 3900.0, 3900.0, 16, true},
 			{L"PDH-PerCore-PerfBase", 2460.0, 2480.0, 2440.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = false;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 0 || allNom) return false;
@@ -550,7 +786,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 2500.0, 2500.0, 2500.0, 16, true},
 			{L"PDH-PerCore-PerfBase", 2493.0, 2495.0, 2490.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 2493.0 || allNom) return false;
@@ -561,7 +797,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 2500.0, 2500.0, 2500.0, 16, true},
 			{L"PDH-PerCore-PerfBase", 2500.0, 2500.0, 2500.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 2500.0 || allNom) return false;
@@ -572,7 +808,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 3900.0, 3900.0, 3900.0, 16, true},
 			{L"PDH-PerCore-PerfBase", 2493.0, 2495.0, 2490.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = false;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 0 || allNom) return false;
@@ -583,7 +819,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 2493.0, 2495.0, 2490.0, 16, true},
 			{L"PDH-PerCore-PerfBase", 2500.0, 2500.0, 2500.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 0 || t[idx].avgMHz != 2493.0 || allNom) return false;
@@ -594,7 +830,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 2493.0, 2495.0, 2490.0, 16, true},
 			{L"PDH-Total-PerfBase", 2500.0, 2500.0, 2500.0, 1, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 0 || t[idx].avgMHz != 2493.0 || allNom) return false;
@@ -605,7 +841,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 2500.0, 2500.0, 2500.0, 16, true},
 			{L"PDH-PerCore-PerfBase", 2493.0, 2495.0, 2490.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 2493.0 || allNom) return false;
@@ -618,7 +854,7 @@ bool RunSelfTests()
 			{L"PDH-Total-PerfBase", 2470.0, 2470.0, 2470.0, 1, true},
 			{L"PDH-ProcessorFrequency-Diagnostic", 2460.0, 2465.0, 2455.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 4, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 2480.0 || allNom) return false;
@@ -629,7 +865,7 @@ bool RunSelfTests()
 			{L"PowerInformation-CurrentMhz", 3900.0, 3900.0, 3900.0, 16, true},
 			{L"PDH-PerCore-PerfBase", 2493.0, 2495.0, 2490.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = false;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 0 || allNom) return false;
@@ -640,7 +876,7 @@ bool RunSelfTests()
 			{L"PDH-PerCore-PerfBase", 2500.0, 2500.0, 2500.0, 16, true},
 			{L"PDH-Total-PerfBase", 2493.0, 2493.0, 2493.0, 1, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 2493.0 || allNom) return false;
@@ -651,7 +887,7 @@ bool RunSelfTests()
 			{L"PDH-PerCore-PerfBase", 2500.0, 2500.0, 2500.0, 16, true},
 			{L"PDH-ProcessorFrequency-Diagnostic", 2493.0, 2495.0, 2490.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 2493.0 || allNom) return false;
@@ -663,7 +899,7 @@ bool RunSelfTests()
 			{L"PDH-Total-PerfBase", 2300.0, 2300.0, 2300.0, 1, true},
 			{L"PDH-ProcessorFrequency-Diagnostic", 2200.0, 2210.0, 2190.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 3, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 0 || t[idx].avgMHz != 2497.0 || allNom) return false;
@@ -674,7 +910,7 @@ bool RunSelfTests()
 			{L"PDH-PerCore-PerfBase", 3900.0, 3900.0, 3900.0, 16, true},
 			{L"PDH-Total-PerfBase", 2493.0, 2493.0, 2493.0, 1, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = false;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 0 || allNom) return false;
@@ -686,7 +922,7 @@ bool RunSelfTests()
 			{L"PDH-Total-PerfBase", 2493.0, 2493.0, 2493.0, 1, true},
 			{L"PDH-ProcessorFrequency-Diagnostic", 3600.0, 3600.0, 3600.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 3, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 2493.0 || allNom) return false;
@@ -697,7 +933,7 @@ bool RunSelfTests()
 			{L"PDH-PerCore-PerfBase", 2500.0, 2500.0, 2500.0, 16, true},
 			{L"PDH-ProcessorFrequency-Diagnostic", 2493.0, 2495.0, 2490.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 2, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 2493.0 || allNom) return false;
@@ -709,7 +945,7 @@ bool RunSelfTests()
 			{L"PDH-Total-PerfBase", 2493.0, 2493.0, 2493.0, 1, true},
 			{L"PDH-ProcessorFrequency-Diagnostic", 3600.0, 3600.0, 3600.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = true;
 		int idx = ChooseBestCandidate(t, 3, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 1 || t[idx].avgMHz != 2493.0 || allNom) return false;
@@ -721,16 +957,80 @@ bool RunSelfTests()
 			{L"PDH-Total-PerfBase", 2493.0, 2493.0, 2493.0, 1, true},
 			{L"PDH-ProcessorFrequency-Diagnostic", 3600.0, 3600.0, 3600.0, 16, true},
 		};
-		SampleWindow w[4];
+		SourceWindow w[4];
 		bool allNom = false;
 		int idx = ChooseBestCandidate(t, 3, w[0], w[1], w[2], w[3], 2500.0, allNom);
 		if(idx != 0 || allNom) return false;
 	}
+#ifdef _DEBUG
+	// Exhaustive equivalence with the loop-based reference: every combination
+	// of present/absent sources, value class relative to base (zero, far below,
+	// below within band, base-like, turbo), NominalLike window state,
+	// known/unknown base and candidate order.
+	{
+		const double kValues[] = { -1.0 /* absent */, 0.0, 1200.0, 2450.0, 2550.0, 3900.0 };
+		constexpr int kValueCount = (int)(sizeof(kValues) / sizeof(kValues[0]));
+		SourceWindow live;
+		SourceWindow stuck;
+		for(int i = 0; i < SourceWindow::kRunLength; ++i)
+			stuck.Push(2500.0, 2500.0);
+
+		int combos = 1;
+		for(int i = 0; i < kSlotCount; ++i) combos *= kValueCount;
+
+		for(double base : { 0.0, 2500.0 })
+		for(int combo = 0; combo < combos; ++combo)
+		for(unsigned nominalMask = 0; nominalMask < kSlotMaskCount; ++nominalMask)
+		for(int reversed = 0; reversed < 2; ++reversed)
+		{
+			CandidateSample t[kSlotCount];
+			int n = 0;
+			int c = combo;
+			for(int k = 0; k < kSlotCount; ++k, c /= kValueCount)
+			{
+				const int slot = reversed ? kSlotCount - 1 - k : k;
+				const double v = kValues[c % kValueCount];
+				if(v < 0.0) continue;
+				t[n++] = { kSlotSourceNames[slot], v, v, v, 1, true };
+			}
+			const SourceWindow* w[kSlotCount];
+			for(int slot = 0; slot < kSlotCount; ++slot)
+				w[slot] = (nominalMask & (1u << slot)) ? &stuck : &live;
+
+			bool nomA = false, nomB = true;
+			int a = ChooseBestCandidate(t, n, *w[0], *w[1], *w[2], *w[3], base, nomA);
+			int b = ChooseBestCandidateReference(t, n, *w[0], *w[1], *w[2], *w[3], base, nomB);
+			if(a != b || nomA != nomB) return false;
+
+			// Lazy reads: a deciding PowerInformation value (whose window is
+			// then never NominalLike) must win over every PDH combination.
+			int piIdx = -1;
+			for(int i = 0; i < n; ++i)
+			{
+				if(t[i].source == kSlotSourceNames[kSlotPowerInfo])
+					piIdx = i;
+			}
+			if(piIdx >= 0 && !(nominalMask & 1u) && PowerInfoDecides(t[piIdx].avgMHz, base) && a != piIdx)
+				return false;
+		}
+	}
+#endif
 	return true;
 }
 
 }
 
+ULONGLONG GetUnixTimeMs()
+{
+	// FILETIME is 100 ns ticks since 1601-01-01.
+	FILETIME ft;
+	GetSystemTimePreciseAsFileTime(&ft);
+	ULARGE_INTEGER t;
+	t.LowPart = ft.dwLowDateTime;
+	t.HighPart = ft.dwHighDateTime;
+	return (t.QuadPart - 116444736000000000ULL) / 10000ULL;
+}
+
 class CpuHzDiagnosticLogger
 {
 	FILE* file_ = nullptr;
@@ -741,22 +1041,23 @@ public:
 	{
 		if(_wfopen_s(&file_, path, L"w") != 0 || !file_)
 			return false;
-		fwprintf(file_, L"timeUtc,source,avgMHz,maxMHz,minMHz,baseMHz,validCoreCount,isNominalLike,pdhStatus,pdhCStatus\n");
+		fwprintf(file_, L"timeUtc,source,avgMHz,maxMHz,minMHz,baseMHz,validCoreCount,isNominalLike,pdhStatus,pdhCStatus,suspended\n");
 		return true;
 	}
 
 	void Write(const std::wstring& timeUtc, const std::wstring& source,
 			   double avgMHz, double maxMHz, double minMHz, double baseMHz,
 			   int validCoreCount, bool isNominalLike,
-			   long pdhStatus, unsigned long pdhCStatus)
+			   long pdhStatus, unsigned long pdhCStatus,
+			   const std::wstring& suspended)
 	{
 		if(!file_) return;
-		fwprintf(file_, L"%s,%s,%.3f,%.3f,%.3f,%.3f,%d,%s,%ld,%lu\n",
+		fwprintf(file_, L"%s,%s,%.3f,%.3f,%.3f,%.3f,%d,%s,%ld,%lu,%s\n",
 			timeUtc.c_str(), source.c_str(),
 			avgMHz, maxMHz, minMHz, baseMHz,
 			validCoreCount,
 			isNominalLike ? L"true" : L"false",
-			pdhStatus, pdhCStatus);
+			pdhStatus, pdhCStatus, suspended.c_str());
 		fflush(file_);
 	}
 
@@ -774,22 +1075,20 @@ CpuFrequency::~CpuFrequency()
 {
 	delete diagnosticLogger_;
 	diagnosticLogger_ = nullptr;
-
-	if(query_)
-	{
-		PdhCloseQuery(query_);
-		query_ = nullptr;
-	}
-	perCoreFreqMHzCounter_ = nullptr;
-	perCorePerfPctCounter_ = nullptr;
-	totalPerfPctCounter_ = nullptr;
-	totalFreqMHzCounter_ = nullptr;
 }
 
 bool CpuFrequency::Initialize()
 {
-	InitBaseWmi();
-	InitPdh(); // best-effort; query_ stays null if PDH unavailable
+	return Initialize(std::make_unique<WindowsCpuSource>());
+}
+
+bool CpuFrequency::Initialize(std::unique_ptr<CpuSourceBackend> source)
+{
+	source_ = std::move(source);
+	baseMHz_ = source_->ReadBaseMHz();
+	InitTopology();
+	source_->OpenCounters(baseMHz_); // best-effort; Read() falls back to PowerInformation
+	processorTimesOpen_ = source_->OpenProcessorTimes(); // best-effort; no busy-weighted clock without
 
 	if(!RunSelfTests())
 		return false;
@@ -797,103 +1096,35 @@ bool CpuFrequency::Initialize()
 	return true;
 }
 
-bool CpuFrequency::InitBaseWmi()
+void CpuFrequency::InitTopology()
 {
-	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
-	if(FAILED(hr) && hr != RPC_E_CHANGED_MODE) return false;
-
-	hr = CoInitializeSecurity(
-		nullptr,
-		-1,
-		nullptr,
-		nullptr,
-		RPC_C_AUTHN_LEVEL_DEFAULT,
-		RPC_C_IMP_LEVEL_IMPERSONATE,
-		nullptr,
-		EOAC_NONE,
-		nullptr
-	);
-	if(FAILED(hr) && hr != RPC_E_TOO_LATE) return false;
-
-	IWbemLocator* locator = nullptr;
-	hr = CoCreateInstance(CLSID_WbemLocator, nullptr, CLSCTX_INPROC_SERVER, IID_IWbemLocator, (LPVOID*)&locator);
-	if(FAILED(hr) || !locator) return false;
-
-	IWbemServices* services = nullptr;
-	hr = locator->ConnectServer(_bstr_t(L"ROOT\\CIMV2"), nullptr, nullptr, 0, 0, nullptr, nullptr, &services);
-	locator->Release();
-	if(FAILED(hr) || !services) return false;
-
-	hr = CoSetProxyBlanket(
-		services,
-		RPC_C_AUTHN_WINNT,
-		RPC_C_AUTHZ_NONE,
-		nullptr,
-		RPC_C_AUTHN_LEVEL_CALL,
-		RPC_C_IMP_LEVEL_IMPERSONATE,
-		nullptr,
-		EOAC_NONE
-	);
-	if(FAILED(hr)) { services->Release(); return false; }
-
-	auto maxMHz = TryReadMaxClockSpeedMHz(services);
-	services->Release();
-
-	if(maxMHz.has_value() && maxMHz.value() > 0)
-		baseMHz_ = maxMHz.value();
-
-	return baseMHz_ > 0;
-}
-
-bool CpuFrequency::InitPdh()
-{
-	auto s = PdhOpenQueryW(nullptr, 0, &query_);
-	if(s != ERROR_SUCCESS || !query_) return false;
-
-	// All counters are best-effort. At least one must provide useful data for Read() to succeed.
-
-	s = PdhAddEnglishCounterW(query_, L"\\Processor Information(*)\\Processor Frequency", 0, &perCoreFreqMHzCounter_);
-	if(s != ERROR_SUCCESS || !perCoreFreqMHzCounter_)
-		perCoreFreqMHzCounter_ = nullptr;
-
-	s = PdhAddEnglishCounterW(query_, L"\\Processor Information(*)\\% Processor Performance", 0, &perCorePerfPctCounter_);
-	if(s != ERROR_SUCCESS || !perCorePerfPctCounter_)
-		perCorePerfPctCounter_ = nullptr;
-
-	s = PdhAddEnglishCounterW(query_, L"\\Processor Information(_Total)\\% Processor Performance", 0, &totalPerfPctCounter_);
-	if(s != ERROR_SUCCESS || !totalPerfPctCounter_)
-		totalPerfPctCounter_ = nullptr;
-
-	// Diagnostic only: total Processor Frequency is kept but never used for baseMHz_.
-	s = PdhAddEnglishCounterW(query_, L"\\Processor Information(_Total)\\Processor Frequency", 0, &totalFreqMHzCounter_);
-	if(s != ERROR_SUCCESS || !totalFreqMHzCounter_)
-		totalFreqMHzCounter_ = nullptr;
-
-	// Prime: PDH may need multiple collections before returning valid data.
-	PdhCollectQueryData(query_);
-	Sleep(50);
-	PdhCollectQueryData(query_);
-
-	// At least one usable source is required.
-	bool hasDirectFreq = perCoreFreqMHzCounter_ != nullptr;
-	bool hasPerCorePerfBase = perCorePerfPctCounter_ != nullptr && baseMHz_ > 0.0;
-	bool hasTotalPerfBase = totalPerfPctCounter_ != nullptr && baseMHz_ > 0.0;
-	if(!hasDirectFreq && !hasPerCorePerfBase && !hasTotalPerfBase)
+	// PowerInformation MaxMhz is the per-processor rated clock; on hybrid
+	// CPUs it differs between core types where WMI has a single value.
+	std::vector<double> maxMHz;
+	DWORD procCount = source_->ProcessorCount();
+	if(procCount > 0)
 	{
-		PdhCloseQuery(query_);
-		query_ = nullptr;
-		return false;
+		ppi_.resize(procCount);
+		if(source_->ReadPowerInformation(ppi_.data(), procCount))
+		{
+			maxMHz.resize(procCount);
+			for(DWORD i = 0; i < procCount; ++i)
+				maxMHz[i] = (double)ppi_[i].MaxMhz;
+		}
 	}
-
-	return true;
+	source_->LoadTopology(topology_, maxMHz, baseMHz_);
+	// The display uses the type-weighted base on hybrid CPUs; selection and
+	// the NominalLike windows must agree with it, or a source idling at the
+	// E/P-core mix reads as "below base" or live.
+	selectionBaseMHz_ = topology_.IsHybrid() ? topology_.WeightedBaseMHz() : baseMHz_;
 }
 
-static bool TryReadDoubleCounter(PDH_HCOUNTER c, double& outValue, unsigned long& outCStatus, long& outStatus)
+static bool TryReadDoubleCounter(CpuSourceBackend& source, CpuCounter c, double& outValue, unsigned long& outCStatus, long& outStatus)
 {
-	if(!c) return false;
+	if(!source.HasCounter(c)) return false;
 
 	PDH_FMT_COUNTERVALUE v{};
-	outStatus = (long)PdhGetFormattedCounterValue(c, PDH_FMT_DOUBLE, nullptr, &v);
+	outStatus = (long)source.ReadCounter(c, v);
 	outCStatus = v.CStatus;
 
 	if(outStatus == ERROR_SUCCESS && (v.CStatus == ERROR_SUCCESS || v.CStatus == PDH_CSTATUS_VALID_DATA || v.CStatus == PDH_CSTATUS_NEW_DATA))
@@ -905,13 +1136,15 @@ static bool TryReadDoubleCounter(PDH_HCOUNTER c, double& outValue, unsigned long
 }
 
 static bool TryReadCounterArrayStats(
-	PDH_HCOUNTER counter,
+	CpuSourceBackend& source,
+	CpuCounter counter,
 	double& outAvg,
 	double& outMax,
 	double& outMin,
 	int& outCount,
 	unsigned long& outCStatus,
-	long& outStatus)
+	long& outStatus,
+	std::vector<double>* outPerCore = nullptr)
 {
 	outAvg = 0.0;
 	outMax = 0.0;
@@ -920,25 +1153,19 @@ static bool TryReadCounterArrayStats(
 	outCStatus = 0;
 	outStatus = 0;
 
-	if(!counter)
+	if(!source.HasCounter(counter))
 		return false;
 
-	DWORD bufferSize = 0;
+	const PDH_FMT_COUNTERVALUE_ITEM_W* items = nullptr;
 	DWORD itemCount = 0;
-	auto s = PdhGetFormattedCounterArrayW(counter, PDH_FMT_DOUBLE, &bufferSize, &itemCount, nullptr);
-	if(s != PDH_MORE_DATA || bufferSize == 0 || itemCount == 0)
-	{
-		outStatus = (long)s;
-		return false;
-	}
-
-	std::vector<BYTE> buffer(bufferSize);
-	auto items = reinterpret_cast<PDH_FMT_COUNTERVALUE_ITEM_W*>(buffer.data());
-	s = PdhGetFormattedCounterArrayW(counter, PDH_FMT_DOUBLE, &bufferSize, &itemCount, items);
+	auto s = source.ReadCounterArray(counter, items, itemCount);
 	outStatus = (long)s;
-	if(s != ERROR_SUCCESS)
+	if(s != ERROR_SUCCESS || !items || itemCount == 0)
 		return false;
 
+	if(outPerCore)
+		std::fill(outPerCore->begin(), outPerCore->end(), 0.0);
+
 	double sum = 0.0;
 	double mx = 0.0;
 	double mn = 0.0;
@@ -962,6 +1189,21 @@ static bool TryReadCounterArrayStats(
 		if(value <= 0.0)
 			continue;
 
+		if(outPerCore)
+		{
+			int group = 0, number = 0;
+			if(ParseProcessorInstance(item.szName, group, number))
+			{
+				int idx = GlobalProcessorIndex(group, number);
+				if(idx >= 0)
+				{
+					if((size_t)idx >= outPerCore->size())
+						outPerCore->resize((size_t)idx + 1, 0.0);
+					(*outPerCore)[(size_t)idx] = value;
+				}
+			}
+		}
+
 		if(first)
 		{
 			mx = value;
@@ -990,14 +1232,14 @@ static bool TryReadCounterArrayStats(
 
 bool CpuFrequency::TryReadPowerInformation(CpuReading& r)
 {
-	DWORD procCount = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+	DWORD procCount = source_->ProcessorCount();
 	if(procCount == 0)
 		return false;
 
-	std::vector<PROCESSOR_POWER_INFORMATION> ppi(procCount);
-	ULONG size = (ULONG)(procCount * sizeof(PROCESSOR_POWER_INFORMATION));
-	if(CallNtPowerInformation(ProcessorInformation, nullptr, 0, ppi.data(), size) != 0)
+	ppi_.resize(procCount);
+	if(!source_->ReadPowerInformation(ppi_.data(), procCount))
 		return false;
+	const auto* ppi = ppi_.data();
 
 	double sum = 0.0;
 	double mx = 0.0;
@@ -1005,11 +1247,18 @@ bool CpuFrequency::TryReadPowerInformation(CpuReading& r)
 	int validCount = 0;
 	bool first = true;
 
+	powerInfoCoreMHz_.assign(procCount, 0.0);
+	powerInfoCoreMaxMHz_.resize(procCount);
+	powerInfoCoreLimitMHz_.resize(procCount);
+
 	for(DWORD i = 0; i < procCount; ++i)
 	{
+		powerInfoCoreMaxMHz_[i] = static_cast<double>(ppi[i].MaxMhz);
+		powerInfoCoreLimitMHz_[i] = static_cast<double>(ppi[i].MhzLimit);
 		DWORD mhz = ppi[i].CurrentMhz;
 		if(mhz == 0)
 			continue;
+		powerInfoCoreMHz_[i] = static_cast<double>(mhz);
 
 		double val = static_cast<double>(mhz);
 		if(first)
@@ -1035,36 +1284,105 @@ bool CpuFrequency::TryReadPowerInformation(CpuReading& r)
 	r.source = L"PowerInformation-CurrentMhz";
 	r.baseMHz = baseMHz_;
 
+	// Limit stage: same sample, so limit and clock are consistent.
+	const LimitStats lim = ComputeLimitStats(powerInfoCoreMHz_.data(), powerInfoCoreMaxMHz_.data(),
+		powerInfoCoreLimitMHz_.data(), (int)procCount);
+	r.limitMHz = lim.avgLimitMHz;
+	r.belowLimitMHz = lim.avgBelowLimitMHz;
+	r.limitedCoreCount = lim.limitedCount;
+	r.cappedCoreCount = lim.cappedCount;
+
 	return true;
 }
 
 CpuReading CpuFrequency::Read()
 {
+	CPUHZ_TRACE_SCOPE("CpuFrequency::Read");
+	OverheadScope readScope(overhead_, OverheadProbe::Read);
+
 	CpuReading r{};
+	r.timeUnixMs = source_->UnixMs();
 	r.baseMHz = baseMHz_;
 
 	CandidateSample candidates[4];
 	int nCandidates = 0;
 
+	// Suspended sources are skipped until their re-probe is due.
+	const ULONGLONG nowTick = source_->TickMs();
+	bool want[kSlotCount];
+	for(int slot = 0; slot < kSlotCount; ++slot)
+		want[slot] = health_[slot].ShouldRead(nowTick);
+	bool attempted[kSlotCount] = {};
+	bool readOk[kSlotCount] = {};
+	double readMHz[kSlotCount] = {};
+	double readUs[kSlotCount] = {};
+
 	// 1. PowerInformation (primary)
+	if(want[kSlotPowerInfo])
 	{
 		CpuReading pi;
 		pi.baseMHz = baseMHz_;
-		if(TryReadPowerInformation(pi))
+		bool piOk;
+		{
+			CPUHZ_TRACE_SCOPE("PowerInformation");
+			OverheadScope scope(overhead_, OverheadProbe::PowerInformation, &readUs[kSlotPowerInfo]);
+			piOk = TryReadPowerInformation(pi);
+		}
+		attempted[kSlotPowerInfo] = true;
+		readOk[kSlotPowerInfo] = piOk;
+		readMHz[kSlotPowerInfo] = pi.avgMHz;
+		if(piOk)
+		{
+			r.perCoreLimitMHz = powerInfoCoreLimitMHz_;
+			r.limitMHz = pi.limitMHz;
+			r.belowLimitMHz = pi.belowLimitMHz;
+			r.limitedCoreCount = pi.limitedCoreCount;
+			r.cappedCoreCount = pi.cappedCoreCount;
+		}
+		if(piOk)
 		{
 			candidates[nCandidates++] = {
 				pi.source, pi.avgMHz, pi.maxMHz, pi.minMHz,
-				pi.validCoreCount, true, 0, 0
+				pi.validCoreCount, true, 0, 0, &powerInfoCoreMHz_
 			};
 		}
 	}
 
-	// 2. PDH sources
+	// 2. PDH sources (one collect serves all three; skipped if all are suspended).
+	// They cannot win while PowerInformation decides, so they are then only
+	// read every kLazyRefreshMs to keep their windows warm. Diagnostic mode
+	// reads everything so the CSV compares like with like.
+	const bool usablePerCorePerf = want[kSlotPerCorePerf] && baseMHz_ > 0.0 && source_->HasCounter(CpuCounter::PerCorePerformance);
+	const bool usableTotalPerf = want[kSlotTotalPerf] && baseMHz_ > 0.0 && source_->HasCounter(CpuCounter::TotalPerformance);
+	const bool usableProcFreq = want[kSlotProcFreq] && source_->HasCounter(CpuCounter::PerCoreFrequency);
+	const bool piDecides = readOk[kSlotPowerInfo] && PowerInfoDecides(readMHz[kSlotPowerInfo], selectionBaseMHz_);
+	const bool refreshDue = lastLowerReadTick_ == 0 || nowTick - lastLowerReadTick_ >= kLazyRefreshMs;
+	const bool readLower = !piDecides || refreshDue || diagnosticLogger_;
+	if(readLower)
+		lastLowerReadTick_ = nowTick;
+	const bool wantPerCorePerf = usablePerCorePerf && readLower;
+	const bool wantTotalPerf = usableTotalPerf && readLower;
+	const bool wantProcFreq = usableProcFreq && readLower;
+	if(overhead_)
+	{
+		const int lower = (int)usablePerCorePerf + (int)usableTotalPerf + (int)usableProcFreq;
+		const int read = (int)attempted[kSlotPowerInfo] + (readLower ? lower : 0);
+		overhead_->CountSourceReads(read, readLower ? 0 : lower);
+	}
+	attempted[kSlotPerCorePerf] = wantPerCorePerf;
+	attempted[kSlotTotalPerf] = wantTotalPerf;
+	attempted[kSlotProcFreq] = wantProcFreq;
+
 	bool pdhCollectAttempted = false;
 	bool pdhCollectFailed = false;
-	if(query_)
+	if(wantPerCorePerf || wantTotalPerf || wantProcFreq)
 	{
-		auto s = PdhCollectQueryData(query_);
+		PDH_STATUS s;
+		{
+			CPUHZ_TRACE_SCOPE("PdhCollectQueryData");
+			OverheadScope scope(overhead_, OverheadProbe::PdhCollect);
+			s = source_->CollectCounters();
+		}
 		lastPdhStatus_ = (long)s;
 		pdhCollectAttempted = true;
 		pdhCollectFailed = (s != ERROR_SUCCESS);
@@ -1077,17 +1395,36 @@ CpuReading CpuFrequency::Read()
 				int count = 0;
 				unsigned long cst = 0;
 				long st = 0;
-				if(baseMHz_ > 0.0 && perCorePerfPctCounter_ &&
-					TryReadCounterArrayStats(perCorePerfPctCounter_, avgPct, maxPct, minPct, count, cst, st))
+				bool ok = false;
+				if(wantPerCorePerf)
+				{
+					CPUHZ_TRACE_SCOPE("PDH-PerCore-PerfBase");
+					OverheadScope scope(overhead_, OverheadProbe::PerCorePerf, &readUs[kSlotPerCorePerf]);
+					ok = TryReadCounterArrayStats(*source_, CpuCounter::PerCorePerformance, avgPct, maxPct, minPct, count, cst, st, &perCorePerfCoreMHz_);
+				}
+				CoreStats mhz{ baseMHz_ * avgPct / 100.0, baseMHz_ * maxPct / 100.0, baseMHz_ * minPct / 100.0, count };
+				if(ok)
 				{
 					lastPdhCStatus_ = cst;
 					lastPdhStatus_ = st;
+					// The percentage is relative to each processor's own rated
+					// clock, which differs per core type on hybrid CPUs.
+					const bool hybrid = topology_.IsHybrid();
+					for(size_t i = 0; i < perCorePerfCoreMHz_.size(); ++i)
+					{
+						const double coreBase = hybrid ? topology_.BaseMHzOf((int)i) : baseMHz_;
+						perCorePerfCoreMHz_[i] = coreBase * perCorePerfCoreMHz_[i] / 100.0;
+					}
+					if(hybrid)
+					{
+						const CoreStats s = ComputeCoreStats(perCorePerfCoreMHz_.data(), (int)perCorePerfCoreMHz_.size());
+						if(s.count > 0)
+							mhz = s;
+					}
 					candidates[nCandidates++] = {
 						L"PDH-PerCore-PerfBase",
-						baseMHz_ * avgPct / 100.0,
-						baseMHz_ * maxPct / 100.0,
-						baseMHz_ * minPct / 100.0,
-						count, true, st, cst
+						mhz.avg, mhz.max, mhz.min,
+						mhz.count, true, st, cst, &perCorePerfCoreMHz_
 					};
 				}
 				else
@@ -1095,19 +1432,30 @@ CpuReading CpuFrequency::Read()
 					lastPdhCStatus_ = cst;
 					lastPdhStatus_ = st;
 				}
+				readOk[kSlotPerCorePerf] = ok;
+				readMHz[kSlotPerCorePerf] = mhz.avg;
 			}
 
-			// 2b. _Total % Processor Performance * baseMHz
+			// 2b. _Total % Processor Performance * base (each core's percentage is
+			// of its own rated clock, so the type-weighted base on hybrid CPUs)
 			{
 				double perfPct = 0.0;
 				unsigned long cst = 0;
 				long st = 0;
-				if(baseMHz_ > 0.0 && totalPerfPctCounter_ &&
-					TryReadDoubleCounter(totalPerfPctCounter_, perfPct, cst, st))
+				bool ok = false;
+				if(wantTotalPerf)
+				{
+					CPUHZ_TRACE_SCOPE("PDH-Total-PerfBase");
+					OverheadScope scope(overhead_, OverheadProbe::TotalPerf, &readUs[kSlotTotalPerf]);
+					ok = TryReadDoubleCounter(*source_, CpuCounter::TotalPerformance, perfPct, cst, st);
+				}
+				readOk[kSlotTotalPerf] = ok;
+				readMHz[kSlotTotalPerf] = selectionBaseMHz_ * perfPct / 100.0;
+				if(ok)
 				{
 					lastPdhCStatus_ = cst;
 					lastPdhStatus_ = st;
-					double mhz = baseMHz_ * perfPct / 100.0;
+					double mhz = selectionBaseMHz_ * perfPct / 100.0;
 					candidates[nCandidates++] = {
 						L"PDH-Total-PerfBase",
 						mhz, mhz, mhz, 1, true, st, cst
@@ -1126,14 +1474,22 @@ CpuReading CpuFrequency::Read()
 				int count = 0;
 				unsigned long cst = 0;
 				long st = 0;
-				if(perCoreFreqMHzCounter_ &&
-					TryReadCounterArrayStats(perCoreFreqMHzCounter_, avg, mx, mn, count, cst, st))
+				bool ok = false;
+				if(wantProcFreq)
+				{
+					CPUHZ_TRACE_SCOPE("PDH-ProcessorFrequency");
+					OverheadScope scope(overhead_, OverheadProbe::ProcessorFrequency, &readUs[kSlotProcFreq]);
+					ok = TryReadCounterArrayStats(*source_, CpuCounter::PerCoreFrequency, avg, mx, mn, count, cst, st, &procFreqCoreMHz_);
+				}
+				readOk[kSlotProcFreq] = ok;
+				readMHz[kSlotProcFreq] = avg;
+				if(ok)
 				{
 					lastPdhCStatus_ = cst;
 					lastPdhStatus_ = st;
 					candidates[nCandidates++] = {
 						L"PDH-ProcessorFrequency-Diagnostic",
-						avg, mx, mn, count, true, st, cst
+						avg, mx, mn, count, true, st, cst, &procFreqCoreMHz_
 					};
 				}
 				else
@@ -1145,28 +1501,91 @@ CpuReading CpuFrequency::Read()
 		}
 	}
 
+	// 2d. Per-processor busy fractions since the previous tick
+	processorBusy_ = nullptr;
+	if(processorTimesOpen_)
+	{
+		CPUHZ_TRACE_SCOPE("ProcessorTimes");
+		OverheadScope scope(overhead_, OverheadProbe::ProcessorTimes);
+		source_->ReadProcessorBusy(processorBusy_);
+	}
+
 	// 3. Push each candidate avgMHz to its per-source sample window
 	for(int i = 0; i < nCandidates; ++i)
 	{
-		SampleWindow* w = nullptr;
+		SourceWindow* w = nullptr;
+		const wchar_t* name = nullptr;
 		if(candidates[i].source == L"PowerInformation-CurrentMhz")
+		{
 			w = &powerInfoWindow_;
+			name = L"PowerInformation-CurrentMhz";
+		}
 		else if(candidates[i].source == L"PDH-PerCore-PerfBase")
+		{
 			w = &perCorePerfWindow_;
+			name = L"PDH-PerCore-PerfBase";
+		}
 		else if(candidates[i].source == L"PDH-Total-PerfBase")
+		{
 			w = &totalPerfWindow_;
+			name = L"PDH-Total-PerfBase";
+		}
 		else if(candidates[i].source == L"PDH-ProcessorFrequency-Diagnostic")
+		{
 			w = &procFreqWindow_;
+			name = L"PDH-ProcessorFrequency-Diagnostic";
+		}
 
 		if(w)
-			w->Push(candidates[i].avgMHz);
+		{
+			w->Push(candidates[i].avgMHz, selectionBaseMHz_);
+			auto& sv = r.sources[r.sourceCount++];
+			sv.source = name;
+			sv.avgMHz = candidates[i].avgMHz;
+			sv.nominalLike = w->IsNominalLike(selectionBaseMHz_);
+		}
+	}
+
+	// 3b. Source health. "Stuck" only counts while another source is live,
+	// so a machine idling at base never loses all its sources.
+	{
+		const SourceWindow* windows[kSlotCount] = { &powerInfoWindow_, &perCorePerfWindow_, &totalPerfWindow_, &procFreqWindow_ };
+		bool live[kSlotCount];
+		for(int slot = 0; slot < kSlotCount; ++slot)
+			live[slot] = readOk[slot] && !windows[slot]->IsNominalLike(selectionBaseMHz_);
+
+		for(int slot = 0; slot < kSlotCount; ++slot)
+		{
+			if(!attempted[slot]) continue;
+			bool otherLive = false;
+			for(int other = 0; other < kSlotCount; ++other)
+				otherLive = otherLive || (other != slot && live[other]);
+			health_[slot].OnRead(nowTick, readOk[slot], readMHz[slot],
+				windows[slot]->IsNominalLike(selectionBaseMHz_), otherLive, readUs[slot]);
+		}
+
+		for(int slot = 0; slot < kSlotCount; ++slot)
+		{
+			if(!health_[slot].IsSuspended()) continue;
+			if(!r.suspendedSources.empty())
+				r.suspendedSources += L"; ";
+			r.suspendedSources += kSlotSourceNames[slot];
+			r.suspendedSources += L" (";
+			r.suspendedSources += SourceHealth::ReasonText(health_[slot].Reason());
+			r.suspendedSources += L")";
+		}
 	}
 
 	// 4. Select best candidate (rules A, B, C)
 	bool allNominalLike = true;
-	int bestIdx = ChooseBestCandidate(candidates, nCandidates,
-		powerInfoWindow_, perCorePerfWindow_, totalPerfWindow_, procFreqWindow_,
-		baseMHz_, allNominalLike);
+	int bestIdx;
+	{
+		CPUHZ_TRACE_SCOPE("ChooseBestCandidate");
+		OverheadScope scope(overhead_, OverheadProbe::Select);
+		bestIdx = ChooseBestCandidate(candidates, nCandidates,
+			powerInfoWindow_, perCorePerfWindow_, totalPerfWindow_, procFreqWindow_,
+			selectionBaseMHz_, allNominalLike);
+	}
 
 	// 5. Build result from selected candidate
 	if(bestIdx >= 0)
@@ -1195,6 +1614,24 @@ CpuReading CpuFrequency::Read()
 		r.lastPdhCStatus = best.pdhCStatus;
 		r.nominalLike = allNominalLike;
 		r.accuracy = L"WindowsEstimated";
+		if(best.perCore)
+			r.perCoreMHz = *best.perCore;
+		if(best.perCore && processorBusy_)
+			r.busyWeightedMHz = CpuUtilization::BusyWeightedMHz(*best.perCore, *processorBusy_);
+		if(best.perCore && topology_.PackageCount() > 0)
+			topology_.ReduceHierarchy(*best.perCore, r.topology);
+		if(best.perCore && topology_.IsHybrid())
+		{
+			r.coreTypeCount = topology_.Reduce(*best.perCore, r.coreTypes, kMaxCoreTypes);
+			double weighted = 0.0;
+			int valid = 0;
+			for(int t = 0; t < r.coreTypeCount; ++t)
+			{
+				weighted += r.coreTypes[t].baseMHz * r.coreTypes[t].validCoreCount;
+				valid += r.coreTypes[t].validCoreCount;
+			}
+			r.typeWeightedBaseMHz = valid > 0 ? weighted / valid : 0.0;
+		}
 		if(allNominalLike)
 			r.warning = L"Values appear stuck near base frequency (NominalLike)";
 
@@ -1204,7 +1641,7 @@ CpuReading CpuFrequency::Read()
 			diagnosticLogger_->Write(ts, r.source,
 				r.avgMHz, r.maxMHz, r.minMHz, r.baseMHz,
 				r.validCoreCount, r.nominalLike,
-				r.lastPdhStatus, r.lastPdhCStatus);
+				r.lastPdhStatus, r.lastPdhCStatus, r.suspendedSources);
 		}
 
 		return r;
@@ -1237,8 +1674,10 @@ CpuReading CpuFrequency::Read()
 	r.baseMHz = baseMHz_;
 	r.accuracy = L"WindowsEstimated";
 
-	bool hasAnyCounter = perCoreFreqMHzCounter_ || perCorePerfPctCounter_ || totalPerfPctCounter_;
-	if(!hasAnyCounter && !query_)
+	bool hasAnyCounter = false;
+	for(int c = 0; c < (int)CpuCounter::Count; ++c)
+		hasAnyCounter = hasAnyCounter || source_->HasCounter((CpuCounter)c);
+	if(!hasAnyCounter)
 		r.source = L"NoUsableCounter";
 	else if(baseMHz_ > 0.0)
 		r.source = L"BaseOnly-NoCurrentHz";
@@ -1248,6 +1687,13 @@ CpuReading CpuFrequency::Read()
 	return r;
 }
 
+void CpuFrequency::SetSampleIntervalMs(unsigned intervalMs)
+{
+	const int run = SamplesForDuration(kNominalLikeMs, intervalMs);
+	for(SourceWindow* w : { &powerInfoWindow_, &perCorePerfWindow_, &totalPerfWindow_, &procFreqWindow_ })
+		w->SetRunLength(run);
+}
+
 void CpuFrequency::EnableDiagnosticLogger(const wchar_t* path)
 {
 	delete diagnosticLogger_;
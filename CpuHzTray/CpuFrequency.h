@@ -1,38 +1,128 @@
 #pragma once
 #include <windows.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
 #include <string>
-#include <pdh.h>
+#include <vector>
 
+#include "CpuSource.h"
+#include "CpuTopology.h"
+#include "SourceHealth.h"
+
+// Per-source rolling window of recent avgMHz samples.
+// - Push() is O(1): samples live in a ring that is never shifted.
+// - The number of consecutive most-recent samples inside the NominalLike band
+//   around baseMHz is maintained on Push(), so the NominalLike verdict does not
+//   rescan the window. Capacity and RunLength are compile-time parameters.
+template <int Capacity, int RunLength>
 struct SampleWindow
 {
-	static constexpr int kCapacity = 10;
-	double samples_[kCapacity] = {};
-	int count_ = 0;
+	static_assert(Capacity > 0 && RunLength > 0 && RunLength <= Capacity);
+	static constexpr int kCapacity = Capacity;
+	static constexpr int kRunLength = RunLength;
+
+	// NominalLike band half-width: max(75 MHz, 3.5% of base).
+	static double BandMHz(double baseMHz)
+	{
+		return baseMHz > 0.0 ? std::max(75.0, baseMHz * 0.035) : 75.0;
+	}
+
+	static bool InBand(double value, double baseMHz)
+	{
+		if(baseMHz <= 0.0 || value <= 0.0) return false;
+		return std::abs(value - baseMHz) <= BandMHz(baseMHz);
+	}
 
-	void Push(double value)
+	void Push(double value, double baseMHz)
 	{
-		if(count_ < kCapacity) ++count_;
-		for(int i = count_ - 1; i > 0; --i)
-			samples_[i] = samples_[i - 1];
-		samples_[0] = value;
+		// Base normally never changes after init; recount once if it does.
+		if(baseMHz != trackedBaseMHz_)
+		{
+			trackedBaseMHz_ = baseMHz;
+			inBandRun_ = CountInBandRun(baseMHz);
+		}
+
+		samples_[head_] = value;
+		head_ = (head_ + 1) % Capacity;
+		if(count_ < Capacity) ++count_;
+
+		if(InBand(value, baseMHz))
+		{
+			if(inBandRun_ < std::max(Capacity, runLength_)) ++inBandRun_;
+		}
+		else
+		{
+			inBandRun_ = 0;
+		}
 	}
 
 	int Count() const { return count_; }
 
+	// Consecutive most-recent samples within the band around the tracked base.
+	int InBandRun() const { return inBandRun_; }
+
 	double Recent(int offset) const
 	{
 		if(offset < 0 || offset >= count_) return 0.0;
-		return samples_[offset];
+		return samples_[(head_ - 1 - offset + Capacity) % Capacity];
+	}
+
+	bool IsNominalLike(double baseMHz) const
+	{
+		if(baseMHz <= 0.0) return false;
+		int run = (baseMHz == trackedBaseMHz_) ? inBandRun_ : CountInBandRun(baseMHz);
+		return run >= runLength_;
+	}
+
+	// In-band samples needed for NominalLike (RunLength by default). May
+	// exceed Capacity: the run is counted, not stored.
+	void SetRunLength(int samples) { runLength_ = std::clamp(samples, 1, kMaxRunLength); }
+	int RequiredRun() const { return runLength_; }
+	static constexpr int kMaxRunLength = 1000;
+
+private:
+	int CountInBandRun(double baseMHz) const
+	{
+		int run = 0;
+		while(run < count_ && InBand(Recent(run), baseMHz))
+			++run;
+		return run;
 	}
+
+	double samples_[Capacity] = {};
+	int head_ = 0;
+	int count_ = 0;
+	int inBandRun_ = 0;
+	int runLength_ = RunLength;
+	double trackedBaseMHz_ = 0.0;
+};
+
+// 10-sample window; NominalLike after kNominalLikeMs of consecutive in-band
+// samples (6 at the 1 s base interval; see CpuFrequency::SetSampleIntervalMs).
+using SourceWindow = SampleWindow<10, 6>;
+inline constexpr unsigned kNominalLikeMs = 6000;
+
+// This tick's value from one candidate source, whether or not it was selected.
+struct SourceValue
+{
+	const wchar_t* source = nullptr; // static source name
+	double avgMHz = 0.0;
+	bool nominalLike = false;
 };
 
 struct CpuReading
 {
+	ULONGLONG timeUnixMs = 0; // wall-clock time the sample was taken
 	double currentMHz = 0.0;
 	double avgMHz = 0.0;
 	double maxMHz = 0.0;
 	double minMHz = 0.0;
 	double baseMHz = 0.0;
+	// Per-core MHz weighted by how busy each processor was since the last
+	// sample: the clock work actually ran at. 0 when unknown (aggregate-only
+	// source, first sample, or an idle machine).
+	double busyWeightedMHz = 0.0;
 	int validCoreCount = 0;
 	bool ok = false;
 	std::wstring source;
@@ -41,9 +131,40 @@ struct CpuReading
 	bool nominalLike = false;
 	std::wstring accuracy;
 	std::wstring warning;
+	// Per logical processor MHz from the selected source, indexed by global
+	// processor index (0 = no value). Empty for aggregate-only sources.
+	std::vector<double> perCoreMHz;
+	// Every source that produced a value this tick (selected one included).
+	SourceValue sources[4];
+	int sourceCount = 0;
+	// Hybrid CPUs: the selected source's per-core values reduced per core type
+	// (fastest first), and the per-type bases weighted by valid processors.
+	// Empty / 0 when the CPU has one core type or the source has no per-core data.
+	CoreTypeStats coreTypes[kMaxCoreTypes];
+	int coreTypeCount = 0;
+	double typeWeightedBaseMHz = 0.0;
+	// The selected source's per-core values per package, die and physical
+	// core. Empty when the source has no per-core data.
+	TopologyStats topology;
+	// PowerInformation clock limits (0 = unknown, e.g. PowerInformation
+	// suspended). A processor is limited when MhzLimit < MaxMhz and capped
+	// when it also runs at that limit (within the band either side): capped
+	// is thermally/power limited, a low clock that is not capped is
+	// idle-clocked, and one well above the limit has a stale limit.
+	std::vector<double> perCoreLimitMHz; // MhzLimit by global processor index
+	double limitMHz = 0.0;               // average MhzLimit
+	double belowLimitMHz = 0.0;          // average MhzLimit - CurrentMhz
+	int limitedCoreCount = 0;
+	int cappedCoreCount = 0;
+	// Sources not being collected, e.g. L"PDH-Total-PerfBase (failing)"; "; "-separated.
+	std::wstring suspendedSources;
 };
 
+// Wall-clock time in milliseconds since 1970-01-01 UTC.
+ULONGLONG GetUnixTimeMs();
+
 class CpuHzDiagnosticLogger;
+class SelfOverhead;
 
 class CpuFrequency
 {
@@ -51,16 +172,24 @@ public:
 	CpuFrequency() = default;
 	~CpuFrequency();
 
+	// Live machine (WindowsCpuSource).
 	bool Initialize();
+	// Any backend, e.g. SimulatedCpuSource.
+	bool Initialize(std::unique_ptr<CpuSourceBackend> source);
 	CpuReading Read();
+	// The period between Read() calls; NominalLike run lengths follow it so
+	// they keep meaning kNominalLikeMs of wall time.
+	void SetSampleIntervalMs(unsigned intervalMs);
 	void EnableDiagnosticLogger(const wchar_t* path);
+	// Per-source read timings go here when set (not owned).
+	void SetOverhead(SelfOverhead* overhead) { overhead_ = overhead; }
 
 private:
-	bool InitBaseWmi();
-	bool InitPdh();
+	void InitTopology();
 	bool TryReadPowerInformation(CpuReading& r);
 
-	double baseMHz_ = 0;
+	double baseMHz_ = 0;          // WMI rated clock, as reported
+	double selectionBaseMHz_ = 0; // type-weighted on hybrid CPUs; what source selection compares against
 
 	double lastGoodAvgMHz_ = 0.0;
 	double lastGoodMaxMHz_ = 0.0;
@@ -68,19 +197,37 @@ private:
 	int lastGoodValidCoreCount_ = 0;
 	std::wstring lastGoodSource_;
 
-	PDH_HQUERY query_ = nullptr;
-	PDH_HCOUNTER perCoreFreqMHzCounter_ = nullptr;
-	PDH_HCOUNTER perCorePerfPctCounter_ = nullptr;
-	PDH_HCOUNTER totalPerfPctCounter_ = nullptr;
-	PDH_HCOUNTER totalFreqMHzCounter_ = nullptr;
+	CpuTopology topology_;
+	bool processorTimesOpen_ = false;
+	const std::vector<double>* processorBusy_ = nullptr; // backend-owned, this tick
+
+	std::unique_ptr<CpuSourceBackend> source_;
 
 	long lastPdhStatus_ = 0;
 	unsigned long lastPdhCStatus_ = 0;
 
-	SampleWindow powerInfoWindow_;
-	SampleWindow perCorePerfWindow_;
-	SampleWindow totalPerfWindow_;
-	SampleWindow procFreqWindow_;
+	// Per-core scratch, reused across ticks (global processor index -> MHz).
+	std::vector<PROCESSOR_POWER_INFORMATION> ppi_;
+	std::vector<double> powerInfoCoreMHz_;
+	std::vector<double> powerInfoCoreMaxMHz_;
+	std::vector<double> powerInfoCoreLimitMHz_;
+	std::vector<double> perCorePerfCoreMHz_;
+	std::vector<double> procFreqCoreMHz_;
+
+	SourceWindow powerInfoWindow_;
+	SourceWindow perCorePerfWindow_;
+	SourceWindow totalPerfWindow_;
+	SourceWindow procFreqWindow_;
+
+	// Indexed like the source slots in CpuFrequency.cpp (PowerInformation,
+	// per-core perf, total perf, Processor Frequency).
+	SourceHealth health_[4];
+
+	// Lower-priority sources are read at least this often while
+	// PowerInformation alone decides the selection.
+	static constexpr ULONGLONG kLazyRefreshMs = 5000;
+	ULONGLONG lastLowerReadTick_ = 0;
 
 	CpuHzDiagnosticLogger* diagnosticLogger_ = nullptr;
+	SelfOverhead* overhead_ = nullptr;
 };
@@ -0,0 +1,221 @@
+#include "CpuSimulator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <pdhmsg.h>
+
+namespace {
+
+// splitmix64 finalizer: a stable pseudo-random value per (processor, tick).
+uint64_t Mix(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+// [-1, 1)
+double Jitter(int cpu, uint64_t tick)
+{
+	const uint64_t h = Mix(((uint64_t)(uint32_t)cpu << 40) ^ tick);
+	return (double)(h >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+}
+
+}
+
+SimulatedCpuSource::SimulatedCpuSource(const SimConfig& config)
+	: config_(config)
+{
+	config_.processors = std::max(config_.processors, 1);
+	config_.packages = std::clamp(config_.packages, 1, config_.processors);
+	config_.threadsPerCore = std::max(config_.threadsPerCore, 1);
+	config_.efficiencyCores = std::clamp(config_.efficiencyCores, 0, config_.processors - 1);
+	for(const auto& step : config_.trace)
+		traceTicks_ += std::max(step.ticks, 0);
+	tickMs_ = firstTickMs_;
+
+	names_.reserve((size_t)config_.processors + 2);
+	for(int i = 0; i < config_.processors; ++i)
+		names_.push_back(L"0," + std::to_wstring(i));
+	names_.push_back(L"0,_Total");
+	names_.push_back(L"_Total");
+	items_.resize(names_.size());
+	for(size_t i = 0; i < names_.size(); ++i)
+		items_[i].szName = names_[i].data();
+}
+
+void SimulatedCpuSource::Advance()
+{
+	++tick_;
+	tickMs_ += config_.tickMs;
+}
+
+const SimTraceStep* SimulatedCpuSource::CurrentStep() const
+{
+	if(traceTicks_ == 0)
+		return nullptr;
+	int t = (int)(tick_ % (uint64_t)traceTicks_);
+	for(const auto& step : config_.trace)
+	{
+		if(t < step.ticks)
+			return &step;
+		t -= std::max(step.ticks, 0);
+	}
+	return nullptr;
+}
+
+double SimulatedCpuSource::RatedMHz(int cpu) const
+{
+	const bool efficiency = cpu >= config_.processors - config_.efficiencyCores;
+	return efficiency ? config_.baseMHz * config_.efficiencyRatio : config_.baseMHz;
+}
+
+bool SimulatedCpuSource::IsOnline(int cpu) const
+{
+	return cpu >= 0 && cpu < config_.processors &&
+		!(config_.offlineEvery > 0 && cpu % config_.offlineEvery == config_.offlineEvery - 1);
+}
+
+double SimulatedCpuSource::ScriptedMHz(int cpu) const
+{
+	if(!IsOnline(cpu))
+		return 0.0;
+	const SimTraceStep* step = CurrentStep();
+	const double scale = RatedMHz(cpu) / config_.baseMHz;
+	double mhz = step ? step->mhz : config_.baseMHz;
+	if(step && step->spreadMHz > 0.0)
+		mhz += step->spreadMHz * Jitter(cpu, tick_);
+	// Whole MHz, like PowerInformation, so every source agrees exactly.
+	return std::max(1.0, std::round(mhz * scale));
+}
+
+double SimulatedCpuSource::ScriptedBusy(int cpu) const
+{
+	if(!IsOnline(cpu))
+		return -1.0;
+	const SimTraceStep* step = CurrentStep();
+	const double load = step ? step->load : SimTraceStep{}.load;
+	// ~tick: a stream independent of the clock jitter.
+	return std::clamp(load * (1.0 + 0.5 * Jitter(cpu, ~tick_)), 0.0, 1.0);
+}
+
+bool SimulatedCpuSource::ReadPowerInformation(PROCESSOR_POWER_INFORMATION* out, DWORD count)
+{
+	for(DWORD i = 0; i < count; ++i)
+	{
+		const int cpu = (int)i;
+		const bool online = IsOnline(cpu);
+		auto& p = out[i];
+		p = PROCESSOR_POWER_INFORMATION{};
+		p.Number = i;
+		p.MaxMhz = (ULONG)RatedMHz(cpu);
+		p.MhzLimit = p.MaxMhz;
+		if(online)
+			p.CurrentMhz = config_.powerInfoStuckAtBase ? p.MaxMhz : (ULONG)ScriptedMHz(cpu);
+	}
+	return count > 0;
+}
+
+bool SimulatedCpuSource::OpenCounters(double)
+{
+	countersOpen_ = true;
+	return true;
+}
+
+PDH_STATUS SimulatedCpuSource::CollectCounters()
+{
+	return countersOpen_ ? (PDH_STATUS)ERROR_SUCCESS : (PDH_STATUS)PDH_INVALID_HANDLE;
+}
+
+PDH_STATUS SimulatedCpuSource::ReadCounterArray(CpuCounter c, const PDH_FMT_COUNTERVALUE_ITEM_W*& items, DWORD& count)
+{
+	items = nullptr;
+	count = 0;
+	if(!countersOpen_ || c == CpuCounter::TotalPerformance)
+		return (PDH_STATUS)PDH_INVALID_HANDLE;
+
+	double sum = 0.0;
+	int online = 0;
+	for(int cpu = 0; cpu < config_.processors; ++cpu)
+	{
+		auto& v = items_[(size_t)cpu].FmtValue;
+		v.CStatus = PDH_CSTATUS_VALID_DATA;
+		v.doubleValue = 0.0;
+		if(!IsOnline(cpu))
+			continue;
+		if(c == CpuCounter::PerCoreFrequency)
+			v.doubleValue = config_.frequencyCounterStuckAtBase ? RatedMHz(cpu) : ScriptedMHz(cpu);
+		else
+			v.doubleValue = 100.0 * ScriptedMHz(cpu) / RatedMHz(cpu);
+		sum += v.doubleValue;
+		++online;
+	}
+	for(size_t i = (size_t)config_.processors; i < items_.size(); ++i)
+	{
+		items_[i].FmtValue.CStatus = PDH_CSTATUS_VALID_DATA;
+		items_[i].FmtValue.doubleValue = online > 0 ? sum / online : 0.0;
+	}
+
+	items = items_.data();
+	count = (DWORD)items_.size();
+	return ERROR_SUCCESS;
+}
+
+PDH_STATUS SimulatedCpuSource::ReadCounter(CpuCounter c, PDH_FMT_COUNTERVALUE& out)
+{
+	out = PDH_FMT_COUNTERVALUE{};
+	if(!countersOpen_ || c != CpuCounter::TotalPerformance)
+		return (PDH_STATUS)PDH_INVALID_HANDLE;
+
+	double sum = 0.0;
+	int online = 0;
+	for(int cpu = 0; cpu < config_.processors; ++cpu)
+	{
+		if(!IsOnline(cpu))
+			continue;
+		sum += 100.0 * ScriptedMHz(cpu) / RatedMHz(cpu);
+		++online;
+	}
+	out.CStatus = PDH_CSTATUS_VALID_DATA;
+	out.doubleValue = online > 0 ? sum / online : 0.0;
+	return ERROR_SUCCESS;
+}
+
+bool SimulatedCpuSource::LoadTopology(CpuTopology& topology, const std::vector<double>& maxMHz, double fallbackBaseMHz)
+{
+	const size_t n = (size_t)config_.processors;
+	const int perPackage = (config_.processors + config_.packages - 1) / config_.packages;
+	std::vector<int> efficiencyClass(n), cluster(n), package(n), core(n);
+	for(int cpu = 0; cpu < config_.processors; ++cpu)
+	{
+		const bool efficiency = cpu >= config_.processors - config_.efficiencyCores;
+		efficiencyClass[(size_t)cpu] = efficiency ? 0 : 1;
+		core[(size_t)cpu] = cpu / config_.threadsPerCore;
+		// P-cores have a private L2; E-cores share one per four.
+		cluster[(size_t)cpu] = efficiency ? config_.processors + cpu / 4 : core[(size_t)cpu];
+		package[(size_t)cpu] = cpu / perPackage;
+	}
+	topology.Build(efficiencyClass, cluster, maxMHz, fallbackBaseMHz);
+	topology.BuildHierarchy(package, package, core);
+	return true;
+}
+
+bool SimulatedCpuSource::OpenProcessorTimes()
+{
+	busy_.assign((size_t)config_.processors, -1.0);
+	timesOpen_ = true;
+	return true;
+}
+
+bool SimulatedCpuSource::ReadProcessorBusy(const std::vector<double>*& busy)
+{
+	busy = nullptr;
+	if(!timesOpen_)
+		return false;
+	for(int cpu = 0; cpu < config_.processors; ++cpu)
+		busy_[(size_t)cpu] = ScriptedBusy(cpu);
+	busy = &busy_;
+	return true;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <windows.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CpuSource.h"
+
+// Synthetic CpuSourceBackend for deterministic end-to-end runs of
+// CpuFrequency (selection, history, render) without live counters.
+// - Any processor count (all in group 0, instance names "0,<n>"), optional
+//   trailing efficiency cores, packages and SMT.
+// - A scripted frequency trace; each processor gets a fixed per-tick offset
+//   within the step's spread (hash of processor and tick, no RNG state).
+// - Offline processors report nothing; PowerInformation and/or the PDH
+//   Processor Frequency counter can be stuck at their rated clock.
+// - Each step has a load; a processor's busy fraction is within +-50% of it,
+//   again a fixed per-tick hash.
+// - The clock only moves on Advance(), so windows, health backoff and lazy
+//   refreshes see exactly the configured tick spacing.
+
+// `ticks` samples at `mhz` (rated-clock scale for efficiency cores).
+struct SimTraceStep
+{
+	int ticks = 1;
+	double mhz = 0.0;
+	double spreadMHz = 0.0; // each processor within +-spread
+	double load = 0.5;      // average busy fraction (0 = idle)
+};
+
+struct SimConfig
+{
+	int processors = 8;
+	double baseMHz = 3000.0;
+	int efficiencyCores = 0;     // last N processors (< processors); rated at efficiencyRatio * base
+	double efficiencyRatio = 0.7;
+	int packages = 1;
+	int threadsPerCore = 2;
+	int offlineEvery = 0;        // every Nth processor is offline (0 = none)
+	bool powerInfoStuckAtBase = false;
+	bool frequencyCounterStuckAtBase = false;
+	std::vector<SimTraceStep> trace; // repeats; empty = always at base
+	ULONGLONG tickMs = 1000;
+	ULONGLONG startUnixMs = 1700000000000ULL;
+};
+
+class SimulatedCpuSource : public CpuSourceBackend
+{
+public:
+	explicit SimulatedCpuSource(const SimConfig& config);
+
+	// Next sample: moves the clock by tickMs and the trace by one tick.
+	void Advance();
+	uint64_t Tick() const { return tick_; }
+
+	// The scripted clock of `cpu` at the current tick (0 when offline).
+	double ScriptedMHz(int cpu) const;
+	// 0..1 at the current tick; -1 when offline.
+	double ScriptedBusy(int cpu) const;
+	double RatedMHz(int cpu) const;
+	bool IsOnline(int cpu) const;
+
+	double ReadBaseMHz() override { return config_.baseMHz; }
+	DWORD ProcessorCount() override { return (DWORD)config_.processors; }
+	bool ReadPowerInformation(PROCESSOR_POWER_INFORMATION* out, DWORD count) override;
+
+	bool OpenCounters(double baseMHz) override;
+	bool HasCounter(CpuCounter) const override { return countersOpen_; }
+	PDH_STATUS CollectCounters() override;
+	PDH_STATUS ReadCounterArray(CpuCounter c, const PDH_FMT_COUNTERVALUE_ITEM_W*& items, DWORD& count) override;
+	PDH_STATUS ReadCounter(CpuCounter c, PDH_FMT_COUNTERVALUE& out) override;
+
+	bool LoadTopology(CpuTopology& topology, const std::vector<double>& maxMHz, double fallbackBaseMHz) override;
+
+	bool OpenProcessorTimes() override;
+	bool ReadProcessorBusy(const std::vector<double>*& busy) override;
+
+	ULONGLONG TickMs() override { return tickMs_; }
+	ULONGLONG UnixMs() override { return config_.startUnixMs + (tickMs_ - firstTickMs_); }
+
+private:
+	const SimTraceStep* CurrentStep() const;
+
+	SimConfig config_;
+	int traceTicks_ = 0; // one pass over the trace
+	uint64_t tick_ = 0;
+	ULONGLONG firstTickMs_ = 1000; // GetTickCount64-like: never 0
+	ULONGLONG tickMs_ = 1000;
+	bool countersOpen_ = false;
+	bool timesOpen_ = false;
+	std::vector<double> busy_;
+
+	// PDH-style instance names ("0,<n>" and the two _Total rows) and items.
+	std::vector<std::wstring> names_;
+	std::vector<PDH_FMT_COUNTERVALUE_ITEM_W> items_;
+};
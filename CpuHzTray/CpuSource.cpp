@@ -0,0 +1,236 @@
+#include "CpuSource.h"
+#include "CpuFrequency.h"
+
+#include <wbemidl.h>
+#include <comdef.h>
+
+#include <optional>
+
+#include <pdhmsg.h>
+#include <powrprof.h>
+
+#pragma comment(lib, "wbemuuid.lib")
+#pragma comment(lib, "pdh.lib")
+#pragma comment(lib, "PowrProf.lib")
+
+static std::optional<double> TryReadMaxClockSpeedMHz(IWbemServices* svc)
+{
+	IEnumWbemClassObject* enumerator = nullptr;
+	auto hr = svc->ExecQuery(
+		bstr_t(L"WQL"),
+		bstr_t(L"SELECT MaxClockSpeed FROM Win32_Processor"),
+		WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY,
+		nullptr,
+		&enumerator
+	);
+	if(FAILED(hr) || !enumerator) return std::nullopt;
+
+	IWbemClassObject* obj = nullptr;
+	ULONG returned = 0;
+	hr = enumerator->Next(WBEM_INFINITE, 1, &obj, &returned);
+	if(FAILED(hr) || returned == 0 || !obj) { enumerator->Release(); return std::nullopt; }
+
+	VARIANT vt;
+	VariantInit(&vt);
+	hr = obj->Get(L"MaxClockSpeed", 0, &vt, nullptr, nullptr);
+
+	std::optional<double> out;
+	if(SUCCEEDED(hr) && (vt.vt == VT_I4 || vt.vt == VT_UI4))
+		out = static_cast<double>(vt.ulVal);
+
+	VariantClear(&vt);
+	obj->Release();
+	enumerator->Release();
+	return out;
+}
+
+WindowsCpuSource::~WindowsCpuSource()
+{
+	CloseCounters();
+}
+
+void WindowsCpuSource::CloseCounters()
+{
+	if(query_)
+	{
+		PdhCloseQuery(query_);
+		query_ = nullptr;
+	}
+	for(auto& c : counters_)
+		c = nullptr;
+	totalFreqMHzCounter_ = nullptr;
+}
+
+double WindowsCpuSource::ReadBaseMHz()
+{
+	HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+	if(FAILED(hr) && hr != RPC_E_CHANGED_MODE) return 0.0;
+
+	hr = CoInitializeSecurity(
+		nullptr,
+		-1,
+		nullptr,
+		nullptr,
+		RPC_C_AUTHN_LEVEL_DEFAULT,
+		RPC_C_IMP_LEVEL_IMPERSONATE,
+		nullptr,
+		EOAC_NONE,
+		nullptr
+	);
+	if(FAILED(hr) && hr != RPC_E_TOO_LATE) return 0.0;
+
+	IWbemLocator* locator = nullptr;
+	hr = CoCreateInstance(CLSID_WbemLocator, nullptr, CLSCTX_INPROC_SERVER, IID_IWbemLocator, (LPVOID*)&locator);
+	if(FAILED(hr) || !locator) return 0.0;
+
+	IWbemServices* services = nullptr;
+	hr = locator->ConnectServer(_bstr_t(L"ROOT\\CIMV2"), nullptr, nullptr, 0, 0, nullptr, nullptr, &services);
+	locator->Release();
+	if(FAILED(hr) || !services) return 0.0;
+
+	hr = CoSetProxyBlanket(
+		services,
+		RPC_C_AUTHN_WINNT,
+		RPC_C_AUTHZ_NONE,
+		nullptr,
+		RPC_C_AUTHN_LEVEL_CALL,
+		RPC_C_IMP_LEVEL_IMPERSONATE,
+		nullptr,
+		EOAC_NONE
+	);
+	if(FAILED(hr)) { services->Release(); return 0.0; }
+
+	auto maxMHz = TryReadMaxClockSpeedMHz(services);
+	services->Release();
+
+	return maxMHz.has_value() && maxMHz.value() > 0 ? maxMHz.value() : 0.0;
+}
+
+DWORD WindowsCpuSource::ProcessorCount()
+{
+	return GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+}
+
+bool WindowsCpuSource::ReadPowerInformation(PROCESSOR_POWER_INFORMATION* out, DWORD count)
+{
+	ULONG size = (ULONG)(count * sizeof(PROCESSOR_POWER_INFORMATION));
+	return CallNtPowerInformation(ProcessorInformation, nullptr, 0, out, size) == 0;
+}
+
+bool WindowsCpuSource::OpenCounters(double baseMHz)
+{
+	CloseCounters();
+	auto s = PdhOpenQueryW(nullptr, 0, &query_);
+	if(s != ERROR_SUCCESS || !query_) return false;
+
+	// All counters are best-effort. At least one must provide useful data for Read() to succeed.
+	static const wchar_t* const kPaths[(int)CpuCounter::Count] = {
+		L"\\Processor Information(*)\\Processor Frequency",
+		L"\\Processor Information(*)\\% Processor Performance",
+		L"\\Processor Information(_Total)\\% Processor Performance",
+	};
+	for(int i = 0; i < (int)CpuCounter::Count; ++i)
+	{
+		if(!(counterMask_ & (1u << i)))
+			continue;
+		s = PdhAddEnglishCounterW(query_, kPaths[i], 0, &counters_[i]);
+		if(s != ERROR_SUCCESS || !counters_[i])
+			counters_[i] = nullptr;
+	}
+
+	// Diagnostic only: total Processor Frequency is kept but never used for the base clock.
+	if(counterMask_ == kAllCounters)
+	{
+		s = PdhAddEnglishCounterW(query_, L"\\Processor Information(_Total)\\Processor Frequency", 0, &totalFreqMHzCounter_);
+		if(s != ERROR_SUCCESS || !totalFreqMHzCounter_)
+			totalFreqMHzCounter_ = nullptr;
+	}
+
+	// Prime: PDH may need multiple collections before returning valid data.
+	PdhCollectQueryData(query_);
+	Sleep(50);
+	PdhCollectQueryData(query_);
+
+	// At least one usable source is required.
+	bool hasDirectFreq = HasCounter(CpuCounter::PerCoreFrequency);
+	bool hasPerCorePerfBase = HasCounter(CpuCounter::PerCorePerformance) && baseMHz > 0.0;
+	bool hasTotalPerfBase = HasCounter(CpuCounter::TotalPerformance) && baseMHz > 0.0;
+	if(!hasDirectFreq && !hasPerCorePerfBase && !hasTotalPerfBase)
+	{
+		CloseCounters();
+		return false;
+	}
+
+	return true;
+}
+
+PDH_STATUS WindowsCpuSource::CollectCounters()
+{
+	return query_ ? PdhCollectQueryData(query_) : (PDH_STATUS)PDH_INVALID_HANDLE;
+}
+
+PDH_STATUS WindowsCpuSource::ReadCounterArray(CpuCounter c, const PDH_FMT_COUNTERVALUE_ITEM_W*& items, DWORD& count)
+{
+	items = nullptr;
+	count = 0;
+	PDH_HCOUNTER counter = counters_[(int)c];
+	if(!counter)
+		return (PDH_STATUS)PDH_INVALID_HANDLE;
+
+	// Try the buffer from the previous tick first; grow it when PDH asks.
+	auto& buffer = arrayBuffers_[(int)c];
+	DWORD bufferSize = (DWORD)buffer.size();
+	auto s = PdhGetFormattedCounterArrayW(counter, PDH_FMT_DOUBLE, &bufferSize, &count,
+		buffer.empty() ? nullptr : reinterpret_cast<PDH_FMT_COUNTERVALUE_ITEM_W*>(buffer.data()));
+	if(s == PDH_MORE_DATA && bufferSize > 0)
+	{
+		buffer.resize(bufferSize);
+		s = PdhGetFormattedCounterArrayW(counter, PDH_FMT_DOUBLE, &bufferSize, &count,
+			reinterpret_cast<PDH_FMT_COUNTERVALUE_ITEM_W*>(buffer.data()));
+	}
+	if(s == ERROR_SUCCESS)
+		items = reinterpret_cast<const PDH_FMT_COUNTERVALUE_ITEM_W*>(buffer.data());
+	else
+		count = 0;
+	return s;
+}
+
+PDH_STATUS WindowsCpuSource::ReadCounter(CpuCounter c, PDH_FMT_COUNTERVALUE& out)
+{
+	out = PDH_FMT_COUNTERVALUE{};
+	PDH_HCOUNTER counter = counters_[(int)c];
+	if(!counter)
+		return (PDH_STATUS)PDH_INVALID_HANDLE;
+	return PdhGetFormattedCounterValue(counter, PDH_FMT_DOUBLE, nullptr, &out);
+}
+
+bool WindowsCpuSource::LoadTopology(CpuTopology& topology, const std::vector<double>& maxMHz, double fallbackBaseMHz)
+{
+	return topology.Load(maxMHz, fallbackBaseMHz);
+}
+
+bool WindowsCpuSource::OpenProcessorTimes()
+{
+	if(!utilization_.IsAvailable() && !utilization_.Initialize())
+		return false;
+	return utilization_.Sample(); // first interval starts here
+}
+
+bool WindowsCpuSource::ReadProcessorBusy(const std::vector<double>*& busy)
+{
+	busy = nullptr;
+	if(!utilization_.Sample())
+		return false;
+	busy = &utilization_.BusyFraction();
+	return true;
+}
+
+ULONGLONG WindowsCpuSource::TickMs()
+{
+	return GetTickCount64();
+}
+
+ULONGLONG WindowsCpuSource::UnixMs()
+{
+	return GetUnixTimeMs();
+}
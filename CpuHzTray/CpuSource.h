@@ -0,0 +1,115 @@
+#pragma once
+#include <windows.h>
+#include <pdh.h>
+
+#include <vector>
+
+#include "CpuTopology.h"
+#include "CpuUtilization.h"
+
+// Everything CpuFrequency reads from the OS, behind one interface, so the
+// whole pipeline can run against a simulator (CpuSimulator.h) as well as
+// the live machine.
+// - WindowsCpuSource: WMI base clock, CallNtPowerInformation, PDH counters,
+//   per-processor times (CpuUtilization), GetLogicalProcessorInformationEx,
+//   GetTickCount64 / system time.
+// - Counter reads return raw PDH statuses and items; filtering, parsing and
+//   reduction stay in CpuFrequency.
+
+// PROCESSOR_POWER_INFORMATION is defined in kernel-mode header ntpoapi.h;
+// define it here for user-mode use with CallNtPowerInformation.
+typedef struct _PROCESSOR_POWER_INFORMATION {
+	ULONG Number;
+	ULONG MaxMhz;
+	ULONG CurrentMhz;
+	ULONG MhzLimit;
+	ULONG MaxIdleState;
+	ULONG CurrentIdleState;
+} PROCESSOR_POWER_INFORMATION;
+
+enum class CpuCounter : int
+{
+	PerCoreFrequency,   // \Processor Information(*)\Processor Frequency
+	PerCorePerformance, // \Processor Information(*)\% Processor Performance
+	TotalPerformance,   // \Processor Information(_Total)\% Processor Performance
+	Count
+};
+
+class CpuSourceBackend
+{
+public:
+	virtual ~CpuSourceBackend() = default;
+
+	// Rated base clock in MHz; 0 if unknown.
+	virtual double ReadBaseMHz() = 0;
+	virtual DWORD ProcessorCount() = 0;
+	// Fills `count` entries; false on failure.
+	virtual bool ReadPowerInformation(PROCESSOR_POWER_INFORMATION* out, DWORD count) = 0;
+
+	// Opens the counters; false if none is usable (`baseMHz` decides whether
+	// the percentage counters count as usable).
+	virtual bool OpenCounters(double baseMHz) = 0;
+	virtual bool HasCounter(CpuCounter c) const = 0;
+	virtual PDH_STATUS CollectCounters() = 0;
+	// Formatted double array of a per-instance counter. `items` points into a
+	// buffer owned by the backend, valid until the next call.
+	virtual PDH_STATUS ReadCounterArray(CpuCounter c, const PDH_FMT_COUNTERVALUE_ITEM_W*& items, DWORD& count) = 0;
+	virtual PDH_STATUS ReadCounter(CpuCounter c, PDH_FMT_COUNTERVALUE& out) = 0;
+
+	virtual bool LoadTopology(CpuTopology& topology, const std::vector<double>& maxMHz, double fallbackBaseMHz) = 0;
+
+	// Per-processor busy fractions for the busy-weighted clock. Open takes
+	// the first sample; false if the times are not available. Read gives
+	// 0..1 per global processor index since the previous read (-1 = unknown),
+	// in a buffer owned by the backend, valid until the next call.
+	virtual bool OpenProcessorTimes() = 0;
+	virtual bool ReadProcessorBusy(const std::vector<double>*& busy) = 0;
+
+	// Monotonic milliseconds (source health, lazy reads) and wall-clock
+	// milliseconds since 1970-01-01 UTC (sample timestamps).
+	virtual ULONGLONG TickMs() = 0;
+	virtual ULONGLONG UnixMs() = 0;
+};
+
+class WindowsCpuSource : public CpuSourceBackend
+{
+public:
+	WindowsCpuSource() = default;
+	// Opens only the counters whose bit (1 << CpuCounter) is set, e.g. for a
+	// second, lighter query next to the main one.
+	explicit WindowsCpuSource(unsigned counterMask) : counterMask_(counterMask) {}
+	~WindowsCpuSource() override;
+	WindowsCpuSource(const WindowsCpuSource&) = delete;
+	WindowsCpuSource& operator=(const WindowsCpuSource&) = delete;
+
+	double ReadBaseMHz() override;
+	DWORD ProcessorCount() override;
+	bool ReadPowerInformation(PROCESSOR_POWER_INFORMATION* out, DWORD count) override;
+
+	bool OpenCounters(double baseMHz) override;
+	bool HasCounter(CpuCounter c) const override { return counters_[(int)c] != nullptr; }
+	PDH_STATUS CollectCounters() override;
+	PDH_STATUS ReadCounterArray(CpuCounter c, const PDH_FMT_COUNTERVALUE_ITEM_W*& items, DWORD& count) override;
+	PDH_STATUS ReadCounter(CpuCounter c, PDH_FMT_COUNTERVALUE& out) override;
+
+	bool LoadTopology(CpuTopology& topology, const std::vector<double>& maxMHz, double fallbackBaseMHz) override;
+
+	bool OpenProcessorTimes() override;
+	bool ReadProcessorBusy(const std::vector<double>*& busy) override;
+
+	ULONGLONG TickMs() override;
+	ULONGLONG UnixMs() override;
+
+private:
+	void CloseCounters();
+
+	static constexpr unsigned kAllCounters = (1u << (int)CpuCounter::Count) - 1;
+
+	unsigned counterMask_ = kAllCounters;
+	PDH_HQUERY query_ = nullptr;
+	PDH_HCOUNTER counters_[(int)CpuCounter::Count] = {};
+	PDH_HCOUNTER totalFreqMHzCounter_ = nullptr;
+	// Array read buffers, reused across ticks.
+	std::vector<BYTE> arrayBuffers_[(int)CpuCounter::Count];
+	CpuUtilization utilization_;
+};
@@ -0,0 +1,362 @@
+#include "CpuTopology.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <tuple>
+
+namespace {
+
+// Running sum/min/max of one topology group.
+struct GroupAccumulator
+{
+	double sum = 0.0;
+	double mx = 0.0;
+	double mn = 0.0;
+	int valid = 0;
+	int logical = 0;
+
+	void Add(double v)
+	{
+		++logical;
+		if(v <= 0.0) return;
+		if(valid == 0 || v > mx) mx = v;
+		if(valid == 0 || v < mn) mn = v;
+		sum += v;
+		++valid;
+	}
+
+	void Merge(const GroupAccumulator& o)
+	{
+		logical += o.logical;
+		if(o.valid == 0) return;
+		if(valid == 0 || o.mx > mx) mx = o.mx;
+		if(valid == 0 || o.mn < mn) mn = o.mn;
+		sum += o.sum;
+		valid += o.valid;
+	}
+
+	TopologyGroupStats Stats(int parent) const
+	{
+		TopologyGroupStats s;
+		s.parent = parent;
+		s.avgMHz = valid > 0 ? sum / valid : 0.0;
+		s.maxMHz = mx;
+		s.minMHz = mn;
+		s.validCount = valid;
+		s.logicalCount = logical;
+		return s;
+	}
+};
+
+}
+
+int GlobalProcessorIndex(int group, int number)
+{
+	static const auto s_groupBase = []
+	{
+		std::vector<int> base;
+		int total = 0;
+		WORD groups = GetActiveProcessorGroupCount();
+		for(WORD g = 0; g < groups; ++g)
+		{
+			base.push_back(total);
+			total += (int)GetActiveProcessorCount(g);
+		}
+		return base;
+	}();
+
+	if(group < 0 || number < 0)
+		return -1;
+	if(group == 0)
+		return number;
+	if((size_t)group >= s_groupBase.size())
+		return -1;
+	return s_groupBase[(size_t)group] + number;
+}
+
+void CpuTopology::Build(const std::vector<int>& efficiencyClass, const std::vector<int>& cluster,
+	const std::vector<double>& maxMHz, double fallbackBaseMHz)
+{
+	*this = CpuTopology{};
+	fallbackBaseMHz_ = fallbackBaseMHz;
+
+	const int n = (int)efficiencyClass.size();
+	if(n == 0)
+		return;
+
+	// Rank distinct classes, fastest first; unknown processors join the slowest.
+	std::vector<int> classes;
+	for(int c : efficiencyClass)
+	{
+		if(c >= 0 && std::find(classes.begin(), classes.end(), c) == classes.end())
+			classes.push_back(c);
+	}
+	std::sort(classes.begin(), classes.end(), std::greater<int>());
+	const int types = std::clamp((int)classes.size(), 1, kMaxCoreTypes);
+
+	typeOf_.resize((size_t)n);
+	for(int cpu = 0; cpu < n; ++cpu)
+	{
+		const int c = efficiencyClass[(size_t)cpu];
+		int rank = types - 1;
+		if(c >= 0)
+			rank = std::min((int)(std::find(classes.begin(), classes.end(), c) - classes.begin()), types - 1);
+		typeOf_[(size_t)cpu] = rank;
+	}
+
+	// Counting sort into the grouped layout.
+	typeStart_.assign((size_t)types + 1, 0);
+	for(int t : typeOf_)
+		++typeStart_[(size_t)t + 1];
+	for(int t = 0; t < types; ++t)
+		typeStart_[(size_t)t + 1] += typeStart_[(size_t)t];
+	order_.resize((size_t)n);
+	std::vector<int> next(typeStart_.begin(), typeStart_.end() - 1);
+	for(int cpu = 0; cpu < n; ++cpu)
+		order_[(size_t)next[(size_t)typeOf_[(size_t)cpu]]++] = cpu;
+
+	// Per-type base: most common MaxMhz of the type.
+	typeBaseMHz_.assign((size_t)types, fallbackBaseMHz);
+	for(int t = 0; t < types; ++t)
+	{
+		std::map<double, int> votes;
+		for(int i = typeStart_[(size_t)t]; i < typeStart_[(size_t)t + 1]; ++i)
+		{
+			const int cpu = order_[(size_t)i];
+			if(cpu < (int)maxMHz.size() && maxMHz[(size_t)cpu] > 0.0)
+				++votes[maxMHz[(size_t)cpu]];
+		}
+		int best = 0;
+		for(const auto& [mhz, count] : votes)
+		{
+			if(count > best)
+			{
+				best = count;
+				typeBaseMHz_[(size_t)t] = mhz;
+			}
+		}
+	}
+
+	// Dense cluster ids.
+	clusterOf_.assign((size_t)n, -1);
+	std::map<int, int> dense;
+	for(int cpu = 0; cpu < n && cpu < (int)cluster.size(); ++cpu)
+	{
+		const int c = cluster[(size_t)cpu];
+		if(c < 0) continue;
+		auto it = dense.emplace(c, (int)dense.size()).first;
+		clusterOf_[(size_t)cpu] = it->second;
+	}
+	clusterCount_ = (int)dense.size();
+}
+
+void CpuTopology::BuildHierarchy(const std::vector<int>& package, const std::vector<int>& die, const std::vector<int>& core)
+{
+	hierOrder_.clear();
+	coreStart_.clear();
+	dieCoreStart_.clear();
+	packageDieStart_.clear();
+
+	const int n = (int)std::max({ package.size(), die.size(), core.size() });
+	if(n == 0)
+		return;
+
+	// Unknown ids: -1 package/die groups them; a unique negative core id
+	// makes the processor its own core.
+	auto idAt = [](const std::vector<int>& v, int cpu) { return cpu < (int)v.size() ? v[(size_t)cpu] : -1; };
+	auto key = [&](int cpu)
+	{
+		const int c = idAt(core, cpu);
+		return std::make_tuple(idAt(package, cpu), idAt(die, cpu), c >= 0 ? c : -2 - cpu, cpu);
+	};
+	hierOrder_.resize((size_t)n);
+	for(int cpu = 0; cpu < n; ++cpu)
+		hierOrder_[(size_t)cpu] = cpu;
+	std::sort(hierOrder_.begin(), hierOrder_.end(), [&](int a, int b) { return key(a) < key(b); });
+
+	// Cut the sorted list at every change of core, die and package.
+	auto prev = key(hierOrder_[0]);
+	for(int i = 0; i < n; ++i)
+	{
+		const auto k = key(hierOrder_[(size_t)i]);
+		const bool newPackage = i == 0 || std::get<0>(k) != std::get<0>(prev);
+		const bool newDie = newPackage || std::get<1>(k) != std::get<1>(prev);
+		const bool newCore = newDie || std::get<2>(k) != std::get<2>(prev);
+		if(newPackage) packageDieStart_.push_back((int)dieCoreStart_.size());
+		if(newDie) dieCoreStart_.push_back((int)coreStart_.size());
+		if(newCore) coreStart_.push_back(i);
+		prev = k;
+	}
+	coreStart_.push_back(n);
+	dieCoreStart_.push_back((int)coreStart_.size() - 1);
+	packageDieStart_.push_back((int)dieCoreStart_.size() - 1);
+}
+
+void CpuTopology::ReduceHierarchy(const std::vector<double>& perCoreMHz, TopologyStats& out) const
+{
+	out.packages.resize((size_t)PackageCount());
+	out.dies.resize((size_t)DieCount());
+	out.cores.resize((size_t)PhysicalCoreCount());
+
+	const int known = (int)perCoreMHz.size();
+	for(int p = 0; p < PackageCount(); ++p)
+	{
+		GroupAccumulator pa;
+		for(int d = packageDieStart_[(size_t)p]; d < packageDieStart_[(size_t)p + 1]; ++d)
+		{
+			GroupAccumulator da;
+			for(int c = dieCoreStart_[(size_t)d]; c < dieCoreStart_[(size_t)d + 1]; ++c)
+			{
+				GroupAccumulator ca;
+				for(int i = coreStart_[(size_t)c]; i < coreStart_[(size_t)c + 1]; ++i)
+				{
+					const int cpu = hierOrder_[(size_t)i];
+					ca.Add(cpu < known ? perCoreMHz[(size_t)cpu] : 0.0);
+				}
+				out.cores[(size_t)c] = ca.Stats(d);
+				da.Merge(ca);
+			}
+			out.dies[(size_t)d] = da.Stats(p);
+			pa.Merge(da);
+		}
+		out.packages[(size_t)p] = pa.Stats(-1);
+	}
+}
+
+bool CpuTopology::Load(const std::vector<double>& maxMHz, double fallbackBaseMHz)
+{
+	DWORD size = 0;
+	GetLogicalProcessorInformationEx(RelationAll, nullptr, &size);
+	if(size == 0)
+		return false;
+	std::vector<BYTE> buffer(size);
+	auto* info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data());
+	if(!GetLogicalProcessorInformationEx(RelationAll, info, &size))
+		return false;
+
+	std::vector<int> efficiencyClass;
+	std::vector<int> cluster;
+	std::vector<int> package;
+	std::vector<int> die;
+	std::vector<int> core;
+	auto forEachProcessor = [](const GROUP_AFFINITY& ga, auto&& fn)
+	{
+		for(int bit = 0; bit < (int)(sizeof(KAFFINITY) * 8); ++bit)
+		{
+			if(ga.Mask & ((KAFFINITY)1 << bit))
+			{
+				const int cpu = GlobalProcessorIndex(ga.Group, bit);
+				if(cpu >= 0) fn(cpu);
+			}
+		}
+	};
+	auto grow = [&](int cpu)
+	{
+		if((size_t)cpu >= efficiencyClass.size())
+		{
+			efficiencyClass.resize((size_t)cpu + 1, -1);
+			cluster.resize((size_t)cpu + 1, -1);
+			package.resize((size_t)cpu + 1, -1);
+			die.resize((size_t)cpu + 1, -1);
+			core.resize((size_t)cpu + 1, -1);
+		}
+	};
+	// Package, die and core records share PROCESSOR_RELATIONSHIP; the
+	// record's ordinal within its kind is the id.
+	auto tag = [&](const PROCESSOR_RELATIONSHIP& pr, std::vector<int>& ids, int id)
+	{
+		for(WORD g = 0; g < pr.GroupCount; ++g)
+		{
+			forEachProcessor(pr.GroupMask[g], [&](int cpu)
+			{
+				grow(cpu);
+				ids[(size_t)cpu] = id;
+			});
+		}
+	};
+
+	int l2Id = 0;
+	int packageId = 0;
+	int dieId = 0;
+	int coreId = 0;
+	for(DWORD offset = 0; offset < size;)
+	{
+		const auto* rec = reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+		if(rec->Size == 0)
+			break;
+		if(rec->Relationship == RelationProcessorCore)
+		{
+			tag(rec->Processor, efficiencyClass, rec->Processor.EfficiencyClass);
+			tag(rec->Processor, core, coreId++);
+		}
+		else if(rec->Relationship == RelationProcessorPackage)
+		{
+			tag(rec->Processor, package, packageId++);
+		}
+		else if(rec->Relationship == RelationProcessorDie)
+		{
+			tag(rec->Processor, die, dieId++);
+		}
+		else if(rec->Relationship == RelationCache && rec->Cache.Level == 2)
+		{
+			const int id = l2Id++;
+			forEachProcessor(rec->Cache.GroupMask, [&](int cpu)
+			{
+				grow(cpu);
+				cluster[(size_t)cpu] = id;
+			});
+		}
+		offset += rec->Size;
+	}
+
+	Build(efficiencyClass, cluster, maxMHz, fallbackBaseMHz);
+	BuildHierarchy(package, die, core);
+	return TypeCount() > 0;
+}
+
+const wchar_t* CpuTopology::TypeName(int type) const
+{
+	static const wchar_t* const kHybridNames[kMaxCoreTypes] = { L"P-cores", L"E-cores", L"LP E-cores" };
+	if(type < 0 || type >= TypeCount())
+		return L"";
+	return TypeCount() == 1 ? L"Cores" : kHybridNames[type];
+}
+
+double CpuTopology::WeightedBaseMHz() const
+{
+	if(order_.empty())
+		return fallbackBaseMHz_;
+	double sum = 0.0;
+	for(int t = 0; t < TypeCount(); ++t)
+		sum += typeBaseMHz_[(size_t)t] * (typeStart_[(size_t)t + 1] - typeStart_[(size_t)t]);
+	return sum / (double)order_.size();
+}
+
+int CpuTopology::Reduce(const std::vector<double>& perCoreMHz, CoreTypeStats* out, int maxTypes) const
+{
+	const int types = std::min(TypeCount(), maxTypes);
+	const int known = (int)perCoreMHz.size();
+	for(int t = 0; t < types; ++t)
+	{
+		CoreTypeStats s;
+		s.name = TypeName(t);
+		s.baseMHz = typeBaseMHz_[(size_t)t];
+		s.logicalCount = typeStart_[(size_t)t + 1] - typeStart_[(size_t)t];
+		double sum = 0.0;
+		for(int i = typeStart_[(size_t)t]; i < typeStart_[(size_t)t + 1]; ++i)
+		{
+			const int cpu = order_[(size_t)i];
+			const double v = cpu < known ? perCoreMHz[(size_t)cpu] : 0.0;
+			if(v <= 0.0) continue;
+			if(s.validCoreCount == 0 || v > s.maxMHz) s.maxMHz = v;
+			if(s.validCoreCount == 0 || v < s.minMHz) s.minMHz = v;
+			sum += v;
+			++s.validCoreCount;
+		}
+		if(s.validCoreCount > 0)
+			s.avgMHz = sum / s.validCoreCount;
+		out[t] = s;
+	}
+	return types;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <windows.h>
+
+#include <vector>
+
+// Logical processors grouped by core type, so hybrid CPUs get per-type
+// frequency stats and a per-type base clock.
+// - Core type comes from the core's EfficiencyClass
+//   (GetLogicalProcessorInformationEx); a higher class is a faster core.
+// - Cluster is the set of logical processors sharing an L2 cache.
+// - Per-type base is the most common PROCESSOR_POWER_INFORMATION::MaxMhz of
+//   that type's processors, else the global base.
+// - Processors are stored grouped by type (order_, typeStart_), so the
+//   per-type reduction is one pass over a contiguous index list.
+// - Separately, processors are sorted by package, die and physical core, so
+//   stats for all three levels come from one pass (SMT siblings of a core
+//   are adjacent).
+// Processors are identified by global logical processor index.
+
+inline constexpr int kMaxCoreTypes = 3; // P, E, low-power E
+
+// Global logical processor index of (group, number): processors of lower
+// groups come first. Group sizes are read once.
+int GlobalProcessorIndex(int group, int number);
+
+struct CoreTypeStats
+{
+	const wchar_t* name = nullptr; // static, e.g. L"P-cores"
+	double avgMHz = 0.0;
+	double maxMHz = 0.0;
+	double minMHz = 0.0;
+	double baseMHz = 0.0;
+	int validCoreCount = 0; // processors of this type with a value
+	int logicalCount = 0;   // processors of this type
+};
+
+// Stats of one package, die or physical core.
+struct TopologyGroupStats
+{
+	int parent = -1; // package index for a die, die index for a core
+	double avgMHz = 0.0;
+	double maxMHz = 0.0;
+	double minMHz = 0.0;
+	int validCount = 0;   // logical processors with a value
+	int logicalCount = 0; // logical processors (SMT threads for a core)
+};
+
+struct TopologyStats
+{
+	std::vector<TopologyGroupStats> packages;
+	std::vector<TopologyGroupStats> dies;
+	std::vector<TopologyGroupStats> cores; // physical cores
+};
+
+class CpuTopology
+{
+public:
+	// Builds from per-processor inputs indexed by global processor index.
+	// An efficiency class < 0 marks an unknown processor (slowest type).
+	// Classes beyond kMaxCoreTypes are merged into the slowest type.
+	void Build(const std::vector<int>& efficiencyClass, const std::vector<int>& cluster,
+		const std::vector<double>& maxMHz, double fallbackBaseMHz);
+
+	// Package, die and physical core id per processor (-1 = unknown). A
+	// package without die information is one die; a processor without a
+	// core id is its own core. Ids only need to be distinct, not dense.
+	void BuildHierarchy(const std::vector<int>& package, const std::vector<int>& die, const std::vector<int>& core);
+
+	// Queries core, die, package and L2 cache relationships from Windows,
+	// then Build() and BuildHierarchy().
+	// `maxMHz` is PROCESSOR_POWER_INFORMATION::MaxMhz per processor.
+	bool Load(const std::vector<double>& maxMHz, double fallbackBaseMHz);
+
+	int TypeCount() const { return (int)typeBaseMHz_.size(); }
+	bool IsHybrid() const { return TypeCount() > 1; }
+	int ClusterCount() const { return clusterCount_; }
+	int TypeOf(int cpu) const { return cpu >= 0 && cpu < (int)typeOf_.size() ? typeOf_[(size_t)cpu] : -1; }
+	int ClusterOf(int cpu) const { return cpu >= 0 && cpu < (int)clusterOf_.size() ? clusterOf_[(size_t)cpu] : -1; }
+	double TypeBaseMHz(int type) const { return type >= 0 && type < TypeCount() ? typeBaseMHz_[(size_t)type] : fallbackBaseMHz_; }
+	double BaseMHzOf(int cpu) const { return TypeBaseMHz(TypeOf(cpu)); }
+	// Per-type base averaged over every processor: what the average clock
+	// reads with all cores at their base (the fallback without a topology).
+	double WeightedBaseMHz() const;
+	const wchar_t* TypeName(int type) const;
+
+	// Per-type avg/min/max of perCoreMHz (0 = no value). Returns the number
+	// of entries written to `out`.
+	int Reduce(const std::vector<double>& perCoreMHz, CoreTypeStats* out, int maxTypes) const;
+
+	int PackageCount() const { return packageDieStart_.empty() ? 0 : (int)packageDieStart_.size() - 1; }
+	int DieCount() const { return dieCoreStart_.empty() ? 0 : (int)dieCoreStart_.size() - 1; }
+	int PhysicalCoreCount() const { return coreStart_.empty() ? 0 : (int)coreStart_.size() - 1; }
+
+	// Per package, die and physical core stats of perCoreMHz; `out` is
+	// resized to the hierarchy. CpuFrequency fills each new reading's
+	// TopologyStats, so these vectors are allocated once per Read().
+	void ReduceHierarchy(const std::vector<double>& perCoreMHz, TopologyStats& out) const;
+
+private:
+	std::vector<int> typeOf_;    // processor -> type (0 = fastest)
+	std::vector<int> clusterOf_; // processor -> cluster, -1 if unknown
+	std::vector<int> order_;     // processors grouped by type
+	std::vector<int> typeStart_; // type t is order_[typeStart_[t], typeStart_[t + 1])
+	std::vector<double> typeBaseMHz_;
+	double fallbackBaseMHz_ = 0.0;
+	int clusterCount_ = 0;
+
+	std::vector<int> hierOrder_;       // processors sorted by (package, die, core)
+	std::vector<int> coreStart_;       // core c is hierOrder_[coreStart_[c], coreStart_[c + 1])
+	std::vector<int> dieCoreStart_;    // die d is cores [dieCoreStart_[d], dieCoreStart_[d + 1])
+	std::vector<int> packageDieStart_; // package p is dies [packageDieStart_[p], packageDieStart_[p + 1])
+};
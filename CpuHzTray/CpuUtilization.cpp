@@ -0,0 +1,102 @@
+#include "CpuUtilization.h"
+#include "CpuTopology.h"
+
+#include <algorithm>
+
+// <winternl.h> does not define it (ntdef.h does).
+#ifndef NT_SUCCESS
+#define NT_SUCCESS(s) (((NTSTATUS)(s)) >= 0)
+#endif
+
+bool CpuUtilization::Initialize()
+{
+	HMODULE ntdll = GetModuleHandleW(L"ntdll.dll");
+	if(!ntdll)
+		return false;
+	queryEx_ = reinterpret_cast<QueryExFn>(GetProcAddress(ntdll, "NtQuerySystemInformationEx"));
+	query_ = reinterpret_cast<QueryFn>(GetProcAddress(ntdll, "NtQuerySystemInformation"));
+	if(!queryEx_ && !query_)
+		return false;
+
+	const WORD groups = queryEx_ ? GetActiveProcessorGroupCount() : 1;
+	int total = 0;
+	for(WORD g = 0; g < groups; ++g)
+	{
+		const int size = (int)GetActiveProcessorCount(g);
+		groupBase_.push_back(GlobalProcessorIndex(g, 0));
+		groupSize_.push_back(size);
+		total = std::max(total, groupBase_.back() + size);
+	}
+	if(total <= 0)
+		return false;
+
+	times_[0].assign((size_t)total, SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION{});
+	times_[1].assign((size_t)total, SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION{});
+	busy_.assign((size_t)total, -1.0);
+	processorCount_ = total;
+	return true;
+}
+
+bool CpuUtilization::Sample()
+{
+	if(!IsAvailable())
+		return false;
+
+	auto& next = times_[current_ ^ 1];
+	for(size_t g = 0; g < groupBase_.size(); ++g)
+	{
+		auto* dst = next.data() + groupBase_[g];
+		const ULONG bytes = (ULONG)(groupSize_[g] * sizeof(SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION));
+		ULONG returned = 0;
+		NTSTATUS s;
+		if(queryEx_)
+		{
+			USHORT group = (USHORT)g;
+			s = queryEx_(SystemProcessorPerformanceInformation, &group, sizeof(group), dst, bytes, &returned);
+		}
+		else
+		{
+			s = query_(SystemProcessorPerformanceInformation, dst, bytes, &returned);
+		}
+		if(!NT_SUCCESS(s))
+		{
+			// Not the previous interval's fractions: nothing is known for this one.
+			std::fill(busy_.begin(), busy_.end(), -1.0);
+			return false;
+		}
+	}
+
+	current_ ^= 1;
+	if(hasPrevious_)
+		ComputeBusyFractions(times_[current_ ^ 1].data(), times_[current_].data(), processorCount_, busy_.data());
+	hasPrevious_ = true;
+	return true;
+}
+
+void CpuUtilization::ComputeBusyFractions(const SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION* prev,
+	const SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION* cur, int count, double* outBusy)
+{
+	for(int i = 0; i < count; ++i)
+	{
+		// KernelTime includes IdleTime.
+		const LONGLONG idle = cur[i].IdleTime.QuadPart - prev[i].IdleTime.QuadPart;
+		const LONGLONG total = (cur[i].KernelTime.QuadPart - prev[i].KernelTime.QuadPart)
+			+ (cur[i].UserTime.QuadPart - prev[i].UserTime.QuadPart);
+		outBusy[i] = total > 0 ? std::clamp(1.0 - (double)idle / (double)total, 0.0, 1.0) : -1.0;
+	}
+}
+
+double CpuUtilization::BusyWeightedMHz(const std::vector<double>& perCoreMHz, const std::vector<double>& busy)
+{
+	const size_t n = std::min(perCoreMHz.size(), busy.size());
+	double weighted = 0.0;
+	double weight = 0.0;
+	for(size_t i = 0; i < n; ++i)
+	{
+		if(perCoreMHz[i] <= 0.0 || busy[i] <= 0.0)
+			continue;
+		weighted += perCoreMHz[i] * busy[i];
+		weight += busy[i];
+	}
+	return weight > 1e-6 ? weighted / weight : 0.0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <windows.h>
+#include <winternl.h>
+
+#include <vector>
+
+// Per logical processor busy fraction between two samples, for a
+// utilization-weighted frequency.
+// - Idle/kernel/user times come from SystemProcessorPerformanceInformation,
+//   one NtQuerySystemInformationEx call per processor group, written straight
+//   into one of two buffers sized at Initialize(). Sample() flips between
+//   them; nothing is parsed, copied or allocated per tick.
+// - Indexed by global processor index, like CpuReading::perCoreMHz.
+
+class CpuUtilization
+{
+public:
+	bool Initialize();
+	bool IsAvailable() const { return processorCount_ > 0; }
+
+	// Takes a new sample; busy fractions are valid from the second success,
+	// and all unknown after a failure.
+	bool Sample();
+
+	// 0..1 per processor since the previous sample; -1 = unknown.
+	const std::vector<double>& BusyFraction() const { return busy_; }
+
+	static void ComputeBusyFractions(const SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION* prev,
+		const SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION* cur, int count, double* outBusy);
+
+	// sum(mhz * busy) / sum(busy) over processors with both values; 0 when
+	// nothing was busy (or nothing is known).
+	static double BusyWeightedMHz(const std::vector<double>& perCoreMHz, const std::vector<double>& busy);
+
+private:
+	using QueryExFn = NTSTATUS(NTAPI*)(SYSTEM_INFORMATION_CLASS, PVOID, ULONG, PVOID, ULONG, PULONG);
+	using QueryFn = NTSTATUS(NTAPI*)(SYSTEM_INFORMATION_CLASS, PVOID, ULONG, PULONG);
+
+	QueryExFn queryEx_ = nullptr;
+	QueryFn query_ = nullptr; // group 0 only, when the Ex variant is missing
+	std::vector<int> groupBase_;
+	std::vector<int> groupSize_;
+	std::vector<SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION> times_[2];
+	int current_ = 0;
+	bool hasPrevious_ = false;
+	int processorCount_ = 0;
+	std::vector<double> busy_;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+// Latency histogram with HDR-style buckets, in nanoseconds.
+// - One bucket per ns below 32 ns; above, every power-of-two range is split
+//   into 16 equal sub-buckets, so a reported percentile is at most 1/16 above
+//   the true value. Values from 2^36 ns (~69 s) up share the last bucket.
+// - Fixed memory (kBuckets counters, ~4 KB), never allocates.
+// - Record() is lock-free (relaxed atomics) and may be called from any
+//   thread; a concurrent reader sees each counter consistently but not the
+//   whole histogram as of one instant.
+// - Histograms merge by adding counts.
+
+struct HdrSnapshot
+{
+	uint64_t count = 0;
+	double meanUs = 0.0;
+	double p50Us = 0.0;
+	double p99Us = 0.0;
+	double p999Us = 0.0;
+	double maxUs = 0.0;
+};
+
+class HdrHistogram
+{
+public:
+	static constexpr int kSubBits = 4;
+	static constexpr int kSub = 1 << kSubBits; // sub-buckets per power of two
+	static constexpr int kLinear = 2 * kSub;   // [0, 32) ns, 1 ns wide
+	static constexpr int kMaxExp = 36;
+	static constexpr int kBuckets = kLinear + (kMaxExp - kSubBits - 1) * kSub;
+
+	HdrHistogram() = default;
+	HdrHistogram(const HdrHistogram&) = delete;
+	HdrHistogram& operator=(const HdrHistogram&) = delete;
+
+	static int BucketFor(uint64_t ns)
+	{
+		if(ns < (uint64_t)kLinear)
+			return (int)ns;
+		const int exp = (int)std::bit_width(ns) - 1; // 2^exp <= ns < 2^(exp+1)
+		if(exp >= kMaxExp)
+			return kBuckets - 1;
+		const int sub = (int)(ns >> (exp - kSubBits)) - kSub;
+		return kLinear + (exp - kSubBits - 1) * kSub + sub;
+	}
+
+	// Exclusive upper bound of `bucket`, in ns.
+	static uint64_t BucketUpperNs(int bucket)
+	{
+		if(bucket < kLinear)
+			return (uint64_t)bucket + 1;
+		const int exp = (bucket - kLinear) / kSub + kSubBits + 1;
+		const uint64_t width = 1ULL << (exp - kSubBits);
+		return ((uint64_t)kSub + (uint64_t)((bucket - kLinear) % kSub) + 1) * width;
+	}
+
+	void Record(double us)
+	{
+		const uint64_t ns = us > 0.0 ? (uint64_t)std::llround(std::min(us, 1e12) * 1000.0) : 0;
+		buckets_[BucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+		count_.fetch_add(1, std::memory_order_relaxed);
+		sumNs_.fetch_add(ns, std::memory_order_relaxed);
+		RaiseMax(ns);
+	}
+
+	// Adds `other`'s samples to this histogram.
+	void Merge(const HdrHistogram& other)
+	{
+		for(int i = 0; i < kBuckets; ++i)
+		{
+			const uint64_t n = other.buckets_[i].load(std::memory_order_relaxed);
+			if(n) buckets_[i].fetch_add(n, std::memory_order_relaxed);
+		}
+		count_.fetch_add(other.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		sumNs_.fetch_add(other.sumNs_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		RaiseMax(other.maxNs_.load(std::memory_order_relaxed));
+	}
+
+	// Not atomic as a whole; only for the thread that owns the recording.
+	void Clear()
+	{
+		for(auto& b : buckets_)
+			b.store(0, std::memory_order_relaxed);
+		count_.store(0, std::memory_order_relaxed);
+		sumNs_.store(0, std::memory_order_relaxed);
+		maxNs_.store(0, std::memory_order_relaxed);
+	}
+
+	uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+	double MaxUs() const { return (double)maxNs_.load(std::memory_order_relaxed) / 1000.0; }
+	double MeanUs() const
+	{
+		const uint64_t n = Count();
+		return n ? (double)sumNs_.load(std::memory_order_relaxed) / (double)n / 1000.0 : 0.0;
+	}
+
+	// Upper bound of the bucket holding the p-th percentile (p in [0, 1]),
+	// clamped to the observed maximum.
+	double PercentileUs(double p) const
+	{
+		const uint64_t n = Count();
+		if(n == 0) return 0.0;
+		p = std::clamp(p, 0.0, 1.0);
+
+		const auto rank = (uint64_t)std::ceil(p * (double)n);
+		const uint64_t maxNs = maxNs_.load(std::memory_order_relaxed);
+		uint64_t seen = 0;
+		for(int i = 0; i < kBuckets; ++i)
+		{
+			seen += buckets_[i].load(std::memory_order_relaxed);
+			if(seen >= rank && seen > 0)
+				return (double)std::min(BucketUpperNs(i), maxNs) / 1000.0;
+		}
+		return (double)maxNs / 1000.0;
+	}
+
+	HdrSnapshot Snapshot() const
+	{
+		HdrSnapshot s;
+		s.count = Count();
+		s.meanUs = MeanUs();
+		s.p50Us = PercentileUs(0.5);
+		s.p99Us = PercentileUs(0.99);
+		s.p999Us = PercentileUs(0.999);
+		s.maxUs = MaxUs();
+		return s;
+	}
+
+private:
+	void RaiseMax(uint64_t ns)
+	{
+		uint64_t cur = maxNs_.load(std::memory_order_relaxed);
+		while(ns > cur && !maxNs_.compare_exchange_weak(cur, ns, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	std::atomic<uint64_t> buckets_[kBuckets] = {};
+	std::atomic<uint64_t> count_{ 0 };
+	std::atomic<uint64_t> sumNs_{ 0 };
+	std::atomic<uint64_t> maxNs_{ 0 };
+};
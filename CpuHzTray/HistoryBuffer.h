@@ -3,19 +3,48 @@
 #include <array>
 #include <algorithm>
 #include <cstddef>
+#include <span>
+#include <type_traits>
 
-// Fixed-size rolling history buffer (ring buffer) for doubles.
+// Fixed-size rolling history buffer (ring buffer).
 // - Push() overwrites the oldest sample when full.
+// - Spans() exposes the contents oldest->newest as at most two contiguous
+//   spans (older part first), so consumers can iterate without copying.
 // - GetOldestToNewest(i) returns samples in time order.
+// T must be trivially copyable (doubles, floats, POD reading records,
+// fixed-size per-core rows such as std::array<float, K>).
 
-template <size_t N>
-struct RingBufferD
+template <typename T>
+struct RingSpans
+{
+	std::span<const T> first;  // oldest part
+	std::span<const T> second; // continues first; empty when not wrapped
+
+	size_t size() const noexcept { return first.size() + second.size(); }
+	bool empty() const noexcept { return size() == 0; }
+
+	const T& operator[](size_t i) const noexcept
+	{
+		return i < first.size() ? first[i] : second[i - first.size()];
+	}
+
+	template <typename Fn>
+	void ForEach(Fn&& fn) const
+	{
+		for(const auto& v : first) fn(v);
+		for(const auto& v : second) fn(v);
+	}
+};
+
+template <typename T, size_t N>
+struct RingBuffer
 {
 	static_assert(N > 1);
+	static_assert(std::is_trivially_copyable_v<T>);
 
 	void Clear() noexcept { head_ = 0; count_ = 0; }
 
-	void Push(double v) noexcept
+	void Push(const T& v) noexcept
 	{
 		data_[head_] = v;
 		head_ = (head_ + 1) % N;
@@ -23,33 +52,72 @@ struct RingBufferD
 	}
 
 	size_t Count() const noexcept { return count_; }
-	constexpr size_t Capacity() const noexcept { return N; }
+	static constexpr size_t Capacity() noexcept { return N; }
+	// False when head/count are out of range (e.g. read back from a corrupt file).
+	bool IsValid() const noexcept { return head_ < N && count_ <= N; }
+
+	RingSpans<T> Spans() const noexcept
+	{
+		const auto oldest = OldestIndex();
+		const auto firstLen = std::min(count_, N - oldest);
+		RingSpans<T> s;
+		s.first = std::span<const T>(data_.data() + oldest, firstLen);
+		s.second = std::span<const T>(data_.data(), count_ - firstLen);
+		return s;
+	}
 
-	double GetOldestToNewest(size_t i) const noexcept
+	// Most recent `n` samples (clamped to Count()), oldest->newest.
+	RingSpans<T> Latest(size_t n) const noexcept
+	{
+		auto s = Spans();
+		if(n >= s.size()) return s;
+		auto skip = s.size() - n;
+		if(skip >= s.first.size())
+		{
+			s.second = s.second.subspan(skip - s.first.size());
+			s.first = {};
+		}
+		else
+		{
+			s.first = s.first.subspan(skip);
+		}
+		return s;
+	}
+
+	T GetOldestToNewest(size_t i) const noexcept
 	{
 		// i in [0, count_-1]
-		if(count_ == 0) return 0.0;
-		const auto oldest = (head_ + N - count_) % N;
-		return data_[(oldest + i) % N];
+		if(count_ == 0) return T{};
+		return data_[(OldestIndex() + i) % N];
 	}
 
-	void MinMax(double& outMin, double& outMax) const noexcept
+	// Newest sample; only meaningful when Count() > 0.
+	const T& Newest() const noexcept { return data_[(head_ + N - 1) % N]; }
+	T& Newest() noexcept { return data_[(head_ + N - 1) % N]; }
+
+	template <typename U = T, typename = std::enable_if_t<std::is_arithmetic_v<U>>>
+	void MinMax(T& outMin, T& outMax) const noexcept
 	{
-		if(count_ == 0) { outMin = 0.0; outMax = 0.0; return; }
-		auto mn = GetOldestToNewest(0);
+		if(count_ == 0) { outMin = T{}; outMax = T{}; return; }
+		auto s = Spans();
+		auto mn = s[0];
 		auto mx = mn;
-		for(size_t i = 1; i < count_; i++)
+		s.ForEach([&](const T& v)
 		{
-			auto v = GetOldestToNewest(i);
 			if(v < mn) mn = v;
 			if(v > mx) mx = v;
-		}
+		});
 		outMin = mn;
 		outMax = mx;
 	}
 
 private:
-	std::array<double, N> data_{};
+	size_t OldestIndex() const noexcept { return (head_ + N - count_) % N; }
+
+	std::array<T, N> data_{};
 	size_t head_ = 0;
 	size_t count_ = 0;
 };
+
+template <size_t N>
+using RingBufferD = RingBuffer<double, N>;
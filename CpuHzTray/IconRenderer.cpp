@@ -1,5 +1,6 @@
 #include "IconRenderer.h"
 #include "SparklineRenderer.h"
+#include "Trace.h"
 #include "resource.h"
 
 
@@ -142,12 +143,202 @@ static int FindBestFontHeight(HDC hdc, const wchar_t* text, const wchar_t* faceN
 	return best;
 }
 
+// 64-bit FNV-1a over the pixels; never 0, so 0 can mean "no frame".
+static uint64_t HashFrame(const unsigned int* px, size_t n)
+{
+	uint64_t h = 0xCBF29CE484222325ULL;
+	for(size_t i = 0; i < n; ++i)
+		h = (h ^ px[i]) * 0x100000001B3ULL;
+	return h ? h : 1;
+}
+
+static void AddTextPath(Gdiplus::GraphicsPath& path, const wchar_t* text, const Gdiplus::FontFamily& ff)
+{
+	Gdiplus::StringFormat fmt(Gdiplus::StringFormat::GenericTypographic());
+	fmt.SetFormatFlags(fmt.GetFormatFlags() | Gdiplus::StringFormatFlagsNoWrap);
+	path.AddString(text, (INT)wcslen(text), &ff, Gdiplus::FontStyleBold, kIconReferenceEm, Gdiplus::PointF(0, 0), &fmt);
+}
+
+// The formatted reading, shared by every size drawn from one spec.
+struct IconText
+{
+	wchar_t text[16]{};
+	Gdiplus::GraphicsPath path; // at kIconReferenceEm
+	Gdiplus::RectF bounds;      // tight glyph bounds of `path`
+	COLORREF rgb = 0;
+};
+
+// Layout: top region is plot-only, bottom region is text-only.
+// 32px icon => bottom ~0.66 for text, top ~0.34 for plot.
+// The text size is the largest em at which the sample ("8.88", `sampleW` x
+// `sampleH` at kIconReferenceEm) fits the text region, so it never jitters with
+// the value.
+IconLayout ComputeIconLayout(int size, float sampleW, float sampleH)
+{
+	size = std::max(size, 16);
+	IconLayout l;
+	l.size = size;
+	int splitY = (int)std::lround(size * kPlotHeightRatio);
+	{
+		int minPlot = 5;
+		int maxPlot = size - 8; // keep at least 8px for text
+		if(splitY < minPlot) splitY = minPlot;
+		if(splitY > maxPlot) splitY = maxPlot;
+	}
+	l.plot = { 0, 0, size, splitY };
+	l.text = { 0, splitY, size, size };
+	// Scale stroke width for the actual icon size (often 16x16/20x20).
+	// Keep it thin but readable.
+	l.lineWidth = std::max(1.2f, 1.6f * (float)size / 32.0f);
+
+	const float targetW = (float)(l.text.right - l.text.left);
+	const float targetH = (float)(l.text.bottom - l.text.top);
+	int lo = 6, hi = 400;
+	l.em = 6;
+	while(lo <= hi)
+	{
+		const int mid = (lo + hi) / 2;
+		const float scale = (float)mid / kIconReferenceEm;
+		if(sampleW * scale <= targetW && sampleH * scale <= targetH)
+		{
+			l.em = mid;
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+	return l;
+}
+
+void IconLayoutTable::Build(float sampleW, float sampleH)
+{
+	sampleW_ = sampleW;
+	sampleH_ = sampleH;
+	layouts_.clear();
+	for(int size : kIconLayoutSizes)
+		layouts_.push_back(ComputeIconLayout(size, sampleW_, sampleH_));
+}
+
+IconLayout IconLayoutTable::Get(int size)
+{
+	size = std::max(size, 16);
+	auto it = std::lower_bound(layouts_.begin(), layouts_.end(), size,
+		[](const IconLayout& l, int s) { return l.size < s; });
+	if(it == layouts_.end() || it->size != size)
+		it = layouts_.insert(it, ComputeIconLayout(size, sampleW_, sampleH_));
+	return *it;
+}
+
+// 32-bit top-down DIB section plus a fully-transparent AND mask (all 1s).
+// The mask matters on some systems where it is still consulted even for
+// 32-bit icons.
+static bool CreateIconBitmaps(int size, HBITMAP& color, void*& bits, HBITMAP& mask)
+{
+	BITMAPV5HEADER bi{};
+	bi.bV5Size = sizeof(bi);
+	bi.bV5Width = size;
+	bi.bV5Height = -size;
+	bi.bV5Planes = 1;
+	bi.bV5BitCount = 32;
+	bi.bV5Compression = BI_BITFIELDS;
+	bi.bV5RedMask   = 0x00FF0000;
+	bi.bV5GreenMask = 0x0000FF00;
+	bi.bV5BlueMask  = 0x000000FF;
+	bi.bV5AlphaMask = 0xFF000000;
+
+	HDC hdcScreen = GetDC(nullptr);
+	color = CreateDIBSection(hdcScreen, (BITMAPINFO*)&bi, DIB_RGB_COLORS, &bits, nullptr, 0);
+	ReleaseDC(nullptr, hdcScreen);
+
+	const auto maskStrideBytes = ((size + 31) / 32) * 4;
+	std::vector<unsigned char> maskBits((size_t)maskStrideBytes * (size_t)size, 0xFF);
+	mask = CreateBitmap(size, size, 1, 1, maskBits.data());
+	return color && bits && mask;
+}
+
+// Draws one frame into `bits`, the 32-bit bitmap selected into `hdc`.
+static void DrawFrame(HDC hdc, void* bits, const IconSpec& spec, const IconLayout& l, const IconText& t)
+{
+	const int size = l.size;
+	memset(bits, 0, (size_t)size * (size_t)size * 4);
+
+	// Draw sparkline first (GDI+ inside SparklineRenderer), then overlay text (GDI+ for correct alpha).
+	if(spec.historyMHz && spec.historyMHz->Count() >= 2)
+	{
+		SparklineStyle style;
+		style.lineWidth = l.lineWidth;
+		DrawAreaSparklineGdiPlus(hdc, l.plot, spec.historyMHz->Spans(), spec.baseMHz, style);
+	}
+
+	// Draw text LAST (top-most), from the shared outline scaled to this
+	// layout's em, so the tight glyph box sits in the bottom region.
+	Gdiplus::Graphics g(hdc);
+	g.ResetClip();
+	g.SetClip(Gdiplus::Rect(0, 0, size, size));
+	g.SetSmoothingMode(Gdiplus::SmoothingModeNone);
+	g.SetTextRenderingHint(Gdiplus::TextRenderingHintSingleBitPerPixelGridFit);
+
+	// We center the tight glyph box vertically inside the bottom region to avoid
+	// the "missing a couple of pixels" clipping caused by hinting/overhang.
+	const float scale = (float)l.em / kIconReferenceEm;
+	const float targetW = (float)(l.text.right - l.text.left);
+	const float targetH = (float)(l.text.bottom - l.text.top);
+	const float x = (float)l.text.left + (targetW - t.bounds.Width * scale) / 2.0f - t.bounds.X * scale;
+	const float y = (float)l.text.top + (targetH - t.bounds.Height * scale) / 2.0f - t.bounds.Y * scale;
+	// Snap to whole pixels to avoid per-frame hinting jitter/jaggies when the text changes.
+	g.TranslateTransform((Gdiplus::REAL)std::lround(x), (Gdiplus::REAL)std::lround(y));
+	g.ScaleTransform(scale, scale);
+
+	Gdiplus::SolidBrush brush(Gdiplus::Color(255, GetRValue(t.rgb), GetGValue(t.rgb), GetBValue(t.rgb)));
+	// Use SourceCopy so anti-aliased edge pixels don't blend with underlying plot pixels (prevents bluish/gray tinting).
+	g.SetCompositingMode(Gdiplus::CompositingModeSourceCopy);
+	g.FillPath(&brush, &t.path);
+}
+
+static void FinishPixels(unsigned int* px, size_t n)
+{
+	// Preserve per-pixel alpha produced by GDI+ (sparkline), but fix up pixels drawn via GDI (text),
+	// which typically leave alpha = 0. We only force alpha to 0xFF when the pixel has RGB != 0 AND alpha == 0.
+	for(size_t i = 0; i < n; i++)
+	{
+		auto v = px[i];
+		if(((v & 0x00FFFFFFu) != 0) && ((v & 0xFF000000u) == 0))
+			px[i] = v | 0xFF000000u;
+	}
+
+	// IMPORTANT: The tray icon pipeline expects *premultiplied* alpha for 32-bit icons.
+	// GDI+ produces straight-alpha RGB for anti-aliased edges. If we hand straight-alpha
+	// pixels to CreateIconIndirect, Windows can treat them as premultiplied and you get
+	// gray halos around glyph edges.
+	// Fix: premultiply RGB by A for all pixels with 0 < A < 255.
+	for(size_t i = 0; i < n; i++)
+	{
+		auto v = px[i];
+		auto a = (unsigned int)((v >> 24) & 0xFFu);
+		if(a > 0 && a < 255)
+		{
+			auto r = (unsigned int)((v >> 16) & 0xFFu);
+			auto g = (unsigned int)((v >> 8) & 0xFFu);
+			auto b = (unsigned int)(v & 0xFFu);
+
+			r = (r * a + 127u) / 255u;
+			g = (g * a + 127u) / 255u;
+			b = (b * a + 127u) / 255u;
+
+			px[i] = (a << 24) | (r << 16) | (g << 8) | b;
+		}
+	}
+}
+
 IconRenderer::IconRenderer()
 {
 }
 
 IconRenderer::~IconRenderer()
 {
+	ReleaseFrame();
 	if(hFont_) { DeleteObject(hFont_); hFont_ = nullptr; }
 	if(fontMemHandle_) { RemoveFontMemResourceEx(fontMemHandle_); fontMemHandle_ = nullptr; }
 }
@@ -243,253 +434,184 @@ void IconRenderer::EnsureInit() const
 	}
 }
 
+void IconRenderer::ReleaseFrame() const
+{
+	if(frameBitmap_) { DeleteObject(frameBitmap_); frameBitmap_ = nullptr; }
+	if(frameMask_) { DeleteObject(frameMask_); frameMask_ = nullptr; }
+	frameBits_ = nullptr;
+	frameSize_ = 0;
+	frameHash_ = 0;
+}
+
 HICON IconRenderer::Render(const IconSpec& spec) const
+{
+	return RenderFrame(spec) ? CreateFrameIcon() : nullptr;
+}
+
+HICON IconRenderer::CreateFrameIcon() const
+{
+	if(!frameBitmap_ || !frameMask_)
+		return nullptr;
+	// CreateIconIndirect copies both bitmaps, so the frame stays ours.
+	ICONINFO ii{};
+	ii.fIcon = TRUE;
+	ii.hbmColor = frameBitmap_;
+	ii.hbmMask = frameMask_;
+	return CreateIconIndirect(&ii);
+}
+
+int IconRenderer::TrayIconSize() const
+{
+	if(traySize_ == 0)
+	{
+		int size = GetSystemMetrics(SM_CXSMICON);
+		int sizeY = GetSystemMetrics(SM_CYSMICON);
+		if(sizeY > size) size = sizeY;
+		if(size <= 0) size = 16;
+		traySize_ = std::max(size, 16);
+	}
+	return traySize_;
+}
+
+bool IconRenderer::OnDisplayChange()
+{
+	const int previous = traySize_;
+	traySize_ = 0;
+	return TrayIconSize() != previous;
+}
+
+bool IconRenderer::EnsureLayouts() const
 {
 	EnsureInit();
 	if(!hFont_)
-		return nullptr;
+		return false;
 
 	// Use embedded font only. No fallback.
 	Gdiplus::PrivateFontCollection* pfc = nullptr;
 	if(!EnsureEmbeddedFont(pfc) || !pfc)
 	{
 		SetFontError(L"Embedded font not available at render time (PrivateFontCollection empty)." );
-		return nullptr;
+		return false;
 	}
+	if(!layouts_.Empty())
+		return true;
 
-	// Render at native tray size.
-	int size = GetSystemMetrics(SM_CXSMICON);
-	int sizeY = GetSystemMetrics(SM_CYSMICON);
-	if(sizeY > size) size = sizeY;
-	if(size <= 0) size = 16;
-	if(size < 16) size = 16;
-
-	BITMAPV5HEADER bi{};
-	bi.bV5Size = sizeof(bi);
-	bi.bV5Width = size;
-	bi.bV5Height = -size;
-	bi.bV5Planes = 1;
-	bi.bV5BitCount = 32;
-	bi.bV5Compression = BI_BITFIELDS;
-	bi.bV5RedMask   = 0x00FF0000;
-	bi.bV5GreenMask = 0x0000FF00;
-	bi.bV5BlueMask  = 0x000000FF;
-	bi.bV5AlphaMask = 0xFF000000;
-
-	void* bits = nullptr;
-	HDC hdcScreen = GetDC(nullptr);
-	HBITMAP hbm = CreateDIBSection(hdcScreen, (BITMAPINFO*)&bi, DIB_RGB_COLORS, &bits, nullptr, 0);
-	ReleaseDC(nullptr, hdcScreen);
-	if(!hbm || !bits) { if(hbm) DeleteObject(hbm); return nullptr; }
-
-	memset(bits, 0, (size_t)size * (size_t)size * 4);
-
-	HDC hdc = CreateCompatibleDC(nullptr);
-	auto oldBmp = (HBITMAP)SelectObject(hdc, hbm);
-
-	// Draw sparkline first (GDI+ inside SparklineRenderer), then overlay text (GDI+ for correct alpha).
-	// Layout: top region is plot-only, bottom region is text-only.
-	// 32px icon => bottom ~0.66 for text, top ~0.34 for plot.
-		const int splitY = (int)std::lround(size * kPlotHeightRatio);
-		int splitYClamped = splitY;
+	Gdiplus::FontFamily ff(kEmbeddedFontFamilyName, pfc);
+	if(!ff.IsAvailable())
 	{
-		int minPlot = 5;
-		int maxPlot = size - 8; // keep at least 8px for text
-		if(splitYClamped < minPlot) splitYClamped = minPlot;
-		if(splitYClamped > maxPlot) splitYClamped = maxPlot;
+		std::wstring msg = L"Embedded font family name not found at render time. Configured kEmbeddedFontFamilyName='";
+		msg += kEmbeddedFontFamilyName;
+		msg += L"'.";
+		SetFontError(msg);
+		return false;
 	}
 
-	RECT plotRc{ 0, 0, size, splitYClamped };
-	// Bottom region is for text only (as per your current two-section layout).
-	RECT textRc{ 0, splitYClamped, size, size };
+	// We safely assume the display format is always like "3.71" (4 chars);
+	// "8.88" is the same length with typically the widest digits.
+	Gdiplus::GraphicsPath sample;
+	AddTextPath(sample, L"8.88", ff);
+	Gdiplus::RectF b{};
+	sample.GetBounds(&b);
+	layouts_.Build(b.Width, b.Height);
+	return true;
+}
 
-	if(spec.historyMHz && spec.historyMHz->Count() >= 2)
-	{
-		double samples[60]{};
-		int n = (int)spec.historyMHz->Count();
-		if(n > 60) n = 60;
-		for(int i = 0; i < n; ++i) samples[i] = spec.historyMHz->GetOldestToNewest((size_t)i);
-		SparklineStyle style;
-		// Scale stroke width for the actual tray icon size (often 16x16/20x20).
-		// Keep it thin but readable.
-		const float scale = (float)size / 32.0f;
-		style.lineWidth = std::max(1.2f, 1.6f * scale);
-		DrawAreaSparklineGdiPlus(hdc, plotRc, samples, n, spec.baseMHz, style);
-	}
+IconLayout IconRenderer::Layout(int size) const
+{
+	if(!EnsureLayouts())
+		return {};
+	return layouts_.Get(size);
+}
+
+bool IconRenderer::PrepareText(const IconSpec& spec, IconText& out) const
+{
+	if(!EnsureLayouts())
+		return false;
+	Gdiplus::PrivateFontCollection* pfc = nullptr;
+	EnsureEmbeddedFont(pfc);
+	Gdiplus::FontFamily ff(kEmbeddedFontFamilyName, pfc);
 
 	// Text color scheme:
 	// - Below base: 1475FF
 	// - Above base: AF1E2D
-	COLORREF rgb = spec.overBase ? spec.textRgbOver : spec.textRgbBelow;
-
-	wchar_t text[16]{};
-	FormatText(spec.ghz, text);
-
-	// Text size is cached per (iconSize, embedded font family) to avoid per-tick size jitter.
-	// We safely assume the display format is always like "3.71" (4 chars).
-	// Cache is computed using a worst-case width sample "8.88" (same length, typically widest digits).
-	static int s_cachedIconSize = 0;
-	static int s_cachedEm = 0;
-	static Gdiplus::RectF s_cachedBounds{};
-	static std::wstring s_cachedFamily;
-
-
-	const auto targetW = (textRc.right - textRc.left);
-	const auto targetH = (textRc.bottom - textRc.top);
-	// Font sizing for the icon uses GDI+ tight glyph bounds below; do not mix
-	// with GDI metrics here (different fonts/rendering modes can disagree).
+	out.rgb = spec.overBase ? spec.textRgbOver : spec.textRgbBelow;
+	FormatText(spec.ghz, out.text);
+	AddTextPath(out.path, out.text, ff);
+	out.path.GetBounds(&out.bounds);
+	return true;
+}
 
-	// Draw text LAST (top-most). Use GDI+ path so we can measure tight glyph bounds
-	// and place the glyph box at the icon bottom with a 1px margin.
+bool IconRenderer::RenderFrame(const IconSpec& spec, int size) const
+{
+	CPUHZ_TRACE_SCOPE("IconRenderer::Render");
+	IconText text;
+	if(!PrepareText(spec, text))
+		return false;
+
+	// Native tray size unless asked otherwise.
+	const IconLayout layout = Layout(size > 0 ? size : TrayIconSize());
+	size = layout.size;
+
+	// The frame (DIB section + AND mask) is retained across calls and only
+	// recreated when the size changes.
+	if(!frameBitmap_ || frameSize_ != size)
 	{
-		Gdiplus::Graphics g(hdc);
-		g.ResetClip();
-		g.SetClip(Gdiplus::Rect(0, 0, size, size));
-		g.SetCompositingMode(Gdiplus::CompositingModeSourceOver);
-		g.SetSmoothingMode(Gdiplus::SmoothingModeNone);
-		g.SetTextRenderingHint(Gdiplus::TextRenderingHintSingleBitPerPixelGridFit);
-
-		// Use embedded font only. No fallback.
-		Gdiplus::FontFamily ff(kEmbeddedFontFamilyName, pfc);
-		if(!ff.IsAvailable())
+		ReleaseFrame();
+		if(!CreateIconBitmaps(size, frameBitmap_, frameBits_, frameMask_))
 		{
-			std::wstring msg = L"Embedded font family name not found at render time. Configured kEmbeddedFontFamilyName='";
-			msg += kEmbeddedFontFamilyName;
-			msg += L"'.";
-			SetFontError(msg);
-			SelectObject(hdc, oldBmp);
-			DeleteDC(hdc);
-			DeleteObject(hbm);
-			return nullptr;
+			ReleaseFrame();
+			return false;
 		}
-
-		auto buildBoundsFor = [&](const wchar_t* t, int em, Gdiplus::RectF& outB)->bool
-		{
-			Gdiplus::GraphicsPath path;
-			Gdiplus::StringFormat fmt(Gdiplus::StringFormat::GenericTypographic());
-			fmt.SetFormatFlags(fmt.GetFormatFlags() | Gdiplus::StringFormatFlagsNoWrap);
-			path.AddString(t, (INT)wcslen(t), &ff, Gdiplus::FontStyleBold, (Gdiplus::REAL)em, Gdiplus::PointF(0, 0), &fmt);
-			outB = Gdiplus::RectF();
-			path.GetBounds(&outB);
-			return outB.Width <= (float)targetW && outB.Height <= (float)targetH;
-		};
-
-		// Compute a stable text size only once per (iconSize, font family).
-		// Use a worst-case sample for width so the cached size never exceeds the icon.
-		const wchar_t* sampleText = L"8.88";
-		// Cache key must include the text box height (because your icon is split into 2 vertical areas).
-		static int s_cachedTextH = 0;
-		if(s_cachedIconSize != size || s_cachedTextH != targetH || s_cachedFamily != kEmbeddedFontFamilyName || s_cachedEm <= 0)
-		{
-			int lo = 6, hi = 400, best = 6;
-			Gdiplus::RectF bestB{};
-			while(lo <= hi)
-			{
-				int mid = (lo + hi) / 2;
-				Gdiplus::RectF b{};
-				if(buildBoundsFor(sampleText, mid, b))
-				{
-					best = mid;
-					bestB = b;
-					lo = mid + 1;
-				}
-				else
-				{
-					hi = mid - 1;
-				}
-			}
-			s_cachedIconSize = size;
-			s_cachedTextH = targetH;
-			s_cachedFamily = kEmbeddedFontFamilyName;
-			s_cachedEm = best;
-			s_cachedBounds = bestB;
-		}
-
-		int best = s_cachedEm;
-		Gdiplus::RectF bestB{};
-		// Measure current text bounds at the cached size (cheap) for accurate placement.
-		buildBoundsFor(text, best, bestB);
-
-		// Final hinting based on chosen size.
-		g.SetTextRenderingHint(Gdiplus::TextRenderingHintSingleBitPerPixelGridFit);
-
-		// Place using the *tight glyph bounds* within the BOTTOM text region.
-		// We center the tight glyph box vertically inside the bottom region to avoid
-		// the "missing a couple of pixels" clipping caused by hinting/overhang.
-		const float x = (float)textRc.left + ((float)targetW - bestB.Width) / 2.0f - bestB.X;
-		const float y = (float)textRc.top + ((float)targetH - bestB.Height) / 2.0f - bestB.Y;
-		// Snap to whole pixels to avoid per-frame hinting jitter/jaggies when the text changes.
-		const float xs = (float)std::lround(x);
-		const float ys = (float)std::lround(y);
-
-		Gdiplus::GraphicsPath path;
-		Gdiplus::StringFormat fmt(Gdiplus::StringFormat::GenericTypographic());
-		fmt.SetFormatFlags(fmt.GetFormatFlags() | Gdiplus::StringFormatFlagsNoWrap);
-		const int style = Gdiplus::FontStyleBold;
-		path.AddString(text, (INT)wcslen(text), &ff, style, (Gdiplus::REAL)best, Gdiplus::PointF(0, 0), &fmt);
-		Gdiplus::Matrix m;
-		m.Translate(xs, ys);
-		path.Transform(&m);
-
-		Gdiplus::SolidBrush brush(Gdiplus::Color(255, GetRValue(rgb), GetGValue(rgb), GetBValue(rgb)));
-		// Use SourceCopy so anti-aliased edge pixels don't blend with underlying plot pixels (prevents bluish/gray tinting).
-		g.SetCompositingMode(Gdiplus::CompositingModeSourceCopy);
-		g.FillPath(&brush, &path);
+		frameSize_ = size;
 	}
+	frameHash_ = 0;
+
+	HDC hdc = CreateCompatibleDC(nullptr);
+	auto oldBmp = (HBITMAP)SelectObject(hdc, frameBitmap_);
+	DrawFrame(hdc, frameBits_, spec, layout, text);
 	SelectObject(hdc, oldBmp);
 	DeleteDC(hdc);
 
-
-	auto* px = (unsigned int*)bits;
+	auto* px = (unsigned int*)frameBits_;
 	const auto n = (size_t)size * (size_t)size;
+	FinishPixels(px, n);
+	frameHash_ = HashFrame(px, n);
+	return true;
+}
 
-// Preserve per-pixel alpha produced by GDI+ (sparkline), but fix up pixels drawn via GDI (text),
-// which typically leave alpha = 0. We only force alpha to 0xFF when the pixel has RGB != 0 AND alpha == 0.
-	for(size_t i = 0; i < n; i++)
-	{
-		auto v = px[i];
-		if(((v & 0x00FFFFFFu) != 0) && ((v & 0xFF000000u) == 0))
-			px[i] = v | 0xFF000000u;
-	}
+size_t IconRenderer::RenderIconSet(const IconSpec& spec, const int* sizes, size_t count, HICON* out) const
+{
+	CPUHZ_TRACE_SCOPE("IconRenderer::RenderIconSet");
+	std::fill(out, out + count, nullptr);
+	IconText text;
+	if(!PrepareText(spec, text))
+		return 0;
 
-	// IMPORTANT: The tray icon pipeline expects *premultiplied* alpha for 32-bit icons.
-	// GDI+ produces straight-alpha RGB for anti-aliased edges. If we hand straight-alpha
-	// pixels to CreateIconIndirect, Windows can treat them as premultiplied and you get
-	// gray halos around glyph edges.
-	// Fix: premultiply RGB by A for all pixels with 0 < A < 255.
-	for(size_t i = 0; i < n; i++)
+	size_t rendered = 0;
+	HDC hdc = CreateCompatibleDC(nullptr);
+	for(size_t i = 0; i < count; ++i)
 	{
-		auto v = px[i];
-		auto a = (unsigned int)((v >> 24) & 0xFFu);
-		if(a > 0 && a < 255)
+		const IconLayout layout = Layout(sizes[i]);
+		HBITMAP color = nullptr, mask = nullptr;
+		void* bits = nullptr;
+		if(CreateIconBitmaps(layout.size, color, bits, mask))
 		{
-			auto r = (unsigned int)((v >> 16) & 0xFFu);
-			auto g = (unsigned int)((v >> 8) & 0xFFu);
-			auto b = (unsigned int)(v & 0xFFu);
-
-			r = (r * a + 127u) / 255u;
-			g = (g * a + 127u) / 255u;
-			b = (b * a + 127u) / 255u;
-
-			px[i] = (a << 24) | (r << 16) | (g << 8) | b;
+			auto oldBmp = (HBITMAP)SelectObject(hdc, color);
+			DrawFrame(hdc, bits, spec, layout, text);
+			SelectObject(hdc, oldBmp);
+			FinishPixels((unsigned int*)bits, (size_t)layout.size * (size_t)layout.size);
+
+			ICONINFO ii{};
+			ii.fIcon = TRUE;
+			ii.hbmColor = color;
+			ii.hbmMask = mask;
+			out[i] = CreateIconIndirect(&ii);
+			if(out[i])
+				++rendered;
 		}
+		if(color) DeleteObject(color);
+		if(mask) DeleteObject(mask);
 	}
-// Build a fully-transparent AND mask (all 1s). This matters on some systems
-	// where the mask is still consulted even for 32-bit icons.
-	const auto maskStrideBytes = ((size + 31) / 32) * 4;
-	std::vector<unsigned char> maskBits((size_t)maskStrideBytes * (size_t)size, 0xFF);
-	HBITMAP hbmMask = CreateBitmap(size, size, 1, 1, maskBits.data());
-	if(!hbmMask) { DeleteObject(hbm); return nullptr; }
-
-	ICONINFO ii{};
-	ii.fIcon = TRUE;
-	ii.hbmColor = hbm;
-	ii.hbmMask = hbmMask;
-
-	auto hIcon = CreateIconIndirect(&ii);
-
-	DeleteObject(hbmMask);
-	DeleteObject(hbm);
-
-	return hIcon;
+	DeleteDC(hdc);
+	return rendered;
 }
@@ -1,7 +1,10 @@
 #pragma once
 #include <windows.h>
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include "HistoryBuffer.h"
 
@@ -19,6 +22,48 @@ inline constexpr float kPlotHeightRatio = 0.35f;
 inline constexpr float kTextBottomMarginPx = 1.0f;
 inline constexpr float kTextBottomSafetyPx = 1.0f;
 
+// Common small-icon sizes (100% to 400% scaling); their layouts are computed
+// once, when the font is first loaded. Other sizes are added on first use.
+inline constexpr int kIconLayoutSizes[] = { 16, 20, 24, 32, 40, 48, 64 };
+
+// Geometry and text size of one icon size.
+struct IconLayout
+{
+	int size = 0;
+	RECT plot{};            // sparkline, top region
+	RECT text{};            // text, bottom region
+	float lineWidth = 0.0f; // sparkline stroke
+	int em = 0;             // text size; 0 if the font is unavailable
+};
+
+// Text outlines are built at kIconReferenceEm. A path is an unhinted
+// outline, so the text at any other size is the same path scaled by
+// em / kIconReferenceEm; one outline serves every icon size.
+inline constexpr float kIconReferenceEm = 100.0f;
+
+// Layout of one size (at least 16). `sampleW` x `sampleH` are the bounds of
+// the widest text ("8.88") at kIconReferenceEm; `em` is the largest size at
+// which it fits the text region. Pure: no font or GDI needed.
+IconLayout ComputeIconLayout(int size, float sampleW, float sampleH);
+
+// Layouts sorted by size: kIconLayoutSizes once the sample is known, other
+// sizes inserted in order on first use.
+class IconLayoutTable
+{
+public:
+	void Build(float sampleW, float sampleH);
+	bool Empty() const { return layouts_.empty(); }
+	IconLayout Get(int size);
+	const std::vector<IconLayout>& Layouts() const { return layouts_; }
+
+private:
+	std::vector<IconLayout> layouts_;
+	float sampleW_ = 0.0f;
+	float sampleH_ = 0.0f;
+};
+
+struct IconText;
+
 
 struct IconSpec
 {
@@ -44,13 +89,48 @@ public:
 	HICON Render(const IconSpec& spec) const; // caller owns, must DestroyIcon
 	const wchar_t* GetFontError() const;
 
+	// Retained frame: RenderFrame draws into a bitmap kept between calls and
+	// hashes the result, so an unchanged frame can be detected before an icon
+	// is built from it. CreateFrameIcon builds that icon (caller owns).
+	// `size` 0 = the tray icon size.
+	bool RenderFrame(const IconSpec& spec, int size = 0) const;
+	uint64_t FrameHash() const { return frameHash_; } // 0 = no frame
+	HICON CreateFrameIcon() const;
+	// The retained frame: FrameSize() x FrameSize() premultiplied 0xAARRGGBB
+	// pixels, top row first (nullptr before the first RenderFrame).
+	const uint32_t* FramePixels() const { return static_cast<const uint32_t*>(frameBits_); }
+	int FrameSize() const { return frameSize_; }
+
+	// Renders `spec` at each of `sizes` (e.g. kIconLayoutSizes) from one text
+	// outline and the layout table. out[i] is nullptr for a size that failed;
+	// the caller owns (DestroyIcon) the rest. Returns the number rendered.
+	size_t RenderIconSet(const IconSpec& spec, const int* sizes, size_t count, HICON* out) const;
+
+	// Layout for a size (at least 16), from the table.
+	IconLayout Layout(int size) const;
+
+	// SM_CXSMICON/SM_CYSMICON, cached; OnDisplayChange() re-reads them and
+	// returns true if the tray icon size changed (DPI or monitor change).
+	int TrayIconSize() const;
+	bool OnDisplayChange();
+
 private:
 	void EnsureInit() const;
 	bool LoadFontFromResource() const;
 	void SetFontError(const std::wstring& msg) const;
+	void ReleaseFrame() const;
+	bool EnsureLayouts() const;
+	bool PrepareText(const IconSpec& spec, IconText& out) const;
 
 	mutable bool initialized_ = false;
 	mutable HANDLE fontMemHandle_ = nullptr; // RemoveFontMemResourceEx in dtor
 	mutable HFONT hFont_ = nullptr;
 	mutable std::wstring fontError_;
+	mutable HBITMAP frameBitmap_ = nullptr; // 32-bit DIB section
+	mutable HBITMAP frameMask_ = nullptr;
+	mutable void* frameBits_ = nullptr;
+	mutable int frameSize_ = 0;
+	mutable uint64_t frameHash_ = 0;
+	mutable int traySize_ = 0;
+	mutable IconLayoutTable layouts_;
 };
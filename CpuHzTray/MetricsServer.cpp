@@ -0,0 +1,581 @@
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include "MetricsServer.h"
+#include "AlertEngine.h"
+#include "CpuFrequency.h"
+#include "ProcessAttribution.h"
+#include "SelfOverhead.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#pragma comment(lib, "Ws2_32.lib")
+
+namespace
+{
+	// Appends printf-style text to a fixed buffer; sticky overflow flag.
+	struct TextSink
+	{
+		char* out;
+		size_t cap;
+		size_t len = 0;
+		bool overflow = false;
+
+		void Append(const char* fmt, ...)
+		{
+			if(overflow) return;
+			va_list ap;
+			va_start(ap, fmt);
+			int n = vsnprintf(out + len, cap - len, fmt, ap);
+			va_end(ap);
+			if(n < 0 || (size_t)n >= cap - len)
+				overflow = true;
+			else
+				len += (size_t)n;
+		}
+	};
+
+	// Label value: source names are ASCII; anything else becomes '?'.
+	void CopyLabelValue(const wchar_t* src, char* out, size_t cap)
+	{
+		size_t n = 0;
+		for(; src && *src && n + 2 < cap; ++src)
+		{
+			wchar_t c = *src;
+			if(c == L'"' || c == L'\\')
+				out[n++] = '\\';
+			out[n++] = (c >= 0x20 && c < 0x7F) ? (char)c : '?';
+		}
+		out[n] = '\0';
+	}
+
+	void CopyLabelValue(const char* src, char* out, size_t cap)
+	{
+		size_t n = 0;
+		for(; src && *src && n + 2 < cap; ++src)
+		{
+			char c = *src;
+			if(c == '"' || c == '\\')
+				out[n++] = '\\';
+			out[n++] = (c >= 0x20 && c < 0x7F) ? c : '?';
+		}
+		out[n] = '\0';
+	}
+
+	void Gauge(TextSink& s, const char* name, const char* help, double value)
+	{
+		s.Append("# TYPE %s gauge\n# HELP %s %s\n%s %.3f\n", name, name, help, name, value);
+	}
+
+	constexpr int kMaxClients = 4;
+	constexpr size_t kRequestMax = 2048;
+	constexpr ULONGLONG kClientTimeoutMs = 5000;
+	constexpr const char* kContentType = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+	struct Client
+	{
+		SOCKET s = INVALID_SOCKET;
+		ULONGLONG acceptedTick = 0;
+		char request[kRequestMax];
+		size_t requestLen = 0;
+		bool responding = false;
+		char header[256];
+		size_t headerLen = 0;
+		std::unique_ptr<char[]> body; // exposition capacity, allocated on first use
+		size_t bodyLen = 0;
+		size_t sent = 0;              // over header + body
+	};
+
+	void CloseClient(Client& c)
+	{
+		if(c.s != INVALID_SOCKET)
+		{
+			shutdown(c.s, SD_SEND);
+			closesocket(c.s);
+		}
+		c.s = INVALID_SOCKET;
+		c.requestLen = 0;
+		c.responding = false;
+		c.headerLen = 0;
+		c.bodyLen = 0;
+		c.sent = 0;
+	}
+
+	void PrepareResponse(Client& c, const MetricsExposition& expo)
+	{
+		const char* status = "200 OK";
+		const char* type = kContentType;
+
+		const char* req = c.request;
+		bool isGet = strncmp(req, "GET ", 4) == 0;
+		const char* path = isGet ? req + 4 : nullptr;
+		bool isMetrics = path && strncmp(path, "/metrics", 8) == 0 &&
+			(path[8] == ' ' || path[8] == '?');
+
+		c.bodyLen = 0;
+		if(!isGet)
+		{
+			status = "405 Method Not Allowed";
+		}
+		else if(!isMetrics)
+		{
+			status = "404 Not Found";
+		}
+		else
+		{
+			if(!c.body)
+				c.body.reset(new char[expo.Capacity()]);
+			c.bodyLen = expo.CopyLatest(c.body.get(), expo.Capacity());
+			if(c.bodyLen == 0)
+				status = "503 Service Unavailable"; // no sample yet
+		}
+		if(c.bodyLen == 0)
+			type = "text/plain; charset=utf-8";
+
+		int n = snprintf(c.header, sizeof(c.header),
+			"HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+			status, type, c.bodyLen);
+		c.headerLen = n > 0 ? (size_t)n : 0;
+		c.sent = 0;
+		c.responding = true;
+	}
+
+	// Returns false when the client should be closed.
+	bool OnReadable(Client& c, const MetricsExposition& expo)
+	{
+		int n = recv(c.s, c.request + c.requestLen, (int)(kRequestMax - 1 - c.requestLen), 0);
+		if(n == 0) return false;
+		if(n < 0) return WSAGetLastError() == WSAEWOULDBLOCK;
+
+		c.requestLen += (size_t)n;
+		c.request[c.requestLen] = '\0';
+		if(strstr(c.request, "\r\n\r\n"))
+			PrepareResponse(c, expo);
+		else if(c.requestLen >= kRequestMax - 1)
+			return false; // oversized request
+		return true;
+	}
+
+	bool OnWritable(Client& c)
+	{
+		const size_t total = c.headerLen + c.bodyLen;
+		while(c.sent < total)
+		{
+			const char* p;
+			size_t len;
+			if(c.sent < c.headerLen)
+			{
+				p = c.header + c.sent;
+				len = c.headerLen - c.sent;
+			}
+			else
+			{
+				p = c.body.get() + (c.sent - c.headerLen);
+				len = total - c.sent;
+			}
+
+			int n = send(c.s, p, (int)len, 0);
+			if(n < 0) return WSAGetLastError() == WSAEWOULDBLOCK;
+			c.sent += (size_t)n;
+		}
+		return false; // done
+	}
+}
+
+size_t FormatOpenMetrics(const CpuReading& r, bool perCore, char* out, size_t cap,
+	const SelfOverhead* overhead, const AlertEngine* alerts, const ProcessAttribution* attribution)
+{
+	if(!out || cap == 0)
+		return 0;
+
+	TextSink s{ out, cap };
+	char label[128];
+
+	Gauge(s, "cpuhz_avg_mhz", "Average frequency reported by the selected source.", r.avgMHz);
+	Gauge(s, "cpuhz_min_mhz", "Minimum per-core frequency reported by the selected source.", r.minMHz);
+	Gauge(s, "cpuhz_max_mhz", "Maximum per-core frequency reported by the selected source.", r.maxMHz);
+	Gauge(s, "cpuhz_limit_mhz", "Average PowerInformation MhzLimit (0 = unknown).", r.limitMHz);
+	Gauge(s, "cpuhz_below_limit_mhz", "Average distance of the clock below its current limit.", r.belowLimitMHz);
+	Gauge(s, "cpuhz_limited_cores", "Processors whose limit is below their rated maximum.", (double)r.limitedCoreCount);
+	Gauge(s, "cpuhz_capped_cores", "Limited processors running at their limit (thermal/power capped).", (double)r.cappedCoreCount);
+	Gauge(s, "cpuhz_busy_weighted_mhz", "Per-core frequency weighted by processor busy time (0 = unknown).", r.busyWeightedMHz);
+	Gauge(s, "cpuhz_base_mhz", "Nominal (base) clock.", r.baseMHz);
+	Gauge(s, "cpuhz_nominal_like", "1 if every source looks stuck near base.", r.nominalLike ? 1.0 : 0.0);
+	Gauge(s, "cpuhz_reading_ok", "1 if the last sample produced a reading.", r.ok ? 1.0 : 0.0);
+	Gauge(s, "cpuhz_valid_cores", "Cores that contributed to the selected value.", (double)r.validCoreCount);
+	Gauge(s, "cpuhz_sample_timestamp_seconds", "Wall-clock time of the sample.", (double)r.timeUnixMs / 1000.0);
+
+	CopyLabelValue(r.source.c_str(), label, sizeof(label));
+	s.Append("# TYPE cpuhz_selected_source info\n"
+		"# HELP cpuhz_selected_source Source the displayed value came from.\n"
+		"cpuhz_selected_source_info{source=\"%s\"} 1\n", label);
+
+	if(r.sourceCount > 0)
+	{
+		s.Append("# TYPE cpuhz_source_mhz gauge\n"
+			"# HELP cpuhz_source_mhz Average frequency per candidate source.\n");
+		for(int i = 0; i < r.sourceCount; ++i)
+		{
+			CopyLabelValue(r.sources[i].source, label, sizeof(label));
+			s.Append("cpuhz_source_mhz{source=\"%s\"} %.3f\n", label, r.sources[i].avgMHz);
+		}
+		s.Append("# TYPE cpuhz_source_nominal_like gauge\n"
+			"# HELP cpuhz_source_nominal_like 1 if the source looks stuck near base.\n");
+		for(int i = 0; i < r.sourceCount; ++i)
+		{
+			CopyLabelValue(r.sources[i].source, label, sizeof(label));
+			s.Append("cpuhz_source_nominal_like{source=\"%s\"} %d\n", label, r.sources[i].nominalLike ? 1 : 0);
+		}
+	}
+
+	if(r.coreTypeCount > 0)
+	{
+		s.Append("# TYPE cpuhz_core_type_mhz gauge\n"
+			"# HELP cpuhz_core_type_mhz Average frequency per core type (hybrid CPUs).\n");
+		for(int t = 0; t < r.coreTypeCount; ++t)
+		{
+			CopyLabelValue(r.coreTypes[t].name, label, sizeof(label));
+			s.Append("cpuhz_core_type_mhz{type=\"%s\"} %.3f\n", label, r.coreTypes[t].avgMHz);
+		}
+		s.Append("# TYPE cpuhz_core_type_base_mhz gauge\n"
+			"# HELP cpuhz_core_type_base_mhz Rated base clock per core type.\n");
+		for(int t = 0; t < r.coreTypeCount; ++t)
+		{
+			CopyLabelValue(r.coreTypes[t].name, label, sizeof(label));
+			s.Append("cpuhz_core_type_base_mhz{type=\"%s\"} %.3f\n", label, r.coreTypes[t].baseMHz);
+		}
+	}
+
+	const auto& topo = r.topology;
+	if(!topo.packages.empty())
+	{
+		s.Append("# TYPE cpuhz_package_mhz gauge\n"
+			"# HELP cpuhz_package_mhz Average frequency per processor package.\n");
+		for(size_t p = 0; p < topo.packages.size(); ++p)
+			s.Append("cpuhz_package_mhz{package=\"%zu\"} %.3f\n", p, topo.packages[p].avgMHz);
+		s.Append("# TYPE cpuhz_package_min_mhz gauge\n"
+			"# HELP cpuhz_package_min_mhz Slowest logical processor per package.\n");
+		for(size_t p = 0; p < topo.packages.size(); ++p)
+			s.Append("cpuhz_package_min_mhz{package=\"%zu\"} %.3f\n", p, topo.packages[p].minMHz);
+		s.Append("# TYPE cpuhz_die_mhz gauge\n"
+			"# HELP cpuhz_die_mhz Average frequency per die.\n");
+		for(size_t d = 0; d < topo.dies.size(); ++d)
+			s.Append("cpuhz_die_mhz{package=\"%d\",die=\"%zu\"} %.3f\n", topo.dies[d].parent, d, topo.dies[d].avgMHz);
+	}
+
+	if(perCore && !topo.cores.empty())
+	{
+		s.Append("# TYPE cpuhz_physical_core_mhz gauge\n"
+			"# HELP cpuhz_physical_core_mhz Average frequency per physical core (over its SMT threads).\n");
+		for(size_t c = 0; c < topo.cores.size(); ++c)
+		{
+			if(topo.cores[c].validCount > 0)
+				s.Append("cpuhz_physical_core_mhz{die=\"%d\",core=\"%zu\"} %.3f\n", topo.cores[c].parent, c, topo.cores[c].avgMHz);
+		}
+	}
+
+	if(perCore && !r.perCoreLimitMHz.empty())
+	{
+		s.Append("# TYPE cpuhz_core_limit_mhz gauge\n"
+			"# HELP cpuhz_core_limit_mhz PowerInformation MhzLimit per logical processor.\n");
+		for(size_t i = 0; i < r.perCoreLimitMHz.size(); ++i)
+		{
+			if(r.perCoreLimitMHz[i] > 0.0)
+				s.Append("cpuhz_core_limit_mhz{cpu=\"%zu\"} %.3f\n", i, r.perCoreLimitMHz[i]);
+		}
+	}
+
+	if(perCore && !r.perCoreMHz.empty())
+	{
+		s.Append("# TYPE cpuhz_core_mhz gauge\n"
+			"# HELP cpuhz_core_mhz Frequency per logical processor (global index).\n");
+		for(size_t i = 0; i < r.perCoreMHz.size(); ++i)
+		{
+			if(r.perCoreMHz[i] > 0.0)
+				s.Append("cpuhz_core_mhz{cpu=\"%zu\"} %.3f\n", i, r.perCoreMHz[i]);
+		}
+	}
+
+	if(overhead)
+	{
+		HdrSnapshot snaps[(int)OverheadProbe::Count];
+		for(int i = 0; i < (int)OverheadProbe::Count; ++i)
+			snaps[i] = overhead->Histogram((OverheadProbe)i).Snapshot();
+
+		s.Append("# TYPE cpuhz_latency_seconds summary\n"
+			"# HELP cpuhz_latency_seconds Self-measured latency per probe since start.\n");
+		for(int i = 0; i < (int)OverheadProbe::Count; ++i)
+		{
+			const HdrSnapshot& h = snaps[i];
+			if(h.count == 0) continue;
+			CopyLabelValue(OverheadProbeName((OverheadProbe)i), label, sizeof(label));
+			s.Append("cpuhz_latency_seconds{probe=\"%s\",quantile=\"0.5\"} %.9f\n", label, h.p50Us / 1e6);
+			s.Append("cpuhz_latency_seconds{probe=\"%s\",quantile=\"0.99\"} %.9f\n", label, h.p99Us / 1e6);
+			s.Append("cpuhz_latency_seconds{probe=\"%s\",quantile=\"0.999\"} %.9f\n", label, h.p999Us / 1e6);
+			s.Append("cpuhz_latency_seconds_sum{probe=\"%s\"} %.9f\n", label, h.meanUs * (double)h.count / 1e6);
+			s.Append("cpuhz_latency_seconds_count{probe=\"%s\"} %llu\n", label, (unsigned long long)h.count);
+		}
+		s.Append("# TYPE cpuhz_latency_max_seconds gauge\n"
+			"# HELP cpuhz_latency_max_seconds Slowest observation per probe since start.\n");
+		for(int i = 0; i < (int)OverheadProbe::Count; ++i)
+		{
+			if(snaps[i].count == 0) continue;
+			CopyLabelValue(OverheadProbeName((OverheadProbe)i), label, sizeof(label));
+			s.Append("cpuhz_latency_max_seconds{probe=\"%s\"} %.9f\n", label, snaps[i].maxUs / 1e6);
+		}
+		s.Append("# TYPE cpuhz_tray_frames_published counter\n"
+			"# HELP cpuhz_tray_frames_published Tray icon frames handed to the shell.\n"
+			"cpuhz_tray_frames_published_total %llu\n", (unsigned long long)overhead->FramesPublished());
+		s.Append("# TYPE cpuhz_tray_frames_skipped counter\n"
+			"# HELP cpuhz_tray_frames_skipped Rendered frames not published (unchanged, or over the publish rate).\n"
+			"cpuhz_tray_frames_skipped_total %llu\n", (unsigned long long)overhead->FramesSkipped());
+	}
+
+	if(alerts && alerts->RuleCount() > 0)
+	{
+		s.Append("# TYPE cpuhz_alert_active gauge\n"
+			"# HELP cpuhz_alert_active 1 while the alert rule is firing.\n");
+		for(int i = 0; i < alerts->RuleCount(); ++i)
+		{
+			CopyLabelValue(alerts->RuleName(i).c_str(), label, sizeof(label));
+			s.Append("cpuhz_alert_active{rule=\"%s\"} %d\n", label, alerts->IsActive(i) ? 1 : 0);
+		}
+		s.Append("# TYPE cpuhz_alert_fired counter\n"
+			"# HELP cpuhz_alert_fired Times the alert rule has fired since start.\n");
+		for(int i = 0; i < alerts->RuleCount(); ++i)
+		{
+			CopyLabelValue(alerts->RuleName(i).c_str(), label, sizeof(label));
+			s.Append("cpuhz_alert_fired_total{rule=\"%s\"} %llu\n", label, (unsigned long long)alerts->FiredCount(i));
+		}
+	}
+
+	if(attribution && !attribution->Top().empty())
+	{
+		struct ProcessGauge
+		{
+			const char* name;
+			const char* help;
+			double ProcessShare::* value;
+		};
+		static const ProcessGauge kGauges[] = {
+			{ "cpuhz_process_ghz_seconds", "Recent CPU seconds x GHz per process (top processes).", &ProcessShare::ghzSeconds },
+			{ "cpuhz_process_boosted_ghz_seconds", "Part of cpuhz_process_ghz_seconds above base clock.", &ProcessShare::boostedGhzSeconds },
+			{ "cpuhz_process_throttled_ghz_seconds", "Part of cpuhz_process_ghz_seconds while throttled (below base, or the capped share of cores).", &ProcessShare::throttledGhzSeconds },
+		};
+		for(const ProcessGauge& g : kGauges)
+		{
+			s.Append("# TYPE %s gauge\n# HELP %s %s\n", g.name, g.name, g.help);
+			for(const ProcessShare& p : attribution->Top())
+			{
+				CopyLabelValue(p.name.c_str(), label, sizeof(label));
+				s.Append("%s{pid=\"%lu\",process=\"%s\"} %.3f\n", g.name, (unsigned long)p.pid, label, p.*g.value);
+			}
+		}
+	}
+
+	s.Append("# EOF\n");
+	return s.overflow ? 0 : s.len;
+}
+
+MetricsExposition::MetricsExposition(size_t capacity)
+	: cap_(std::max(capacity, kMinCapacity))
+{
+	buf_[0].reset(new char[cap_]);
+	buf_[1].reset(new char[cap_]);
+	len_[0] = 0;
+	len_[1] = 0;
+}
+
+bool MetricsExposition::Update(const CpuReading& r, bool perCore, const SelfOverhead* overhead,
+	const AlertEngine* alerts, const ProcessAttribution* attribution)
+{
+	const uint64_t seq = seq_.load(std::memory_order_relaxed);
+	const uint64_t next = seq / 2 + 1;
+	const int idx = (int)(next & 1);
+
+	// Mark buffer idx as being rewritten before touching it.
+	seq_.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	// Aggregates always fit (kMinCapacity); drop per-core gauges if they do not.
+	size_t len = FormatOpenMetrics(r, perCore, buf_[idx].get(), cap_, overhead, alerts, attribution);
+	bool complete = len != 0;
+	if(!complete)
+		len = FormatOpenMetrics(r, false, buf_[idx].get(), cap_, overhead, alerts, attribution);
+
+	len_[idx].store(len, std::memory_order_relaxed);
+	seq_.store(seq + 2, std::memory_order_release);
+	return complete;
+}
+
+size_t MetricsExposition::CopyLatest(char* out, size_t outCap) const
+{
+	for(;;)
+	{
+		const uint64_t seq = seq_.load(std::memory_order_acquire);
+		const uint64_t published = seq / 2;
+		if(published == 0)
+			return 0;
+
+		const int idx = (int)(published & 1);
+		size_t len = len_[idx].load(std::memory_order_relaxed);
+		if(len > outCap)
+			return 0;
+		memcpy(out, buf_[idx].get(), len);
+
+		// buf_[idx] is only rewritten once the sampler starts body published+2.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(seq_.load(std::memory_order_relaxed) < 2 * (published + 1) + 1)
+			return len;
+	}
+}
+
+MetricsServer::~MetricsServer()
+{
+	Stop();
+}
+
+bool MetricsServer::Start(uint16_t port, const MetricsExposition* exposition)
+{
+	Stop();
+	if(!exposition)
+		return false;
+
+	WSADATA wsa{};
+	if(WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+		return false;
+	wsaStarted_ = true;
+
+	SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if(s == INVALID_SOCKET)
+	{
+		Stop();
+		return false;
+	}
+
+	BOOL exclusive = TRUE;
+	setsockopt(s, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, (const char*)&exclusive, sizeof(exclusive));
+
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // never reachable off-box
+
+	u_long nonBlocking = 1;
+	if(bind(s, (const sockaddr*)&addr, sizeof(addr)) != 0 ||
+		listen(s, SOMAXCONN) != 0 ||
+		ioctlsocket(s, FIONBIO, &nonBlocking) != 0)
+	{
+		closesocket(s);
+		Stop();
+		return false;
+	}
+
+	listenSocket_ = (uintptr_t)s;
+	exposition_ = exposition;
+	stop_ = false;
+	thread_ = std::thread(&MetricsServer::Run, this);
+	return true;
+}
+
+void MetricsServer::Stop()
+{
+	stop_ = true;
+	if(thread_.joinable())
+		thread_.join();
+
+	if(listenSocket_ != (uintptr_t)INVALID_SOCKET)
+	{
+		closesocket((SOCKET)listenSocket_);
+		listenSocket_ = (uintptr_t)INVALID_SOCKET;
+	}
+	if(wsaStarted_)
+	{
+		WSACleanup();
+		wsaStarted_ = false;
+	}
+	exposition_ = nullptr;
+}
+
+void MetricsServer::Run()
+{
+	const auto listenSocket = (SOCKET)listenSocket_;
+	Client clients[kMaxClients];
+
+	while(!stop_)
+	{
+		fd_set readSet;
+		fd_set writeSet;
+		FD_ZERO(&readSet);
+		FD_ZERO(&writeSet);
+		FD_SET(listenSocket, &readSet);
+		for(auto& c : clients)
+		{
+			if(c.s == INVALID_SOCKET) continue;
+			if(c.responding)
+				FD_SET(c.s, &writeSet);
+			else
+				FD_SET(c.s, &readSet);
+		}
+
+		// Short timeout so Stop() is noticed without a wake-up socket.
+		timeval tv{ 0, 200 * 1000 };
+		int ready = select(0, &readSet, &writeSet, nullptr, &tv);
+		if(ready == SOCKET_ERROR)
+		{
+			Sleep(200);
+			continue;
+		}
+
+		if(FD_ISSET(listenSocket, &readSet))
+		{
+			for(;;)
+			{
+				SOCKET s = accept(listenSocket, nullptr, nullptr);
+				if(s == INVALID_SOCKET)
+					break;
+
+				Client* slot = nullptr;
+				for(auto& c : clients)
+				{
+					if(c.s == INVALID_SOCKET)
+					{
+						slot = &c;
+						break;
+					}
+				}
+				u_long nonBlocking = 1;
+				if(!slot || ioctlsocket(s, FIONBIO, &nonBlocking) != 0)
+				{
+					closesocket(s);
+					continue;
+				}
+				slot->s = s;
+				slot->acceptedTick = GetTickCount64();
+			}
+		}
+
+		const ULONGLONG now = GetTickCount64();
+		for(auto& c : clients)
+		{
+			if(c.s == INVALID_SOCKET) continue;
+
+			bool keep = true;
+			if(FD_ISSET(c.s, &readSet))
+				keep = OnReadable(c, *exposition_);
+			else if(FD_ISSET(c.s, &writeSet))
+				keep = OnWritable(c);
+			else if(now - c.acceptedTick > kClientTimeoutMs)
+				keep = false;
+
+			if(!keep)
+				CloseClient(c);
+		}
+	}
+
+	for(auto& c : clients)
+		CloseClient(c);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <windows.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+struct CpuReading;
+class AlertEngine;
+class ProcessAttribution;
+class SelfOverhead;
+
+// Formats one reading as OpenMetrics text (terminated by "# EOF"), plus the
+// per-probe latency summaries of `overhead`, the state of every alert rule
+// in `alerts` and the top processes of `attribution` when given.
+// Returns the body length, or 0 if it does not fit in `cap` bytes.
+size_t FormatOpenMetrics(const CpuReading& r, bool perCore, char* out, size_t cap,
+	const SelfOverhead* overhead = nullptr, const AlertEngine* alerts = nullptr,
+	const ProcessAttribution* attribution = nullptr);
+
+// Pre-serialized exposition body, double-buffered.
+// - Update() (sampler) formats into the buffer readers are not using and
+//   publishes it; it never waits on readers.
+// - CopyLatest() (server thread) copies the last published body and retries
+//   only if the sampler started overwriting that buffer mid-copy, which takes
+//   two Update() calls during one memcpy.
+class MetricsExposition
+{
+public:
+	// Enough for every gauge except the per-core, per-alert-rule and per-process ones.
+	static constexpr size_t kMinCapacity = 16384;
+	static constexpr size_t kBytesPerCore = 128;
+	static constexpr size_t kBytesPerAlertRule = 160;
+	static constexpr size_t kBytesPerTopProcess = 512;
+
+	explicit MetricsExposition(size_t capacity);
+
+	size_t Capacity() const { return cap_; }
+
+	// Returns false if the per-core gauges did not fit and were left out.
+	bool Update(const CpuReading& r, bool perCore, const SelfOverhead* overhead = nullptr,
+		const AlertEngine* alerts = nullptr, const ProcessAttribution* attribution = nullptr);
+
+	// Returns the body length copied into `out`, or 0 if nothing was published yet.
+	size_t CopyLatest(char* out, size_t outCap) const;
+
+private:
+	std::unique_ptr<char[]> buf_[2];
+	std::atomic<size_t> len_[2];
+	size_t cap_ = 0;
+	// 2k = k bodies published (latest in buf_[k & 1]); 2k+1 = writing body k+1.
+	std::atomic<uint64_t> seq_{ 0 };
+};
+
+// Minimal HTTP/1.1 server bound to 127.0.0.1 serving GET /metrics from a
+// MetricsExposition. One thread, non-blocking sockets and select(); each
+// connection is answered once and closed.
+class MetricsServer
+{
+public:
+	MetricsServer() = default;
+	~MetricsServer();
+	MetricsServer(const MetricsServer&) = delete;
+	MetricsServer& operator=(const MetricsServer&) = delete;
+
+	bool Start(uint16_t port, const MetricsExposition* exposition);
+	void Stop();
+	bool IsRunning() const { return thread_.joinable(); }
+
+private:
+	void Run();
+
+	const MetricsExposition* exposition_ = nullptr;
+	uintptr_t listenSocket_ = ~(uintptr_t)0; // SOCKET; kept opaque to avoid winsock2.h here
+	std::atomic<bool> stop_{ false };
+	std::thread thread_;
+	bool wsaStarted_ = false;
+};
@@ -0,0 +1,201 @@
+#include "PersistentHistory.h"
+
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<HistoryFileImage>);
+
+void InitHistoryFileHeader(HistoryFileHeader& h, uint64_t nowUnixMs)
+{
+	memset(&h, 0, sizeof(h));
+	h.magic = kHistoryFileMagic;
+	h.version = kHistoryFileVersion;
+	h.headerSize = (uint32_t)sizeof(HistoryFileHeader);
+	h.imageSize = (uint32_t)sizeof(HistoryFileImage);
+	h.tierCount = TieredHistory::kTierCount;
+	for(int i = 0; i < TieredHistory::kTierCount; ++i)
+	{
+		h.tierBucketSec[i] = TieredHistory::kTiers[i].bucketSec;
+		h.tierCapacity[i] = (uint32_t)TieredHistory::kTiers[i].capacity;
+	}
+	h.sparklineCapacity = (uint32_t)SparklineHistory::Capacity();
+	h.createdUnixMs = nowUnixMs;
+}
+
+bool IsCompatibleHistoryFileHeader(const HistoryFileHeader& h)
+{
+	if(h.magic != kHistoryFileMagic) return false;
+	if(h.version != kHistoryFileVersion) return false;
+	if(h.headerSize != sizeof(HistoryFileHeader)) return false;
+	if(h.imageSize != sizeof(HistoryFileImage)) return false;
+	if(h.tierCount != TieredHistory::kTierCount) return false;
+	for(int i = 0; i < TieredHistory::kTierCount; ++i)
+	{
+		if(h.tierBucketSec[i] != TieredHistory::kTiers[i].bucketSec) return false;
+		if(h.tierCapacity[i] != TieredHistory::kTiers[i].capacity) return false;
+	}
+	return h.sparklineCapacity == SparklineHistory::Capacity();
+}
+
+bool IsValidHistoryImage(const HistoryFileImage& img)
+{
+	return IsCompatibleHistoryFileHeader(img.header) && img.tiers.IsValid() && img.sparkline.IsValid();
+}
+
+// Resets an image in place. All-zero bytes are the empty state of every ring.
+static void ResetImage(HistoryFileImage& img, uint64_t nowUnixMs)
+{
+	memset((void*)&img, 0, sizeof(img));
+	InitHistoryFileHeader(img.header, nowUnixMs);
+}
+
+PersistentHistory::~PersistentHistory()
+{
+	Close();
+	delete heap_;
+	heap_ = nullptr;
+}
+
+void PersistentHistory::UseInMemory(uint64_t nowUnixMs)
+{
+	if(!heap_)
+		heap_ = new (std::nothrow) HistoryFileImage();
+	if(heap_)
+		ResetImage(*heap_, nowUnixMs);
+	image_ = heap_;
+	restored_ = false;
+}
+
+bool PersistentHistory::Open(const wchar_t* path, uint64_t nowUnixMs)
+{
+	Close();
+
+	if(path && *path)
+	{
+		file_ = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+			OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	}
+
+	if(file_ != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER existing{};
+		GetFileSizeEx(file_, &existing);
+
+		// Mapping with an explicit size grows a new or short file to the image size.
+		const auto size = (DWORD)sizeof(HistoryFileImage);
+		mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READWRITE, 0, size, nullptr);
+		if(mapping_)
+			view_ = static_cast<HistoryFileImage*>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, size));
+
+		if(view_)
+		{
+			image_ = view_;
+			// Ring indices are trusted by every reader, so a corrupt file is reset.
+			restored_ = existing.QuadPart >= (LONGLONG)size && IsValidHistoryImage(*view_);
+			if(!restored_)
+				ResetImage(*view_, nowUnixMs);
+			else if(nowUnixMs < view_->header.lastSampleUnixMs ||
+				nowUnixMs - view_->header.lastSampleUnixMs > kSparklineStaleMs)
+				view_->sparkline.Clear();
+			return true;
+		}
+	}
+
+	Close();
+	UseInMemory(nowUnixMs);
+	return false;
+}
+
+void PersistentHistory::Close()
+{
+	if(view_)
+	{
+		UnmapViewOfFile(view_);
+		view_ = nullptr;
+	}
+	if(mapping_)
+	{
+		CloseHandle(mapping_);
+		mapping_ = nullptr;
+	}
+	if(file_ != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file_);
+		file_ = INVALID_HANDLE_VALUE;
+	}
+	image_ = heap_;
+	restored_ = false;
+}
+
+void PersistentHistory::Flush()
+{
+	// Dirty pages reach the file even if the process crashes; this only
+	// matters for OS crashes or power loss (called on logoff/shutdown).
+	if(view_)
+		FlushViewOfFile(view_, 0);
+}
+
+void PersistentHistory::Push(uint64_t unixMs, double mhz)
+{
+	if(!image_)
+		UseInMemory(unixMs);
+	if(!image_)
+		return;
+
+	// The sparkline keeps one point per second whatever the sampling interval:
+	// samples within a second replace that second's point, and short gaps left
+	// by a backed-off interval repeat the previous value.
+	auto& spark = image_->sparkline;
+	const uint64_t sec = unixMs / 1000;
+	const uint64_t lastSec = image_->header.lastSampleUnixMs / 1000;
+	if(spark.Count() > 0 && sec == lastSec)
+	{
+		spark.Newest() = mhz;
+	}
+	else
+	{
+		if(spark.Count() > 0 && sec > lastSec && sec - lastSec <= kSparklineHoldMaxSec)
+		{
+			const double held = spark.Newest();
+			for(uint64_t t = lastSec + 1; t < sec; ++t)
+				spark.Push(held);
+		}
+		spark.Push(mhz);
+	}
+
+	image_->tiers.Push(sec, mhz);
+	image_->header.lastSampleUnixMs = unixMs;
+	++image_->header.sampleCount;
+}
+
+bool LoadHistorySnapshot(const wchar_t* path, HistoryFileImage& out)
+{
+	HANDLE f = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(f == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD read = 0;
+	const bool ok = ReadFile(f, &out, (DWORD)sizeof(out), &read, nullptr) && read == sizeof(out);
+	CloseHandle(f);
+	return ok && IsValidHistoryImage(out);
+}
+
+bool GetAppDataFilePath(const wchar_t* fileName, wchar_t* out, size_t outCount)
+{
+	wchar_t dir[MAX_PATH]{};
+	DWORD n = GetEnvironmentVariableW(L"LOCALAPPDATA", dir, MAX_PATH);
+	if(n == 0 || n >= MAX_PATH)
+		return false;
+
+	if(wcscat_s(dir, L"\\CpuHzTray") != 0)
+		return false;
+	CreateDirectoryW(dir, nullptr); // fails harmlessly if it already exists
+
+	return swprintf_s(out, outCount, L"%s\\%s", dir, fileName) > 0;
+}
+
+bool GetDefaultHistoryFilePath(wchar_t* out, size_t outCount)
+{
+	return GetAppDataFilePath(L"history.bin", out, outCount);
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <windows.h>
+
+#include <cstdint>
+
+#include "HistoryBuffer.h"
+#include "TieredHistory.h"
+
+// History that survives restarts (update, logoff, crash).
+// The rings live directly inside a memory-mapped file, so restoring is just
+// mapping the file and validating its header; nothing is parsed or copied.
+// If the file cannot be mapped, the same layout is kept in process memory.
+
+using SparklineHistory = RingBufferD<30>;
+
+inline constexpr uint32_t kHistoryFileMagic = 0x485A4843; // 'CHZH'
+inline constexpr uint32_t kHistoryFileVersion = 1;
+
+// A restored sparkline older than this is dropped (tiers are kept).
+inline constexpr uint64_t kSparklineStaleMs = 120000;
+
+// Longest gap (seconds) the sparkline bridges by repeating the previous value.
+inline constexpr uint64_t kSparklineHoldMaxSec = 60;
+
+struct HistoryFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t imageSize;
+	uint32_t tierCount;
+	uint32_t tierBucketSec[TieredHistory::kTierCount];
+	uint32_t tierCapacity[TieredHistory::kTierCount];
+	uint32_t sparklineCapacity;
+	uint64_t createdUnixMs;
+	uint64_t lastSampleUnixMs;
+	uint64_t sampleCount;
+};
+
+// On-disk (and in-memory) image. Trivially copyable, no pointers.
+struct HistoryFileImage
+{
+	HistoryFileHeader header;
+	TieredHistory tiers;
+	SparklineHistory sparkline;
+};
+
+void InitHistoryFileHeader(HistoryFileHeader& h, uint64_t nowUnixMs);
+bool IsCompatibleHistoryFileHeader(const HistoryFileHeader& h);
+// Compatible header and every ring's head/count in range.
+bool IsValidHistoryImage(const HistoryFileImage& img);
+
+class PersistentHistory
+{
+public:
+	PersistentHistory() = default;
+	~PersistentHistory();
+	PersistentHistory(const PersistentHistory&) = delete;
+	PersistentHistory& operator=(const PersistentHistory&) = delete;
+
+	// Maps `path` (created if missing). Returns true when backed by the file;
+	// on failure the history is kept in memory only. Always leaves usable storage.
+	bool Open(const wchar_t* path, uint64_t nowUnixMs);
+	void Close();
+	void Flush();
+
+	TieredHistory& Tiers() { return image_->tiers; }
+	SparklineHistory& Sparkline() { return image_->sparkline; }
+	const HistoryFileHeader& Header() const { return image_->header; }
+
+	void Push(uint64_t unixMs, double mhz);
+
+	bool IsMapped() const { return view_ != nullptr; }
+	bool Restored() const { return restored_; }
+
+private:
+	void UseInMemory(uint64_t nowUnixMs);
+
+	HANDLE file_ = INVALID_HANDLE_VALUE;
+	HANDLE mapping_ = nullptr;
+	HistoryFileImage* view_ = nullptr;
+	HistoryFileImage* heap_ = nullptr;
+	HistoryFileImage* image_ = nullptr;
+	bool restored_ = false;
+};
+
+// Copies a history file into `out` without mapping it, so it can be read
+// while the tray has it open. A bucket being written at that moment may be
+// torn. False if the file is missing, short, of another version or corrupt.
+bool LoadHistorySnapshot(const wchar_t* path, HistoryFileImage& out);
+
+// %LOCALAPPDATA%\CpuHzTray\<fileName> (directory created on demand).
+bool GetAppDataFilePath(const wchar_t* fileName, wchar_t* out, size_t outCount);
+
+// %LOCALAPPDATA%\CpuHzTray\history.bin
+bool GetDefaultHistoryFilePath(wchar_t* out, size_t outCount);
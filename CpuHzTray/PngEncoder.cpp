@@ -0,0 +1,332 @@
+#include "PngEncoder.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+
+static constexpr uint32_t kWindow = 32768;
+static constexpr int kHashBits = 15;
+static constexpr size_t kMaxMatch = 258;
+
+// Fixed Huffman codes (RFC 1951, 3.2.6), bit-reversed for LSB-first output.
+struct DeflateTables
+{
+	uint16_t litCode[288];
+	uint8_t litBits[288];
+	uint8_t lengthSymbol[kMaxMatch + 1]; // length -> symbol - 257
+	uint8_t distSymbol[512];             // see DistanceSymbol()
+
+	static constexpr uint16_t kLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static constexpr uint8_t kLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static constexpr uint16_t kDistBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static constexpr uint8_t kDistExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	static constexpr uint16_t Reverse(uint16_t code, int bits)
+	{
+		uint16_t r = 0;
+		for(int i = 0; i < bits; ++i)
+			r = (uint16_t)((r << 1) | ((code >> i) & 1));
+		return r;
+	}
+
+	constexpr DeflateTables() : litCode{}, litBits{}, lengthSymbol{}, distSymbol{}
+	{
+		for(int s = 0; s < 288; ++s)
+		{
+			int code, bits;
+			if(s < 144) { code = 0x30 + s; bits = 8; }
+			else if(s < 256) { code = 0x190 + s - 144; bits = 9; }
+			else if(s < 280) { code = s - 256; bits = 7; }
+			else { code = 0xC0 + s - 280; bits = 8; }
+			litCode[s] = Reverse((uint16_t)code, bits);
+			litBits[s] = (uint8_t)bits;
+		}
+		for(int i = 0; i < 29; ++i)
+		{
+			const int end = i + 1 < 29 ? kLengthBase[i + 1] : (int)kMaxMatch + 1;
+			for(int len = kLengthBase[i]; len < end && len <= (int)kMaxMatch; ++len)
+				lengthSymbol[len] = (uint8_t)i;
+		}
+		// Distances 1..256 directly, larger ones by (d - 1) >> 7, as zlib does.
+		for(int i = 0; i < 30; ++i)
+		{
+			const int end = i + 1 < 30 ? kDistBase[i + 1] : 32769;
+			for(int d = kDistBase[i]; d < end; ++d)
+			{
+				if(d <= 256)
+					distSymbol[d - 1] = (uint8_t)i;
+				else
+					distSymbol[256 + ((d - 1) >> 7)] = (uint8_t)i;
+			}
+		}
+	}
+
+	int DistanceSymbol(uint32_t d) const
+	{
+		return d <= 256 ? distSymbol[d - 1] : distSymbol[256 + ((d - 1) >> 7)];
+	}
+};
+
+static constexpr DeflateTables kTables;
+
+static constexpr std::array<uint32_t, 256> kCrcTable = []
+{
+	std::array<uint32_t, 256> t{};
+	for(uint32_t n = 0; n < 256; ++n)
+	{
+		uint32_t c = n;
+		for(int k = 0; k < 8; ++k)
+			c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		t[n] = c;
+	}
+	return t;
+}();
+
+uint32_t PngEncoder::Crc32(const uint8_t* data, size_t size, uint32_t crc)
+{
+	crc = ~crc;
+	for(size_t i = 0; i < size; ++i)
+		crc = kCrcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+uint32_t PngEncoder::Adler32(const uint8_t* data, size_t size)
+{
+	uint32_t a = 1, b = 0;
+	while(size > 0)
+	{
+		// Largest run before b can overflow 32 bits.
+		size_t n = std::min<size_t>(size, 5552);
+		size -= n;
+		while(n--)
+		{
+			a += *data++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
+
+static uint32_t Hash3(const uint8_t* p)
+{
+	const uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+	return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+static uint8_t Paeth(int a, int b, int c)
+{
+	const int p = a + b - c;
+	const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	if(pa <= pb && pa <= pc) return (uint8_t)a;
+	return (uint8_t)(pb <= pc ? b : c);
+}
+
+void PngEncoder::FilterRows(const uint32_t* pixels, int width, int height, size_t stridePx)
+{
+	const size_t rowBytes = (size_t)width * 4;
+	raw_.resize((rowBytes + 1) * (size_t)height);
+	for(auto& r : rows_)
+		r.assign(rowBytes, 0);
+
+	uint8_t* out = raw_.data();
+	for(int y = 0; y < height; ++y)
+	{
+		uint8_t* cur = rows_[y & 1].data();
+		const uint8_t* prev = rows_[(y & 1) ^ 1].data(); // zeros above the first row
+		const uint32_t* src = pixels + (size_t)y * stridePx;
+		for(int x = 0; x < width; ++x)
+		{
+			const uint32_t v = src[x];
+			const uint32_t a = v >> 24;
+			uint32_t r = (v >> 16) & 0xFF, g = (v >> 8) & 0xFF, b = v & 0xFF;
+			if(a == 0)
+			{
+				r = g = b = 0;
+			}
+			else if(a < 255)
+			{
+				r = std::min(255u, (r * 255 + a / 2) / a);
+				g = std::min(255u, (g * 255 + a / 2) / a);
+				b = std::min(255u, (b * 255 + a / 2) / a);
+			}
+			uint8_t* d = cur + (size_t)x * 4;
+			d[0] = (uint8_t)r;
+			d[1] = (uint8_t)g;
+			d[2] = (uint8_t)b;
+			d[3] = (uint8_t)a;
+		}
+
+		// Pick the filter with the smallest sum of |residual| (as signed bytes).
+		uint32_t sums[5] = {};
+		for(size_t i = 0; i < rowBytes; ++i)
+		{
+			const int left = i >= 4 ? cur[i - 4] : 0;
+			const int up = prev[i];
+			const int upLeft = i >= 4 ? prev[i - 4] : 0;
+			sums[0] += (uint32_t)std::abs((int8_t)cur[i]);
+			sums[1] += (uint32_t)std::abs((int8_t)(uint8_t)(cur[i] - left));
+			sums[2] += (uint32_t)std::abs((int8_t)(uint8_t)(cur[i] - up));
+			sums[4] += (uint32_t)std::abs((int8_t)(uint8_t)(cur[i] - Paeth(left, up, upLeft)));
+		}
+		int filter = 0;
+		for(int f : { 1, 2, 4 })
+		{
+			if(sums[f] < sums[filter])
+				filter = f;
+		}
+
+		*out++ = (uint8_t)filter;
+		for(size_t i = 0; i < rowBytes; ++i)
+		{
+			const int left = i >= 4 ? cur[i - 4] : 0;
+			const int up = prev[i];
+			switch(filter)
+			{
+			case 1: *out++ = (uint8_t)(cur[i] - left); break;
+			case 2: *out++ = (uint8_t)(cur[i] - up); break;
+			case 4: *out++ = (uint8_t)(cur[i] - Paeth(left, up, i >= 4 ? prev[i - 4] : 0)); break;
+			default: *out++ = cur[i]; break;
+			}
+		}
+	}
+}
+
+void PngEncoder::Deflate(const uint8_t* data, size_t size)
+{
+	auto put = [this](uint32_t value, int bits)
+	{
+		bits_ |= (uint64_t)value << bitCount_;
+		bitCount_ += bits;
+		while(bitCount_ >= 8)
+		{
+			out_[outPos_++] = (uint8_t)bits_;
+			bits_ >>= 8;
+			bitCount_ -= 8;
+		}
+	};
+	auto literal = [&](int s) { put(kTables.litCode[s], kTables.litBits[s]); };
+
+	if(head_.empty())
+		head_.assign((size_t)1 << kHashBits, 0);
+	// Entries hold position + base_ + 1; anything <= base_ is from an
+	// earlier image. Rebase before the counter could wrap.
+	if(base_ > 0xFFFFFFFFu - (uint32_t)std::min<size_t>(size, 0x7FFFFFFF) - 2)
+	{
+		std::fill(head_.begin(), head_.end(), 0);
+		base_ = 0;
+	}
+
+	bits_ = 0;
+	bitCount_ = 0;
+	put(1, 1); // BFINAL
+	put(1, 2); // BTYPE = fixed Huffman
+
+	size_t i = 0;
+	while(i + 3 <= size)
+	{
+		const uint32_t h = Hash3(data + i);
+		const uint32_t cand = head_[h];
+		head_[h] = base_ + 1 + (uint32_t)i;
+		if(cand > base_)
+		{
+			const size_t c = cand - base_ - 1;
+			const size_t dist = i - c;
+			if(dist <= kWindow && data[c] == data[i] && data[c + 1] == data[i + 1] && data[c + 2] == data[i + 2])
+			{
+				const size_t maxLen = std::min(kMaxMatch, size - i);
+				size_t len = 3;
+				while(len < maxLen && data[c + len] == data[i + len])
+					++len;
+
+				const int ls = kTables.lengthSymbol[len];
+				literal(257 + ls);
+				if(DeflateTables::kLengthExtra[ls])
+					put((uint32_t)(len - DeflateTables::kLengthBase[ls]), DeflateTables::kLengthExtra[ls]);
+				const int ds = kTables.DistanceSymbol((uint32_t)dist);
+				put(DeflateTables::Reverse((uint16_t)ds, 5), 5);
+				if(DeflateTables::kDistExtra[ds])
+					put((uint32_t)(dist - DeflateTables::kDistBase[ds]), DeflateTables::kDistExtra[ds]);
+
+				// Short matches are indexed in full; long runs (transparent
+				// rows) only cost one lookup each.
+				if(len <= 4)
+				{
+					for(size_t k = 1; k < len && i + k + 3 <= size; ++k)
+						head_[Hash3(data + i + k)] = base_ + 1 + (uint32_t)(i + k);
+				}
+				i += len;
+				continue;
+			}
+		}
+		literal(data[i]);
+		++i;
+	}
+	for(; i < size; ++i)
+		literal(data[i]);
+	literal(256);
+	if(bitCount_ > 0)
+		put(0, 8 - bitCount_);
+
+	base_ += (uint32_t)size + 1;
+}
+
+static void PutU32(uint8_t* p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+const std::vector<uint8_t>& PngEncoder::Encode(const uint32_t* pixels, int width, int height, size_t stridePx)
+{
+	out_.clear();
+	if(!pixels || width <= 0 || height <= 0)
+		return out_;
+
+	FilterRows(pixels, width, height, stridePx);
+
+	// Fixed Huffman never needs more than 9 bits per input byte.
+	static constexpr uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	const size_t bound = sizeof(kSignature) + 25 + 12 + 2 + raw_.size() + raw_.size() / 8 + 16 + 4 + 12;
+	out_.resize(bound);
+	uint8_t* p = out_.data();
+	std::copy(kSignature, kSignature + 8, p);
+
+	uint8_t* ihdr = p + 8;
+	PutU32(ihdr, 13);
+	std::copy_n("IHDR", 4, ihdr + 4);
+	PutU32(ihdr + 8, (uint32_t)width);
+	PutU32(ihdr + 12, (uint32_t)height);
+	ihdr[16] = 8; // bit depth
+	ihdr[17] = 6; // RGBA
+	ihdr[18] = ihdr[19] = ihdr[20] = 0;
+	PutU32(ihdr + 21, Crc32(ihdr + 4, 17));
+
+	const size_t idat = 8 + 25;
+	std::copy_n("IDAT", 4, p + idat + 4);
+	outPos_ = idat + 8;
+	out_[outPos_++] = 0x78; // zlib: deflate, 32K window
+	out_[outPos_++] = 0x01; // fastest, no dictionary
+	Deflate(raw_.data(), raw_.size());
+	PutU32(out_.data() + outPos_, Adler32(raw_.data(), raw_.size()));
+	outPos_ += 4;
+	p = out_.data();
+	PutU32(p + idat, (uint32_t)(outPos_ - idat - 8));
+	PutU32(p + outPos_, Crc32(p + idat + 4, outPos_ - idat - 4));
+	outPos_ += 4;
+
+	PutU32(p + outPos_, 0);
+	std::copy_n("IEND", 4, p + outPos_ + 4);
+	PutU32(p + outPos_ + 8, Crc32(p + outPos_ + 4, 4));
+	outPos_ += 12;
+
+	out_.resize(outPos_);
+	return out_;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Minimal PNG writer for rendered tray frames (8-bit RGBA, non-interlaced).
+// Standard C++ only: writing the file is up to the caller.
+// - Input is what IconRenderer draws: premultiplied 0xAARRGGBB pixels, top
+//   row first. Rows are converted to straight RGBA and filtered per row
+//   (None/Sub/Up/Paeth, smallest sum of absolute residuals).
+// - Compression is a single fixed-Huffman deflate block with a one-probe
+//   LZ77 hash (zlib level-1 territory): icons and sprite sheets are small
+//   and repetitive, so speed matters more than the last few percent.
+// - Row buffers, the match table and the output are kept between calls and
+//   only grow; encoding frames of one size never allocates after the first.
+//   Match-table entries are stamped with a running base position, so the
+//   table is not cleared per image either.
+
+class PngEncoder
+{
+public:
+	// `stridePx` is the distance between rows, in pixels. Returns the PNG
+	// file bytes (valid until the next call).
+	const std::vector<uint8_t>& Encode(const uint32_t* pixels, int width, int height, size_t stridePx);
+
+	const std::vector<uint8_t>& Output() const { return out_; }
+
+	static uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+	static uint32_t Adler32(const uint8_t* data, size_t size);
+
+private:
+	void FilterRows(const uint32_t* pixels, int width, int height, size_t stridePx);
+	void Deflate(const uint8_t* data, size_t size);
+
+	std::vector<uint8_t> raw_;     // filter byte + filtered row, per row
+	std::vector<uint8_t> rows_[2]; // straight RGBA: previous and current row
+	std::vector<uint32_t> head_;   // hash -> position + base_
+	uint32_t base_ = 0;
+	std::vector<uint8_t> out_;
+	size_t outPos_ = 0;
+	uint64_t bits_ = 0;
+	int bitCount_ = 0;
+};
@@ -0,0 +1,344 @@
+#include "ProcessAttribution.h"
+#include "CpuFrequency.h"
+
+#include <psapi.h>
+
+#include <algorithm>
+#include <cmath>
+
+static uint64_t ToUInt64(const FILETIME& ft)
+{
+	ULARGE_INTEGER v;
+	v.LowPart = ft.dwLowDateTime;
+	v.HighPart = ft.dwHighDateTime;
+	return v.QuadPart;
+}
+
+bool WindowsProcessSource::ListPids(std::vector<DWORD>& out)
+{
+	if(out.size() < 1024)
+		out.resize(1024);
+	for(;;)
+	{
+		DWORD bytes = 0;
+		const DWORD capacity = (DWORD)(out.size() * sizeof(DWORD));
+		if(!EnumProcesses(out.data(), capacity, &bytes))
+			return false;
+		// A full buffer may have been truncated.
+		if(bytes < capacity)
+		{
+			out.resize(bytes / sizeof(DWORD));
+			return true;
+		}
+		out.resize(out.size() * 2);
+	}
+}
+
+HANDLE WindowsProcessSource::Open(DWORD pid)
+{
+	return OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+}
+
+void WindowsProcessSource::Close(HANDLE h)
+{
+	if(h) CloseHandle(h);
+}
+
+bool WindowsProcessSource::Times(HANDLE h, uint64_t& creation, uint64_t& cpu)
+{
+	FILETIME c, e, k, u;
+	if(!GetProcessTimes(h, &c, &e, &k, &u))
+		return false;
+	creation = ToUInt64(c);
+	cpu = ToUInt64(k) + ToUInt64(u);
+	return true;
+}
+
+uint64_t WindowsProcessSource::Affinity(HANDLE h)
+{
+	DWORD_PTR process = 0, system = 0;
+	return GetProcessAffinityMask(h, &process, &system) ? (uint64_t)process : 0;
+}
+
+std::wstring WindowsProcessSource::Name(HANDLE h)
+{
+	wchar_t path[MAX_PATH];
+	DWORD size = MAX_PATH;
+	if(!QueryFullProcessImageNameW(h, 0, path, &size))
+		return L"?";
+	const wchar_t* slash = wcsrchr(path, L'\\');
+	return slash ? slash + 1 : path;
+}
+
+ProcessAttribution::~ProcessAttribution()
+{
+	Stop();
+}
+
+void ProcessAttribution::Start(std::unique_ptr<ProcessSource> source, const AttributionConfig& config)
+{
+	Stop();
+	source_ = std::move(source);
+	config_ = config;
+	config_.scanBudget = std::max<size_t>(config_.scanBudget, 1);
+}
+
+void ProcessAttribution::Stop()
+{
+	if(source_)
+	{
+		for(DWORD pid : hot_)
+			source_->Close(entries_[pid].handle);
+	}
+	source_.reset();
+	entries_.clear();
+	pids_.clear();
+	hot_.clear();
+	charged_.clear();
+	top_.clear();
+	rank_.clear();
+	cursor_ = 0;
+	lastOpens_ = 0;
+	lastRescanMs_ = 0;
+	lastUpdateMs_ = 0;
+}
+
+void ProcessAttribution::Cool(Entry& e)
+{
+	source_->Close(e.handle);
+	e.handle = nullptr;
+	e.idleTicks = 0;
+}
+
+void ProcessAttribution::Rescan(uint64_t nowMs)
+{
+	lastRescanMs_ = nowMs;
+	if(!source_->ListPids(pids_))
+		pids_.clear();
+	// The cursor carries on where it was, so a list longer than
+	// scanBudget x (rescanMs / tick) is still covered in full.
+	if(cursor_ >= pids_.size())
+		cursor_ = 0;
+	++generation_;
+	for(DWORD pid : pids_)
+	{
+		Entry& e = entries_[pid];
+		e.generation = generation_;
+		e.share.pid = pid;
+	}
+
+	// Gone from the list: hot handles are closed now, totals are kept until
+	// they have decayed.
+	for(size_t i = 0; i < hot_.size();)
+	{
+		Entry& e = entries_[hot_[i]];
+		if(e.generation != generation_)
+		{
+			Cool(e);
+			hot_[i] = hot_.back();
+			hot_.pop_back();
+			continue;
+		}
+		++i;
+	}
+	for(auto it = entries_.begin(); it != entries_.end();)
+	{
+		if(it->second.generation != generation_ && !it->second.charged)
+			it = entries_.erase(it);
+		else
+			++it;
+	}
+}
+
+double ProcessAttribution::ClockFor(const Entry& e, const CpuReading& r) const
+{
+	const double all = r.busyWeightedMHz > 0.0 ? r.busyWeightedMHz : r.avgMHz;
+	if(e.affinity == 0 || r.perCoreMHz.empty())
+		return all;
+
+	double sum = 0.0;
+	int n = 0;
+	bool restricted = false;
+	const size_t count = std::min<size_t>(r.perCoreMHz.size(), 64);
+	for(size_t i = 0; i < count; ++i)
+	{
+		if(r.perCoreMHz[i] <= 0.0)
+			continue;
+		if(e.affinity & (1ULL << i))
+		{
+			sum += r.perCoreMHz[i];
+			++n;
+		}
+		else
+		{
+			restricted = true;
+		}
+	}
+	return restricted && n > 0 ? sum / n : all;
+}
+
+void ProcessAttribution::Charge(Entry& e, uint64_t cpuDelta, const CpuReading& r)
+{
+	const double mhz = ClockFor(e, r);
+	const double seconds = (double)cpuDelta / 1e7;
+	const double ghzSeconds = seconds * mhz / 1000.0;
+	const double base = r.baseMHz;
+	const double band = SourceWindow::BandMHz(base);
+
+	e.share.cpuSeconds += seconds;
+	e.share.ghzSeconds += ghzSeconds;
+	if(base > 0.0 && mhz > base + band)
+		e.share.boostedGhzSeconds += ghzSeconds;
+	// Below base, all of it was throttled. Otherwise only the capped cores'
+	// share of it: one capped core out of 16 throttles a sixteenth.
+	double throttled = 0.0;
+	if(base > 0.0 && mhz < base - band)
+		throttled = 1.0;
+	else if(r.cappedCoreCount > 0)
+		throttled = r.validCoreCount > 0 ? std::min(1.0, (double)r.cappedCoreCount / r.validCoreCount) : 1.0;
+	e.share.throttledGhzSeconds += ghzSeconds * throttled;
+	if(!e.charged)
+	{
+		e.charged = true;
+		charged_.push_back(e.share.pid);
+	}
+}
+
+void ProcessAttribution::Visit(DWORD pid, Entry& e, const CpuReading& r)
+{
+	HANDLE h = source_->Open(pid);
+	++lastOpens_;
+	if(!h)
+		return;
+
+	uint64_t creation = 0, cpu = 0;
+	if(!source_->Times(h, creation, cpu))
+	{
+		source_->Close(h);
+		return;
+	}
+	// First sight, or the PID now names another process: baseline only.
+	if(!e.seen || creation != e.creation)
+	{
+		e.seen = true;
+		e.creation = creation;
+		e.cpu = cpu;
+		e.share = ProcessShare{};
+		e.share.pid = pid;
+		source_->Close(h);
+		return;
+	}
+
+	const uint64_t delta = cpu > e.cpu ? cpu - e.cpu : 0;
+	e.cpu = cpu;
+	if(delta == 0)
+	{
+		source_->Close(h);
+		return;
+	}
+	if(e.share.name.empty())
+		e.share.name = source_->Name(h);
+	e.affinity = source_->Affinity(h);
+	Charge(e, delta, r);
+	if(hot_.size() < config_.maxHot)
+	{
+		e.handle = h;
+		e.idleTicks = 0;
+		hot_.push_back(pid);
+	}
+	else
+	{
+		source_->Close(h);
+	}
+}
+
+void ProcessAttribution::Update(const CpuReading& r)
+{
+	if(!source_)
+		return;
+	const uint64_t now = r.timeUnixMs;
+	lastOpens_ = 0;
+	if(lastRescanMs_ == 0 || now < lastRescanMs_ || now - lastRescanMs_ >= config_.rescanMs)
+		Rescan(now);
+
+	// Decay, and drop totals that no longer matter.
+	double keep = 1.0;
+	if(config_.decaySec > 0.0 && lastUpdateMs_ != 0 && now > lastUpdateMs_)
+		keep = std::exp(-(double)(now - lastUpdateMs_) / 1000.0 / config_.decaySec);
+	lastUpdateMs_ = now;
+	for(size_t i = 0; i < charged_.size();)
+	{
+		auto it = entries_.find(charged_[i]);
+		if(it != entries_.end())
+		{
+			ProcessShare& s = it->second.share;
+			s.ghzSeconds *= keep;
+			s.boostedGhzSeconds *= keep;
+			s.throttledGhzSeconds *= keep;
+			s.cpuSeconds *= keep;
+			if(s.ghzSeconds >= 1e-6)
+			{
+				++i;
+				continue;
+			}
+			it->second.charged = false;
+			if(it->second.generation != generation_ && !it->second.handle)
+				entries_.erase(it);
+		}
+		charged_[i] = charged_.back();
+		charged_.pop_back();
+	}
+
+	// Hot processes: one read each, through the handle kept open.
+	for(size_t i = 0; i < hot_.size();)
+	{
+		Entry& e = entries_[hot_[i]];
+		uint64_t creation = 0, cpu = 0;
+		bool cool = !source_->Times(e.handle, creation, cpu) || creation != e.creation;
+		if(!cool)
+		{
+			const uint64_t delta = cpu > e.cpu ? cpu - e.cpu : 0;
+			e.cpu = cpu;
+			if(delta > 0)
+			{
+				Charge(e, delta, r);
+				e.idleTicks = 0;
+			}
+			else
+			{
+				cool = ++e.idleTicks >= config_.idleTicksToCool;
+			}
+		}
+		if(cool)
+		{
+			Cool(e);
+			hot_[i] = hot_.back();
+			hot_.pop_back();
+			continue;
+		}
+		++i;
+	}
+
+	// The next slice of the PID list.
+	const size_t budget = std::min(config_.scanBudget, pids_.size());
+	for(size_t n = 0; n < budget; ++n)
+	{
+		if(cursor_ >= pids_.size())
+			cursor_ = 0;
+		const DWORD pid = pids_[cursor_++];
+		auto it = entries_.find(pid);
+		if(pid == 0 || it == entries_.end() || it->second.handle)
+			continue; // idle process, or hot and already read
+		Visit(pid, it->second, r);
+	}
+
+	rank_.clear();
+	for(DWORD pid : charged_)
+		rank_.push_back(&entries_[pid].share);
+	const size_t n = std::min(config_.topN, rank_.size());
+	std::partial_sort(rank_.begin(), rank_.begin() + n, rank_.end(),
+		[](const ProcessShare* a, const ProcessShare* b) { return a->ghzSeconds > b->ghzSeconds; });
+	top_.resize(n);
+	for(size_t i = 0; i < n; ++i)
+		top_[i] = *rank_[i];
+}
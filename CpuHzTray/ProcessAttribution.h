@@ -0,0 +1,133 @@
+#pragma once
+#include <windows.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CpuReading;
+
+// Which processes consumed the clock: CPU time per process joined with the
+// frequency it ran at, as GHz-seconds (CPU seconds x GHz).
+// - The PID list is refreshed only every `rescanMs`. Each tick opens at most
+//   `scanBudget` PIDs from it (round-robin) to find the ones using CPU.
+// - A PID that used CPU becomes hot: its handle stays open and is read on
+//   every tick until it has been idle for a while. At most `maxHot`.
+// - Windows does not say which processor a thread ran on, so a process is
+//   charged the busy-weighted clock, or the average clock of the processors
+//   its affinity allows when it is restricted to some of them. CPU time
+//   found on a round-robin visit is charged at the current clock.
+// - Totals decay with a `decaySec` time constant (0 = never), so the ranking
+//   follows recent load; time at boost (above base) and throttled are kept
+//   separately. Throttled is all of it below base, otherwise the capped
+//   share of the valid cores (cores at their limit).
+
+class ProcessSource
+{
+public:
+	virtual ~ProcessSource() = default;
+
+	// All current PIDs; false on failure.
+	virtual bool ListPids(std::vector<DWORD>& out) = 0;
+	// nullptr if the process cannot be opened.
+	virtual HANDLE Open(DWORD pid) = 0;
+	virtual void Close(HANDLE h) = 0;
+	// Creation time and user + kernel time, both in 100 ns units.
+	virtual bool Times(HANDLE h, uint64_t& creation, uint64_t& cpu) = 0;
+	// Affinity within processor group 0; 0 if unknown.
+	virtual uint64_t Affinity(HANDLE h) = 0;
+	// Image file name without the directory.
+	virtual std::wstring Name(HANDLE h) = 0;
+};
+
+class WindowsProcessSource : public ProcessSource
+{
+public:
+	bool ListPids(std::vector<DWORD>& out) override;
+	HANDLE Open(DWORD pid) override;
+	void Close(HANDLE h) override;
+	bool Times(HANDLE h, uint64_t& creation, uint64_t& cpu) override;
+	uint64_t Affinity(HANDLE h) override;
+	std::wstring Name(HANDLE h) override;
+};
+
+struct AttributionConfig
+{
+	size_t topN = 10;
+	size_t maxHot = 256;
+	size_t scanBudget = 512;
+	unsigned rescanMs = 10000;
+	double decaySec = 60.0;
+	int idleTicksToCool = 30; // hot PIDs idle this many ticks are closed
+};
+
+struct ProcessShare
+{
+	DWORD pid = 0;
+	std::wstring name;
+	double ghzSeconds = 0.0;
+	double boostedGhzSeconds = 0.0;
+	double throttledGhzSeconds = 0.0;
+	double cpuSeconds = 0.0;
+};
+
+class ProcessAttribution
+{
+public:
+	ProcessAttribution() = default;
+	~ProcessAttribution();
+	ProcessAttribution(const ProcessAttribution&) = delete;
+	ProcessAttribution& operator=(const ProcessAttribution&) = delete;
+
+	void Start(std::unique_ptr<ProcessSource> source, const AttributionConfig& config);
+	void Stop();
+	bool IsRunning() const { return source_ != nullptr; }
+
+	// Reads hot processes and the next slice of the PID list, charges their
+	// CPU time at this reading's clock and refreshes Top().
+	void Update(const CpuReading& r);
+
+	// Highest GHz-seconds first, at most topN.
+	const std::vector<ProcessShare>& Top() const { return top_; }
+
+	size_t KnownCount() const { return entries_.size(); }
+	size_t HotCount() const { return hot_.size(); }
+	// PIDs opened during the last Update (hot reads excluded).
+	size_t LastOpenCount() const { return lastOpens_; }
+
+private:
+	struct Entry
+	{
+		HANDLE handle = nullptr; // open while hot
+		uint64_t creation = 0;
+		uint64_t cpu = 0;        // last seen user + kernel time
+		uint64_t affinity = 0;
+		uint32_t generation = 0; // PID list it was last seen in
+		int idleTicks = 0;
+		bool seen = false;
+		bool charged = false;    // listed in charged_
+		ProcessShare share;
+	};
+
+	void Rescan(uint64_t nowMs);
+	void Visit(DWORD pid, Entry& e, const CpuReading& r);
+	void Charge(Entry& e, uint64_t cpuDelta, const CpuReading& r);
+	double ClockFor(const Entry& e, const CpuReading& r) const;
+	void Cool(Entry& e);
+
+	std::unique_ptr<ProcessSource> source_;
+	AttributionConfig config_;
+	std::unordered_map<DWORD, Entry> entries_;
+	std::vector<DWORD> pids_;    // from the last rescan
+	std::vector<DWORD> hot_;
+	std::vector<DWORD> charged_; // entries with non-zero totals
+	std::vector<ProcessShare> top_;
+	std::vector<const ProcessShare*> rank_;
+	size_t cursor_ = 0;
+	size_t lastOpens_ = 0;
+	uint32_t generation_ = 0;
+	uint64_t lastRescanMs_ = 0;
+	uint64_t lastUpdateMs_ = 0;
+};
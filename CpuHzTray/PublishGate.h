@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+
+// Decides whether a rendered tray frame is worth publishing (Shell_NotifyIcon).
+// - A frame whose pixel hash matches the last published one is skipped; only
+//   the tooltip goes out, and only if it changed.
+// - New frames are published at most every `minIntervalMs`. A frame held back
+//   by the budget leaves the gate pending, so the caller re-renders on the
+//   next tick even if its own redraw policy says nothing changed.
+// Time is whatever millisecond clock the caller uses (GetTickCount64).
+
+enum class PublishAction
+{
+	None,
+	TooltipOnly,
+	Icon, // icon and tooltip
+};
+
+class PublishGate
+{
+public:
+	explicit PublishGate(unsigned minIntervalMs = 250) { SetMinIntervalMs(minIntervalMs); }
+
+	// 0 = no rate limit.
+	void SetMinIntervalMs(unsigned ms) { minIntervalMs_ = ms; }
+	unsigned MinIntervalMs() const { return minIntervalMs_; }
+
+	// `frameHash` is the rendered frame (0 = nothing rendered this tick).
+	PublishAction Decide(uint64_t nowMs, uint64_t frameHash, bool tooltipChanged)
+	{
+		if(frameHash != 0)
+		{
+			if(frameHash == publishedHash_)
+			{
+				pending_ = false;
+				++skipped_;
+			}
+			else if(publishedHash_ != 0 && minIntervalMs_ > 0 && nowMs - lastPublishMs_ < minIntervalMs_)
+			{
+				pending_ = true;
+				++deferred_;
+			}
+			else
+			{
+				publishedHash_ = frameHash;
+				lastPublishMs_ = nowMs;
+				pending_ = false;
+				++published_;
+				return PublishAction::Icon;
+			}
+		}
+		return tooltipChanged ? PublishAction::TooltipOnly : PublishAction::None;
+	}
+
+	// Forgets the published frame (e.g. the icon was re-added after Explorer
+	// restarted), so the next frame is published regardless of its hash.
+	void Invalidate()
+	{
+		publishedHash_ = 0;
+		pending_ = false;
+	}
+
+	bool Pending() const { return pending_; }
+	uint64_t PublishedCount() const { return published_; }
+	uint64_t SkippedCount() const { return skipped_; }   // identical to the published frame
+	uint64_t DeferredCount() const { return deferred_; } // held back by the rate limit
+
+private:
+	unsigned minIntervalMs_ = 250;
+	uint64_t publishedHash_ = 0;
+	uint64_t lastPublishMs_ = 0;
+	uint64_t published_ = 0;
+	uint64_t skipped_ = 0;
+	uint64_t deferred_ = 0;
+	bool pending_ = false;
+};
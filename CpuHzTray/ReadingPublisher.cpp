@@ -0,0 +1,86 @@
+#include "ReadingPublisher.h"
+#include "CpuFrequency.h"
+
+#include <cstring>
+
+void FillShmReading(CpuHzShmReading& out, const CpuReading& r, uint64_t sampleIndex, bool perCore)
+{
+	out.timeUnixMs = r.timeUnixMs;
+	out.sampleIndex = sampleIndex;
+	out.avgMHz = r.avgMHz;
+	out.maxMHz = r.maxMHz;
+	out.minMHz = r.minMHz;
+	out.baseMHz = r.baseMHz;
+	out.validCoreCount = r.validCoreCount;
+	out.ok = r.ok ? 1 : 0;
+	out.nominalLike = r.nominalLike ? 1 : 0;
+	out.lastPdhStatus = (int32_t)r.lastPdhStatus;
+	out.lastPdhCStatus = (uint32_t)r.lastPdhCStatus;
+	wcsncpy_s(out.source, r.source.c_str(), _TRUNCATE);
+
+	int n = 0;
+	if(perCore)
+	{
+		n = (int)std::min<size_t>(r.perCoreMHz.size(), CPUHZ_SHM_MAX_CORES);
+		for(int i = 0; i < n; ++i)
+			out.perCoreMHz[i] = (float)r.perCoreMHz[(size_t)i];
+	}
+	out.perCoreCount = n;
+}
+
+ReadingPublisher::~ReadingPublisher()
+{
+	Close();
+}
+
+bool ReadingPublisher::Open(const wchar_t* name)
+{
+	Close();
+
+	mapping_ = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)sizeof(CpuHzShmSegment), name);
+	if(!mapping_)
+		return false;
+
+	segment_ = static_cast<CpuHzShmSegment*>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(CpuHzShmSegment)));
+	if(!segment_)
+	{
+		Close();
+		return false;
+	}
+
+	// Readers validate the header before touching the reading; seq stays 0
+	// ("nothing published") until the first Publish().
+	memset((void*)segment_, 0, sizeof(CpuHzShmSegment));
+	segment_->magic = CPUHZ_SHM_MAGIC;
+	segment_->version = CPUHZ_SHM_VERSION;
+	segment_->size = (uint32_t)sizeof(CpuHzShmSegment);
+	segment_->maxCores = CPUHZ_SHM_MAX_CORES;
+	return true;
+}
+
+void ReadingPublisher::Close()
+{
+	if(segment_)
+	{
+		UnmapViewOfFile(segment_);
+		segment_ = nullptr;
+	}
+	if(mapping_)
+	{
+		CloseHandle(mapping_);
+		mapping_ = nullptr;
+	}
+}
+
+void ReadingPublisher::Publish(const CpuReading& r)
+{
+	if(!segment_)
+		return;
+
+	// Seqlock write: odd while writing, even when consistent. The interlocked
+	// increments are full barriers, so the record is never observed half-written
+	// with an unchanged even sequence.
+	InterlockedIncrement(&segment_->seq);
+	FillShmReading(segment_->reading, r, ++sampleIndex_, publishPerCore_);
+	InterlockedIncrement(&segment_->seq);
+}
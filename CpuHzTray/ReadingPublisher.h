@@ -0,0 +1,38 @@
+#pragma once
+#include <windows.h>
+
+#include <cstdint>
+
+#include "../CpuHzShm/CpuHzShm.h"
+
+struct CpuReading;
+
+// Publishes each CpuReading into a named shared-memory segment (CpuHzShm.h)
+// under a seqlock, so other local processes can read the current frequency
+// without running their own PDH/WMI queries. Writes never wait on readers.
+class ReadingPublisher
+{
+public:
+	ReadingPublisher() = default;
+	~ReadingPublisher();
+	ReadingPublisher(const ReadingPublisher&) = delete;
+	ReadingPublisher& operator=(const ReadingPublisher&) = delete;
+
+	bool Open(const wchar_t* name = CPUHZ_SHM_NAME);
+	void Close();
+	bool IsOpen() const { return segment_ != nullptr; }
+
+	// Per-core values are optional (they add up to 8 KB per write).
+	void SetPublishPerCore(bool on) { publishPerCore_ = on; }
+
+	void Publish(const CpuReading& r);
+
+private:
+	HANDLE mapping_ = nullptr;
+	CpuHzShmSegment* segment_ = nullptr;
+	bool publishPerCore_ = false;
+	uint64_t sampleIndex_ = 0;
+};
+
+// Fills a shared-memory reading record (everything except the seqlock).
+void FillShmReading(CpuHzShmReading& out, const CpuReading& r, uint64_t sampleIndex, bool perCore);
@@ -0,0 +1,162 @@
+#include "SelfOverhead.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cwchar>
+
+const wchar_t* OverheadProbeName(OverheadProbe p)
+{
+	switch(p)
+	{
+	case OverheadProbe::PowerInformation: return L"PowerInformation";
+	case OverheadProbe::PdhCollect: return L"PdhCollectQueryData";
+	case OverheadProbe::PerCorePerf: return L"PDH-PerCore-Perf";
+	case OverheadProbe::TotalPerf: return L"PDH-Total-Perf";
+	case OverheadProbe::ProcessorFrequency: return L"PDH-ProcessorFrequency";
+	case OverheadProbe::ProcessorTimes: return L"ProcessorTimes";
+	case OverheadProbe::Select: return L"ChooseBestCandidate";
+	case OverheadProbe::Read: return L"Read";
+	case OverheadProbe::Tick: return L"Tick";
+	case OverheadProbe::Render: return L"Render";
+	case OverheadProbe::TickLateness: return L"TickLateness";
+	case OverheadProbe::TickToPublish: return L"TickToPublish";
+	case OverheadProbe::Alerts: return L"AlertRules";
+	case OverheadProbe::BurstSample: return L"BurstSample";
+	case OverheadProbe::Attribution: return L"ProcessAttribution";
+	default: return L"?";
+	}
+}
+
+SelfOverhead::SelfOverhead()
+{
+	minuteStartCpu100ns_ = ProcessCpu100ns();
+}
+
+SelfOverhead::~SelfOverhead()
+{
+	if(log_)
+	{
+		fclose(log_);
+		log_ = nullptr;
+	}
+}
+
+double SelfOverhead::TicksToUs(int64_t ticks)
+{
+	static const double usPerTick = []
+	{
+		LARGE_INTEGER f{};
+		QueryPerformanceFrequency(&f);
+		return f.QuadPart > 0 ? 1e6 / (double)f.QuadPart : 0.0;
+	}();
+	return (double)ticks * usPerTick;
+}
+
+uint64_t SelfOverhead::ProcessCpu100ns()
+{
+	FILETIME created{}, exited{}, kernel{}, user{};
+	if(!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+		return 0;
+	auto k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+	auto u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+	return k + u;
+}
+
+void SelfOverhead::Record(OverheadProbe p, double us)
+{
+	if(p < OverheadProbe::PowerInformation || p >= OverheadProbe::Count)
+		return;
+	hist_[(int)p].Record(us);
+}
+
+void SelfOverhead::SampleProcessCpu(uint64_t nowUnixMs)
+{
+	if(minuteStartMs_ == 0 || nowUnixMs < minuteStartMs_)
+	{
+		minuteStartMs_ = nowUnixMs;
+		minuteStartCpu100ns_ = ProcessCpu100ns();
+		return;
+	}
+
+	const uint64_t elapsedMs = nowUnixMs - minuteStartMs_;
+	if(elapsedMs < 60000)
+		return;
+
+	// Normalize to one minute so a late tick (or a long sleep) does not skew it.
+	const uint64_t cpu = ProcessCpu100ns();
+	const double usedMs = (double)(cpu - minuteStartCpu100ns_) / 10000.0;
+	lastMinuteCpuMs_ = usedMs * 60000.0 / (double)elapsedMs;
+	cpuMsPerMinute_.Push((float)lastMinuteCpuMs_);
+
+	minuteStartMs_ = nowUnixMs;
+	minuteStartCpu100ns_ = cpu;
+
+	WriteLogRows(nowUnixMs);
+}
+
+void SelfOverhead::CountSourceReads(int read, int skipped)
+{
+	++readTicks_;
+	sourceReads_ += (uint64_t)std::max(read, 0);
+	skippedReads_ += (uint64_t)std::max(skipped, 0);
+}
+
+std::wstring SelfOverhead::Summary() const
+{
+	// Parts in priority order; one that would pass kSummaryMaxChars is left
+	// out whole, as the tooltip does with lines.
+	std::wstring line;
+	auto append = [&line](const wchar_t* format, auto... args)
+	{
+		wchar_t part[64]{};
+		if(swprintf_s(part, format, args...) > 0 && line.size() + wcslen(part) <= kSummaryMaxChars)
+			line += part;
+	};
+	const auto& tick = Histogram(OverheadProbe::Tick);
+	const auto& late = Histogram(OverheadProbe::TickLateness);
+	if(late.Count() > 0)
+		append(L"Self: %.2f/%.2f ms p99", tick.PercentileUs(0.99) / 1000.0, late.PercentileUs(0.99) / 1000.0);
+	else
+		append(L"Self: %.2f ms p99", tick.PercentileUs(0.99) / 1000.0);
+	if(missedTicks_ > 0)
+		append(L", %llu missed", (unsigned long long)missedTicks_);
+	if(lastMinuteCpuMs_ >= 0.0)
+		append(L", %.0f ms CPU/min", lastMinuteCpuMs_);
+	if(readTicks_ > 0)
+		append(L", %.1f reads/tick skipped", SkippedReadsPerTick());
+	if(framesSkipped_ > 0)
+		append(L", %.0f%% frames skipped", 100.0 * (double)framesSkipped_ / (double)(framesSkipped_ + framesPublished_));
+	return line;
+}
+
+bool SelfOverhead::OpenLog(const wchar_t* path)
+{
+	if(log_)
+	{
+		fclose(log_);
+		log_ = nullptr;
+	}
+	if(_wfopen_s(&log_, path, L"w") != 0 || !log_)
+	{
+		log_ = nullptr;
+		return false;
+	}
+	fwprintf(log_, L"timeUnixMs,probe,count,meanUs,p50Us,p99Us,p999Us,maxUs,cpuMsLastMinute\n");
+	fflush(log_);
+	return true;
+}
+
+void SelfOverhead::WriteLogRows(uint64_t nowUnixMs)
+{
+	if(!log_) return;
+	for(int i = 0; i < (int)OverheadProbe::Count; ++i)
+	{
+		const HdrSnapshot h = hist_[i].Snapshot();
+		if(h.count == 0) continue;
+		fwprintf(log_, L"%llu,%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f\n",
+			(unsigned long long)nowUnixMs, OverheadProbeName((OverheadProbe)i),
+			(unsigned long long)h.count, h.meanUs, h.p50Us, h.p99Us, h.p999Us, h.maxUs,
+			lastMinuteCpuMs_);
+	}
+	fflush(log_);
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <windows.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "HdrHistogram.h"
+#include "HistoryBuffer.h"
+
+// Always-on measurement of the monitor's own cost, so sources can be chosen
+// by what they actually cost and the tray can be shown not to perturb the
+// clock it measures.
+// - Per-probe HDR latency histograms (QueryPerformanceCounter, ~20 ns per
+//   scope); Record() is lock-free.
+// - Own process CPU time (GetProcessTimes), closed into per-minute buckets.
+// Everything except Record() is single-threaded: call it from the thread
+// that samples.
+
+enum class OverheadProbe : int
+{
+	PowerInformation,   // CallNtPowerInformation
+	PdhCollect,         // PdhCollectQueryData
+	PerCorePerf,        // per-core % Processor Performance array
+	TotalPerf,          // _Total % Processor Performance
+	ProcessorFrequency, // per-core Processor Frequency array
+	ProcessorTimes,     // per-processor idle/busy times (utilization weighting)
+	Select,             // ChooseBestCandidate
+	Read,               // CpuFrequency::Read as a whole
+	Tick,               // whole timer tick (read, history, tooltip, icon)
+	Render,             // IconRenderer::Render
+	TickLateness,       // tick start vs its scheduled deadline
+	TickToPublish,      // scheduled deadline to reading published (shm, metrics)
+	Alerts,             // AlertEngine::Update
+	BurstSample,        // one burst-capture sample (capture thread)
+	Attribution,        // ProcessAttribution::Update
+	Count
+};
+
+const wchar_t* OverheadProbeName(OverheadProbe p);
+
+class SelfOverhead
+{
+public:
+	SelfOverhead();
+	~SelfOverhead();
+	SelfOverhead(const SelfOverhead&) = delete;
+	SelfOverhead& operator=(const SelfOverhead&) = delete;
+
+	void Record(OverheadProbe p, double us);
+	const HdrHistogram& Histogram(OverheadProbe p) const { return hist_[(int)p]; }
+
+	// Call once per tick. Closes a one-minute CPU bucket every 60 s of wall
+	// time and, if a log is open, appends that minute's summary to it.
+	void SampleProcessCpu(uint64_t nowUnixMs);
+
+	// CPU time (user + kernel) spent in the last closed minute; -1 before the
+	// first minute closes.
+	double LastMinuteCpuMs() const { return lastMinuteCpuMs_; }
+	const RingBuffer<float, 60>& CpuMsPerMinute() const { return cpuMsPerMinute_; }
+
+	// Source reads done and skipped by lazy evaluation in one Read().
+	void CountSourceReads(int read, int skipped);
+	double SkippedReadsPerTick() const { return readTicks_ ? (double)skippedReads_ / (double)readTicks_ : 0.0; }
+	double SourceReadsPerTick() const { return readTicks_ ? (double)sourceReads_ / (double)readTicks_ : 0.0; }
+
+	// Scheduler deadlines skipped so far (TickScheduler::MissedDeadlines).
+	void SetMissedTicks(uint64_t missed) { missedTicks_ = missed; }
+	uint64_t MissedTicks() const { return missedTicks_; }
+
+	// Tray frames handed to the shell, and rendered frames that were not
+	// (identical to the last one, or over the publish rate) (PublishGate).
+	void SetFrameCounts(uint64_t published, uint64_t skipped) { framesPublished_ = published; framesSkipped_ = skipped; }
+	uint64_t FramesPublished() const { return framesPublished_; }
+	uint64_t FramesSkipped() const { return framesSkipped_; }
+
+	// One short line for the tooltip, at most kSummaryMaxChars, e.g.
+	// "Self: 0.84/0.12 ms p99, 41 ms CPU/min, 2.9 reads/tick skipped": tick and
+	// lateness p99, then (as room allows) missed deadlines, CPU per minute,
+	// skipped source reads and skipped frames.
+	static constexpr size_t kSummaryMaxChars = 64;
+	std::wstring Summary() const;
+
+	// CSV of per-probe stats, one block of rows per closed minute.
+	bool OpenLog(const wchar_t* path);
+	void WriteLogRows(uint64_t nowUnixMs);
+
+	static double TicksToUs(int64_t ticks);
+
+private:
+	static uint64_t ProcessCpu100ns();
+
+	HdrHistogram hist_[(int)OverheadProbe::Count];
+	uint64_t minuteStartMs_ = 0;
+	uint64_t minuteStartCpu100ns_ = 0;
+	double lastMinuteCpuMs_ = -1.0;
+	RingBuffer<float, 60> cpuMsPerMinute_; // last hour
+	uint64_t readTicks_ = 0;
+	uint64_t sourceReads_ = 0;
+	uint64_t skippedReads_ = 0;
+	uint64_t missedTicks_ = 0;
+	uint64_t framesPublished_ = 0;
+	uint64_t framesSkipped_ = 0;
+	FILE* log_ = nullptr;
+};
+
+// Records the lifetime of the scope into `o` and/or `outUs` (no-op when
+// both are null).
+class OverheadScope
+{
+public:
+	OverheadScope(SelfOverhead* o, OverheadProbe p, double* outUs = nullptr)
+		: o_(o), p_(p), outUs_(outUs)
+	{
+		if(o_ || outUs_) QueryPerformanceCounter(&start_);
+	}
+
+	~OverheadScope()
+	{
+		if(!o_ && !outUs_) return;
+		LARGE_INTEGER end;
+		QueryPerformanceCounter(&end);
+		const double us = SelfOverhead::TicksToUs(end.QuadPart - start_.QuadPart);
+		if(o_) o_->Record(p_, us);
+		if(outUs_) *outUs_ = us;
+	}
+
+	// Time since the scope started (0 when it records nowhere).
+	double ElapsedUs() const
+	{
+		if(!o_ && !outUs_) return 0.0;
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		return SelfOverhead::TicksToUs(now.QuadPart - start_.QuadPart);
+	}
+
+	OverheadScope(const OverheadScope&) = delete;
+	OverheadScope& operator=(const OverheadScope&) = delete;
+
+private:
+	SelfOverhead* o_;
+	OverheadProbe p_;
+	double* outUs_;
+	LARGE_INTEGER start_{};
+};
@@ -0,0 +1,157 @@
+#pragma once
+#include <windows.h>
+
+#include <algorithm>
+#include <cmath>
+
+// Per-source health, so sources that are consistently useless stop being
+// collected every tick.
+// - Tracks failure rate, consecutive failures, how long the source has been
+//   stuck at base while another source is live, value spread and read cost.
+// - A source that keeps failing, or stays NominalLike while another source
+//   moves, is suspended; it is re-probed for a few reads after a backoff
+//   that doubles on every failed probe.
+// Times are monotonic milliseconds (GetTickCount64).
+
+enum class SourceHealthState
+{
+	Active,
+	Suspended,
+	Probing
+};
+
+enum class SuspendReason
+{
+	None,
+	Failing,
+	StuckAtBase
+};
+
+struct SourceHealthPolicy
+{
+	int failuresToSuspend = 30;                // consecutive failed reads
+	ULONGLONG stuckToSuspendMs = 10 * 60000;   // NominalLike while another source is live
+	ULONGLONG firstBackoffMs = 60000;
+	ULONGLONG maxBackoffMs = 30 * 60000;
+	int probeReads = 3;                        // reads per re-probe
+};
+
+class SourceHealth
+{
+public:
+	SourceHealth() = default;
+	explicit SourceHealth(const SourceHealthPolicy& policy)
+		: policy_(policy), nextBackoffMs_(policy.firstBackoffMs)
+	{
+	}
+
+	// Whether to read the source this tick. Starts a probe once a suspended
+	// source's backoff has elapsed.
+	bool ShouldRead(ULONGLONG nowMs)
+	{
+		if(state_ == SourceHealthState::Suspended && nowMs >= resumeAtMs_)
+		{
+			state_ = SourceHealthState::Probing;
+			probeReadsLeft_ = policy_.probeReads;
+		}
+		return state_ != SourceHealthState::Suspended;
+	}
+
+	// Feeds the outcome of one read. `nominalLike` is the source's window
+	// verdict after this read; `otherLive` is true if another source is
+	// currently not NominalLike.
+	void OnRead(ULONGLONG nowMs, bool ok, double valueMHz, bool nominalLike, bool otherLive, double costUs)
+	{
+		constexpr double kAlpha = 1.0 / 32.0;
+		failureRate_ += kAlpha * ((ok ? 0.0 : 1.0) - failureRate_);
+		costUs_ = reads_ == 0 ? costUs : costUs_ + kAlpha * (costUs - costUs_);
+		++reads_;
+		if(ok && okReads_++ == 0)
+		{
+			meanMHz_ = valueMHz;
+		}
+		else if(ok)
+		{
+			// Exponentially weighted mean/variance of the value.
+			const double d = valueMHz - meanMHz_;
+			meanMHz_ += kAlpha * d;
+			varMHz2_ = (1.0 - kAlpha) * (varMHz2_ + kAlpha * d * d);
+		}
+
+		consecutiveFailures_ = ok ? 0 : consecutiveFailures_ + 1;
+		const bool stuck = ok && nominalLike && otherLive;
+		if(!stuck)
+			stuckSinceMs_ = 0;
+		else if(stuckSinceMs_ == 0)
+			stuckSinceMs_ = nowMs;
+
+		if(state_ == SourceHealthState::Probing)
+		{
+			if(ok && !stuck)
+			{
+				state_ = SourceHealthState::Active;
+				reason_ = SuspendReason::None;
+				nextBackoffMs_ = policy_.firstBackoffMs;
+				stuckSinceMs_ = 0;
+			}
+			else if(--probeReadsLeft_ <= 0)
+			{
+				Suspend(nowMs, ok ? SuspendReason::StuckAtBase : SuspendReason::Failing);
+			}
+			return;
+		}
+
+		if(state_ != SourceHealthState::Active)
+			return;
+		if(consecutiveFailures_ >= policy_.failuresToSuspend)
+			Suspend(nowMs, SuspendReason::Failing);
+		else if(stuck && nowMs - stuckSinceMs_ >= policy_.stuckToSuspendMs)
+			Suspend(nowMs, SuspendReason::StuckAtBase);
+	}
+
+	SourceHealthState State() const { return state_; }
+	SuspendReason Reason() const { return reason_; }
+	bool IsSuspended() const { return state_ == SourceHealthState::Suspended; }
+	ULONGLONG ResumeAtMs() const { return resumeAtMs_; }
+
+	double FailureRate() const { return failureRate_; }
+	double StdDevMHz() const { return std::sqrt(varMHz2_); }
+	double CostUs() const { return costUs_; }
+	ULONGLONG StuckMs(ULONGLONG nowMs) const { return stuckSinceMs_ ? nowMs - stuckSinceMs_ : 0; }
+
+	static const wchar_t* ReasonText(SuspendReason r)
+	{
+		switch(r)
+		{
+		case SuspendReason::Failing: return L"failing";
+		case SuspendReason::StuckAtBase: return L"stuck at base";
+		default: return L"";
+		}
+	}
+
+private:
+	void Suspend(ULONGLONG nowMs, SuspendReason reason)
+	{
+		state_ = SourceHealthState::Suspended;
+		reason_ = reason;
+		resumeAtMs_ = nowMs + nextBackoffMs_;
+		nextBackoffMs_ = std::min(nextBackoffMs_ * 2, policy_.maxBackoffMs);
+		probeReadsLeft_ = 0;
+	}
+
+	SourceHealthPolicy policy_;
+	SourceHealthState state_ = SourceHealthState::Active;
+	SuspendReason reason_ = SuspendReason::None;
+	ULONGLONG nextBackoffMs_ = SourceHealthPolicy{}.firstBackoffMs;
+	ULONGLONG resumeAtMs_ = 0;
+	int probeReadsLeft_ = 0;
+
+	unsigned long long reads_ = 0;
+	unsigned long long okReads_ = 0;
+	int consecutiveFailures_ = 0;
+	ULONGLONG stuckSinceMs_ = 0;
+	double failureRate_ = 0.0;
+	double meanMHz_ = 0.0;
+	double varMHz2_ = 0.0;
+	double costUs_ = 0.0;
+};
@@ -43,14 +43,13 @@ static Gdiplus::Color MakeArgb(BYTE a, COLORREF rgb)
 void DrawAreaSparklineGdiPlus(
 	HDC hdc,
 	const RECT& plotRcWin,
-	const double* samples,
-	int sampleCount,
+	const RingSpans<double>& samples,
 	double baseMHz,
 	const SparklineStyle& style
 )
 {
 	if(hdc == nullptr) return;
-	if(samples == nullptr) return;
+	const int sampleCount = (int)samples.size();
 	if(sampleCount < 2) return;
 
 	int w = plotRcWin.right - plotRcWin.left;
@@ -74,12 +73,10 @@ void DrawAreaSparklineGdiPlus(
 	const float halfH = (float)(bottom - top) / 2.0f;
 	const float dx = (float)(right - left) / (float)(sampleCount - 1);
 
-	// Copy values and compute robust stats.
-	std::vector<double> vals;
-	vals.reserve((size_t)sampleCount);
-	for(int i = 0; i < sampleCount; ++i) vals.push_back(samples[i]);
-
-	std::vector<double> sorted = vals;
+	// Robust stats need a sorted copy; the curve itself reads the ring spans directly.
+	std::vector<double> sorted;
+	sorted.reserve((size_t)sampleCount);
+	samples.ForEach([&](double v) { sorted.push_back(v); });
 	double p10 = Percentile(sorted, 0.10);
 	double p90 = Percentile(sorted, 0.90);
 	double median = Percentile(sorted, 0.50);
@@ -106,7 +103,7 @@ void DrawAreaSparklineGdiPlus(
 
 	for(int i = 0; i < sampleCount; ++i)
 	{
-		double v = vals[(size_t)i];
+		double v = samples[(size_t)i];
 		double d = (v - base) / halfRange;
 		d = ClampD(d, -1.0, 1.0);
 
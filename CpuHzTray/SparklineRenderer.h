@@ -2,6 +2,8 @@
 
 #include <windows.h>
 
+#include "HistoryBuffer.h"
+
 // No GDI+ types in this header (avoids build issues in translation units that
 // include this before <gdiplus.h>). Implementation uses GDI+ internally.
 
@@ -41,13 +43,12 @@ struct SparklineStyle
 };
 
 // Draw a baseline-centered smooth line curve sparkline into plotRc on the given HDC.
-// samples must be ordered oldest->newest.
+// samples are read in place (oldest->newest) from the ring's two spans.
 // baseMHz is the baseline value; if baseMHz <= 0, median(samples) is used.
 void DrawAreaSparklineGdiPlus(
 	HDC hdc,
 	const RECT& plotRc,
-	const double* samples,
-	int sampleCount,
+	const RingSpans<double>& samples,
 	double baseMHz,
 	const SparklineStyle& style
 );
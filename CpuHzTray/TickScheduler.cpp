@@ -0,0 +1,155 @@
+#include "TickScheduler.h"
+
+#include <algorithm>
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+uint64_t TickScheduler::Now()
+{
+	FILETIME ft;
+	GetSystemTimePreciseAsFileTime(&ft);
+	ULARGE_INTEGER t;
+	t.LowPart = ft.dwLowDateTime;
+	t.HighPart = ft.dwHighDateTime;
+	return t.QuadPart;
+}
+
+uint64_t TickScheduler::NextDeadline(uint64_t now, uint64_t interval, uint64_t prevDeadline, uint64_t& missed)
+{
+	interval = std::max<uint64_t>(interval, 1);
+	uint64_t after = prevDeadline ? prevDeadline : now;
+	if(prevDeadline > now + interval || (prevDeadline && prevDeadline < now && now - prevDeadline > kClockStepIntervals * interval))
+		after = now; // clock stepped back or forward
+	uint64_t next = (after / interval + 1) * interval;
+	if(next <= now)
+	{
+		missed += (now - next) / interval + 1;
+		next = (now / interval + 1) * interval;
+	}
+	return next;
+}
+
+bool TickScheduler::Start(HWND hwnd, UINT msg, unsigned intervalMs, bool raisePriority)
+{
+	Stop();
+	hwnd_ = hwnd;
+	msg_ = msg;
+	raisePriority_ = raisePriority;
+	interval_.store((uint64_t)std::max(intervalMs, 1u) * 10000);
+	pending_.store(false);
+
+	// High-resolution timers (Windows 10 1803+) are not rounded to the
+	// system timer tick; older systems get a regular waitable timer.
+	timer_ = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if(!timer_)
+		timer_ = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+	stop_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+	reschedule_ = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+	if(timer_ && stop_ && reschedule_)
+		thread_ = CreateThread(nullptr, 0, ThreadProc, this, 0, nullptr);
+	if(!thread_)
+	{
+		Stop();
+		return false;
+	}
+	return true;
+}
+
+void TickScheduler::Stop()
+{
+	if(thread_)
+	{
+		SetEvent(stop_);
+		WaitForSingleObject(thread_, INFINITE);
+		CloseHandle(thread_);
+		thread_ = nullptr;
+	}
+	for(HANDLE* h : { &timer_, &stop_, &reschedule_ })
+	{
+		if(*h)
+		{
+			CloseHandle(*h);
+			*h = nullptr;
+		}
+	}
+}
+
+void TickScheduler::SetInterval(unsigned intervalMs)
+{
+	const uint64_t interval = (uint64_t)std::max(intervalMs, 1u) * 10000;
+	if(interval_.exchange(interval) != interval && reschedule_)
+		SetEvent(reschedule_);
+}
+
+double TickScheduler::Acknowledge()
+{
+	pending_.store(false, std::memory_order_release);
+	const uint64_t deadline = deadline_.load(std::memory_order_relaxed);
+	const uint64_t now = Now();
+	return deadline && now > deadline ? (double)(now - deadline) / 10.0 : 0.0;
+}
+
+DWORD WINAPI TickScheduler::ThreadProc(LPVOID param)
+{
+	static_cast<TickScheduler*>(param)->Run();
+	return 0;
+}
+
+void TickScheduler::Run()
+{
+	if(raisePriority_)
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+	uint64_t deadline = 0;
+	const HANDLE handles[] = { stop_, reschedule_, timer_ };
+	for(;;)
+	{
+		uint64_t missed = 0;
+		deadline = NextDeadline(Now(), interval_.load(), deadline, missed);
+		if(missed)
+			missed_.fetch_add(missed, std::memory_order_relaxed);
+
+		// Positive due time = absolute FILETIME.
+		LARGE_INTEGER due;
+		due.QuadPart = (LONGLONG)deadline;
+		if(!SetWaitableTimer(timer_, &due, 0, nullptr, nullptr, FALSE))
+			return;
+
+		// An absolute timer follows the system clock: after a backward step
+		// it would not fire for as long as the step. Wake up anyway and let
+		// NextDeadline re-grid.
+		const DWORD timeoutMs = (DWORD)(interval_.load() / 10000 * 2 + 100);
+		const DWORD w = WaitForMultipleObjects(_countof(handles), handles, FALSE, timeoutMs);
+		if(w == WAIT_OBJECT_0 + 1)
+		{
+			// New interval: restart on its grid from now, nothing is missed.
+			deadline = 0;
+			continue;
+		}
+		if(w == WAIT_TIMEOUT)
+			continue;
+		if(w != WAIT_OBJECT_0 + 2)
+			return;
+
+		// Fired long after its deadline: the clock stepped forward (or the
+		// system resumed). Re-grid rather than post a tick hours late.
+		const uint64_t now = Now();
+		if(now > deadline && now - deadline > kClockStepIntervals * interval_.load())
+		{
+			deadline = 0;
+			continue;
+		}
+
+		// The window is still busy with the previous tick: skip this one.
+		if(pending_.exchange(true, std::memory_order_acq_rel))
+		{
+			missed_.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+		deadline_.store(deadline, std::memory_order_relaxed);
+		if(!PostMessageW(hwnd_, msg_, 0, 0))
+			pending_.store(false, std::memory_order_release);
+	}
+}
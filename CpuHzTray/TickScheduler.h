@@ -0,0 +1,66 @@
+#pragma once
+#include <windows.h>
+
+#include <atomic>
+#include <cstdint>
+
+// Sample ticks on absolute, wall-clock-aligned deadlines (multiples of the
+// interval since the FILETIME epoch, so 1 s ticks land on whole seconds).
+// - A dedicated thread waits on a high-resolution waitable timer armed with
+//   each absolute deadline, then posts `msg` to the window; SetTimer periods
+//   drift and get coalesced, which skews PDH rate counters.
+// - A deadline that has already passed when the next one is computed is
+//   counted as missed and skipped; so is a tick the window has not picked up
+//   yet (Acknowledge). Ticks never bunch up in the message queue.
+// - Interval changes re-arm immediately on the new boundary grid.
+// - A system clock step (a deadline more than an interval ahead of now, or
+//   more than kClockStepIntervals behind) re-grids from now; nothing counts
+//   as missed. The wait is bounded, so a backward step cannot stall ticks.
+// Times are FILETIME units (100 ns since 1601-01-01 UTC).
+
+class TickScheduler
+{
+public:
+	TickScheduler() = default;
+	~TickScheduler() { Stop(); }
+	TickScheduler(const TickScheduler&) = delete;
+	TickScheduler& operator=(const TickScheduler&) = delete;
+
+	// `raisePriority` runs the timer thread at time-critical priority.
+	bool Start(HWND hwnd, UINT msg, unsigned intervalMs, bool raisePriority);
+	void Stop();
+	bool IsRunning() const { return thread_ != nullptr; }
+
+	void SetInterval(unsigned intervalMs);
+
+	// Call when handling `msg`: re-enables posting and returns how late the
+	// tick is against its deadline, in microseconds.
+	double Acknowledge();
+
+	uint64_t MissedDeadlines() const { return missed_.load(std::memory_order_relaxed); }
+
+	static constexpr uint64_t kClockStepIntervals = 4;
+
+	// Next deadline on the `interval` grid strictly after `prevDeadline` (or
+	// after `now` when there is none, or the clock stepped). Deadlines
+	// already at or before `now` are skipped and added to `missed`.
+	static uint64_t NextDeadline(uint64_t now, uint64_t interval, uint64_t prevDeadline, uint64_t& missed);
+
+	static uint64_t Now();
+
+private:
+	static DWORD WINAPI ThreadProc(LPVOID param);
+	void Run();
+
+	HANDLE thread_ = nullptr;
+	HANDLE timer_ = nullptr;
+	HANDLE stop_ = nullptr;
+	HANDLE reschedule_ = nullptr;
+	HWND hwnd_ = nullptr;
+	UINT msg_ = 0;
+	bool raisePriority_ = false;
+	std::atomic<uint64_t> interval_{ 0 };
+	std::atomic<uint64_t> deadline_{ 0 }; // of the tick last posted
+	std::atomic<bool> pending_{ false };
+	std::atomic<uint64_t> missed_{ 0 };
+};
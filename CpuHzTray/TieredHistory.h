@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "HistoryBuffer.h"
+
+// Multi-resolution frequency history (1 s / 10 s / 1 min / 1 h buckets).
+// - Each tier is a fixed, preallocated ring of min/avg/max rollups.
+// - Push() updates the open bucket of every tier in place, which is the same
+//   as rolling up the tier below, in O(tiers) per sample.
+// - A bucket is keyed by its start time, so gaps (sleep, app not running)
+//   show up as missing buckets rather than stretched ones.
+// - The whole object is trivially copyable (no pointers), so it can live in a
+//   memory-mapped file.
+//
+// Memory: (3600 + 2160 + 10080 + 720) * 20 bytes ~= 323 KB.
+// Coverage: 1 h at 1 s, 6 h at 10 s, 7 days at 1 min, 30 days at 1 h.
+
+struct HistoryRollup
+{
+	uint32_t startSec = 0; // bucket start, unix seconds
+	uint32_t count = 0;    // raw samples folded into this bucket
+	float minMHz = 0.0f;
+	float avgMHz = 0.0f;
+	float maxMHz = 0.0f;
+};
+
+struct HistoryTierInfo
+{
+	uint32_t bucketSec;
+	size_t capacity;
+};
+
+class TieredHistory
+{
+public:
+	static constexpr int kTierCount = 4;
+	static constexpr HistoryTierInfo kTiers[kTierCount] = {
+		{ 1, 3600 },
+		{ 10, 2160 },
+		{ 60, 10080 },
+		{ 3600, 720 },
+	};
+
+	void Clear() noexcept
+	{
+		t0_.Clear();
+		t1_.Clear();
+		t2_.Clear();
+		t3_.Clear();
+		for(auto& s : sums_) s = 0.0;
+	}
+
+	void Push(uint64_t unixSec, double mhz) noexcept
+	{
+		if(mhz <= 0.0) return;
+		const auto t = (uint32_t)unixSec;
+		Fold(t0_, sums_[0], kTiers[0].bucketSec, t, mhz);
+		Fold(t1_, sums_[1], kTiers[1].bucketSec, t, mhz);
+		Fold(t2_, sums_[2], kTiers[2].bucketSec, t, mhz);
+		Fold(t3_, sums_[3], kTiers[3].bucketSec, t, mhz);
+	}
+
+	// Rollups of one tier, oldest->newest. The newest bucket may still be open.
+	RingSpans<HistoryRollup> Tier(int tier) const noexcept
+	{
+		switch(tier)
+		{
+		case 0: return t0_.Spans();
+		case 1: return t1_.Spans();
+		case 2: return t2_.Spans();
+		case 3: return t3_.Spans();
+		default: return {};
+		}
+	}
+
+	// The most recent `n` rollups of one tier, oldest->newest.
+	RingSpans<HistoryRollup> Latest(int tier, size_t n) const noexcept
+	{
+		switch(tier)
+		{
+		case 0: return t0_.Latest(n);
+		case 1: return t1_.Latest(n);
+		case 2: return t2_.Latest(n);
+		case 3: return t3_.Latest(n);
+		default: return {};
+		}
+	}
+
+	bool IsValid() const noexcept
+	{
+		return t0_.IsValid() && t1_.IsValid() && t2_.IsValid() && t3_.IsValid();
+	}
+
+	// Finest tier whose span covers `seconds`, or the coarsest tier.
+	static int TierForSpan(uint64_t seconds) noexcept
+	{
+		for(int i = 0; i < kTierCount; ++i)
+		{
+			if((uint64_t)kTiers[i].bucketSec * kTiers[i].capacity >= seconds)
+				return i;
+		}
+		return kTierCount - 1;
+	}
+
+	// Copies the avgMHz of the latest `n` rollups of a tier into `out`
+	// (oldest->newest) for renderers that plot plain doubles.
+	size_t CopyAvgMHz(int tier, size_t n, double* out) const noexcept
+	{
+		size_t i = 0;
+		Latest(tier, n).ForEach([&](const HistoryRollup& r) { out[i++] = r.avgMHz; });
+		return i;
+	}
+
+private:
+	template <size_t N>
+	static void Fold(RingBuffer<HistoryRollup, N>& ring, double& sum, uint32_t bucketSec, uint32_t t, double mhz) noexcept
+	{
+		const auto start = t - (t % bucketSec);
+		const auto v = (float)mhz;
+		if(ring.Count() == 0 || ring.Newest().startSec != start)
+		{
+			HistoryRollup r;
+			r.startSec = start;
+			r.count = 1;
+			r.minMHz = v;
+			r.avgMHz = v;
+			r.maxMHz = v;
+			ring.Push(r);
+			sum = mhz;
+			return;
+		}
+
+		auto& r = ring.Newest();
+		++r.count;
+		sum += mhz;
+		if(v < r.minMHz) r.minMHz = v;
+		if(v > r.maxMHz) r.maxMHz = v;
+		r.avgMHz = (float)(sum / r.count);
+	}
+
+	RingBuffer<HistoryRollup, kTiers[0].capacity> t0_;
+	RingBuffer<HistoryRollup, kTiers[1].capacity> t1_;
+	RingBuffer<HistoryRollup, kTiers[2].capacity> t2_;
+	RingBuffer<HistoryRollup, kTiers[3].capacity> t3_;
+	double sums_[kTierCount] = {}; // running sum of the open bucket per tier
+};
+
+static_assert(std::is_trivially_copyable_v<TieredHistory>);
@@ -0,0 +1,144 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+	struct TraceRing
+	{
+		DWORD threadId = 0;
+		std::atomic<uint64_t> written{ 0 }; // events ever written by the owner
+		TraceEvent events[kTraceRingCapacity];
+	};
+
+	// Rings are registered once per thread and never freed, so a dump can
+	// still show threads that have exited.
+	std::atomic<TraceRing*> g_rings[kTraceMaxThreads];
+	std::atomic<int> g_ringCount{ 0 };
+
+	TraceRing* ThreadRing()
+	{
+		thread_local TraceRing* ring = nullptr;
+		thread_local bool noSlot = false;
+		if(ring || noSlot)
+			return ring;
+
+		int slot = g_ringCount.fetch_add(1, std::memory_order_relaxed);
+		if(slot >= kTraceMaxThreads)
+		{
+			noSlot = true;
+			return nullptr;
+		}
+		ring = new TraceRing();
+		ring->threadId = GetCurrentThreadId();
+		g_rings[slot].store(ring, std::memory_order_release);
+		return ring;
+	}
+
+	struct EventCopy
+	{
+		const char* name;
+		int64_t startTicks;
+		int64_t endTicks;
+	};
+
+	void AppendEscaped(std::string& out, const char* s)
+	{
+		for(; s && *s; ++s)
+		{
+			if(*s == '"' || *s == '\\')
+				out += '\\';
+			out += (*s >= 0x20) ? *s : '?';
+		}
+	}
+}
+
+void TraceRecord(const char* name, int64_t startTicks, int64_t endTicks)
+{
+	TraceRing* ring = ThreadRing();
+	if(!ring)
+		return;
+
+	const uint64_t n = ring->written.load(std::memory_order_relaxed);
+	TraceEvent& e = ring->events[n % kTraceRingCapacity];
+
+	e.seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	e.name.store(name, std::memory_order_relaxed);
+	e.startTicks.store(startTicks, std::memory_order_relaxed);
+	e.endTicks.store(endTicks, std::memory_order_relaxed);
+	e.seq.store(n + 1, std::memory_order_release);
+	ring->written.store(n + 1, std::memory_order_release);
+}
+
+std::string FormatChromeTrace()
+{
+	LARGE_INTEGER freq{};
+	QueryPerformanceFrequency(&freq);
+	const double usPerTick = freq.QuadPart > 0 ? 1e6 / (double)freq.QuadPart : 0.0;
+	const DWORD pid = GetCurrentProcessId();
+
+	// Timestamps are relative to the earliest retained event.
+	int64_t origin = INT64_MAX;
+	const int rings = std::min(g_ringCount.load(std::memory_order_acquire), kTraceMaxThreads);
+	for(int r = 0; r < rings; ++r)
+	{
+		TraceRing* ring = g_rings[r].load(std::memory_order_acquire);
+		if(!ring) continue;
+		for(const auto& e : ring->events)
+		{
+			if(e.seq.load(std::memory_order_acquire) == 0) continue;
+			int64_t t = e.startTicks.load(std::memory_order_relaxed);
+			if(t < origin) origin = t;
+		}
+	}
+
+	std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	char num[160];
+	for(int r = 0; r < rings; ++r)
+	{
+		TraceRing* ring = g_rings[r].load(std::memory_order_acquire);
+		if(!ring) continue;
+
+		const uint64_t written = ring->written.load(std::memory_order_acquire);
+		const uint64_t begin = written > kTraceRingCapacity ? written - kTraceRingCapacity : 0;
+		for(uint64_t i = begin; i < written; ++i)
+		{
+			const TraceEvent& e = ring->events[i % kTraceRingCapacity];
+			if(e.seq.load(std::memory_order_acquire) != i + 1) continue;
+			EventCopy c{
+				e.name.load(std::memory_order_relaxed),
+				e.startTicks.load(std::memory_order_relaxed),
+				e.endTicks.load(std::memory_order_relaxed)
+			};
+			// Skip the slot if the owner started rewriting it during the copy.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(e.seq.load(std::memory_order_relaxed) != i + 1) continue;
+
+			if(!first) out += ',';
+			first = false;
+			out += "\n{\"name\":\"";
+			AppendEscaped(out, c.name);
+			snprintf(num, sizeof(num), "\",\"cat\":\"cpuhz\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%lu}",
+				(double)(c.startTicks - origin) * usPerTick,
+				(double)(c.endTicks - c.startTicks) * usPerTick,
+				(unsigned long)pid, (unsigned long)ring->threadId);
+			out += num;
+		}
+	}
+	out += "\n]}\n";
+	return out;
+}
+
+bool DumpChromeTrace(const wchar_t* path)
+{
+	FILE* f = nullptr;
+	if(_wfopen_s(&f, path, L"wb") != 0 || !f)
+		return false;
+	const std::string json = FormatChromeTrace();
+	bool ok = fwrite(json.data(), 1, json.size(), f) == json.size();
+	fclose(f);
+	return ok;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <windows.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Scoped hot-path trace markers, exported in Chrome trace event format
+// (load the JSON in chrome://tracing or https://ui.perfetto.dev).
+// - CPUHZ_TRACE_SCOPE("name") records one complete event for the enclosing
+//   scope; `name` must be a string literal.
+// - Each thread writes into its own fixed ring (no locks, no allocation after
+//   the thread's first marker); the newest kTraceRingCapacity events per
+//   thread are kept.
+// - Build with CPUHZ_ENABLE_TRACE=0 to compile every marker out.
+
+#ifndef CPUHZ_ENABLE_TRACE
+#define CPUHZ_ENABLE_TRACE 1
+#endif
+
+inline constexpr uint32_t kTraceRingCapacity = 4096; // events per thread
+inline constexpr int kTraceMaxThreads = 16;
+
+// One ring slot. Fields are relaxed atomics so a dump can run concurrently
+// with the owning thread; `seq` tells the dump whether the slot was complete.
+struct TraceEvent
+{
+	std::atomic<const char*> name{ nullptr };
+	std::atomic<int64_t> startTicks{ 0 }; // QueryPerformanceCounter
+	std::atomic<int64_t> endTicks{ 0 };
+	std::atomic<uint64_t> seq{ 0 }; // 1-based write index once complete; 0 = empty or being written
+};
+
+// Appends one event to the calling thread's ring.
+void TraceRecord(const char* name, int64_t startTicks, int64_t endTicks);
+
+// All threads' retained events as {"traceEvents":[...]} JSON.
+std::string FormatChromeTrace();
+
+// Writes FormatChromeTrace() to `path`.
+bool DumpChromeTrace(const wchar_t* path);
+
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* name)
+		: name_(name)
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		start_ = t.QuadPart;
+	}
+
+	~TraceScope()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		TraceRecord(name_, start_, t.QuadPart);
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* name_;
+	int64_t start_;
+};
+
+#if CPUHZ_ENABLE_TRACE
+#define CPUHZ_TRACE_CONCAT_(a, b) a##b
+#define CPUHZ_TRACE_CONCAT(a, b) CPUHZ_TRACE_CONCAT_(a, b)
+#define CPUHZ_TRACE_SCOPE(name) TraceScope CPUHZ_TRACE_CONCAT(cpuhzTraceScope_, __LINE__)(name)
+#else
+#define CPUHZ_TRACE_SCOPE(name) ((void)0)
+#endif
@@ -3,10 +3,14 @@
 #include <shellapi.h>
 
 constexpr UINT WMAPP_TRAY = WM_APP + 1;
+constexpr UINT WMAPP_TICK = WM_APP + 2; // TickScheduler deadline reached
 constexpr UINT_PTR TIMER_ID = 1;
 constexpr UINT TIMER_INTERVAL_MS = 1000;
 
 constexpr UINT ID_TRAY_EXIT = 1001;
+constexpr UINT ID_TRAY_SAVE_TRACE = 1002;
+constexpr UINT ID_TRAY_BURST_ARM = 1003;
+constexpr UINT ID_TRAY_BURST_TRIGGER = 1004;
 
 inline void SafeDestroyIcon(HICON& h) noexcept
 {
@@ -1,16 +1,37 @@
 #include "TrayApp.h"
+#include "AdaptiveInterval.h"
+#include "AlertEngine.h"
+#include "BurstCapture.h"
 #include "CpuFrequency.h"
+#include "CpuSimulator.h"
+#include "CpuTopology.h"
+#include "CpuUtilization.h"
 #include "IconRenderer.h"
+#include "MetricsServer.h"
+#include "PngEncoder.h"
+#include "ProcessAttribution.h"
+#include "PublishGate.h"
+#include "ReadingPublisher.h"
+#include "SelfOverhead.h"
+#include "SourceHealth.h"
+#include "TickScheduler.h"
+#include "Trace.h"
 
 #include "HistoryBuffer.h"
+#include "PersistentHistory.h"
+#include "TieredHistory.h"
 
 // GDI+ relies on COM declarations like IStream.
 #include <objidl.h>
 #include <gdiplus.h>
 
+#include <cstdarg>
+#include <map>
+#include <memory>
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <thread>
 
 static const wchar_t* kWndClass = L"CpuHzTray.HiddenWindow";
 
@@ -21,7 +42,25 @@ static UINT g_taskbarCreatedMsg = 0;
 
 static CpuFrequency g_cpu;
 static IconRenderer g_renderer;
-static RingBufferD<30> g_historyMHz;
+static PersistentHistory g_history; // sparkline + tiers, mapped from disk
+static ReadingPublisher g_publisher; // latest reading for other local processes
+static std::unique_ptr<MetricsExposition> g_metrics; // OpenMetrics body, serialized per sample
+static MetricsServer g_metricsServer;
+static bool g_metricsPerCore = false;
+static AdaptiveInterval g_interval; // sampling period, follows signal volatility
+static UINT g_timerMs = 0;
+static TickScheduler g_scheduler; // absolute-deadline ticks; SetTimer if it cannot start
+static bool g_samplerPriority = false;
+static SelfOverhead g_overhead; // own cost: per-source read, tick, render, CPU/min
+static bool g_showOverhead = false;
+static AlertEngine g_alerts; // user rules over the reading stream
+static FILE* g_alertLog = nullptr; // alerts.csv, opened on the first event
+static BurstCapture g_burst; // high-rate pre/post-trigger capture, off unless armed
+static BurstConfig g_burstConfig;
+static bool g_burstArmPending = false; // arm on the next reading (needs its base and source)
+static PublishGate g_publish; // skips unchanged tray frames, caps the icon update rate
+static bool g_iconSizeChanged = false; // DPI/monitor change: redraw on the next tick
+static ProcessAttribution g_attribution; // top processes by GHz-seconds, off unless --attribution
 
 static ULONG_PTR g_gdiplusToken = 0;
 
@@ -30,7 +69,23 @@ static constexpr GUID kTrayIconGuid =
 
 static double ToGhz(double mhz) { return mhz / 1000.0; }
 
+// Alert rule names and messages are UTF-8.
+static std::wstring Utf8ToWide(const std::string& s)
+{
+	if(s.empty())
+		return {};
+	const int n = MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0);
+	if(n <= 0)
+		return {};
+	std::wstring w((size_t)n, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), w.data(), n);
+	return w;
+}
+
 static constexpr bool kRedrawEverySampleForSparkline = false;
+// Periodic sparkline redraw, in wall time (converted to samples with the
+// current interval, see SamplesForDuration).
+static constexpr unsigned kSparklineRedrawMs = 3000;
 
 struct RedrawDecisionInput
 {
@@ -40,6 +95,7 @@ struct RedrawDecisionInput
 	int previousHistoryCount;
 	int currentHistoryCount;
 	int samplesSinceIconRedraw;
+	int redrawEverySamples = 3; // kSparklineRedrawMs at the current interval
 };
 
 struct RedrawDecision
@@ -66,8 +122,8 @@ static RedrawDecision ComputeRedrawDecision(const RedrawDecisionInput& in)
 		return d;
 	}
 
-	// 3. Throttled periodic redraw: redraw every 3 valid samples when sparkline is visible.
-	if(in.currentHistoryCount >= 2 && in.samplesSinceIconRedraw >= 3)
+	// 3. Throttled periodic redraw: every redrawEverySamples valid samples when sparkline is visible.
+	if(in.currentHistoryCount >= 2 && in.samplesSinceIconRedraw >= in.redrawEverySamples)
 	{
 		d.redrawIcon = true;
 		return d;
@@ -165,6 +221,22 @@ static bool RunRedrawDecisionTests()
 		auto d = ComputeRedrawDecision(in);
 		if(d.redrawIcon || d.updateTooltipOnly) return false;
 	}
+	// The throttle is wall time: 3 s is 12 samples at 250 ms, 1 at 4 s.
+	{
+		RedrawDecisionInput in{};
+		in.readingOk = true;
+		in.previousHistoryCount = 2;
+		in.currentHistoryCount = 3;
+		in.samplesSinceIconRedraw = 3;
+		in.redrawEverySamples = SamplesForDuration(kSparklineRedrawMs, 250);
+		if(in.redrawEverySamples != 12 || ComputeRedrawDecision(in).redrawIcon) return false;
+		in.samplesSinceIconRedraw = 12;
+		if(!ComputeRedrawDecision(in).redrawIcon) return false;
+		in.samplesSinceIconRedraw = 1;
+		in.redrawEverySamples = SamplesForDuration(kSparklineRedrawMs, 4000);
+		if(!ComputeRedrawDecision(in).redrawIcon) return false;
+		if(SamplesForDuration(kSparklineRedrawMs, 1000) != RedrawDecisionInput{}.redrawEverySamples) return false;
+	}
 	return true;
 }
 #endif
@@ -177,16 +249,1730 @@ static void FillTrayIconIdentity(NOTIFYICONDATAW& nid, HWND hwnd) noexcept
 	nid.guidItem = kTrayIconGuid;
 }
 
-#ifdef _DEBUG
-static bool RunTrayIdentityTests()
+#ifdef _DEBUG
+static bool RunTrayIdentityTests()
+{
+	NOTIFYICONDATAW nid{};
+	nid.cbSize = sizeof(nid);
+	FillTrayIconIdentity(nid, reinterpret_cast<HWND>(static_cast<UINT_PTR>(0x1234)));
+	if(nid.hWnd != reinterpret_cast<HWND>(static_cast<UINT_PTR>(0x1234))) return false;
+	if(nid.uID != 1) return false;
+	if((nid.uFlags & NIF_GUID) == 0) return false;
+	if(!IsEqualGUID(nid.guidItem, kTrayIconGuid)) return false;
+	return true;
+}
+#endif
+
+#ifdef _DEBUG
+static bool RunHistoryBufferTests()
+{
+	// Empty ring exposes two empty spans.
+	{
+		RingBuffer<double, 4> rb;
+		auto s = rb.Spans();
+		if(!s.empty() || !s.first.empty() || !s.second.empty()) return false;
+	}
+	// Not yet wrapped: one span, oldest->newest.
+	{
+		RingBuffer<double, 4> rb;
+		rb.Push(1.0);
+		rb.Push(2.0);
+		rb.Push(3.0);
+		auto s = rb.Spans();
+		if(s.first.size() != 3 || !s.second.empty()) return false;
+		if(s[0] != 1.0 || s[2] != 3.0) return false;
+	}
+	// Wrapped: two spans that continue each other, oldest->newest.
+	{
+		RingBuffer<double, 4> rb;
+		for(int i = 1; i <= 6; ++i)
+			rb.Push((double)i);
+		auto s = rb.Spans();
+		if(s.size() != 4 || s.first.size() != 2 || s.second.size() != 2) return false;
+		for(size_t i = 0; i < 4; ++i)
+			if(s[i] != (double)(i + 3) || rb.GetOldestToNewest(i) != s[i]) return false;
+		if(rb.Newest() != 6.0) return false;
+		auto l = rb.Latest(3);
+		if(l.size() != 3 || l[0] != 4.0 || l[2] != 6.0) return false;
+		l = rb.Latest(1);
+		if(l.size() != 1 || !l.first.empty() || l[0] != 6.0) return false;
+		double mn = 0.0, mx = 0.0;
+		rb.MinMax(mn, mx);
+		if(mn != 3.0 || mx != 6.0) return false;
+	}
+	// POD records and per-core rows.
+	{
+		struct Rec { float mhz; int cores; };
+		RingBuffer<Rec, 2> rb;
+		rb.Push({ 1000.0f, 4 });
+		rb.Push({ 2000.0f, 8 });
+		rb.Push({ 3000.0f, 16 });
+		auto s = rb.Spans();
+		if(s.size() != 2 || s[0].cores != 8 || s[1].mhz != 3000.0f) return false;
+
+		RingBuffer<std::array<float, 3>, 2> rows;
+		rows.Push({ 1.0f, 2.0f, 3.0f });
+		if(rows.Spans()[0][2] != 3.0f) return false;
+	}
+	return true;
+}
+#endif
+
+#ifdef _DEBUG
+static bool RunTieredHistoryTests()
+{
+	// Empty history exposes empty tiers.
+	{
+		static TieredHistory h;
+		for(int t = 0; t < TieredHistory::kTierCount; ++t)
+			if(!h.Tier(t).empty()) return false;
+		if(!h.Tier(TieredHistory::kTierCount).empty()) return false;
+	}
+	// Samples within one bucket fold into a single min/avg/max rollup.
+	{
+		static TieredHistory h;
+		h.Push(1000, 2000.0);
+		h.Push(1000, 3000.0);
+		auto t0 = h.Tier(0);
+		if(t0.size() != 1) return false;
+		if(t0[0].startSec != 1000 || t0[0].count != 2) return false;
+		if(t0[0].minMHz != 2000.0f || t0[0].maxMHz != 3000.0f || t0[0].avgMHz != 2500.0f) return false;
+		// Non-positive samples are ignored.
+		h.Push(1001, 0.0);
+		if(h.Tier(0).size() != 1) return false;
+	}
+	// Coarser tiers roll up the samples of the tier below.
+	{
+		static TieredHistory h;
+		for(uint64_t t = 3600; t < 3600 + 25; ++t)
+			h.Push(t, (double)(1000 + (t - 3600) * 10));
+		if(h.Tier(0).size() != 25) return false;
+		auto t1 = h.Tier(1);
+		if(t1.size() != 3) return false;
+		if(t1[0].startSec != 3600 || t1[0].count != 10) return false;
+		if(t1[0].minMHz != 1000.0f || t1[0].maxMHz != 1090.0f || t1[0].avgMHz != 1045.0f) return false;
+		if(t1[2].startSec != 3620 || t1[2].count != 5) return false;
+		auto t2 = h.Tier(2);
+		if(t2.size() != 1 || t2[0].count != 25 || t2[0].minMHz != 1000.0f || t2[0].maxMHz != 1240.0f) return false;
+		auto t3 = h.Tier(3);
+		if(t3.size() != 1 || t3[0].startSec != 3600 || t3[0].count != 25) return false;
+
+		auto latest = h.Latest(0, 3);
+		if(latest.size() != 3 || latest[2].avgMHz != 1240.0f) return false;
+		double avg[4]{};
+		if(h.CopyAvgMHz(1, 4, avg) != 3 || avg[0] != 1045.0) return false;
+	}
+	// Gaps leave missing buckets rather than stretched ones.
+	{
+		static TieredHistory h;
+		h.Push(100, 1000.0);
+		h.Push(105, 2000.0);
+		auto t0 = h.Tier(0);
+		if(t0.size() != 2 || t0[1].startSec != 105) return false;
+	}
+	// Tier selection by time span.
+	if(TieredHistory::TierForSpan(30) != 0) return false;
+	if(TieredHistory::TierForSpan(3 * 3600) != 1) return false;
+	if(TieredHistory::TierForSpan(7 * 24 * 3600) != 2) return false;
+	if(TieredHistory::TierForSpan(365ull * 24 * 3600) != 3) return false;
+	return true;
+}
+#endif
+
+#ifdef _DEBUG
+static bool RunPersistentHistoryTests()
+{
+	// Header round-trip and layout validation.
+	{
+		HistoryFileHeader h;
+		InitHistoryFileHeader(h, 1234);
+		if(!IsCompatibleHistoryFileHeader(h) || h.createdUnixMs != 1234) return false;
+		auto bad = h;
+		bad.magic = 0;
+		if(IsCompatibleHistoryFileHeader(bad)) return false;
+		bad = h;
+		bad.version = kHistoryFileVersion + 1;
+		if(IsCompatibleHistoryFileHeader(bad)) return false;
+		bad = h;
+		bad.imageSize -= 8;
+		if(IsCompatibleHistoryFileHeader(bad)) return false;
+		bad = h;
+		bad.tierCapacity[2] += 1;
+		if(IsCompatibleHistoryFileHeader(bad)) return false;
+	}
+	// Ring indices out of range make the image invalid.
+	{
+		auto img = std::make_unique<HistoryFileImage>();
+		InitHistoryFileHeader(img->header, 1234);
+		if(!IsValidHistoryImage(*img)) return false;
+		img->sparkline.Push(2000.0);
+		img->tiers.Push(1, 2000.0);
+		if(!IsValidHistoryImage(*img)) return false;
+		// count_ is the ring's last member.
+		const size_t badCount = SparklineHistory::Capacity() + 1;
+		memcpy(reinterpret_cast<char*>(&img->sparkline) + sizeof(img->sparkline) - sizeof(size_t), &badCount, sizeof(badCount));
+		if(img->sparkline.IsValid() || IsValidHistoryImage(*img)) return false;
+	}
+	// Without a file the same layout is kept in memory.
+	{
+		PersistentHistory h;
+		if(h.Open(nullptr, 5000) || h.IsMapped() || h.Restored()) return false;
+		if(!IsCompatibleHistoryFileHeader(h.Header())) return false;
+		h.Push(5000, 2000.0);
+		h.Push(6000, 3000.0);
+		if(h.Sparkline().Count() != 2 || h.Tiers().Tier(0).size() != 2) return false;
+		if(h.Header().lastSampleUnixMs != 6000 || h.Header().sampleCount != 2) return false;
+
+		// Sparkline stays one point per second: same-second samples replace the
+		// point, short gaps repeat it, long gaps are not bridged.
+		h.Push(6500, 3100.0);
+		if(h.Sparkline().Count() != 2 || h.Sparkline().Newest() != 3100.0) return false;
+		h.Push(9200, 2800.0);
+		if(h.Sparkline().Count() != 5) return false;
+		if(h.Sparkline().GetOldestToNewest(2) != 3100.0 || h.Sparkline().GetOldestToNewest(3) != 3100.0) return false;
+		h.Push(9000 + (kSparklineHoldMaxSec + 1) * 1000, 2900.0);
+		if(h.Sparkline().Count() != 6) return false;
+	}
+	return true;
+}
+#endif
+
+#ifdef _DEBUG
+static bool RunAdaptiveIntervalTests()
+{
+	AdaptiveIntervalConfig cfg;
+	cfg.minMs = 250;
+	cfg.baseMs = 1000;
+	cfg.maxMs = 4000;
+	cfg.flatSamplesPerStep = 3;
+	AdaptiveInterval a(cfg);
+	if(a.CurrentMs() != 1000) return false;
+
+	// Flat signal backs off one doubling per 3 samples, capped at max.
+	a.OnSample(true, 2500.0, 87.5);
+	for(int i = 0; i < 3; ++i) a.OnSample(true, 2510.0, 87.5);
+	if(a.CurrentMs() != 2000) return false;
+	for(int i = 0; i < 9; ++i) a.OnSample(true, 2500.0, 87.5);
+	if(a.CurrentMs() != 4000) return false;
+
+	// A material jump goes straight to the minimum.
+	if(a.OnSample(true, 3800.0, 87.5) != 250) return false;
+	if(a.OnSample(true, 2400.0, 87.5) != 250) return false;
+
+	// Failed readings fall back to base and forget the previous value.
+	if(a.OnSample(false, 0.0, 87.5) != 1000) return false;
+	if(a.OnSample(true, 4000.0, 87.5) != 1000) return false;
+
+	// Config is clamped: base within [min, max], max >= min.
+	cfg.minMs = 2000;
+	cfg.baseMs = 500;
+	cfg.maxMs = 1000;
+	a.SetConfig(cfg);
+	if(a.Config().maxMs != 2000 || a.CurrentMs() != 2000) return false;
+	return true;
+}
+#endif
+
+#ifdef _DEBUG
+static bool RunCpuTopologyTests()
+{
+	// 2 P-cores with SMT (class 1, 3.0 GHz, one L2 each), 4 E-cores (class 0,
+	// 2.2 GHz, one shared L2; one reports no MaxMhz) and one unknown processor.
+	const std::vector<int> cls = { 1, 1, 1, 1, 0, 0, 0, 0, -1 };
+	const std::vector<int> l2 = { 10, 10, 11, 11, 20, 20, 20, 20, -1 };
+	const std::vector<double> maxMHz = { 3000, 3000, 3000, 3000, 2200, 2200, 0, 2200, 0 };
+	CpuTopology t;
+	t.Build(cls, l2, maxMHz, 2500.0);
+	if(t.TypeCount() != 2 || !t.IsHybrid() || t.ClusterCount() != 3) return false;
+	if(t.TypeOf(0) != 0 || t.TypeOf(4) != 1 || t.TypeOf(8) != 1 || t.TypeOf(9) != -1) return false;
+	if(t.ClusterOf(2) != 1 || t.ClusterOf(8) != -1) return false;
+	if(t.TypeBaseMHz(0) != 3000.0 || t.TypeBaseMHz(1) != 2200.0 || t.BaseMHzOf(9) != 2500.0) return false;
+	if(wcscmp(t.TypeName(0), L"P-cores") != 0 || wcscmp(t.TypeName(1), L"E-cores") != 0) return false;
+	if(std::abs(t.WeightedBaseMHz() - (4 * 3000.0 + 5 * 2200.0) / 9) > 1e-9) return false;
+
+	CoreTypeStats s[kMaxCoreTypes];
+	const std::vector<double> mhz = { 4800, 4600, 0, 4700, 3600, 3400, 3500, 0 }; // shorter than the topology
+	if(t.Reduce(mhz, s, kMaxCoreTypes) != 2) return false;
+	if(s[0].validCoreCount != 3 || s[0].logicalCount != 4 || s[0].avgMHz != 4700.0 || s[0].maxMHz != 4800.0 || s[0].minMHz != 4600.0) return false;
+	if(s[1].validCoreCount != 3 || s[1].logicalCount != 5 || s[1].avgMHz != 3500.0 || s[1].baseMHz != 2200.0) return false;
+
+	// Extra classes merge into the slowest type; one class is not hybrid.
+	t.Build({ 3, 2, 1, 0 }, {}, {}, 2500.0);
+	if(t.TypeCount() != kMaxCoreTypes || t.TypeOf(3) != kMaxCoreTypes - 1 || t.TypeBaseMHz(2) != 2500.0) return false;
+	t.Build({ 0, 0 }, {}, {}, 2500.0);
+	if(t.IsHybrid() || wcscmp(t.TypeName(0), L"Cores") != 0) return false;
+	t.Build({}, {}, {}, 2500.0);
+	if(t.TypeCount() != 0 || t.Reduce(mhz, s, kMaxCoreTypes) != 0 || t.WeightedBaseMHz() != 2500.0) return false;
+
+	// Hierarchy: package 7 has two dies of two SMT cores; package 3 has no
+	// die info and processor 9 has no core id. Ids are sparse and unordered.
+	//                            cpu: 0   1   2   3   4   5   6   7   8   9
+	const std::vector<int> package =  { 7,  7,  7,  7,  7,  7,  7,  7,  3,  3 };
+	const std::vector<int> die =      { 0,  0,  0,  0,  5,  5,  5,  5, -1, -1 };
+	const std::vector<int> core =     { 1,  1,  2,  2,  9,  9,  8,  8,  4, -1 };
+	const std::vector<double> v =     { 4000, 4200, 3800, 0, 4100, 4100, 4300, 4300, 1500, 1700 };
+	t.BuildHierarchy(package, die, core);
+	if(t.PackageCount() != 2 || t.DieCount() != 3 || t.PhysicalCoreCount() != 6) return false;
+	TopologyStats ts;
+	t.ReduceHierarchy(v, ts);
+	// Sorted by id: package 3 first (one die; core-less processor 9 sorts
+	// before core 4), then package 7.
+	if(ts.packages[0].avgMHz != 1600.0 || ts.packages[0].logicalCount != 2) return false;
+	if(ts.packages[1].validCount != 7 || ts.packages[1].logicalCount != 8 || ts.packages[1].minMHz != 3800.0) return false;
+	if(ts.dies[0].parent != 0 || ts.dies[1].parent != 1 || ts.dies[2].parent != 1) return false;
+	if(ts.dies[1].avgMHz != 4000.0 || ts.dies[2].maxMHz != 4300.0) return false;
+	if(ts.cores[0].parent != 0 || ts.cores[0].avgMHz != 1700.0 || ts.cores[1].avgMHz != 1500.0) return false;
+	if(ts.cores[2].avgMHz != 4100.0 || ts.cores[2].logicalCount != 2) return false;
+	if(ts.cores[3].validCount != 1 || ts.cores[3].avgMHz != 3800.0) return false;
+	if(ts.cores[4].avgMHz != 4300.0 || ts.cores[5].avgMHz != 4100.0 || ts.cores[5].parent != 2) return false;
+	t.BuildHierarchy({}, {}, {});
+	t.ReduceHierarchy(v, ts);
+	return t.PackageCount() == 0 && ts.packages.empty() && ts.cores.empty();
+}
+#endif
+
+#ifdef _DEBUG
+static bool RunCpuUtilizationTests()
+{
+	// 1024-processor fixture: processor i was busy (i % 5) / 4 of the interval,
+	// i.e. 0, 25, 50, 75 and 100%. Times are 100 ns units; kernel includes idle.
+	constexpr int kProcs = 1024;
+	constexpr LONGLONG kInterval = 10000000; // 1 s
+	std::vector<SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION> prev(kProcs), cur(kProcs);
+	for(int i = 0; i < kProcs; ++i)
+	{
+		const LONGLONG busy = kInterval * (i % 5) / 4;
+		prev[i].IdleTime.QuadPart = 1000 + i;
+		prev[i].KernelTime.QuadPart = 5000 + i;
+		prev[i].UserTime.QuadPart = 700;
+		cur[i] = prev[i];
+		cur[i].IdleTime.QuadPart += kInterval - busy;
+		cur[i].KernelTime.QuadPart += kInterval - busy + busy / 2;
+		cur[i].UserTime.QuadPart += busy - busy / 2;
+	}
+	cur[1020] = prev[1020]; // no time passed: unknown
+	std::vector<double> busy(kProcs);
+	CpuUtilization::ComputeBusyFractions(prev.data(), cur.data(), kProcs, busy.data());
+	if(busy[0] != 0.0 || busy[1] != 0.25 || busy[4] != 1.0 || busy[1020] != -1.0) return false;
+
+	// Busy processors at 4 GHz, the idle ones report 1 GHz: the weighted
+	// value ignores idle processors where the plain average does not.
+	std::vector<double> mhz(kProcs);
+	for(int i = 0; i < kProcs; ++i)
+		mhz[i] = (i % 5) >= 2 ? 4000.0 : 1000.0;
+	const double w = CpuUtilization::BusyWeightedMHz(mhz, busy);
+	// Per 5 processors: 0.25 * 1000 + (0.5 + 0.75 + 1.0) * 4000 over a weight
+	// of 2.5 (the 4 trailing processors shift it by < 1 MHz).
+	if(std::abs(w - (0.25 * 1000.0 + 2.25 * 4000.0) / 2.5) > 1.0) return false;
+
+	// Nothing busy, no values, shorter inputs.
+	if(CpuUtilization::BusyWeightedMHz(mhz, std::vector<double>(kProcs, 0.0)) != 0.0) return false;
+	if(CpuUtilization::BusyWeightedMHz({}, busy) != 0.0) return false;
+	return CpuUtilization::BusyWeightedMHz({ 3000.0 }, busy) == 0.0 && CpuUtilization::BusyWeightedMHz({ 0.0, 3000.0 }, busy) == 3000.0;
+}
+#endif
+
+#ifdef _DEBUG
+static bool RunSourceHealthTests()
+{
+	SourceHealthPolicy p;
+	p.failuresToSuspend = 3;
+	p.stuckToSuspendMs = 10000;
+	p.firstBackoffMs = 1000;
+	p.maxBackoffMs = 4000;
+	p.probeReads = 2;
+
+	// Consecutive failures suspend; backoff doubles per failed probe, capped.
+	{
+		SourceHealth h(p);
+		ULONGLONG t = 0;
+		for(int i = 0; i < 3; ++i, t += 100)
+		{
+			if(!h.ShouldRead(t)) return false;
+			h.OnRead(t, false, 0.0, false, true, 10.0);
+		}
+		if(!h.IsSuspended() || h.Reason() != SuspendReason::Failing || h.ResumeAtMs() != 1200) return false;
+		if(h.ShouldRead(1199)) return false;
+		if(!h.ShouldRead(1200) || h.State() != SourceHealthState::Probing) return false;
+		h.OnRead(1200, false, 0.0, false, true, 10.0);
+		if(h.State() != SourceHealthState::Probing) return false;
+		h.OnRead(1300, false, 0.0, false, true, 10.0);
+		if(!h.IsSuspended() || h.ResumeAtMs() != 1300 + 2000) return false;
+		h.ShouldRead(3300);
+		h.OnRead(3300, false, 0.0, false, true, 10.0);
+		h.OnRead(3400, false, 0.0, false, true, 10.0);
+		if(h.ResumeAtMs() != 3400 + 4000) return false;
+		h.ShouldRead(7400);
+		h.OnRead(7400, false, 0.0, false, true, 10.0);
+		h.OnRead(7500, false, 0.0, false, true, 10.0);
+		if(h.ResumeAtMs() != 7500 + 4000) return false;
+
+		// A good probe read reactivates and resets the backoff.
+		h.ShouldRead(11500);
+		h.OnRead(11500, true, 3000.0, false, true, 10.0);
+		if(h.State() != SourceHealthState::Active || h.Reason() != SuspendReason::None) return false;
+		if(h.FailureRate() <= 0.0 || h.CostUs() != 10.0) return false;
+	}
+	// Stuck at base only counts while another source is live.
+	{
+		SourceHealth h(p);
+		h.OnRead(0, true, 2500.0, true, false, 5.0);
+		h.OnRead(20000, true, 2500.0, true, false, 5.0);
+		if(h.IsSuspended()) return false; // nothing else moves: keep it
+		h.OnRead(21000, true, 2500.0, true, true, 5.0);
+		h.OnRead(30000, true, 2500.0, true, true, 5.0);
+		if(h.IsSuspended() || h.StuckMs(30000) != 9000) return false;
+		h.OnRead(31000, true, 2500.0, true, true, 5.0);
+		if(!h.IsSuspended() || h.Reason() != SuspendReason::StuckAtBase) return false;
+		if(h.StdDevMHz() != 0.0) return false;
+
+		// Probe still stuck -> suspended again; moving value -> active.
+		h.ShouldRead(32000);
+		h.OnRead(32000, true, 2500.0, true, true, 5.0);
+		h.OnRead(33000, true, 2500.0, true, true, 5.0);
+		if(!h.IsSuspended() || h.ResumeAtMs() != 33000 + 2000) return false;
+		h.ShouldRead(35000);
+		h.OnRead(35000, true, 3400.0, false, true, 5.0);
+		if(h.State() != SourceHealthState::Active || h.StdDevMHz() <= 0.0) return false;
+	}
+	return true;
+}
+#endif
+
+#ifdef _DEBUG
+static bool RunSelfOverheadTests()
+{
+	// HDR buckets: 1 ns wide below 32 ns, then 16 per power of two; the last
+	// one is open-ended.
+	if(HdrHistogram::BucketFor(0) != 0 || HdrHistogram::BucketFor(31) != 31) return false;
+	if(HdrHistogram::BucketFor(32) != 32 || HdrHistogram::BucketFor(33) != 32) return false;
+	if(HdrHistogram::BucketFor(63) != 47 || HdrHistogram::BucketFor(64) != 48) return false;
+	if(HdrHistogram::BucketFor(~0ULL) != HdrHistogram::kBuckets - 1) return false;
+	for(uint64_t ns = 1; ns < (1ULL << 36); ns = ns * 3 / 2 + 1)
+	{
+		const int b = HdrHistogram::BucketFor(ns);
+		const uint64_t upper = HdrHistogram::BucketUpperNs(b);
+		if(upper <= ns || (double)(upper - ns) > (double)ns / HdrHistogram::kSub + 1.0) return false;
+		if(b > 0 && HdrHistogram::BucketUpperNs(b - 1) > ns) return false;
+	}
+
+	HdrHistogram h;
+	if(h.PercentileUs(0.5) != 0.0 || h.MeanUs() != 0.0) return false;
+	for(int i = 0; i < 98; ++i) h.Record(3.0);  // [2944, 3072) ns
+	h.Record(100.0);                             // [98304, 102400) ns
+	h.Record(700.0);
+	if(h.Count() != 100 || h.MaxUs() != 700.0) return false;
+	if(h.PercentileUs(0.5) != 3.072) return false;
+	if(h.PercentileUs(0.99) != 102.4) return false;
+	if(h.PercentileUs(0.999) != 700.0 || h.PercentileUs(1.0) != 700.0) return false; // clamped to the observed max
+	if(std::abs(h.MeanUs() - (98 * 3.0 + 800.0) / 100.0) > 1e-9) return false;
+	h.Record(0.2); // sub-microsecond values keep their resolution
+	if(h.PercentileUs(0.0) != 0.208) return false;
+
+	// Merging adds counts; recording is safe from several threads.
+	{
+		HdrHistogram m;
+		m.Record(5000.0);
+		m.Merge(h);
+		if(m.Count() != 102 || m.MaxUs() != 5000.0 || m.PercentileUs(0.5) != 3.072) return false;
+		HdrHistogram shared;
+		std::thread a([&] { for(int i = 0; i < 20000; ++i) shared.Record(1.0); });
+		for(int i = 0; i < 20000; ++i) shared.Record(2.0);
+		a.join();
+		const HdrSnapshot s = shared.Snapshot();
+		if(s.count != 40000 || s.maxUs != 2.0 || s.p50Us != 1.024 || s.p999Us != 2.0) return false;
+	}
+
+	SelfOverhead o;
+	o.Record(OverheadProbe::Tick, 500.0);
+	o.Record(OverheadProbe::Count, 1.0); // ignored
+	if(o.Histogram(OverheadProbe::Tick).Count() != 1) return false;
+	if(o.LastMinuteCpuMs() >= 0.0) return false;
+	o.SampleProcessCpu(1000);
+	o.SampleProcessCpu(31000);
+	if(o.LastMinuteCpuMs() >= 0.0) return false;
+	o.SampleProcessCpu(61000);
+	if(o.LastMinuteCpuMs() < 0.0 || o.CpuMsPerMinute().Count() != 1) return false;
+	if(o.Summary().rfind(L"Self: 0.50 ms p99, ", 0) != 0) return false;
+
+	o.CountSourceReads(1, 3); // PowerInformation decided
+	o.CountSourceReads(4, 0); // refresh
+	if(o.SourceReadsPerTick() != 2.5 || o.SkippedReadsPerTick() != 1.5) return false;
+	if(o.Summary().find(L", 1.5 reads/tick skipped") == std::wstring::npos) return false;
+
+	o.Record(OverheadProbe::TickLateness, 300.0);
+	o.SetMissedTicks(2);
+	std::wstring s = o.Summary();
+	if(s.rfind(L"Self: 0.50/0.30 ms p99, 2 missed, ", 0) != 0) return false;
+
+	// Parts that do not fit are left out; the line never grows past the cap.
+	o.SetMissedTicks(123456789012ULL);
+	o.SetFrameCounts(1, 3);
+	s = o.Summary();
+	return s.size() <= SelfOverhead::kSummaryMaxChars && s.find(L", 123456789012 missed") != std::wstring::npos
+		&& s.find(L"75% frames skipped") == std::wstring::npos;
+}
+#endif
+
+#ifdef _DEBUG
+static bool RunTickSchedulerTests()
+{
+	constexpr uint64_t kSec = 10000000; // FILETIME units
+	uint64_t missed = 0;
+	// First deadline is the next boundary strictly after now.
+	if(TickScheduler::NextDeadline(12 * kSec + 345, kSec, 0, missed) != 13 * kSec || missed) return false;
+	if(TickScheduler::NextDeadline(13 * kSec, kSec, 0, missed) != 14 * kSec || missed) return false;
+	// On time (or slightly early): the following boundary, nothing missed.
+	if(TickScheduler::NextDeadline(13 * kSec + 3, kSec, 13 * kSec, missed) != 14 * kSec || missed) return false;
+	if(TickScheduler::NextDeadline(13 * kSec - 3, kSec, 13 * kSec, missed) != 14 * kSec || missed) return false;
+	// Woken 2.5 intervals late: two deadlines are skipped, not run back to back.
+	if(TickScheduler::NextDeadline(15 * kSec + kSec / 2, kSec, 13 * kSec, missed) != 16 * kSec || missed != 2) return false;
+	// A shorter interval continues on its own grid.
+	missed = 0;
+	if(TickScheduler::NextDeadline(16 * kSec + 1, kSec / 4, 16 * kSec, missed) != 16 * kSec + kSec / 4 || missed) return false;
+	// Clock stepped back an hour: re-grid from now instead of waiting it out.
+	if(TickScheduler::NextDeadline(20 * kSec + 5, kSec, 3620 * kSec, missed) != 21 * kSec || missed) return false;
+	// Less than an interval back: still on the old grid.
+	if(TickScheduler::NextDeadline(20 * kSec + 1, kSec, 21 * kSec, missed) != 22 * kSec || missed) return false;
+	// Clock stepped forward an hour: re-grid, the skipped hour is not missed.
+	if(TickScheduler::NextDeadline(3620 * kSec + 5, kSec, 20 * kSec, missed) != 3621 * kSec || missed) return false;
+	// Four intervals late is still a miss, not a step.
+	if(TickScheduler::NextDeadline(24 * kSec, kSec, 20 * kSec, missed) != 25 * kSec || missed != 4) return false;
+	return true;
+}
+#endif
+
+#ifdef _DEBUG
+static bool RunTraceTests()
+{
+	{
+		CPUHZ_TRACE_SCOPE("SelfTest.Outer");
+		CPUHZ_TRACE_SCOPE("SelfTest.Inner");
+	}
+	LARGE_INTEGER now{};
+	QueryPerformanceCounter(&now);
+	TraceRecord("SelfTest.\"Quoted\"", now.QuadPart, now.QuadPart + 1);
+
+	const std::string json = FormatChromeTrace();
+	if(json.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) != 0) return false;
+	if(json.find("SelfTest.\\\"Quoted\\\"\",\"cat\":\"cpuhz\",\"ph\":\"X\"") == std::string::npos) return false;
+#if CPUHZ_ENABLE_TRACE
+	if(json.find("\"name\":\"SelfTest.Outer\"") == std::string::npos) return false;
+	if(json.find("\"name\":\"SelfTest.Inner\"") == std::string::npos) return false;
+#endif
+	return json.size() >= 4 && json.compare(json.size() - 4, 4, "\n]}\n") == 0;
+}
+#endif
+
+#ifdef _DEBUG
+static bool RunMetricsExpositionTests()
+{
+	CpuReading r;
+	r.timeUnixMs = 1700000000500;
+	r.ok = true;
+	r.avgMHz = 3412.5;
+	r.minMHz = 2000.0;
+	r.maxMHz = 4800.0;
+	r.baseMHz = 2500.0;
+	r.validCoreCount = 2;
+	r.source = L"PDH-PerCore-PerfBase";
+	r.sources[0] = { L"PowerInformation-CurrentMhz", 2500.0, true };
+	r.sources[1] = { L"PDH-PerCore-PerfBase", 3412.5, false };
+	r.sourceCount = 2;
+	r.perCoreMHz = { 2000.0, 0.0, 4800.0 };
+	r.perCoreLimitMHz = { 2800.0, 2800.0, 0.0 };
+	r.limitMHz = 2800.0;
+	r.limitedCoreCount = 2;
+	r.cappedCoreCount = 1;
+	r.topology.packages.resize(2);
+	r.topology.packages[1].avgMHz = 2000.0;
+	r.topology.dies.resize(2);
+	r.topology.dies[1].parent = 1;
+	r.topology.cores.resize(1);
+	r.topology.cores[0] = { 0, 4800.0, 4800.0, 4800.0, 1, 2 };
+
+	// Body content.
+	{
+		char buf[8192];
+		size_t n = FormatOpenMetrics(r, true, buf, sizeof(buf) - 1);
+		if(n == 0) return false;
+		buf[n] = '\0';
+		const char* expected[] = {
+			"\ncpuhz_avg_mhz 3412.500\n",
+			"\ncpuhz_base_mhz 2500.000\n",
+			"\ncpuhz_nominal_like 0.000\n",
+			"cpuhz_selected_source_info{source=\"PDH-PerCore-PerfBase\"} 1\n",
+			"cpuhz_source_mhz{source=\"PowerInformation-CurrentMhz\"} 2500.000\n",
+			"cpuhz_source_nominal_like{source=\"PowerInformation-CurrentMhz\"} 1\n",
+			"cpuhz_core_mhz{cpu=\"2\"} 4800.000\n",
+			"cpuhz_core_limit_mhz{cpu=\"1\"} 2800.000\n",
+			"\ncpuhz_capped_cores 1.000\n",
+			"cpuhz_package_mhz{package=\"1\"} 2000.000\n",
+			"cpuhz_die_mhz{package=\"1\",die=\"1\"} 0.000\n",
+			"cpuhz_physical_core_mhz{die=\"0\",core=\"0\"} 4800.000\n",
+			"cpuhz_sample_timestamp_seconds 1700000000.500\n",
+		};
+		for(auto* e : expected)
+			if(!strstr(buf, e)) return false;
+		if(strstr(buf, "cpuhz_core_mhz{cpu=\"1\"}")) return false; // cores without a value are skipped
+		if(n < 6 || strcmp(buf + n - 6, "# EOF\n") != 0) return false;
+
+		if(FormatOpenMetrics(r, true, buf, 64) != 0) return false;
+
+		// Latency summaries, only for probes with samples.
+		SelfOverhead o;
+		for(int i = 0; i < 1000; ++i)
+			o.Record(OverheadProbe::Read, i < 999 ? 100.0 : 250000.0);
+		n = FormatOpenMetrics(r, false, buf, sizeof(buf) - 1, &o);
+		if(n == 0) return false;
+		buf[n] = '\0';
+		const char* latency[] = {
+			"cpuhz_latency_seconds{probe=\"Read\",quantile=\"0.5\"} 0.000102400\n",
+			"cpuhz_latency_seconds{probe=\"Read\",quantile=\"0.999\"} 0.000102400\n",
+			"cpuhz_latency_seconds_count{probe=\"Read\"} 1000\n",
+			"cpuhz_latency_max_seconds{probe=\"Read\"} 0.250000000\n",
+		};
+		for(auto* e : latency)
+			if(!strstr(buf, e)) return false;
+		if(strstr(buf, "probe=\"Tick\"")) return false;
+	}
+	// Double buffer: nothing before the first Update, latest body after each.
+	{
+		MetricsExposition expo(0);
+		std::unique_ptr<char[]> out(new char[expo.Capacity()]);
+		if(expo.CopyLatest(out.get(), expo.Capacity()) != 0) return false;
+		for(int i = 0; i < 3; ++i)
+		{
+			r.avgMHz = 1000.0 + i;
+			if(!expo.Update(r, false)) return false;
+			size_t n = expo.CopyLatest(out.get(), expo.Capacity());
+			std::string body(out.get(), n);
+			char line[64];
+			sprintf_s(line, "\ncpuhz_avg_mhz %.3f\n", r.avgMHz);
+			if(body.find(line) == std::string::npos) return false;
+		}
+		// Per-core gauges that do not fit are dropped, aggregates are kept.
+		r.perCoreMHz.assign(4096, 3000.0);
+		if(expo.Update(r, true)) return false;
+		size_t n = expo.CopyLatest(out.get(), expo.Capacity());
+		std::string body(out.get(), n);
+		if(body.find("cpuhz_core_mhz") != std::string::npos || body.find("cpuhz_avg_mhz") == std::string::npos) return false;
+	}
+	return true;
+}
+
+static bool RunAlertEngineTests()
+{
+	// Compile: bad lines are reported and skipped, windows are shared.
+	{
+		AlertEngine e;
+		std::string errors;
+		int added = e.Compile(
+			"# comment\n"
+			"low-clock: avg < 70% and capped > 0 for 30s clear 10s\n"
+			"\n"
+			"sag: avg(avg, 30s) < 2000 and min(valid, 1m) >= 8\n"
+			"sag2: avg(avg, 30s) < base\n"
+			"broken avg < 1\n"
+			"bad: foo(avg, 1s) < 1\n"
+			"bad2: avg < 1 for 5x\n", &errors);
+		if(added != 3 || e.RuleCount() != 3) return false;
+		if(e.AggregateCount() != 2) return false;
+		if(errors != "line 6: expected '<name>:'\nline 7: unknown function 'foo'\nline 8: expected a duration after 'for'") return false;
+		if(e.RuleName(0) != "low-clock") return false;
+		// Names are UTF-8 and shown as such.
+		if(e.Compile("takt-\xC3\xA4\xE2\x82\xAC: avg < 1") != 1) return false;
+		if(Utf8ToWide(e.RuleName(3)) != L"takt-\u00E4\u20AC") return false;
+	}
+	// Time hysteresis: fires after `for`, clears after `clear`; a one-sample
+	// blip restarts the timer on either side.
+	{
+		AlertEngine e;
+		if(e.Compile("low-clock: avg < 70% and capped > 0 for 30s clear 10s") != 1) return false;
+		CpuReading r;
+		r.ok = true;
+		r.baseMHz = 3000.0;
+		const uint64_t t0 = 1700000000000ULL;
+		int fired = 0, cleared = 0;
+		uint64_t firedAt = 0, clearedAt = 0;
+		for(int s = 0; s <= 70; ++s)
+		{
+			r.timeUnixMs = t0 + (uint64_t)s * 1000;
+			r.avgMHz = s == 10 ? 2500.0 : 1500.0;
+			r.cappedCoreCount = (s == 43 || s >= 45) ? 0 : 2;
+			for(const AlertEvent& ev : e.Update(r, r.timeUnixMs))
+			{
+				if(ev.rule != 0) return false;
+				if(ev.fired) { ++fired; firedAt = ev.timeUnixMs; }
+				else { ++cleared; clearedAt = ev.timeUnixMs; }
+			}
+			if(s == 44 && (!e.IsActive(0) || e.ActiveCount() != 1)) return false;
+		}
+		if(fired != 1 || cleared != 1) return false;
+		if(firedAt != t0 + 41000 || clearedAt != t0 + 55000) return false;
+		if(e.IsActive(0) || e.ActiveCount() != 0 || e.FiredCount(0) != 1) return false;
+	}
+	// Windowed aggregates match a brute-force scan over irregular samples.
+	{
+		AlertEngine e;
+		if(e.Compile(
+			"a: avg(avg, 10s) > 0\n"
+			"b: min(avg, 10s) > 0\n"
+			"c: max(avg, 10s) > 0\n"
+			"d: sum(avg, 10s) > 0\n"
+			"f: count(capped, 10s) > 0\n") != 5) return false;
+		std::vector<std::pair<uint64_t, CpuReading>> seen;
+		uint32_t rng = 12345;
+		uint64_t t = 1700000000000ULL;
+		for(int i = 0; i < 2000; ++i)
+		{
+			rng = rng * 1664525u + 1013904223u;
+			t += 100 + (rng >> 8) % 1900;
+			CpuReading r;
+			r.ok = true;
+			r.timeUnixMs = t;
+			r.avgMHz = 800.0 + (double)((rng >> 4) % 4000);
+			r.cappedCoreCount = (rng >> 20) % 3 == 0 ? 1 : 0;
+			e.Update(r, t);
+			seen.push_back({ t, r });
+
+			double sum = 0.0, mn = 1e300, mx = -1e300, count = 0.0;
+			int n = 0;
+			for(auto it = seen.rbegin(); it != seen.rend(); ++it)
+			{
+				if(it != seen.rbegin() && it->first + 10000 <= t)
+					break;
+				const CpuReading& x = it->second;
+				sum += x.avgMHz;
+				mn = std::min(mn, x.avgMHz);
+				mx = std::max(mx, x.avgMHz);
+				count += x.cappedCoreCount != 0 ? 1.0 : 0.0;
+				++n;
+			}
+			if(std::abs(e.AggregateValue(0) - sum / n) > 1e-6) return false;
+			if(e.AggregateValue(1) != mn || e.AggregateValue(2) != mx) return false;
+			if(std::abs(e.AggregateValue(3) - sum) > 1e-3) return false;
+			if(e.AggregateValue(4) != count) return false;
+		}
+	}
+	// Windowed conditions stay false until the window has filled once.
+	{
+		AlertEngine e;
+		if(e.Compile("stuck: max(nominal, 10m) == 1 and min(nominal, 10m) == 1") != 1) return false;
+		CpuReading r;
+		r.ok = true;
+		r.nominalLike = true;
+		const uint64_t t0 = 1700000000000ULL;
+		for(int s = 0; s < 600; s += 10)
+		{
+			r.timeUnixMs = t0 + (uint64_t)s * 1000;
+			if(!e.Update(r, r.timeUnixMs).empty()) return false;
+		}
+		r.timeUnixMs = t0 + 600000;
+		if(e.Update(r, r.timeUnixMs).size() != 1 || !e.IsActive(0)) return false;
+		r.nominalLike = false;
+		r.timeUnixMs += 1000;
+		if(e.Update(r, r.timeUnixMs).size() != 1 || e.IsActive(0)) return false;
+
+		char buf[4096];
+		size_t n = FormatOpenMetrics(r, false, buf, sizeof(buf) - 1, nullptr, &e);
+		if(n == 0) return false;
+		buf[n] = '\0';
+		if(!strstr(buf, "cpuhz_alert_active{rule=\"stuck\"} 0\n")) return false;
+		if(!strstr(buf, "cpuhz_alert_fired_total{rule=\"stuck\"} 1\n")) return false;
+	}
+	// Failed readings neither feed windows nor restart `for`; `ok` still
+	// sees them. The wall clock stepping back an hour does not matter: time
+	// is the tick, events carry the reading's time.
+	{
+		AlertEngine e;
+		if(e.Compile(
+			"high: avg > 2000 for 10s\n"
+			"floor: min(avg, 5s) > 1000\n"
+			"down: ok == 0 for 2s\n") != 3) return false;
+		CpuReading r;
+		r.baseMHz = 3000.0;
+		const uint64_t tick0 = 5000;
+		uint64_t firedAt = 0;
+		for(int s = 0; s <= 10; ++s)
+		{
+			r.ok = s != 4 && s != 5;
+			r.avgMHz = r.ok ? 2500.0 : 0.0;
+			r.timeUnixMs = 1700000000000ULL + (uint64_t)s * 1000 - (s >= 7 ? 3600000 : 0);
+			for(const AlertEvent& ev : e.Update(r, tick0 + (uint64_t)s * 1000))
+			{
+				if(e.RuleName(ev.rule) != "high" && e.RuleName(ev.rule) != "floor") return false;
+				if(e.RuleName(ev.rule) == "high")
+					firedAt = ev.timeUnixMs;
+			}
+			if(e.AggregateValue(0) != 2500.0) return false;
+		}
+		if(!e.IsActive(0) || !e.IsActive(1) || e.IsActive(2)) return false;
+		if(firedAt != 1700000000000ULL + 10000 - 3600000) return false;
+
+		// `ok` rules still run on failed readings.
+		r.ok = false;
+		for(int s = 11; s <= 13; ++s)
+			e.Update(r, tick0 + (uint64_t)s * 1000);
+		if(!e.IsActive(2) || !e.IsActive(0)) return false;
+	}
+	return true;
+}
+
+static bool RunBurstRecorderTests()
+{
+	BurstConfig config;
+	config.periodUs = 1000;
+	config.preMs = 10;
+	config.postMs = 5;
+	config.baseMHz = 3000.0;
+	config.dropBelowMHz = 2000.0;
+	config.jumpMHz = 100.0;
+	config.cooldownMs = 0;
+
+	BurstRecorder rec;
+	rec.Configure(config);
+	if(rec.PreCapacity() != 10 || rec.PostCapacity() != 5) return false;
+
+	// Drop: the pre-trigger buffer holds only the last 10 samples before it.
+	int64_t t = 0;
+	for(int i = 0; i < 50; ++i, t += 1000)
+		if(rec.Push(t, 3000.0)) return false;
+	if(rec.Push(t, 1500.0) || rec.Trigger() != BurstTrigger::Drop) return false;
+	for(int i = 1; i <= 5; ++i)
+	{
+		t += 1000;
+		if(rec.Push(t, 1500.0) != (i == 5)) return false;
+	}
+	if(!rec.Frozen() || rec.Push(t + 1000, 1.0)) return false;
+	if(rec.CaptureSize() != 16 || rec.TriggerIndex() != 10) return false;
+	for(size_t i = 0; i < rec.CaptureSize(); ++i)
+	{
+		BurstSample s = rec.CaptureSample(i);
+		if(s.offsetUs != ((int64_t)i - 10) * 1000) return false;
+		if(s.mhz != (i < 10 ? 3000.0 : 1500.0)) return false;
+	}
+	BurstFileHeader h;
+	rec.FillHeader(h, 1700000000123ULL);
+	if(h.magic != kBurstFileMagic || h.sampleCount != 16 || h.triggerIndex != 10 || h.trigger != (uint32_t)BurstTrigger::Drop) return false;
+	if(h.headerSize != sizeof(BurstFileHeader) || h.sampleSize != sizeof(BurstSample) || h.levelMHz != 3000.0) return false;
+
+	// Staying below the drop threshold does not re-trigger; a jump from the
+	// recent level does, once warmed up.
+	rec.Rearm();
+	for(int i = 0; i < 8; ++i, t += 1000)
+		if(rec.Push(t, i == 3 ? 1650.0 : 1500.0) || rec.Triggered()) return false;
+	rec.Push(t, 1700.0);
+	if(rec.Trigger() != BurstTrigger::Jump || rec.TriggerIndex() != 8) return false;
+
+	// Manual trigger on the first sample; no post window completes at once.
+	config.postMs = 0;
+	rec.Configure(config);
+	if(!rec.Push(0, 3000.0, true) || rec.Trigger() != BurstTrigger::Manual) return false;
+	if(rec.CaptureSize() != 1 || rec.TriggerIndex() != 0 || rec.CaptureSample(0).offsetUs != 0) return false;
+
+	// Cooldown: after a capture, drops and jumps are ignored for cooldownMs
+	// (manual still fires); afterwards they trigger again.
+	config.postMs = 1;
+	config.cooldownMs = 20;
+	rec.Configure(config);
+	t = 0;
+	for(int i = 0; i < 10; ++i, t += 1000)
+		rec.Push(t, 3000.0);
+	rec.Push(t, 1500.0);
+	t += 1000;
+	if(!rec.Push(t, 1500.0) || rec.Trigger() != BurstTrigger::Drop) return false;
+	rec.Rearm(); // holdoff until t + 20 ms
+	for(int i = 0; i < 19; ++i)
+	{
+		t += 1000;
+		rec.Push(t, (i & 1) ? 3000.0 : 1500.0);
+		if(rec.Triggered()) return false;
+	}
+	t += 1000;
+	rec.Push(t, 3000.0, true);
+	if(rec.Trigger() != BurstTrigger::Manual || !rec.Push(t += 1000, 3000.0)) return false;
+	rec.Rearm();
+	rec.Push(t += 1000, 3000.0);
+	rec.Push(t += 1000, 1500.0);
+	if(rec.Triggered()) return false;
+	rec.Push(t += 21000, 3000.0);
+	rec.Push(t += 1000, 1500.0);
+	if(rec.Trigger() != BurstTrigger::Drop) return false;
+	return true;
+}
+#endif
+
+// Processes as plain counters; handles are the PIDs (attribution tests and
+// --simulate-bench).
+struct FakeProcesses
+{
+	struct Proc
+	{
+		uint64_t creation = 1;
+		uint64_t cpu = 0;
+		uint64_t affinity = ~0ULL;
+	};
+	std::map<DWORD, Proc> procs;
+	int openHandles = 0;
+};
+
+class FakeProcessSource : public ProcessSource
+{
+public:
+	explicit FakeProcessSource(FakeProcesses* p) : p_(p) {}
+
+	bool ListPids(std::vector<DWORD>& out) override
+	{
+		out.clear();
+		for(const auto& kv : p_->procs)
+			out.push_back(kv.first);
+		return true;
+	}
+	HANDLE Open(DWORD pid) override
+	{
+		if(!p_->procs.count(pid)) return nullptr;
+		++p_->openHandles;
+		return (HANDLE)(uintptr_t)pid;
+	}
+	void Close(HANDLE h) override { if(h) --p_->openHandles; }
+	bool Times(HANDLE h, uint64_t& creation, uint64_t& cpu) override
+	{
+		auto it = p_->procs.find((DWORD)(uintptr_t)h);
+		if(it == p_->procs.end()) return false;
+		creation = it->second.creation;
+		cpu = it->second.cpu;
+		return true;
+	}
+	uint64_t Affinity(HANDLE h) override
+	{
+		auto it = p_->procs.find((DWORD)(uintptr_t)h);
+		return it == p_->procs.end() ? 0 : it->second.affinity;
+	}
+	std::wstring Name(HANDLE h) override { return L"p" + std::to_wstring((DWORD)(uintptr_t)h); }
+
+private:
+	FakeProcesses* p_;
+};
+
+#ifdef _DEBUG
+static bool RunProcessAttributionTests()
+{
+	auto near = [](double a, double b) { return std::abs(a - b) < 1e-6; };
+
+	FakeProcesses fake;
+	for(DWORD pid = 4; pid <= 4000; pid += 4)
+		fake.procs[pid];
+	fake.procs[1200].affinity = 0x3;
+
+	AttributionConfig config;
+	config.topN = 3;
+	config.maxHot = 4;
+	config.scanBudget = 100;
+	config.decaySec = 0.0;
+	config.idleTicksToCool = 3;
+	ProcessAttribution a;
+	a.Start(std::make_unique<FakeProcessSource>(&fake), config);
+
+	CpuReading r;
+	r.ok = true;
+	r.baseMHz = 2000.0;
+	r.avgMHz = 3000.0;
+	r.busyWeightedMHz = 3000.0;
+	r.perCoreMHz = { 1000.0, 1000.0, 5000.0, 5000.0 };
+	r.timeUnixMs = 1700000000000ULL;
+
+	// 1000 PIDs at 100 per tick: the first pass only takes baselines; from
+	// the second, busy ones stay hot and every later CPU second is charged.
+	for(int t = 0; t < 30; ++t)
+	{
+		fake.procs[400].cpu += 5000000;  // 0.5 s per tick
+		fake.procs[800].cpu += 2500000;  // 0.25 s
+		fake.procs[1200].cpu += 1000000; // 0.1 s, on processors 0-1 only
+		a.Update(r);
+		if(a.LastOpenCount() > config.scanBudget) return false;
+		r.timeUnixMs += 1000;
+	}
+	if(a.KnownCount() != 1000 || a.HotCount() != 3 || fake.openHandles != 3) return false;
+	const auto& top = a.Top();
+	if(top.size() != 3 || top[0].pid != 400 || top[1].pid != 800 || top[2].pid != 1200) return false;
+	// Baselines: 400 at tick 0 (0.5 s), 800 at tick 1 (0.5 s), 1200 at tick 2 (0.3 s).
+	if(!near(top[0].cpuSeconds, 14.5) || !near(top[0].ghzSeconds, 43.5) || !near(top[0].boostedGhzSeconds, 43.5)) return false;
+	if(!near(top[1].ghzSeconds, 21.0) || top[1].throttledGhzSeconds != 0.0) return false;
+	if(!near(top[2].ghzSeconds, 2.7) || !near(top[2].throttledGhzSeconds, 2.7) || top[2].boostedGhzSeconds != 0.0) return false;
+	if(top[0].name != L"p400") return false;
+
+	// Idle hot PIDs are closed; a reused PID starts over.
+	fake.procs[800].creation = 2;
+	fake.procs[800].cpu = 0;
+	for(int t = 0; t < 12; ++t)
+	{
+		fake.procs[1200].cpu += 1000000;
+		a.Update(r);
+		r.timeUnixMs += 1000;
+	}
+	if(a.HotCount() != 1 || fake.openHandles != 1) return false;
+	if(a.Top().size() != 2 || a.Top()[0].pid != 400 || !near(a.Top()[0].ghzSeconds, 43.5)) return false;
+
+	// Totals decay and drop out of the ranking.
+	config.decaySec = 1.0;
+	a.Start(std::make_unique<FakeProcessSource>(&fake), config);
+	if(fake.openHandles != 0) return false;
+	for(int t = 0; t < 20; ++t)
+	{
+		fake.procs[400].cpu += t < 12 ? 5000000 : 0;
+		a.Update(r);
+		r.timeUnixMs += 1000;
+	}
+	if(a.Top().empty() || a.Top()[0].pid != 400) return false;
+	for(int t = 0; t < 30; ++t)
+	{
+		a.Update(r);
+		r.timeUnixMs += 1000;
+	}
+	if(!a.Top().empty()) return false;
+
+	// One capped core of four throttles a quarter of the time above base;
+	// below base (1200, on processors 0-1) all of it is throttled.
+	config.decaySec = 0.0;
+	a.Start(std::make_unique<FakeProcessSource>(&fake), config);
+	r.validCoreCount = 4;
+	r.cappedCoreCount = 1;
+	for(int t = 0; t < 20; ++t)
+	{
+		fake.procs[400].cpu += 5000000;
+		fake.procs[1200].cpu += 1000000;
+		a.Update(r);
+		r.timeUnixMs += 1000;
+	}
+	if(a.Top().size() != 2 || a.Top()[0].pid != 400 || a.Top()[1].pid != 1200) return false;
+	if(a.Top()[0].ghzSeconds <= 0.0 || !near(a.Top()[0].throttledGhzSeconds, a.Top()[0].ghzSeconds / 4)) return false;
+	if(a.Top()[1].ghzSeconds <= 0.0 || !near(a.Top()[1].throttledGhzSeconds, a.Top()[1].ghzSeconds)) return false;
+	a.Stop();
+	return fake.openHandles == 0;
+}
+
+static bool RunPublishGateTests()
+{
+	PublishGate g(250);
+	// First frame goes out; the same pixels again are skipped.
+	if(g.Decide(1000, 0xA, false) != PublishAction::Icon) return false;
+	if(g.Decide(2000, 0xA, false) != PublishAction::None) return false;
+	if(g.Decide(3000, 0xA, true) != PublishAction::TooltipOnly) return false;
+	if(g.SkippedCount() != 2 || g.PublishedCount() != 1) return false;
+	// Nothing rendered: tooltip only, not counted as a frame.
+	if(g.Decide(3100, 0, true) != PublishAction::TooltipOnly || g.SkippedCount() != 2) return false;
+
+	// A new frame inside the budget is held back and left pending...
+	if(g.Decide(4000, 0xB, false) != PublishAction::Icon) return false;
+	if(g.Decide(4100, 0xC, true) != PublishAction::TooltipOnly || !g.Pending()) return false;
+	if(g.DeferredCount() != 1) return false;
+	// ...until the budget allows it.
+	if(g.Decide(4250, 0xC, false) != PublishAction::Icon || g.Pending()) return false;
+	// Reverting to the published frame while pending clears it.
+	if(g.Decide(4300, 0xD, false) != PublishAction::None || !g.Pending()) return false;
+	if(g.Decide(4350, 0xC, false) != PublishAction::None || g.Pending()) return false;
+
+	// After Invalidate() the same frame is published again.
+	g.Invalidate();
+	if(g.Decide(4360, 0xC, false) != PublishAction::Icon) return false;
+
+	// No rate limit.
+	g.SetMinIntervalMs(0);
+	if(g.Decide(4361, 0xE, false) != PublishAction::Icon) return false;
+	return g.PublishedCount() == 5;
+}
+#endif
+
+// Runs the sampling pipeline (read, select, history, optional render) against
+// a SimulatedCpuSource for `ticks` samples. The checksum covers every
+// reading, so two runs of the same config must match.
+struct SimulationResult
+{
+	CpuReading last;
+	double seconds = 0.0;
+	uint64_t checksum = 0;
+};
+
+static void HashBytes(uint64_t& h, const void* data, size_t size)
+{
+	// FNV-1a
+	auto p = static_cast<const unsigned char*>(data);
+	for(size_t i = 0; i < size; ++i)
+		h = (h ^ p[i]) * 0x100000001B3ULL;
+}
+
+static bool RunSimulation(const SimConfig& config, int ticks, bool render, SimulationResult& out)
+{
+	auto source = std::make_unique<SimulatedCpuSource>(config);
+	SimulatedCpuSource* sim = source.get();
+	CpuFrequency cpu;
+	if(!cpu.Initialize(std::move(source)))
+		return false;
+	PersistentHistory history;
+	history.Open(nullptr, sim->UnixMs());
+
+	out.checksum = 0xCBF29CE484222325ULL;
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
+	for(int t = 0; t < ticks; ++t)
+	{
+		sim->Advance();
+		out.last = cpu.Read();
+		const CpuReading& r = out.last;
+		if(r.ok)
+			history.Push(r.timeUnixMs, r.avgMHz);
+		if(render)
+		{
+			IconSpec spec{};
+			spec.ghz = ToGhz(r.avgMHz);
+			spec.baseMHz = r.typeWeightedBaseMHz > 0 ? r.typeWeightedBaseMHz : r.baseMHz;
+			spec.overBase = spec.baseMHz > 0 && r.avgMHz > spec.baseMHz;
+			spec.historyMHz = &history.Sparkline();
+			HICON icon = g_renderer.Render(spec);
+			SafeDestroyIcon(icon);
+		}
+
+		const double values[] = { r.avgMHz, r.maxMHz, r.minMHz, r.busyWeightedMHz, r.typeWeightedBaseMHz };
+		HashBytes(out.checksum, values, sizeof(values));
+		HashBytes(out.checksum, &r.validCoreCount, sizeof(r.validCoreCount));
+		HashBytes(out.checksum, r.source.data(), r.source.size() * sizeof(wchar_t));
+		for(const auto& core : r.topology.cores)
+			HashBytes(out.checksum, &core.avgMHz, sizeof(core.avgMHz));
+	}
+	QueryPerformanceCounter(&end);
+	out.seconds = SelfOverhead::TicksToUs(end.QuadPart - start.QuadPart) / 1e6;
+	return true;
+}
+
+static void WriteBenchRow(FILE* f, const wchar_t* stage, int size, int ticks, double seconds, uint64_t checksum, const wchar_t* source)
+{
+	fwprintf(f, L"%s,%d,%d,%.3f,%.1f,%.2f,%016llx,%s\n", stage, size, ticks, seconds,
+		seconds > 0 ? ticks / seconds : 0.0,
+		ticks > 0 ? seconds * 1e6 / ticks : 0.0,
+		(unsigned long long)checksum, source);
+}
+
+// Busy fractions and the busy-weighted clock alone, over `processors` fixed
+// processor times (CpuUtilization does the same per tick after its query).
+static double BenchBusyFractions(int processors, int ticks, uint64_t& checksum)
+{
+	std::vector<SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION> times[2];
+	times[0].resize((size_t)processors);
+	times[1].resize((size_t)processors);
+	std::vector<double> busy((size_t)processors), mhz((size_t)processors);
+	for(int i = 0; i < processors; ++i)
+		mhz[(size_t)i] = 3000.0 + (i % 7) * 100.0;
+
+	checksum = 0xCBF29CE484222325ULL;
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
+	for(int t = 0; t < ticks; ++t)
+	{
+		auto& prev = times[t & 1];
+		auto& cur = times[(t & 1) ^ 1];
+		for(int i = 0; i < processors; ++i)
+		{
+			// 100 ms per tick, busy (i + t) % 11 tenths of it.
+			const LONGLONG busyTime = 1000000 * ((i + t) % 11) / 10;
+			cur[(size_t)i].IdleTime.QuadPart = prev[(size_t)i].IdleTime.QuadPart + 1000000 - busyTime;
+			cur[(size_t)i].KernelTime.QuadPart = prev[(size_t)i].KernelTime.QuadPart + 1000000 - busyTime / 2;
+			cur[(size_t)i].UserTime.QuadPart = prev[(size_t)i].UserTime.QuadPart + busyTime / 2;
+		}
+		CpuUtilization::ComputeBusyFractions(prev.data(), cur.data(), processors, busy.data());
+		const double w = CpuUtilization::BusyWeightedMHz(mhz, busy);
+		HashBytes(checksum, &w, sizeof(w));
+	}
+	QueryPerformanceCounter(&end);
+	return SelfOverhead::TicksToUs(end.QuadPart - start.QuadPart) / 1e6;
+}
+
+// ProcessAttribution::Update over `processes` fake processes, every 100th
+// busy on every tick; one tick is a second, so the PID list is refreshed
+// every rescanMs.
+static double BenchAttribution(int processes, int ticks, unsigned rescanMs, uint64_t& checksum)
+{
+	FakeProcesses fake;
+	for(int i = 0; i < processes; ++i)
+		fake.procs[(DWORD)(4 + 4 * i)];
+	AttributionConfig config;
+	config.rescanMs = rescanMs;
+	ProcessAttribution a;
+	a.Start(std::make_unique<FakeProcessSource>(&fake), config);
+
+	CpuReading r;
+	r.ok = true;
+	r.baseMHz = 3000.0;
+	r.avgMHz = 3500.0;
+	r.busyWeightedMHz = 4000.0;
+	r.timeUnixMs = 1700000000000ULL;
+
+	checksum = 0xCBF29CE484222325ULL;
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
+	for(int t = 0; t < ticks; ++t)
+	{
+		for(int i = 0; i < processes; i += 100)
+			fake.procs[(DWORD)(4 + 4 * i)].cpu += 1000000 + 1000 * (uint64_t)((i + t) % 7);
+		a.Update(r);
+		r.timeUnixMs += 1000;
+		if(!a.Top().empty())
+			HashBytes(checksum, &a.Top()[0].ghzSeconds, sizeof(double));
+	}
+	QueryPerformanceCounter(&end);
+	a.Stop();
+	return SelfOverhead::TicksToUs(end.QuadPart - start.QuadPart) / 1e6;
+}
+
+// AlertEngine::Update with `rules` rules over a varying reading: a third
+// plain, a third windowed over 8 shared windows, a third with two windowed
+// conditions and hysteresis. 0 if the rules do not compile.
+static double BenchAlerts(int rules, int ticks, uint64_t& checksum)
+{
+	static const char* const kFns[] = { "avg", "min", "max", "count" };
+	static const char* const kMetrics[] = { "avg", "busy", "capped", "valid" };
+	std::string text;
+	char line[160];
+	for(int i = 0; i < rules; ++i)
+	{
+		const int w = 10 + 10 * (i % 8);
+		if(i % 3 == 0)
+			snprintf(line, sizeof(line), "r%d: avg < %d%% and capped > 0 for %ds\n", i, 60 + i % 40, i % 30);
+		else if(i % 3 == 1)
+			snprintf(line, sizeof(line), "r%d: %s(%s, %ds) >= %d\n", i, kFns[i % 4], kMetrics[(i / 4) % 4], w, 1 + i % 7);
+		else
+			snprintf(line, sizeof(line), "r%d: avg(avg, %ds) < %d and min(valid, %ds) >= 8 for 5s clear 10s\n",
+				i, w, 2500 + i % 1000, w);
+		text += line;
+	}
+	AlertEngine e;
+	if(e.Compile(text.c_str()) != rules)
+		return 0.0;
+
+	CpuReading r;
+	r.ok = true;
+	r.baseMHz = 3000.0;
+	r.validCoreCount = 16;
+	r.timeUnixMs = 1700000000000ULL;
+	uint64_t tickMs = 1000;
+
+	checksum = 0xCBF29CE484222325ULL;
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
+	for(int t = 0; t < ticks; ++t)
+	{
+		r.avgMHz = 1500.0 + (t * 37 % 2500);
+		r.minMHz = r.avgMHz - 400.0;
+		r.maxMHz = r.avgMHz + 400.0;
+		r.busyWeightedMHz = r.avgMHz + 200.0;
+		r.cappedCoreCount = (t / 50) % 3;
+		const size_t events = e.Update(r, tickMs).size();
+		HashBytes(checksum, &events, sizeof(events));
+		tickMs += 1000;
+		r.timeUnixMs += 1000;
+	}
+	QueryPerformanceCounter(&end);
+	return SelfOverhead::TicksToUs(end.QuadPart - start.QuadPart) / 1e6;
+}
+
+// --simulate-bench: the full pipeline at 1..4096 simulated processors, then
+// single stages at scale, results in %LOCALAPPDATA%\CpuHzTray\simulate_bench.csv.
+static int RunSimulateBench(int ticks)
+{
+	wchar_t path[MAX_PATH]{};
+	FILE* f = nullptr;
+	if(!GetAppDataFilePath(L"simulate_bench.csv", path, MAX_PATH) || _wfopen_s(&f, path, L"w") != 0 || !f)
+		return 1;
+	fwprintf(f, L"stage,size,ticks,seconds,ticksPerSec,usPerTick,checksum,source\n");
+
+	SimConfig config;
+	config.trace = { { 20, 3000.0, 50.0 }, { 20, 4500.0, 300.0 }, { 20, 1200.0, 100.0 }, { 20, 3800.0, 400.0 } };
+	int rc = 0;
+	for(int processors : { 1, 64, 256, 1024, 4096 })
+	{
+		config.processors = processors;
+		config.packages = processors >= 256 ? 4 : 1;
+		SimulationResult result;
+		if(!RunSimulation(config, ticks, true, result))
+		{
+			rc = 1;
+			break;
+		}
+		WriteBenchRow(f, L"pipeline", processors, ticks, result.seconds, result.checksum, result.last.source.c_str());
+	}
+	if(rc == 0)
+	{
+		uint64_t checksum = 0;
+		double seconds = BenchBusyFractions(1024, ticks, checksum);
+		WriteBenchRow(f, L"busy-fractions", 1024, ticks, seconds, checksum, L"ProcessorTimes");
+		// The PID list refreshed every 10 s (the default), and on every tick.
+		const int processes = 50000;
+		seconds = BenchAttribution(processes, ticks, AttributionConfig{}.rescanMs, checksum);
+		WriteBenchRow(f, L"attribution", processes, ticks, seconds, checksum, L"FakeProcessSource");
+		seconds = BenchAttribution(processes, ticks, 0, checksum);
+		WriteBenchRow(f, L"attribution-rescan", processes, ticks, seconds, checksum, L"FakeProcessSource");
+		seconds = BenchAlerts(500, ticks, checksum);
+		WriteBenchRow(f, L"alerts", 500, ticks, seconds, checksum, L"AlertEngine");
+	}
+	fclose(f);
+	return rc;
+}
+
+// --render-png=<dir | file.png>: the tray icon for every bucket of the last
+// --render-span-sec= (default a day) of history.bin, at the finest tier that
+// covers it. No tray, no sampling; the history is read from a snapshot, so
+// this may run next to the tray. A directory gets frame-NNNNN.png per bucket;
+// a .png path gets one sprite sheet, kRenderSheetColumns frames per row,
+// oldest first.
+struct RenderPngOptions
+{
+	std::wstring target;
+	uint64_t spanSec = 86400;
+	double baseMHz = 0.0; // 0 = this machine's
+	int size = 0;         // icon size in pixels; 0 = the tray's
+};
+
+static constexpr size_t kRenderSheetColumns = 60;
+
+// Writes an encoded PNG to `path`; false on I/O failure.
+static bool WritePngFile(const wchar_t* path, const std::vector<uint8_t>& png)
+{
+	FILE* f = nullptr;
+	if(!path || png.empty() || _wfopen_s(&f, path, L"wb") != 0 || !f)
+		return false;
+	const bool ok = fwrite(png.data(), 1, png.size(), f) == png.size();
+	return fclose(f) == 0 && ok;
+}
+
+// There is no console to print to: the outcome of --render-png (one line,
+// "ok: ..." or "error: ...") goes to %LOCALAPPDATA%\CpuHzTray\render_png.log,
+// rewritten each run. Returns `rc`.
+static int ReportRenderPng(int rc, const wchar_t* format, ...)
+{
+	wchar_t path[MAX_PATH]{};
+	FILE* f = nullptr;
+	if(GetAppDataFilePath(L"render_png.log", path, MAX_PATH) && _wfopen_s(&f, path, L"w") == 0 && f)
+	{
+		va_list args;
+		va_start(args, format);
+		vfwprintf(f, format, args);
+		va_end(args);
+		fputwc(L'\n', f);
+		fclose(f);
+	}
+	return rc;
+}
+
+static int RunRenderPng(const RenderPngOptions& opt)
+{
+	auto image = std::make_unique<HistoryFileImage>();
+	wchar_t historyPath[MAX_PATH]{};
+	if(!GetDefaultHistoryFilePath(historyPath, MAX_PATH))
+		return ReportRenderPng(1, L"error: %%LOCALAPPDATA%% is not set");
+	if(GetFileAttributesW(historyPath) == INVALID_FILE_ATTRIBUTES)
+		return ReportRenderPng(1, L"error: no history file at %s (run the tray first)", historyPath);
+	if(!LoadHistorySnapshot(historyPath, *image))
+		return ReportRenderPng(1, L"error: %s is unreadable, corrupt or not version %u", historyPath, kHistoryFileVersion);
+
+	double baseMHz = opt.baseMHz;
+	if(baseMHz <= 0.0)
+	{
+		CpuFrequency cpu;
+		if(cpu.Initialize())
+		{
+			const CpuReading r = cpu.Read();
+			baseMHz = r.typeWeightedBaseMHz > 0 ? r.typeWeightedBaseMHz : r.baseMHz;
+		}
+	}
+
+	const int tier = TieredHistory::TierForSpan(opt.spanSec);
+	const uint32_t bucketSec = TieredHistory::kTiers[tier].bucketSec;
+	const auto rollups = image->tiers.Latest(tier, (size_t)((opt.spanSec + bucketSec - 1) / bucketSec));
+	const size_t frames = rollups.size();
+	if(frames == 0)
+		return ReportRenderPng(1, L"error: no history in the last %llu s", (unsigned long long)opt.spanSec);
+
+	const auto& t = opt.target;
+	const bool sheet = t.size() > 4 && _wcsicmp(t.c_str() + t.size() - 4, L".png") == 0;
+	if(!sheet)
+		CreateDirectoryW(t.c_str(), nullptr); // fails harmlessly if it already exists
+
+	PngEncoder png;
+	SparklineHistory spark;
+	std::vector<uint32_t> sheetPixels;
+	size_t columns = std::min(frames, kRenderSheetColumns);
+	uint64_t lastHash = 0;
+	for(size_t i = 0; i < frames; ++i)
+	{
+		const double mhz = rollups[i].avgMHz;
+		spark.Push(mhz);
+		IconSpec spec{};
+		spec.ghz = ToGhz(mhz);
+		spec.baseMHz = baseMHz;
+		spec.overBase = baseMHz > 0 && mhz > baseMHz;
+		spec.historyMHz = &spark;
+		if(!g_renderer.RenderFrame(spec, opt.size))
+		{
+			const wchar_t* err = g_renderer.GetFontError();
+			return ReportRenderPng(1, L"error: cannot render frame %zu (%s)", i, err ? err : L"bitmap");
+		}
+
+		const int size = g_renderer.FrameSize();
+		const uint32_t* pixels = g_renderer.FramePixels();
+		if(sheet)
+		{
+			const size_t stride = columns * (size_t)size;
+			if(sheetPixels.empty())
+				sheetPixels.assign(stride * (size_t)size * ((frames + columns - 1) / columns), 0);
+			uint32_t* dst = sheetPixels.data() + (i / columns) * stride * (size_t)size + (i % columns) * (size_t)size;
+			for(int y = 0; y < size; ++y)
+				std::copy_n(pixels + (size_t)y * size, size, dst + (size_t)y * stride);
+			continue;
+		}
+
+		// Flat stretches render identical frames; their PNG is reused.
+		if(g_renderer.FrameHash() != lastHash)
+		{
+			png.Encode(pixels, size, size, (size_t)size);
+			lastHash = g_renderer.FrameHash();
+		}
+		wchar_t path[MAX_PATH]{};
+		swprintf_s(path, L"%s\\frame-%05zu.png", t.c_str(), i);
+		if(!WritePngFile(path, png.Output()))
+			return ReportRenderPng(1, L"error: cannot write %s", path);
+	}
+
+	if(sheet)
+	{
+		const size_t width = columns * (size_t)g_renderer.FrameSize();
+		png.Encode(sheetPixels.data(), (int)width, (int)(sheetPixels.size() / width), width);
+		if(!WritePngFile(t.c_str(), png.Output()))
+			return ReportRenderPng(1, L"error: cannot write %s", t.c_str());
+	}
+	return ReportRenderPng(0, L"ok: %zu frames of %d px (%u s buckets) to %s", frames, g_renderer.FrameSize(), bucketSec, t.c_str());
+}
+
+#ifdef _DEBUG
+// Test-only decoder for what PngEncoder writes: a zlib stream of one
+// fixed-Huffman block. Written from RFC 1950/1951, independent of the
+// encoder's tables. False on anything malformed or unexpected.
+static bool InflateFixedForTest(const uint8_t* z, size_t size, std::vector<uint8_t>& out)
+{
+	static const uint16_t kLenBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const uint8_t kLenExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const uint16_t kDistBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const uint8_t kDistExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	out.clear();
+	if(size < 6 || z[0] != 0x78 || ((z[0] << 8) | z[1]) % 31 != 0)
+		return false;
+	size_t pos = 2;
+	int bitPos = 0;
+	bool bad = false;
+	auto bits = [&](int n)
+	{
+		uint32_t v = 0;
+		for(int i = 0; i < n; ++i)
+		{
+			if(pos >= size)
+			{
+				bad = true;
+				return 0u;
+			}
+			v |= (uint32_t)((z[pos] >> bitPos) & 1) << i;
+			if(++bitPos == 8)
+			{
+				bitPos = 0;
+				++pos;
+			}
+		}
+		return v;
+	};
+	// Huffman codes are packed most significant bit first.
+	auto code = [&](int n, uint32_t prefix) { for(int i = 0; i < n; ++i) prefix = prefix << 1 | bits(1); return prefix; };
+
+	if(bits(1) != 1 || bits(2) != 1) // one final block, fixed Huffman
+		return false;
+	for(;;)
+	{
+		uint32_t c = code(7, 0);
+		int sym;
+		if(c <= 0x17)
+			sym = 256 + (int)c;
+		else if((c = code(1, c)) >= 0x30 && c <= 0xBF)
+			sym = (int)c - 0x30;
+		else if(c >= 0xC0 && c <= 0xC7)
+			sym = 280 + (int)c - 0xC0;
+		else
+			sym = 144 + (int)code(1, c) - 0x190;
+		if(bad || sym < 0 || sym > 285)
+			return false;
+		if(sym < 256)
+		{
+			out.push_back((uint8_t)sym);
+			continue;
+		}
+		if(sym == 256)
+			break;
+		const size_t len = kLenBase[sym - 257] + bits(kLenExtra[sym - 257]);
+		const uint32_t ds = code(5, 0);
+		if(ds >= 30)
+			return false;
+		const size_t dist = kDistBase[ds] + bits(kDistExtra[ds]);
+		if(bad || dist > out.size())
+			return false;
+		for(size_t k = 0; k < len; ++k)
+			out.push_back(out[out.size() - dist]);
+	}
+	if(bitPos)
+		++pos;
+	if(pos + 4 != size)
+		return false;
+	const uint32_t adler = (uint32_t)z[pos] << 24 | (uint32_t)z[pos + 1] << 16 | (uint32_t)z[pos + 2] << 8 | z[pos + 3];
+	return adler == PngEncoder::Adler32(out.data(), out.size());
+}
+
+// Inflates `png`'s IDAT and undoes the row filters: straight RGBA rows.
+static bool DecodePngForTest(const std::vector<uint8_t>& png, int width, int height, std::vector<uint8_t>& rgba)
+{
+	if(png.size() < 8 + 25 + 12)
+		return false;
+	const uint8_t* c = png.data() + 8 + 25;
+	const uint32_t len = (uint32_t)c[0] << 24 | (uint32_t)c[1] << 16 | (uint32_t)c[2] << 8 | c[3];
+	std::vector<uint8_t> raw;
+	if(memcmp(c + 4, "IDAT", 4) != 0 || 8 + 25 + 12 + (size_t)len > png.size() || !InflateFixedForTest(c + 8, len, raw))
+		return false;
+	const size_t rowBytes = (size_t)width * 4;
+	if(raw.size() != (rowBytes + 1) * (size_t)height)
+		return false;
+	rgba.assign(rowBytes * (size_t)height, 0);
+	for(int y = 0; y < height; ++y)
+	{
+		const uint8_t filter = raw[(size_t)y * (rowBytes + 1)];
+		const uint8_t* in = raw.data() + (size_t)y * (rowBytes + 1) + 1;
+		uint8_t* row = rgba.data() + (size_t)y * rowBytes;
+		const uint8_t* prev = y > 0 ? row - rowBytes : nullptr;
+		for(size_t i = 0; i < rowBytes; ++i)
+		{
+			const int a = i >= 4 ? row[i - 4] : 0, b = prev ? prev[i] : 0, d = prev && i >= 4 ? prev[i - 4] : 0;
+			const int p = a + b - d, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - d);
+			int pred;
+			switch(filter)
+			{
+			case 0: pred = 0; break;
+			case 1: pred = a; break;
+			case 2: pred = b; break;
+			case 3: pred = (a + b) / 2; break;
+			case 4: pred = pa <= pb && pa <= pc ? a : (pb <= pc ? b : d); break;
+			default: return false;
+			}
+			row[i] = (uint8_t)(in[i] + pred);
+		}
+	}
+	return true;
+}
+
+static bool RunPngEncoderTests()
+{
+	// Known check values.
+	if(PngEncoder::Crc32((const uint8_t*)"IEND", 4) != 0xAE426082u) return false;
+	if(PngEncoder::Adler32((const uint8_t*)"Wikipedia", 9) != 0x11E60398u) return false;
+
+	uint32_t px[6] = { 0xFF102030, 0x80402010, 0x00000000, 0xFFFFFFFF, 0xFF102030, 0x40202020 };
+	PngEncoder png;
+	const std::vector<uint8_t> first = png.Encode(px, 3, 2, 3);
+	static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if(first.size() < 57 || memcmp(first.data(), kSignature, 8) != 0) return false;
+
+	// Every chunk's CRC checks out, and the IHDR says 3x2 RGBA.
+	size_t pos = 8;
+	int chunks = 0;
+	while(pos + 12 <= first.size())
+	{
+		const uint8_t* c = first.data() + pos;
+		const uint32_t len = (uint32_t)c[0] << 24 | (uint32_t)c[1] << 16 | (uint32_t)c[2] << 8 | c[3];
+		if(pos + 12 + len > first.size()) return false;
+		const uint8_t* crc = c + 8 + len;
+		const uint32_t expected = (uint32_t)crc[0] << 24 | (uint32_t)crc[1] << 16 | (uint32_t)crc[2] << 8 | crc[3];
+		if(PngEncoder::Crc32(c + 4, 4 + len) != expected) return false;
+		if(chunks == 0 && (memcmp(c + 4, "IHDR", 4) != 0 || c[11] != 3 || c[15] != 2 || c[16] != 8 || c[17] != 6)) return false;
+		pos += 12 + len;
+		++chunks;
+	}
+	if(chunks != 3 || pos != first.size()) return false;
+
+	// Same input, same bytes; same size, same buffers.
+	const uint8_t* buffer = png.Output().data();
+	if(png.Encode(px, 3, 2, 3) != first || png.Output().data() != buffer) return false;
+
+	// IDAT inflates to the filtered rows: known straight-RGBA answer,
+	// semi-transparent pixels un-premultiplied with rounding.
+	static const uint8_t kRgba[24] = {
+		0x10, 0x20, 0x30, 0xFF, 0x80, 0x40, 0x20, 0x80, 0x00, 0x00, 0x00, 0x00,
+		0xFF, 0xFF, 0xFF, 0xFF, 0x10, 0x20, 0x30, 0xFF, 0x80, 0x80, 0x80, 0x40,
+	};
+	std::vector<uint8_t> rgba;
+	if(!DecodePngForTest(first, 3, 2, rgba) || memcmp(rgba.data(), kRgba, sizeof(kRgba)) != 0) return false;
+
+	// Long matches, all filters and a stride wider than the image round-trip.
+	std::vector<uint32_t> pattern(40 * 24, 0);
+	for(int y = 0; y < 24; ++y)
+		for(int x = 0; x < 30; ++x)
+			pattern[(size_t)y * 40 + x] = y >= 20 ? 0 : 0xFF000000u | (uint32_t)(x * 8) << 16 | (uint32_t)(y * 10) << 8 | (uint32_t)((x ^ y) & 3) * 60;
+	if(!DecodePngForTest(png.Encode(pattern.data(), 30, 24, 40), 30, 24, rgba)) return false;
+	for(int y = 0; y < 24; ++y)
+	{
+		for(int x = 0; x < 30; ++x)
+		{
+			const uint32_t v = pattern[(size_t)y * 40 + x];
+			const uint8_t* d = rgba.data() + ((size_t)y * 30 + x) * 4;
+			if(d[0] != (uint8_t)(v >> 16) || d[1] != (uint8_t)(v >> 8) || d[2] != (uint8_t)v || d[3] != (uint8_t)(v >> 24)) return false;
+		}
+	}
+
+	// A transparent icon is mostly one long match.
+	std::vector<uint32_t> empty(32 * 32, 0);
+	if(png.Encode(empty.data(), 32, 32, 32).size() >= 120) return false;
+	return DecodePngForTest(png.Output(), 32, 32, rgba) && std::all_of(rgba.begin(), rgba.end(), [](uint8_t b) { return b == 0; });
+}
+
+static bool RunIconLayoutTests()
+{
+	// A "8.88" outline 240 x 90 at the reference em (font-free).
+	const float sampleW = 240.0f, sampleH = 90.0f;
+	IconLayoutTable table;
+	table.Build(sampleW, sampleH);
+	const auto& layouts = table.Layouts();
+	if(layouts.size() != std::size(kIconLayoutSizes)) return false;
+
+	// An unlisted size is inserted in order; asking again does not add it twice.
+	if(table.Get(28).size != 28 || table.Get(28).size != 28) return false;
+	if(layouts.size() != std::size(kIconLayoutSizes) + 1) return false;
+	if(table.Get(8).size != 16 || layouts.size() != std::size(kIconLayoutSizes) + 1) return false;
+	for(size_t i = 0; i < layouts.size(); ++i)
+	{
+		const IconLayout& l = layouts[i];
+		if(i > 0 && (l.size <= layouts[i - 1].size || l.em < layouts[i - 1].em)) return false;
+		if(l.plot.bottom != l.text.top || l.text.bottom != l.size || l.text.right != l.size) return false;
+		// `em` is the largest size at which the sample fits the text region.
+		const float w = (float)(l.text.right - l.text.left), h = (float)(l.text.bottom - l.text.top);
+		const float fit = (float)l.em / kIconReferenceEm, over = (float)(l.em + 1) / kIconReferenceEm;
+		if(sampleW * fit > w || sampleH * fit > h) return false;
+		if(sampleW * over <= w && sampleH * over <= h) return false;
+	}
+	if(layouts.front().em >= layouts.back().em) return false;
+
+	// The renderer's multi-size path: every size comes back at its size.
+	// Without the embedded font nothing renders (reported at startup).
+	HICON icons[std::size(kIconLayoutSizes)];
+	IconSpec spec{};
+	spec.ghz = 3.71;
+	const size_t rendered = g_renderer.RenderIconSet(spec, kIconLayoutSizes, std::size(kIconLayoutSizes), icons);
+	if(rendered == 0)
+		return g_renderer.GetFontError() != nullptr && std::all_of(std::begin(icons), std::end(icons), [](HICON h) { return h == nullptr; });
+	bool ok = rendered == std::size(kIconLayoutSizes);
+	for(size_t i = 0; i < std::size(icons); ++i)
+	{
+		ICONINFO ii{};
+		BITMAP bm{};
+		if(!icons[i] || !GetIconInfo(icons[i], &ii))
+		{
+			ok = false;
+			continue;
+		}
+		ok = ok && GetObjectW(ii.hbmColor, sizeof(bm), &bm) == sizeof(bm) && bm.bmWidth == kIconLayoutSizes[i];
+		DeleteObject(ii.hbmColor);
+		DeleteObject(ii.hbmMask);
+		SafeDestroyIcon(icons[i]);
+	}
+	return ok;
+}
+
+static bool RunSimulatorTests()
 {
-	NOTIFYICONDATAW nid{};
-	nid.cbSize = sizeof(nid);
-	FillTrayIconIdentity(nid, reinterpret_cast<HWND>(static_cast<UINT_PTR>(0x1234)));
-	if(nid.hWnd != reinterpret_cast<HWND>(static_cast<UINT_PTR>(0x1234))) return false;
-	if(nid.uID != 1) return false;
-	if((nid.uFlags & NIF_GUID) == 0) return false;
-	if(!IsEqualGUID(nid.guidItem, kTrayIconGuid)) return false;
+	SimConfig base;
+	base.processors = 16;
+	base.trace = { { 8, 3000.0, 0.0 }, { 8, 4200.0, 100.0 } };
+
+	// The selected value follows the trace.
+	{
+		SimulationResult res;
+		if(!RunSimulation(base, 12, false, res)) return false;
+		const CpuReading& r = res.last;
+		if(!r.ok || r.source != L"PowerInformation-CurrentMhz") return false;
+		if(std::abs(r.avgMHz - 4200.0) > 100.0 || r.validCoreCount != 16) return false;
+		if(r.timeUnixMs != base.startUnixMs + 12 * base.tickMs) return false;
+		if(r.topology.cores.size() != 8) return false;
+		// Busy-weighted from the scripted load: a replay of the same ticks.
+		SimulatedCpuSource replay(base);
+		for(int t = 0; t < 12; ++t)
+			replay.Advance();
+		double weighted = 0.0, weight = 0.0;
+		for(int cpu = 0; cpu < base.processors; ++cpu)
+		{
+			weighted += replay.ScriptedMHz(cpu) * replay.ScriptedBusy(cpu);
+			weight += replay.ScriptedBusy(cpu);
+		}
+		if(r.busyWeightedMHz <= 0.0 || std::abs(r.busyWeightedMHz - weighted / weight) > 1e-6) return false;
+		if(std::abs(r.busyWeightedMHz - r.avgMHz) > 100.0) return false;
+	}
+	// An idle machine has no busy-weighted clock.
+	{
+		SimConfig c = base;
+		c.trace = { { 1, 4200.0, 0.0, 0.0 } };
+		SimulationResult res;
+		if(!RunSimulation(c, 4, false, res)) return false;
+		if(!res.last.ok || res.last.busyWeightedMHz != 0.0) return false;
+	}
+	// PowerInformation stuck at base loses to a per-core PDH source.
+	{
+		SimConfig c = base;
+		c.powerInfoStuckAtBase = true;
+		c.trace = { { 1, 4200.0, 0.0 } };
+		SimulationResult res;
+		if(!RunSimulation(c, 10, false, res)) return false;
+		if(res.last.source.rfind(L"PowerInformation", 0) == 0) return false;
+		if(std::abs(res.last.avgMHz - 4200.0) > 1.0) return false;
+	}
+	// Offline processors report nothing.
+	{
+		SimConfig c = base;
+		c.offlineEvery = 4;
+		SimulationResult res;
+		if(!RunSimulation(c, 12, false, res)) return false;
+		if(res.last.validCoreCount != 12 || res.last.perCoreMHz[3] != 0.0) return false;
+	}
+	// Hybrid: two core types, E-cores compared to their own base.
+	{
+		SimConfig c = base;
+		c.efficiencyCores = 8;
+		SimulationResult res;
+		if(!RunSimulation(c, 12, false, res)) return false;
+		if(res.last.coreTypeCount != 2 || res.last.coreTypes[1].baseMHz != 2100.0) return false;
+	}
+	// Hybrid idling at base: selection compares against the type-weighted
+	// base the display uses, so it is at base just like a non-hybrid CPU.
+	{
+		SimConfig c = base;
+		c.trace.clear();
+		SimulationResult flat, hybrid;
+		if(!RunSimulation(c, 12, false, flat)) return false;
+		c.efficiencyCores = 8;
+		if(!RunSimulation(c, 12, false, hybrid)) return false;
+		if(hybrid.last.typeWeightedBaseMHz != 2550.0 || std::abs(hybrid.last.avgMHz - 2550.0) > 1.0) return false;
+		if(hybrid.last.nominalLike != flat.last.nominalLike || hybrid.last.source != flat.last.source) return false;
+	}
+	// Deterministic: same config, same readings.
+	{
+		SimConfig c = base;
+		c.processors = 256;
+		c.packages = 2;
+		SimulationResult a, b;
+		if(!RunSimulation(c, 200, false, a) || !RunSimulation(c, 200, false, b)) return false;
+		if(a.checksum != b.checksum) return false;
+		c.trace[1].spreadMHz = 101.0;
+		if(!RunSimulation(c, 200, false, b) || a.checksum == b.checksum) return false;
+	}
 	return true;
 }
 #endif
@@ -209,6 +1995,180 @@ static void RemoveTrayIcon()
 	}
 }
 
+// szTip holds 127 characters. Lines go in in priority order; one that does
+// not fit is left out whole (a shorter later line may still fit) rather than
+// cut off by the shell.
+static constexpr size_t kTooltipMaxChars = sizeof(NOTIFYICONDATAW::szTip) / sizeof(wchar_t) - 1;
+
+static void AppendTooltipLine(std::wstring& tip, const std::wstring& line)
+{
+	const size_t separator = tip.empty() ? 0 : 1;
+	if(line.empty() || tip.size() + separator + line.size() > kTooltipMaxChars)
+		return;
+	if(separator)
+		tip += L'\n';
+	tip += line;
+}
+
+// Compares with the tooltip as the shell holds it (`shown` is szTip, cut to
+// kTooltipMaxChars), so a long tooltip does not count as changed every tick.
+static bool TooltipChanged(const std::wstring& next, const wchar_t* shown)
+{
+	const size_t n = std::min(next.size(), kTooltipMaxChars);
+	return next.compare(0, n, shown) != 0;
+}
+
+// Most important lines first (see AppendTooltipLine). `selfLine` is the
+// --show-overhead summary (empty when off); it goes right after the clock,
+// or the lines below would crowd it out.
+static std::wstring FormatTooltip(const CpuReading& reading, const std::wstring& selfLine)
+{
+	std::wstring tip;
+	auto ghz = [](double mhz)
+	{
+		std::wstringstream ss;
+		ss << std::fixed << std::setprecision(2) << ToGhz(mhz);
+		return ss.str();
+	};
+	if(reading.ok)
+	{
+		AppendTooltipLine(tip, L"CPU Avg: " + ghz(reading.avgMHz) + L" GHz");
+		AppendTooltipLine(tip, selfLine);
+		AppendTooltipLine(tip, L"Source: " + reading.source);
+		if(!reading.warning.empty())
+			AppendTooltipLine(tip, L"Warning: " + reading.warning);
+		if(g_alerts.ActiveCount() > 0)
+		{
+			std::wstring line = L"Alert: ";
+			bool first = true;
+			for(int i = 0; i < g_alerts.RuleCount(); ++i)
+			{
+				if(!g_alerts.IsActive(i))
+					continue;
+				line += first ? L"" : L", ";
+				line += Utf8ToWide(g_alerts.RuleName(i));
+				first = false;
+			}
+			AppendTooltipLine(tip, line);
+		}
+		if(reading.busyWeightedMHz > 0)
+			AppendTooltipLine(tip, L"CPU Busy: " + ghz(reading.busyWeightedMHz) + L" GHz");
+		AppendTooltipLine(tip, L"CPU Max: " + ghz(reading.maxMHz) + L" GHz");
+		AppendTooltipLine(tip, L"CPU Min: " + ghz(reading.minMHz) + L" GHz");
+		if(reading.baseMHz > 0)
+			AppendTooltipLine(tip, L"Base: " + ghz(reading.baseMHz) + L" GHz");
+		if(reading.limitedCoreCount > 0)
+		{
+			AppendTooltipLine(tip, L"Limited: " + std::to_wstring(reading.limitedCoreCount) + L" cores, "
+				+ std::to_wstring(reading.cappedCoreCount) + L" at limit (avg " + ghz(reading.limitMHz) + L" GHz)");
+		}
+		// A slow socket (or die) hides in the overall average.
+		const bool byPackage = reading.topology.packages.size() > 1;
+		const auto& groups = byPackage ? reading.topology.packages : reading.topology.dies;
+		if(groups.size() > 1)
+		{
+			std::wstring line = byPackage ? L"Packages: " : L"Dies: ";
+			for(size_t i = 0; i < groups.size(); ++i)
+				line += (i ? L", " : L"") + ghz(groups[i].avgMHz);
+			AppendTooltipLine(tip, line + L" GHz");
+		}
+		if(reading.coreTypeCount > 0)
+		{
+			std::wstring line;
+			for(int t = 0; t < reading.coreTypeCount; ++t)
+			{
+				line += t ? L", " : L"";
+				line += reading.coreTypes[t].name;
+				line += L": " + ghz(reading.coreTypes[t].avgMHz);
+			}
+			AppendTooltipLine(tip, line + L" GHz");
+		}
+		if(!g_attribution.Top().empty())
+		{
+			const ProcessShare& top = g_attribution.Top()[0];
+			std::wstringstream ss;
+			ss << L"Top: " << top.name << L" " << std::fixed << std::setprecision(1) << top.ghzSeconds << L" GHz-s";
+			AppendTooltipLine(tip, ss.str());
+		}
+		if(g_burst.IsArmed())
+			AppendTooltipLine(tip, L"Burst capture: armed, " + std::to_wstring(g_burst.CaptureCount()) + L" saved");
+		if(!reading.suspendedSources.empty())
+			AppendTooltipLine(tip, L"Suspended: " + reading.suspendedSources);
+		if(!reading.accuracy.empty())
+			AppendTooltipLine(tip, L"Accuracy: " + reading.accuracy);
+		if(reading.validCoreCount > 0)
+			AppendTooltipLine(tip, L"Cores: " + std::to_wstring(reading.validCoreCount));
+	}
+	else
+	{
+		AppendTooltipLine(tip, L"CPU: --");
+		if(!reading.source.empty())
+			AppendTooltipLine(tip, L"Source: " + reading.source);
+	}
+	return tip;
+}
+
+#ifdef _DEBUG
+static bool RunTooltipTests()
+{
+	std::wstring tip;
+	AppendTooltipLine(tip, L"CPU Avg: 3.71 GHz");
+	AppendTooltipLine(tip, L"Source: PowerInformation-CurrentMhz");
+	if(tip != L"CPU Avg: 3.71 GHz\nSource: PowerInformation-CurrentMhz") return false;
+	// A line that does not fit is skipped whole; a shorter one still fits.
+	AppendTooltipLine(tip, std::wstring(100, L'x'));
+	if(tip.find(L'x') != std::wstring::npos) return false;
+	AppendTooltipLine(tip, L"Cores: 16");
+	if(tip.size() > kTooltipMaxChars || tip.rfind(L"\nCores: 16") != tip.size() - 10) return false;
+	// Fill to the limit exactly.
+	AppendTooltipLine(tip, std::wstring(kTooltipMaxChars - tip.size() - 1, L'y'));
+	if(tip.size() != kTooltipMaxChars) return false;
+
+	// A full tooltip with --show-overhead keeps the Self line and the source.
+	CpuReading r;
+	r.ok = true;
+	r.avgMHz = 3712.0;
+	r.busyWeightedMHz = 4410.0;
+	r.maxMHz = 5100.0;
+	r.minMHz = 800.0;
+	r.baseMHz = 3000.0;
+	r.source = L"PowerInformation-CurrentMhz";
+	r.limitedCoreCount = 4;
+	r.cappedCoreCount = 2;
+	r.limitMHz = 3600.0;
+	r.accuracy = L"per-core";
+	r.validCoreCount = 16;
+	SelfOverhead o;
+	for(int i = 0; i < 100; ++i)
+	{
+		o.Record(OverheadProbe::Tick, 1234.0);
+		o.Record(OverheadProbe::TickLateness, 15678.0);
+	}
+	o.SetMissedTicks(1234);
+	o.SampleProcessCpu(1000);
+	o.SampleProcessCpu(61000);
+	o.CountSourceReads(1, 3);
+	o.SetFrameCounts(100, 300);
+	const std::wstring self = o.Summary();
+	if(self.size() < 30) return false;
+	tip = FormatTooltip(r, self);
+	if(tip.size() > kTooltipMaxChars || tip.find(L"\n" + self + L"\n") == std::wstring::npos) return false;
+	if(tip.find(L"\nSource: PowerInformation-CurrentMhz") == std::wstring::npos) return false;
+	if(FormatTooltip(r, L"").find(L"Self:") != std::wstring::npos) return false;
+
+	// An unchanged tooltip longer than szTip is not an update.
+	NOTIFYICONDATAW nid{};
+	const std::wstring longTip(200, L'z');
+	wcsncpy_s(nid.szTip, longTip.c_str(), _TRUNCATE);
+	if(TooltipChanged(longTip, nid.szTip)) return false;
+	if(!TooltipChanged(longTip.substr(0, 100) + L"!", nid.szTip)) return false;
+	if(!TooltipChanged(L"short", nid.szTip)) return false;
+	PublishGate gate(0);
+	gate.Decide(1000, 0xA, true);
+	return gate.Decide(2000, 0xA, TooltipChanged(longTip, nid.szTip)) == PublishAction::None;
+}
+#endif
+
 static const wchar_t* EffectiveTooltip(const wchar_t* tooltip) noexcept
 {
 	return (tooltip && *tooltip) ? tooltip : L"CPU Hz tray";
@@ -243,6 +2203,7 @@ static bool AddTrayIcon(HWND hwnd, HICON icon, const wchar_t* tooltip)
 
 static bool ModifyTrayIcon(HWND hwnd, HICON icon, const wchar_t* tooltip)
 {
+	CPUHZ_TRACE_SCOPE("ModifyTrayIcon");
 	if(!g_trayIconAdded)
 		return AddTrayIcon(hwnd, icon, tooltip);
 
@@ -267,47 +2228,115 @@ static bool ModifyTrayIcon(HWND hwnd, HICON icon, const wchar_t* tooltip)
 	return AddTrayIcon(hwnd, icon, tooltip);
 }
 
-static void UpdateTrayIcon(HWND hwnd)
+static void LogAlertEvents(const std::vector<AlertEvent>& events)
+{
+	if(!g_alertLog)
+	{
+		wchar_t path[MAX_PATH]{};
+		if(!GetAppDataFilePath(L"alerts.csv", path, MAX_PATH) || _wfopen_s(&g_alertLog, path, L"w") != 0 || !g_alertLog)
+		{
+			g_alertLog = nullptr;
+			return;
+		}
+		fputs("timeUnixMs,rule,event,value\n", g_alertLog);
+	}
+	for(const AlertEvent& e : events)
+	{
+		fprintf(g_alertLog, "%llu,%s,%s,%.3f\n", (unsigned long long)e.timeUnixMs,
+			g_alerts.RuleName(e.rule).c_str(), e.fired ? "fired" : "cleared", e.value);
+	}
+	fflush(g_alertLog);
+}
+
+// Samples PowerInformation when it tracks the clock (no PDH query at all),
+// else the single _Total performance counter on a query of its own.
+static bool ArmBurstCapture(const CpuReading& r)
 {
+	BurstConfig config = g_burstConfig;
+	config.baseMHz = r.baseMHz;
+	const bool powerInfoLive = r.source == L"PowerInformation-CurrentMhz" && !r.nominalLike;
+	std::unique_ptr<WindowsCpuSource> source;
+	if(powerInfoLive || r.baseMHz <= 0.0)
+	{
+		config.source = BurstSource::PowerInformation;
+		source = std::make_unique<WindowsCpuSource>(0u);
+	}
+	else
+	{
+		config.source = BurstSource::TotalPerformance;
+		source = std::make_unique<WindowsCpuSource>(1u << (int)CpuCounter::TotalPerformance);
+	}
+	return g_burst.Arm(std::move(source), config, &g_overhead);
+}
+
+// `lateUs`: how long after its deadline this tick started; < 0 for updates
+// that are not sampling ticks (taskbar re-creation, first update).
+static void UpdateTrayIcon(HWND hwnd, double lateUs = -1.0)
+{
+	CPUHZ_TRACE_SCOPE("Tick");
+	OverheadScope tickScope(&g_overhead, OverheadProbe::Tick);
+
 	auto reading = g_cpu.Read();
+	g_overhead.SampleProcessCpu(reading.timeUnixMs);
+	if(g_burstArmPending && reading.ok)
+	{
+		g_burstArmPending = false;
+		ArmBurstCapture(reading);
+	}
+	if(g_attribution.IsRunning())
+	{
+		CPUHZ_TRACE_SCOPE("ProcessAttribution");
+		OverheadScope attributionScope(&g_overhead, OverheadProbe::Attribution);
+		g_attribution.Update(reading);
+	}
+	if(g_alerts.RuleCount() > 0)
+	{
+		CPUHZ_TRACE_SCOPE("AlertRules");
+		OverheadScope alertScope(&g_overhead, OverheadProbe::Alerts);
+		const auto& events = g_alerts.Update(reading, GetTickCount64());
+		if(!events.empty())
+			LogAlertEvents(events);
+	}
+	{
+		CPUHZ_TRACE_SCOPE("PublishReading");
+		g_publisher.Publish(reading);
+		if(g_metrics)
+			g_metrics->Update(reading, g_metricsPerCore, &g_overhead, &g_alerts, &g_attribution);
+	}
+	if(lateUs >= 0.0)
+		g_overhead.Record(OverheadProbe::TickToPublish, lateUs + tickScope.ElapsedUs());
+
+	// Re-arm the sampling timer when the adaptive interval changes. The
+	// threshold is the same material delta the source selection uses.
+	UINT nextMs = g_interval.OnSample(reading.ok, reading.avgMHz, SourceWindow::BandMHz(reading.baseMHz));
+	g_cpu.SetSampleIntervalMs(nextMs);
+	if(nextMs != g_timerMs && g_scheduler.IsRunning())
+	{
+		g_scheduler.SetInterval(nextMs);
+		g_timerMs = nextMs;
+	}
+	else if(nextMs != g_timerMs && SetTimer(hwnd, TIMER_ID, nextMs, nullptr))
+	{
+		g_timerMs = nextMs;
+	}
+	g_overhead.SetMissedTicks(g_scheduler.MissedDeadlines());
 
 	// Push history and track throttle counter.
 	static int s_samplesSinceIconRedraw = 0;
 	if(reading.ok)
 	{
-		g_historyMHz.Push(reading.avgMHz);
+		CPUHZ_TRACE_SCOPE("HistoryPush");
+		g_history.Push(reading.timeUnixMs, reading.avgMHz);
 		++s_samplesSinceIconRedraw;
 	}
 
-	// Build tooltip
 	std::wstring newTooltip;
 	{
-		std::wstringstream ss;
-		if(reading.ok)
-		{
-			ss << L"CPU Avg: " << std::fixed << std::setprecision(2) << ToGhz(reading.avgMHz) << L" GHz";
-			ss << L"\nCPU Max: " << std::fixed << std::setprecision(2) << ToGhz(reading.maxMHz) << L" GHz";
-			ss << L"\nCPU Min: " << std::fixed << std::setprecision(2) << ToGhz(reading.minMHz) << L" GHz";
-			if(reading.baseMHz > 0)
-				ss << L"\nBase: " << std::fixed << std::setprecision(2) << ToGhz(reading.baseMHz) << L" GHz";
-			if(reading.validCoreCount > 0)
-				ss << L"\nCores: " << reading.validCoreCount;
-			if(!reading.accuracy.empty())
-				ss << L"\nAccuracy: " << reading.accuracy;
-			if(!reading.warning.empty())
-				ss << L"\nWarning: " << reading.warning;
-			ss << L"\nSource: " << reading.source;
-		}
-		else
-		{
-			ss << L"CPU: --";
-			if(!reading.source.empty())
-				ss << L"\nSource: " << reading.source;
-		}
-		newTooltip = ss.str();
+		CPUHZ_TRACE_SCOPE("FormatTooltip");
+		newTooltip = FormatTooltip(reading, g_showOverhead ? g_overhead.Summary() : std::wstring());
 	}
 
-	bool tooltipChanged = (newTooltip != g_nid.szTip);
+	bool tooltipChanged = TooltipChanged(newTooltip, g_nid.szTip);
 
 	// Track display key change.
 	wchar_t displayKey[16]{};
@@ -318,7 +2347,7 @@ static void UpdateTrayIcon(HWND hwnd)
 
 	// Sparkline drawability tracking.
 	static int s_prevHistoryCount = 0;
-	int currHistoryCount = (int)g_historyMHz.Count();
+	int currHistoryCount = (int)g_history.Sparkline().Count();
 
 	// Compute redraw decision.
 	RedrawDecisionInput in{};
@@ -328,22 +2357,30 @@ static void UpdateTrayIcon(HWND hwnd)
 	in.previousHistoryCount = s_prevHistoryCount;
 	in.currentHistoryCount = currHistoryCount;
 	in.samplesSinceIconRedraw = s_samplesSinceIconRedraw;
+	in.redrawEverySamples = SamplesForDuration(kSparklineRedrawMs, g_interval.CurrentMs());
 
 	auto decision = ComputeRedrawDecision(in);
 	s_prevHistoryCount = currHistoryCount;
+	// A frame held back by the publish budget is re-rendered until it goes out.
+	if(g_publish.Pending() || g_iconSizeChanged)
+		decision.redrawIcon = true;
 
 	if(!decision.redrawIcon && !decision.updateTooltipOnly)
 		return;
 
+	uint64_t frameHash = 0;
 	if(decision.redrawIcon)
 	{
 		IconSpec spec{};
 		if(reading.ok)
 		{
 			spec.ghz = ToGhz(reading.avgMHz);
-			spec.baseMHz = reading.baseMHz;
-			spec.overBase = (reading.baseMHz > 0) ? (reading.avgMHz > reading.baseMHz) : false;
-			spec.historyMHz = &g_historyMHz;
+			// Hybrid CPUs compare against the per-type bases, so E-cores do
+			// not read as permanently below base.
+			const double baseMHz = reading.typeWeightedBaseMHz > 0 ? reading.typeWeightedBaseMHz : reading.baseMHz;
+			spec.baseMHz = baseMHz;
+			spec.overBase = (baseMHz > 0) ? (reading.avgMHz > baseMHz) : false;
+			spec.historyMHz = &g_history.Sparkline();
 		}
 		else
 		{
@@ -353,8 +2390,12 @@ static void UpdateTrayIcon(HWND hwnd)
 			spec.historyMHz = nullptr;
 		}
 
-		HICON next = g_renderer.Render(spec);
-		if(!next)
+		bool rendered;
+		{
+			OverheadScope renderScope(&g_overhead, OverheadProbe::Render);
+			rendered = g_renderer.RenderFrame(spec);
+		}
+		if(!rendered)
 		{
 			static bool s_shown = false;
 			if(!s_shown)
@@ -371,19 +2412,29 @@ static void UpdateTrayIcon(HWND hwnd)
 		}
 
 		s_lastDisplayKey = displayKey;
+		s_samplesSinceIconRedraw = 0;
+		g_iconSizeChanged = false;
+		frameHash = g_renderer.FrameHash();
+	}
 
-		if(ModifyTrayIcon(hwnd, next, newTooltip.c_str()))
+	// Identical frames never reach the shell; new ones are rate-limited.
+	const auto action = g_publish.Decide(GetTickCount64(), frameHash, tooltipChanged);
+	g_overhead.SetFrameCounts(g_publish.PublishedCount(), g_publish.SkippedCount() + g_publish.DeferredCount());
+	if(action == PublishAction::Icon)
+	{
+		HICON next = g_renderer.CreateFrameIcon();
+		if(next && ModifyTrayIcon(hwnd, next, newTooltip.c_str()))
 		{
 			SafeDestroyIcon(g_hIcon);
 			g_hIcon = next;
-			s_samplesSinceIconRedraw = 0;
 		}
 		else
 		{
 			SafeDestroyIcon(next);
+			g_publish.Invalidate();
 		}
 	}
-	else
+	else if(action == PublishAction::TooltipOnly)
 	{
 		ModifyTrayIcon(hwnd, g_hIcon, newTooltip.c_str());
 	}
@@ -394,6 +2445,12 @@ static void ShowContextMenu(HWND hwnd, POINT pt)
 	HMENU menu = CreatePopupMenu();
 	if(!menu) return;
 
+#if CPUHZ_ENABLE_TRACE
+	AppendMenuW(menu, MF_STRING, ID_TRAY_SAVE_TRACE, L"Save trace");
+#endif
+	const bool armed = g_burst.IsArmed() || g_burstArmPending;
+	AppendMenuW(menu, MF_STRING | (armed ? MF_CHECKED : 0), ID_TRAY_BURST_ARM, L"Burst capture armed");
+	AppendMenuW(menu, MF_STRING | (g_burst.IsArmed() ? 0 : MF_GRAYED), ID_TRAY_BURST_TRIGGER, L"Trigger burst capture");
 	AppendMenuW(menu, MF_STRING, ID_TRAY_EXIT, L"Exit");
 
 	SetForegroundWindow(hwnd);
@@ -406,6 +2463,7 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
 	if(g_taskbarCreatedMsg != 0 && msg == g_taskbarCreatedMsg)
 	{
 		g_trayIconAdded = false;
+		g_iconSizeChanged |= g_renderer.OnDisplayChange();
 		if(g_hIcon)
 			AddTrayIcon(hwnd, g_hIcon, g_nid.szTip[0] ? g_nid.szTip : L"CPU Hz tray");
 		UpdateTrayIcon(hwnd);
@@ -415,21 +2473,46 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
 	switch(msg)
 	{
 	case WM_CREATE:
-		SetTimer(hwnd, TIMER_ID, TIMER_INTERVAL_MS, nullptr);
+		g_timerMs = g_interval.CurrentMs();
+		if(!g_scheduler.Start(hwnd, WMAPP_TICK, g_timerMs, g_samplerPriority))
+			SetTimer(hwnd, TIMER_ID, g_timerMs, nullptr);
+		return 0;
+
+	case WMAPP_TICK:
+	{
+		const double lateUs = g_scheduler.Acknowledge();
+		g_overhead.Record(OverheadProbe::TickLateness, lateUs);
+		UpdateTrayIcon(hwnd, lateUs);
 		return 0;
+	}
 
 	case WM_TIMER:
+		// The fallback timer has no deadline, so no lateness is recorded.
 		if(wParam == TIMER_ID)
 			UpdateTrayIcon(hwnd);
 		return 0;
 
+	case WM_DISPLAYCHANGE:
+	case WM_DPICHANGED:
+	case WM_SETTINGCHANGE:
+		// The tray icon size follows the taskbar monitor's DPI.
+		if(g_renderer.OnDisplayChange())
+		{
+			g_iconSizeChanged = true;
+			UpdateTrayIcon(hwnd);
+		}
+		break;
+
 	case WM_QUERYENDSESSION:
 		RemoveTrayIcon();
 		return TRUE;
 
 	case WM_ENDSESSION:
 		if(wParam)
+		{
 			RemoveTrayIcon();
+			g_history.Flush();
+		}
 		return 0;
 
 	case WM_COMMAND:
@@ -438,6 +2521,33 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
 			DestroyWindow(hwnd);
 			return 0;
 		}
+		if(LOWORD(wParam) == ID_TRAY_BURST_ARM)
+		{
+			if(g_burst.IsArmed() || g_burstArmPending)
+			{
+				g_burstArmPending = false;
+				g_burst.Disarm();
+		g_attribution.Stop();
+			}
+			else
+			{
+				g_burstArmPending = true;
+			}
+			return 0;
+		}
+		if(LOWORD(wParam) == ID_TRAY_BURST_TRIGGER)
+		{
+			g_burst.Trigger();
+			return 0;
+		}
+		if(LOWORD(wParam) == ID_TRAY_SAVE_TRACE)
+		{
+			// %LOCALAPPDATA%\CpuHzTray\trace.json, open in chrome://tracing or Perfetto.
+			wchar_t path[MAX_PATH]{};
+			if(!GetAppDataFilePath(L"trace.json", path, MAX_PATH) || !DumpChromeTrace(path))
+				MessageBoxW(hwnd, L"Failed to save trace.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+			return 0;
+		}
 		break;
 
 	case WMAPP_TRAY:
@@ -451,9 +2561,18 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
 		return 0;
 
 	case WM_DESTROY:
+		g_scheduler.Stop();
+		g_burst.Disarm();
 		KillTimer(hwnd, TIMER_ID);
 		RemoveTrayIcon();
 		SafeDestroyIcon(g_hIcon);
+		g_history.Flush();
+		g_metricsServer.Stop();
+		if(g_alertLog)
+		{
+			fclose(g_alertLog);
+			g_alertLog = nullptr;
+		}
 		PostQuitMessage(0);
 		return 0;
 	}
@@ -462,6 +2581,37 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
 
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int)
 {
+	// Headless render: no tray, so the single-instance check does not apply.
+	{
+		RenderPngOptions renderPng;
+		int argc = 0;
+		auto argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+		if(argv)
+		{
+			for(int i = 0; i < argc; ++i)
+			{
+				if(_wcsnicmp(argv[i], L"--render-png=", 13) == 0)
+					renderPng.target = argv[i] + 13;
+				else if(_wcsnicmp(argv[i], L"--render-span-sec=", 18) == 0)
+					renderPng.spanSec = (uint64_t)std::max(_wtoi(argv[i] + 18), 1);
+				else if(_wcsnicmp(argv[i], L"--render-base-mhz=", 18) == 0)
+					renderPng.baseMHz = std::max(_wtof(argv[i] + 18), 0.0);
+				else if(_wcsnicmp(argv[i], L"--render-size=", 14) == 0)
+					renderPng.size = std::clamp(_wtoi(argv[i] + 14), 16, 256);
+			}
+			LocalFree(argv);
+		}
+		if(!renderPng.target.empty())
+		{
+			Gdiplus::GdiplusStartupInput gdiplusStartupInput;
+			if(Gdiplus::GdiplusStartup(&g_gdiplusToken, &gdiplusStartupInput, nullptr) != Gdiplus::Ok)
+				return ReportRenderPng(1, L"error: GDI+ failed to start");
+			const int rc = RunRenderPng(renderPng);
+			Gdiplus::GdiplusShutdown(g_gdiplusToken);
+			return rc;
+		}
+	}
+
 	HANDLE hMutex = CreateMutexW(nullptr, TRUE, L"Local\\CpuHzTray.SingleInstance");
 	if(!hMutex) return 1;
 	if(GetLastError() == ERROR_ALREADY_EXISTS)
@@ -470,7 +2620,17 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int)
 		return 0;
 	}
 
-	// Parse --diagnose-hz flag
+	// Parse command-line flags
+	bool publishShm = true;
+	int metricsPort = 0;
+	int simulateBenchTicks = 0;
+	std::wstring alertsPath;
+	AttributionConfig attributionCfg;
+	bool attribution = false;
+	AdaptiveIntervalConfig intervalCfg;
+	intervalCfg.baseMs = TIMER_INTERVAL_MS;
+	int minIntervalMs = -1, maxIntervalMs = -1; // -1 = default
+	bool fixedInterval = false;
 	{
 		int argc = 0;
 		auto argv = CommandLineToArgvW(GetCommandLineW(), &argc);
@@ -481,19 +2641,138 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int)
 				if(_wcsicmp(argv[i], L"--diagnose-hz") == 0)
 				{
 					g_cpu.EnableDiagnosticLogger(L"candidate_readings.csv");
-					break;
+					g_overhead.OpenLog(L"overhead.csv");
+				}
+				else if(_wcsicmp(argv[i], L"--show-overhead") == 0)
+					g_showOverhead = true;
+				else if(_wcsicmp(argv[i], L"--no-shm") == 0)
+					publishShm = false;
+				else if(_wcsicmp(argv[i], L"--shm-per-core") == 0)
+					g_publisher.SetPublishPerCore(true);
+				else if(_wcsnicmp(argv[i], L"--metrics-port=", 15) == 0)
+					metricsPort = _wtoi(argv[i] + 15);
+				else if(_wcsicmp(argv[i], L"--metrics-per-core") == 0)
+					g_metricsPerCore = true;
+				else if(_wcsnicmp(argv[i], L"--min-interval-ms=", 18) == 0)
+					minIntervalMs = std::max(_wtoi(argv[i] + 18), 0);
+				else if(_wcsnicmp(argv[i], L"--max-interval-ms=", 18) == 0)
+					maxIntervalMs = std::max(_wtoi(argv[i] + 18), 0);
+				else if(_wcsnicmp(argv[i], L"--max-publish-hz=", 17) == 0)
+				{
+					const double hz = _wtof(argv[i] + 17);
+					g_publish.SetMinIntervalMs(hz > 0.0 ? (unsigned)(1000.0 / hz) : 0);
+				}
+				else if(_wcsicmp(argv[i], L"--fixed-interval") == 0)
+					fixedInterval = true;
+				else if(_wcsicmp(argv[i], L"--sampler-priority") == 0)
+					g_samplerPriority = true;
+				else if(_wcsicmp(argv[i], L"--simulate-bench") == 0)
+					simulateBenchTicks = 2000;
+				else if(_wcsnicmp(argv[i], L"--simulate-bench=", 17) == 0)
+					simulateBenchTicks = std::max(_wtoi(argv[i] + 17), 1);
+				else if(_wcsnicmp(argv[i], L"--alerts=", 9) == 0)
+					alertsPath = argv[i] + 9;
+				else if(_wcsicmp(argv[i], L"--attribution") == 0)
+					attribution = true;
+				else if(_wcsnicmp(argv[i], L"--attribution=", 14) == 0)
+				{
+					attribution = true;
+					attributionCfg.topN = (size_t)std::clamp(_wtoi(argv[i] + 14), 1, 100);
 				}
+				else if(_wcsicmp(argv[i], L"--burst-capture") == 0)
+					g_burstArmPending = true;
+				else if(_wcsnicmp(argv[i], L"--burst-period-us=", 18) == 0)
+					g_burstConfig.periodUs = (unsigned)std::max(_wtoi(argv[i] + 18), 100);
+				else if(_wcsnicmp(argv[i], L"--burst-window-ms=", 18) == 0)
+					g_burstConfig.preMs = g_burstConfig.postMs = (unsigned)std::clamp(_wtoi(argv[i] + 18), 1, 10000);
+				else if(_wcsnicmp(argv[i], L"--burst-drop-mhz=", 17) == 0)
+					g_burstConfig.dropBelowMHz = std::max(_wtof(argv[i] + 17), 0.0);
+				else if(_wcsnicmp(argv[i], L"--burst-jump-mhz=", 17) == 0)
+					g_burstConfig.jumpMHz = std::max(_wtof(argv[i] + 17), 0.0);
+				else if(_wcsnicmp(argv[i], L"--burst-cooldown-ms=", 20) == 0)
+					g_burstConfig.cooldownMs = (unsigned)std::max(_wtoi(argv[i] + 20), 0);
+				else if(_wcsnicmp(argv[i], L"--burst-max-files=", 18) == 0)
+					g_burstConfig.maxFiles = (unsigned)std::max(_wtoi(argv[i] + 18), 0);
 			}
 			LocalFree(argv);
 		}
 	}
+	// Interval flags are resolved after parsing, so their order does not
+	// matter: --fixed-interval wins over --min/--max-interval-ms=.
+	if(fixedInterval)
+		intervalCfg.minMs = intervalCfg.maxMs = TIMER_INTERVAL_MS;
+	else
+	{
+		if(minIntervalMs >= 0)
+			intervalCfg.minMs = (unsigned)minIntervalMs;
+		if(maxIntervalMs >= 0)
+			intervalCfg.maxMs = (unsigned)maxIntervalMs;
+	}
+	// Longer gaps would break the sparkline's one-point-per-second hold.
+	intervalCfg.maxMs = std::min<unsigned>(intervalCfg.maxMs, (unsigned)kSparklineHoldMaxSec * 1000);
+	g_interval.SetConfig(intervalCfg);
+	// Samples are taken on this thread when the scheduler's tick arrives.
+	if(g_samplerPriority)
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_ABOVE_NORMAL);
 	// GDI+ is used for sparkline rendering.
 	Gdiplus::GdiplusStartupInput gdiplusStartupInput;
 	if(Gdiplus::GdiplusStartup(&g_gdiplusToken, &gdiplusStartupInput, nullptr) != Gdiplus::Ok)
 		g_gdiplusToken = 0;
 
+	// Simulated processors only; nothing is read from this machine.
+	if(simulateBenchTicks > 0)
+	{
+		int rc = RunSimulateBench(simulateBenchTicks);
+		if(g_gdiplusToken) Gdiplus::GdiplusShutdown(g_gdiplusToken);
+		CloseHandle(hMutex);
+		return rc;
+	}
+
+	g_cpu.SetOverhead(&g_overhead);
 	g_cpu.Initialize();
 
+	// Best-effort: the tray works the same without the shared segment.
+	if(publishShm)
+		g_publisher.Open();
+
+	// Alert rules: --alerts=<file>, else alerts.txt next to the history if present.
+	{
+		const bool explicitPath = !alertsPath.empty();
+		wchar_t defaultPath[MAX_PATH]{};
+		if(!explicitPath && GetAppDataFilePath(L"alerts.txt", defaultPath, MAX_PATH))
+			alertsPath = defaultPath;
+		std::string errors;
+		const bool loaded = !alertsPath.empty() && g_alerts.LoadFile(alertsPath.c_str(), &errors);
+		if((explicitPath && !loaded) || !errors.empty())
+		{
+			std::wstring msg = L"Alert rules in " + alertsPath + L":\n";
+			msg += errors.empty() ? L"cannot be read." : Utf8ToWide(errors);
+			MessageBoxW(nullptr, msg.c_str(), L"CpuHzTray", MB_OK | MB_ICONWARNING);
+		}
+	}
+
+	if(attribution)
+		g_attribution.Start(std::make_unique<WindowsProcessSource>(), attributionCfg);
+
+	// Optional loopback scrape endpoint; off unless a port is given.
+	if(metricsPort > 0 && metricsPort <= 65535)
+	{
+		size_t cores = g_metricsPerCore ? GetActiveProcessorCount(ALL_PROCESSOR_GROUPS) : 0;
+		g_metrics = std::make_unique<MetricsExposition>(MetricsExposition::kMinCapacity
+			+ cores * MetricsExposition::kBytesPerCore + (size_t)g_alerts.RuleCount() * MetricsExposition::kBytesPerAlertRule
+			+ (attribution ? attributionCfg.topN * MetricsExposition::kBytesPerTopProcess : 0));
+		if(!g_metricsServer.Start((uint16_t)metricsPort, g_metrics.get()))
+			g_metrics.reset();
+	}
+
+	// Restore history from the previous run by mapping it (falls back to memory).
+	{
+		wchar_t historyPath[MAX_PATH]{};
+		if(!GetDefaultHistoryFilePath(historyPath, MAX_PATH))
+			historyPath[0] = L'\0';
+		g_history.Open(historyPath, GetUnixTimeMs());
+	}
+
 #ifdef _DEBUG
 	if(!RunRedrawDecisionTests())
 	{
@@ -507,6 +2786,120 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, PWSTR, int)
 		CloseHandle(hMutex);
 		return 1;
 	}
+	if(!RunHistoryBufferTests())
+	{
+		MessageBoxW(nullptr, L"HistoryBuffer self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunTieredHistoryTests())
+	{
+		MessageBoxW(nullptr, L"TieredHistory self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunPersistentHistoryTests())
+	{
+		MessageBoxW(nullptr, L"PersistentHistory self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunAdaptiveIntervalTests())
+	{
+		MessageBoxW(nullptr, L"AdaptiveInterval self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunCpuTopologyTests())
+	{
+		MessageBoxW(nullptr, L"CpuTopology self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunCpuUtilizationTests())
+	{
+		MessageBoxW(nullptr, L"CpuUtilization self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunSourceHealthTests())
+	{
+		MessageBoxW(nullptr, L"SourceHealth self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunSimulatorTests())
+	{
+		MessageBoxW(nullptr, L"Simulator self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunTickSchedulerTests())
+	{
+		MessageBoxW(nullptr, L"TickScheduler self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunSelfOverheadTests())
+	{
+		MessageBoxW(nullptr, L"SelfOverhead self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunTraceTests())
+	{
+		MessageBoxW(nullptr, L"Trace self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunMetricsExpositionTests())
+	{
+		MessageBoxW(nullptr, L"MetricsExposition self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunAlertEngineTests())
+	{
+		MessageBoxW(nullptr, L"AlertEngine self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunBurstRecorderTests())
+	{
+		MessageBoxW(nullptr, L"BurstRecorder self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunProcessAttributionTests())
+	{
+		MessageBoxW(nullptr, L"ProcessAttribution self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunPublishGateTests())
+	{
+		MessageBoxW(nullptr, L"PublishGate self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunPngEncoderTests())
+	{
+		MessageBoxW(nullptr, L"PngEncoder self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunTooltipTests())
+	{
+		MessageBoxW(nullptr, L"Tooltip self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
+	if(!RunIconLayoutTests())
+	{
+		MessageBoxW(nullptr, L"IconLayout self-tests failed.", L"CpuHzTray", MB_OK | MB_ICONERROR);
+		CloseHandle(hMutex);
+		return 1;
+	}
 #endif
 
 	g_taskbarCreatedMsg = RegisterWindowMessageW(L"TaskbarCreated");